@@ -0,0 +1,238 @@
+// Deterministic synthetic image corpus, see bench_corpus.h.
+
+#include "bench_corpus.h"
+#include <cstdio>
+#include <cstring>
+#include <jpeglib.h>
+#include <png.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+using fastresize::ResizeOptions;
+using fastresize::internal::ImageData;
+using fastresize::internal::ImageFormat;
+
+namespace bench {
+
+struct Bucket {
+    const char* name;
+    int width;
+    int height;
+};
+
+static const Bucket BUCKETS[] = {
+    {"small",   640,  480},
+    {"medium", 1600, 1200},
+    {"large",  4000, 3000},
+};
+
+enum Writer {
+    WRITE_ENCODER,          // fastresize's own encoder
+    WRITE_JPEG_PROGRESSIVE,
+    WRITE_PNG_PALETTE
+};
+
+struct Kind {
+    const char* name;
+    const char* extension;
+    ImageFormat format;
+    int channels;
+    Writer writer;
+    bool webp_lossless;
+};
+
+static const Kind KINDS[] = {
+    {"jpeg-baseline",    "jpg",  fastresize::internal::FORMAT_JPEG, 3, WRITE_ENCODER,          false},
+    {"jpeg-progressive", "jpg",  fastresize::internal::FORMAT_JPEG, 3, WRITE_JPEG_PROGRESSIVE, false},
+    {"png-rgb",          "png",  fastresize::internal::FORMAT_PNG,  3, WRITE_ENCODER,          false},
+    {"png-rgba",         "png",  fastresize::internal::FORMAT_PNG,  4, WRITE_ENCODER,          false},
+    {"png-palette",      "png",  fastresize::internal::FORMAT_PNG,  3, WRITE_PNG_PALETTE,      false},
+    {"webp-lossy",       "webp", fastresize::internal::FORMAT_WEBP, 3, WRITE_ENCODER,          false},
+    {"webp-lossless",    "webp", fastresize::internal::FORMAT_WEBP, 4, WRITE_ENCODER,          true},
+    {"bmp",              "bmp",  fastresize::internal::FORMAT_BMP,  3, WRITE_ENCODER,          false},
+};
+
+static unsigned char clamp_byte(int value) {
+    return (unsigned char)(value < 0 ? 0 : value > 255 ? 255 : value);
+}
+
+ImageData synthetic_image(int width, int height, int channels, unsigned int seed) {
+    ImageData data;
+    data.width = width;
+    data.height = height;
+    data.channels = channels;
+    data.pixels = fastresize::internal::alloc_pixels((size_t)width * height * channels);
+
+    // Block layout and hue shift vary with the seed; everything else is shared
+    int block = 128 + (int)(seed % 4) * 64;
+    int hue = (int)(seed * 37 % 96);
+
+    unsigned int state = 12345 + seed * 7919;
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            state = state * 1103515245 + 12345;
+            int noise = (int)((state >> 16) & 15) - 8;
+            bool in_block = ((x / block) + (y / block)) % 3 == 0;
+
+            unsigned char* p = data.pixels + ((size_t)y * width + x) * channels;
+            int r = x * 255 / width + noise + hue;
+            int g = y * 255 / height + noise;
+            int b = in_block ? 200 - hue : (x + y) * 127 / (width + height) + noise;
+
+            if (channels == 1) {
+                p[0] = clamp_byte((r * 77 + g * 150 + b * 29) >> 8);
+                continue;
+            }
+            p[0] = clamp_byte(r);
+            p[1] = clamp_byte(g);
+            p[2] = clamp_byte(b);
+            if (channels == 4) {
+                long dx = x - width / 2;
+                long dy = y - height / 2;
+                long radius = (long)width * width / 4 + (long)height * height / 4;
+                p[3] = clamp_byte(255 - (int)((dx * dx + dy * dy) * 255 / radius));
+            }
+        }
+    }
+
+    return data;
+}
+
+static bool write_jpeg_progressive(const std::string& path, const ImageData& image) {
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) return false;
+
+    jpeg_compress_struct cinfo;
+    jpeg_error_mgr jerr;
+    cinfo.err = jpeg_std_error(&jerr);
+    jpeg_create_compress(&cinfo);
+    jpeg_stdio_dest(&cinfo, file);
+
+    cinfo.image_width = image.width;
+    cinfo.image_height = image.height;
+    cinfo.input_components = 3;
+    cinfo.in_color_space = JCS_RGB;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, 85, TRUE);
+    jpeg_simple_progression(&cinfo);
+
+    jpeg_start_compress(&cinfo, TRUE);
+    while (cinfo.next_scanline < cinfo.image_height) {
+        JSAMPROW row = image.pixels + (size_t)cinfo.next_scanline * image.width * 3;
+        jpeg_write_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_compress(&cinfo);
+    jpeg_destroy_compress(&cinfo);
+
+    return fclose(file) == 0;
+}
+
+// 6x6x6 colour cube, the classic web-safe palette
+static bool write_png_palette(const std::string& path, const ImageData& image) {
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) return false;
+
+    png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+    png_infop info = png ? png_create_info_struct(png) : nullptr;
+    if (!info || setjmp(png_jmpbuf(png))) {
+        png_destroy_write_struct(&png, info ? &info : nullptr);
+        fclose(file);
+        return false;
+    }
+
+    png_color palette[216];
+    for (int i = 0; i < 216; ++i) {
+        palette[i].red = (png_byte)(i / 36 * 51);
+        palette[i].green = (png_byte)(i / 6 % 6 * 51);
+        palette[i].blue = (png_byte)(i % 6 * 51);
+    }
+
+    png_init_io(png, file);
+    png_set_IHDR(png, info, image.width, image.height, 8, PNG_COLOR_TYPE_PALETTE,
+                 PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+    png_set_PLTE(png, info, palette, 216);
+    png_write_info(png, info);
+
+    std::vector<png_byte> row(image.width);
+    for (int y = 0; y < image.height; ++y) {
+        const unsigned char* src = image.pixels + (size_t)y * image.width * 3;
+        for (int x = 0; x < image.width; ++x) {
+            const unsigned char* p = src + x * 3;
+            row[x] = (png_byte)((p[0] + 25) / 51 * 36 + (p[1] + 25) / 51 * 6 + (p[2] + 25) / 51);
+        }
+        png_write_row(png, row.data());
+    }
+
+    png_write_end(png, nullptr);
+    png_destroy_write_struct(&png, &info);
+    return fclose(file) == 0;
+}
+
+static bool write_image(const std::string& path, const Kind& kind, const ImageData& image) {
+    switch (kind.writer) {
+        case WRITE_JPEG_PROGRESSIVE:
+            return write_jpeg_progressive(path, image);
+        case WRITE_PNG_PALETTE:
+            return write_png_palette(path, image);
+        case WRITE_ENCODER:
+            break;
+    }
+
+    ResizeOptions opts;
+    opts.quality = 85;
+    opts.webp_lossless = kind.webp_lossless;
+    opts.webp_effort = kind.webp_lossless ? 0 : 4;
+    return fastresize::internal::encode_image(path, image, kind.format, opts);
+}
+
+static bool file_exists(const std::string& path) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 && st.st_size > 0;
+}
+
+bool generate_corpus(const std::string& dir, const CorpusSpec& spec, std::vector<CorpusImage>& images) {
+    images.clear();
+    if (mkdir(dir.c_str(), 0755) != 0 && !file_exists(dir)) {
+        fprintf(stderr, "Error: Cannot create corpus directory %s\n", dir.c_str());
+        return false;
+    }
+
+    for (const Bucket& bucket : BUCKETS) {
+        if (!spec.include_large && strcmp(bucket.name, "large") == 0) continue;
+
+        for (const Kind& kind : KINDS) {
+            for (int seed = 0; seed < spec.seeds; ++seed) {
+                char name[128];
+                snprintf(name, sizeof(name), "%s-%s-%d.%s", bucket.name, kind.name, seed, kind.extension);
+
+                CorpusImage entry;
+                entry.path = dir + "/" + name;
+                entry.kind = kind.name;
+                entry.bucket = bucket.name;
+                entry.width = bucket.width;
+                entry.height = bucket.height;
+                entry.format = kind.format;
+
+                if (!file_exists(entry.path)) {
+                    ImageData image = synthetic_image(bucket.width, bucket.height, kind.channels, seed);
+                    bool written = write_image(entry.path, kind, image);
+                    fastresize::internal::free_image_data(image);
+
+                    if (!written) {
+                        remove(entry.path.c_str());
+                        // WebP support is optional at build time
+                        if (kind.format == fastresize::internal::FORMAT_WEBP) break;
+                        fprintf(stderr, "Error: Failed to write %s\n", entry.path.c_str());
+                        return false;
+                    }
+                }
+
+                images.push_back(entry);
+            }
+        }
+    }
+
+    return true;
+}
+
+}
@@ -0,0 +1,40 @@
+// Deterministic synthetic image corpus for the benchmarks and perf tests.
+//
+// Every image is generated from a fixed seed, so two machines (or two runs)
+// benchmark byte-identical inputs. Files already present in the corpus
+// directory are reused rather than regenerated.
+
+#ifndef FASTRESIZE_BENCH_CORPUS_H
+#define FASTRESIZE_BENCH_CORPUS_H
+
+#include "internal.h"
+#include <string>
+#include <vector>
+
+namespace bench {
+
+struct CorpusImage {
+    std::string path;
+    std::string kind;       // "jpeg-baseline", "png-palette", ...
+    std::string bucket;     // "small", "medium", "large"
+    int width;
+    int height;
+    fastresize::internal::ImageFormat format;
+};
+
+struct CorpusSpec {
+    bool include_large = true;  // 4000x3000 images; slow to generate and decode
+    int seeds = 2;              // Images per kind and bucket
+};
+
+// Photo-like frame: gradients, texture noise, hard-edged blocks and, with
+// 4 channels, a soft alpha vignette. Same seed, same pixels.
+fastresize::internal::ImageData synthetic_image(int width, int height, int channels, unsigned int seed);
+
+// Writes the corpus into dir (created if needed) and lists it. Kinds the
+// build can't write (WebP without libwebp) are left out.
+bool generate_corpus(const std::string& dir, const CorpusSpec& spec, std::vector<CorpusImage>& images);
+
+}
+
+#endif
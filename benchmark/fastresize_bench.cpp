@@ -0,0 +1,404 @@
+// Layer-by-layer benchmarks on a deterministic synthetic corpus.
+//
+// Times the SIMD resize kernels, the stb_image_resize fallback, every
+// decoder and encoder, the thread pool, the pipeline's bounded queue and
+// end-to-end batch_resize with and without max_speed. Each benchmark runs
+// once to warm up, then N times; the table and the JSON report give the
+// fastest and the median run, with throughput taken from the median.
+
+#include <fastresize.h>
+#include "internal.h"
+#include "pipeline.h"
+#include "simd_resize.h"
+#include "bench_corpus.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/stat.h>
+
+#ifndef FASTRESIZE_VERSION
+#define FASTRESIZE_VERSION "dev"
+#endif
+
+using fastresize::ResizeOptions;
+using fastresize::internal::ImageData;
+using fastresize::internal::ImageFormat;
+
+struct BenchResult {
+    std::string group;
+    std::string name;
+    std::string unit;       // Throughput unit: "Mpx/s", "images/s", ...
+    int iterations;
+    double min_ms;
+    double median_ms;
+    double throughput;      // Per second, at the median time
+};
+
+struct BenchContext {
+    int iterations = 5;
+    std::string filter;     // Only groups containing this
+    std::string out_dir = "bench_out";
+    std::vector<bench::CorpusImage> corpus;
+    std::vector<BenchResult> results;
+};
+
+static bool selected(const BenchContext& ctx, const std::string& group) {
+    return ctx.filter.empty() || group.find(ctx.filter) != std::string::npos;
+}
+
+// Runs fn once to warm up, then iterations times; false as soon as fn fails
+static bool run_bench(BenchContext& ctx, const std::string& group, const std::string& name,
+                      const std::string& unit, double work, const std::function<bool()>& fn) {
+    if (!fn()) {
+        std::cerr << "Error: " << group << " / " << name << " failed: "
+                  << fastresize::get_last_error() << "\n";
+        return false;
+    }
+
+    std::vector<double> samples;
+    for (int i = 0; i < ctx.iterations; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        bool ok = fn();
+        auto end = std::chrono::steady_clock::now();
+        if (!ok) return false;
+        samples.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+    }
+    std::sort(samples.begin(), samples.end());
+
+    BenchResult result;
+    result.group = group;
+    result.name = name;
+    result.unit = unit;
+    result.iterations = ctx.iterations;
+    result.min_ms = samples.front();
+    result.median_ms = samples[samples.size() / 2];
+    result.throughput = result.median_ms > 0.0 ? work / (result.median_ms / 1000.0) : 0.0;
+    ctx.results.push_back(result);
+
+    printf("%-14s %-34s %10.3f %10.3f %12.1f %s\n", group.c_str(), name.c_str(),
+           result.min_ms, result.median_ms, result.throughput, unit.c_str());
+    fflush(stdout);
+    return true;
+}
+
+static const char* quality_name(fastresize::internal::ResizeQuality quality) {
+    switch (quality) {
+        case fastresize::internal::ResizeQuality::FAST: return "fast";
+        case fastresize::internal::ResizeQuality::GOOD: return "good";
+        case fastresize::internal::ResizeQuality::BEST: return "best";
+    }
+    return "?";
+}
+
+static void bench_simd_resize(BenchContext& ctx) {
+    const int src_w = 1920, src_h = 1080, dst_w = 640, dst_h = 360;
+    const fastresize::internal::ResizeQuality qualities[] = {
+        fastresize::internal::ResizeQuality::FAST,
+        fastresize::internal::ResizeQuality::GOOD,
+        fastresize::internal::ResizeQuality::BEST,
+    };
+
+    for (int channels : {1, 3, 4}) {
+        ImageData src = bench::synthetic_image(src_w, src_h, channels, 1);
+        std::vector<uint8_t> dst(fastresize::internal::simd_resize_buffer_size(dst_w, dst_h, channels));
+
+        for (fastresize::internal::ResizeQuality quality : qualities) {
+            auto resize = [&]() {
+                return fastresize::internal::simd_resize(src.pixels, src_w, src_h, 0, channels,
+                                                         dst.data(), dst_w, dst_h, 0, 0, quality);
+            };
+
+            char name[64];
+            snprintf(name, sizeof(name), "%dch %s 1920x1080->640x360", channels, quality_name(quality));
+
+            // Kernels exist per architecture and quality; the rest fall back to stbir
+            if (!resize()) {
+                printf("%-14s %-34s %10s\n", "simd_resize", name, "no kernel");
+                continue;
+            }
+            run_bench(ctx, "simd_resize", name, "Mpx/s", src_w * src_h / 1e6, resize);
+        }
+        fastresize::internal::free_image_data(src);
+    }
+}
+
+// resize_image() as the library calls it. Catmull-Rom and box always take
+// the stb_image_resize path; Mitchell and triangle at this ratio use the
+// SIMD kernels where the build has them.
+static void bench_resize_image(BenchContext& ctx) {
+    const int src_w = 1920, src_h = 1080;
+    struct Case {
+        const char* name;
+        ResizeOptions::Filter filter;
+        const char* group;
+    };
+    const Case cases[] = {
+        {"catmull_rom", ResizeOptions::CATMULL_ROM, "stbir"},
+        {"box",         ResizeOptions::BOX,         "stbir"},
+        {"mitchell",    ResizeOptions::MITCHELL,    "resize_image"},
+        {"triangle",    ResizeOptions::TRIANGLE,    "resize_image"},
+    };
+
+    for (int channels : {3, 4}) {
+        ImageData src = bench::synthetic_image(src_w, src_h, channels, 2);
+        for (const Case& c : cases) {
+            ResizeOptions opts;
+            opts.filter = c.filter;
+
+            char name[64];
+            snprintf(name, sizeof(name), "%dch %s 1920x1080->640x360", channels, c.name);
+            run_bench(ctx, c.group, name, "Mpx/s", src_w * src_h / 1e6, [&]() {
+                unsigned char* out = nullptr;
+                bool ok = fastresize::internal::resize_image(src.pixels, src_w, src_h, channels,
+                                                             &out, 640, 360, opts);
+                fastresize::internal::free_pixels(out);
+                return ok;
+            });
+        }
+        fastresize::internal::free_image_data(src);
+    }
+}
+
+static void bench_decode(BenchContext& ctx) {
+    for (const bench::CorpusImage& image : ctx.corpus) {
+        // One image per kind and bucket is enough for the decoders
+        if (image.path.find("-0.") == std::string::npos) continue;
+
+        std::string name = image.bucket + " " + image.kind;
+        run_bench(ctx, "decode", name, "Mpx/s", image.width * (double)image.height / 1e6, [&]() {
+            ImageData data = fastresize::internal::decode_image(image.path, image.format);
+            bool ok = data.pixels != nullptr;
+            fastresize::internal::free_image_data(data);
+            return ok;
+        });
+
+        // JPEGs also decode DCT-scaled when the target is much smaller
+        if (image.format == fastresize::internal::FORMAT_JPEG) {
+            run_bench(ctx, "decode", name + " for 800w", "Mpx/s",
+                      image.width * (double)image.height / 1e6, [&]() {
+                ImageData data = fastresize::internal::decode_image(image.path, image.format, 800, 600);
+                bool ok = data.pixels != nullptr;
+                fastresize::internal::free_image_data(data);
+                return ok;
+            });
+        }
+    }
+}
+
+static void bench_encode(BenchContext& ctx) {
+    const int width = 1600, height = 1200;
+    struct Case {
+        const char* name;
+        const char* extension;
+        ImageFormat format;
+        int channels;
+        bool webp_lossless;
+    };
+    const Case cases[] = {
+        {"jpeg q85",          "jpg",  fastresize::internal::FORMAT_JPEG, 3, false},
+        {"png rgb",           "png",  fastresize::internal::FORMAT_PNG,  3, false},
+        {"png rgba",          "png",  fastresize::internal::FORMAT_PNG,  4, false},
+        {"webp lossy q85",    "webp", fastresize::internal::FORMAT_WEBP, 3, false},
+        {"webp lossless",     "webp", fastresize::internal::FORMAT_WEBP, 4, true},
+        {"bmp",               "bmp",  fastresize::internal::FORMAT_BMP,  3, false},
+    };
+
+    ImageData rgb = bench::synthetic_image(width, height, 3, 3);
+    ImageData rgba = bench::synthetic_image(width, height, 4, 3);
+    for (const Case& c : cases) {
+        ResizeOptions opts;
+        opts.webp_lossless = c.webp_lossless;
+
+        std::string path = ctx.out_dir + "/encode." + c.extension;
+        const ImageData& image = c.channels == 4 ? rgba : rgb;
+        run_bench(ctx, "encode", c.name, "Mpx/s", width * (double)height / 1e6, [&]() {
+            return fastresize::internal::encode_image(path, image, c.format, opts);
+        });
+        remove(path.c_str());
+    }
+    fastresize::internal::free_image_data(rgb);
+    fastresize::internal::free_image_data(rgba);
+}
+
+static void bench_thread_pool(BenchContext& ctx) {
+    const int tasks = 20000;
+    for (size_t threads : {1, 4, 8}) {
+        fastresize::internal::ThreadPool* pool = fastresize::internal::create_thread_pool(threads);
+        std::atomic<int> counter(0);
+
+        char name[64];
+        snprintf(name, sizeof(name), "%d empty tasks, %zu threads", tasks, threads);
+        run_bench(ctx, "thread_pool", name, "tasks/s", tasks, [&]() {
+            for (int i = 0; i < tasks; ++i) {
+                fastresize::internal::thread_pool_enqueue(pool, [&counter]() {
+                    counter.fetch_add(1, std::memory_order_relaxed);
+                });
+            }
+            fastresize::internal::thread_pool_wait(pool);
+            return true;
+        });
+        fastresize::internal::destroy_thread_pool(pool);
+    }
+}
+
+static void bench_bounded_queue(BenchContext& ctx) {
+    const int items = 200000;
+    for (size_t capacity : {8, 32}) {
+        char name[64];
+        snprintf(name, sizeof(name), "1 producer 1 consumer, capacity %zu", capacity);
+        run_bench(ctx, "bounded_queue", name, "items/s", items, [&]() {
+            fastresize::internal::BoundedQueue<int> queue(capacity, fastresize::internal::QUEUE_DECODED);
+            long long sum = 0;
+            std::thread consumer([&]() {
+                int value;
+                while (queue.pop(value)) sum += value;
+            });
+            for (int i = 0; i < items; ++i) {
+                int value = i;
+                queue.push(std::move(value));
+            }
+            queue.set_done();
+            consumer.join();
+            return sum == (long long)items * (items - 1) / 2;
+        });
+    }
+}
+
+static void bench_batch(BenchContext& ctx) {
+    std::vector<std::string> inputs;
+    for (const bench::CorpusImage& image : ctx.corpus) {
+        inputs.push_back(image.path);
+    }
+
+    ResizeOptions opts;
+    opts.mode = ResizeOptions::FIT_WIDTH;
+    opts.target_width = 800;
+
+    std::string batch_dir = ctx.out_dir + "/batch";
+    mkdir(batch_dir.c_str(), 0755);
+
+    for (bool max_speed : {false, true}) {
+        fastresize::BatchOptions batch_opts;
+        batch_opts.max_speed = max_speed;
+
+        char name[64];
+        snprintf(name, sizeof(name), "%zu images to 800w%s", inputs.size(),
+                 max_speed ? ", max_speed" : "");
+        run_bench(ctx, "batch_resize", name, "images/s", (double)inputs.size(), [&]() {
+            fastresize::BatchResult result = fastresize::batch_resize(inputs, batch_dir, opts, batch_opts);
+            return result.failed == 0;
+        });
+    }
+}
+
+static std::string json_escape(const std::string& text) {
+    std::string escaped;
+    for (char c : text) {
+        if (c == '"' || c == '\\') escaped += '\\';
+        escaped += c;
+    }
+    return escaped;
+}
+
+static bool write_json(const BenchContext& ctx, const std::string& path) {
+    FILE* file = fopen(path.c_str(), "w");
+    if (!file) {
+        std::cerr << "Error: Cannot write " << path << "\n";
+        return false;
+    }
+
+    fprintf(file, "{\n  \"version\": \"%s\",\n", FASTRESIZE_VERSION);
+    fprintf(file, "  \"hardware_threads\": %u,\n", std::thread::hardware_concurrency());
+    fprintf(file, "  \"corpus_images\": %zu,\n", ctx.corpus.size());
+    fprintf(file, "  \"iterations\": %d,\n", ctx.iterations);
+    fprintf(file, "  \"results\": [");
+    for (size_t i = 0; i < ctx.results.size(); ++i) {
+        const BenchResult& r = ctx.results[i];
+        fprintf(file, "%s\n    {\"group\": \"%s\", \"name\": \"%s\", \"iterations\": %d, "
+                      "\"min_ms\": %.4f, \"median_ms\": %.4f, \"throughput\": %.3f, \"unit\": \"%s\"}",
+                i == 0 ? "" : ",", json_escape(r.group).c_str(), json_escape(r.name).c_str(),
+                r.iterations, r.min_ms, r.median_ms, r.throughput, r.unit.c_str());
+    }
+    fprintf(file, "\n  ]\n}\n");
+
+    return fclose(file) == 0;
+}
+
+static void print_usage(const char* program) {
+    std::cout << "Usage: " << program << " [OPTIONS]\n\n";
+    std::cout << "  --corpus DIR        Synthetic corpus, generated on first use (default: bench_corpus)\n";
+    std::cout << "  --out DIR           Scratch directory for outputs (default: bench_out)\n";
+    std::cout << "  --json FILE         Write results as JSON\n";
+    std::cout << "  -n, --iterations N  Timed runs per benchmark (default: 5)\n";
+    std::cout << "  --filter GROUP      Only run groups whose name contains GROUP\n";
+    std::cout << "  --quick             Leave the 4000x3000 images out of the corpus\n";
+    std::cout << "  --corpus-only       Generate the corpus and exit\n\n";
+    std::cout << "Groups: simd_resize, stbir, resize_image, decode, encode, thread_pool,\n";
+    std::cout << "        bounded_queue, batch_resize\n";
+}
+
+int main(int argc, char** argv) {
+    BenchContext ctx;
+    bench::CorpusSpec spec;
+    std::string corpus_dir = "bench_corpus";
+    std::string json_path;
+    bool corpus_only = false;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--corpus" && i + 1 < argc) {
+            corpus_dir = argv[++i];
+        } else if (arg == "--out" && i + 1 < argc) {
+            ctx.out_dir = argv[++i];
+        } else if (arg == "--json" && i + 1 < argc) {
+            json_path = argv[++i];
+        } else if ((arg == "-n" || arg == "--iterations") && i + 1 < argc) {
+            ctx.iterations = std::atoi(argv[++i]);
+        } else if (arg == "--filter" && i + 1 < argc) {
+            ctx.filter = argv[++i];
+        } else if (arg == "--quick") {
+            spec.include_large = false;
+        } else if (arg == "--corpus-only") {
+            corpus_only = true;
+        } else if (arg == "--help") {
+            print_usage(argv[0]);
+            return 0;
+        } else {
+            std::cerr << "Error: Unknown option: " << arg << "\n";
+            return 1;
+        }
+    }
+    if (ctx.iterations < 1) ctx.iterations = 1;
+
+    if (!bench::generate_corpus(corpus_dir, spec, ctx.corpus)) {
+        return 1;
+    }
+    if (corpus_only) {
+        std::cout << "Corpus: " << ctx.corpus.size() << " images in " << corpus_dir << "\n";
+        return 0;
+    }
+    mkdir(ctx.out_dir.c_str(), 0755);
+
+    printf("Corpus: %zu images, %d timed runs each\n\n", ctx.corpus.size(), ctx.iterations);
+    printf("%-14s %-34s %10s %10s %12s\n", "group", "benchmark", "min ms", "median ms", "throughput");
+
+    if (selected(ctx, "simd_resize")) bench_simd_resize(ctx);
+    if (selected(ctx, "stbir") || selected(ctx, "resize_image")) bench_resize_image(ctx);
+    if (selected(ctx, "decode")) bench_decode(ctx);
+    if (selected(ctx, "encode")) bench_encode(ctx);
+    if (selected(ctx, "thread_pool")) bench_thread_pool(ctx);
+    if (selected(ctx, "bounded_queue")) bench_bounded_queue(ctx);
+    if (selected(ctx, "batch_resize")) bench_batch(ctx);
+
+    if (!json_path.empty() && !write_json(ctx, json_path)) {
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,155 @@
+// PNG encode throughput against output size for the PNG encoder settings.
+//
+// Encodes one image with each configuration and prints raw megabytes per
+// second (best of N runs) next to the output size, relative to the default
+// settings. Without an input image a synthetic photo-like frame is used.
+
+#include <fastresize.h>
+#include "internal.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <sys/stat.h>
+
+using fastresize::ResizeOptions;
+
+struct BenchConfig {
+    const char* name;
+    int level;
+    ResizeOptions::PngFilter filter;
+    ResizeOptions::PngStrategy strategy;
+    int window_bits;
+    int mem_level;
+};
+
+static const BenchConfig CONFIGS[] = {
+    {"default",            2, ResizeOptions::PNG_ADAPTIVE, ResizeOptions::PNG_STRATEGY_DEFAULT,  15, 8},
+    {"adaptive level 6",   6, ResizeOptions::PNG_ADAPTIVE, ResizeOptions::PNG_STRATEGY_DEFAULT,  15, 8},
+    {"adaptive level 1",   1, ResizeOptions::PNG_ADAPTIVE, ResizeOptions::PNG_STRATEGY_DEFAULT,  15, 8},
+    {"adaptive rle",       2, ResizeOptions::PNG_ADAPTIVE, ResizeOptions::PNG_STRATEGY_RLE,      15, 8},
+    {"paeth",              2, ResizeOptions::PNG_PAETH,    ResizeOptions::PNG_STRATEGY_DEFAULT,  15, 8},
+    {"up",                 2, ResizeOptions::PNG_UP,       ResizeOptions::PNG_STRATEGY_DEFAULT,  15, 8},
+    {"sub",                2, ResizeOptions::PNG_SUB,      ResizeOptions::PNG_STRATEGY_DEFAULT,  15, 8},
+    {"up rle",             2, ResizeOptions::PNG_UP,       ResizeOptions::PNG_STRATEGY_RLE,      15, 8},
+    {"sub rle",            2, ResizeOptions::PNG_SUB,      ResizeOptions::PNG_STRATEGY_RLE,      15, 8},
+    {"up level 1",         1, ResizeOptions::PNG_UP,       ResizeOptions::PNG_STRATEGY_DEFAULT,  15, 8},
+    {"up window 12",       2, ResizeOptions::PNG_UP,       ResizeOptions::PNG_STRATEGY_DEFAULT,  12, 8},
+    {"up mem 9",           2, ResizeOptions::PNG_UP,       ResizeOptions::PNG_STRATEGY_DEFAULT,  15, 9},
+    {"none rle",           2, ResizeOptions::PNG_NONE,     ResizeOptions::PNG_STRATEGY_RLE,      15, 8},
+    {"up huffman",         2, ResizeOptions::PNG_UP,       ResizeOptions::PNG_STRATEGY_HUFFMAN,  15, 8},
+};
+
+// Inverse of the encoder's quality -> zlib level mapping
+static int quality_for_level(int level) {
+    return 1 + (9 - level) * 11;
+}
+
+// Smooth gradients, texture noise and a few hard edges
+static fastresize::internal::ImageData synthetic_image(int width, int height) {
+    fastresize::internal::ImageData data;
+    data.width = width;
+    data.height = height;
+    data.channels = 3;
+    data.pixels = fastresize::internal::alloc_pixels((size_t)width * height * 3);
+
+    unsigned int seed = 12345;
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            seed = seed * 1103515245 + 12345;
+            int noise = (int)((seed >> 16) & 7) - 4;
+            bool block = ((x / 256) + (y / 256)) % 3 == 0;
+            unsigned char* p = data.pixels + ((size_t)y * width + x) * 3;
+            int r = x * 255 / width + noise;
+            int g = y * 255 / height + noise;
+            int b = block ? 200 : (x + y) * 127 / (width + height) + noise;
+            p[0] = (unsigned char)(r < 0 ? 0 : r > 255 ? 255 : r);
+            p[1] = (unsigned char)(g < 0 ? 0 : g > 255 ? 255 : g);
+            p[2] = (unsigned char)(b < 0 ? 0 : b > 255 ? 255 : b);
+        }
+    }
+
+    return data;
+}
+
+static long file_size(const std::string& path) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 ? (long)st.st_size : -1;
+}
+
+int main(int argc, char** argv) {
+    std::string input_path;
+    std::string output_path = "png_encode_bench.tmp.png";
+    int iterations = 3;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if ((arg == "-n" || arg == "--iterations") && i + 1 < argc) {
+            iterations = std::atoi(argv[++i]);
+        } else if ((arg == "-o" || arg == "--output") && i + 1 < argc) {
+            output_path = argv[++i];
+        } else if (arg == "--help") {
+            std::cout << "Usage: " << argv[0] << " [-n ITERATIONS] [-o TEMP_PNG] [image]\n";
+            return 0;
+        } else {
+            input_path = arg;
+        }
+    }
+    if (iterations < 1) iterations = 1;
+
+    fastresize::internal::ImageData image;
+    if (input_path.empty()) {
+        image = synthetic_image(2048, 1536);
+    } else {
+        fastresize::internal::ImageFormat format = fastresize::internal::detect_format(input_path);
+        image = fastresize::internal::decode_image(input_path, format);
+        if (!image.pixels) {
+            std::cerr << "Error: Failed to decode " << input_path << "\n";
+            return 1;
+        }
+    }
+
+    double raw_mb = (double)image.width * image.height * image.channels / (1024.0 * 1024.0);
+    std::cout << "Image: " << (input_path.empty() ? "synthetic" : input_path) << " "
+              << image.width << "x" << image.height << "x" << image.channels
+              << " (" << raw_mb << " MB raw), best of " << iterations << "\n\n";
+
+    printf("%-20s %5s %10s %12s %8s\n", "config", "level", "MB/s", "bytes", "size");
+
+    long baseline_bytes = 0;
+    for (const BenchConfig& config : CONFIGS) {
+        ResizeOptions opts;
+        opts.quality = quality_for_level(config.level);
+        opts.png_filter = config.filter;
+        opts.png_strategy = config.strategy;
+        opts.png_window_bits = config.window_bits;
+        opts.png_mem_level = config.mem_level;
+
+        double best_seconds = 0.0;
+        for (int run = 0; run < iterations; ++run) {
+            auto start = std::chrono::steady_clock::now();
+            bool ok = fastresize::internal::encode_image(
+                output_path, image, fastresize::internal::FORMAT_PNG, opts);
+            auto end = std::chrono::steady_clock::now();
+            if (!ok) {
+                std::cerr << "Error: Encoding failed for " << config.name << "\n";
+                fastresize::internal::free_image_data(image);
+                return 1;
+            }
+
+            double seconds = std::chrono::duration<double>(end - start).count();
+            if (run == 0 || seconds < best_seconds) best_seconds = seconds;
+        }
+
+        long bytes = file_size(output_path);
+        if (baseline_bytes == 0) baseline_bytes = bytes;
+
+        printf("%-20s %5d %10.1f %12ld %7.1f%%\n", config.name, config.level,
+               raw_mb / best_seconds, bytes, 100.0 * bytes / baseline_bytes);
+    }
+
+    remove(output_path.c_str());
+    fastresize::internal::free_image_data(image);
+    return 0;
+}
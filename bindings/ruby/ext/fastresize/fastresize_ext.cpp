@@ -85,6 +85,114 @@ static fastresize::ResizeOptions parse_resize_options(VALUE options) {
         opts.mode = fastresize::ResizeOptions::FIT_HEIGHT;
     }
 
+    VALUE fit = rb_hash_aref(options, ID2SYM(rb_intern("fit")));
+    if (!NIL_P(fit)) {
+        Check_Type(fit, T_SYMBOL);
+        ID fit_id = SYM2ID(fit);
+
+        if (NIL_P(width) || NIL_P(height) || !NIL_P(scale)) {
+            rb_raise(rb_eArgError, "fit requires both width and height");
+        }
+
+        if (fit_id == rb_intern("cover")) {
+            opts.mode = fastresize::ResizeOptions::COVER;
+        } else if (fit_id == rb_intern("contain")) {
+            opts.mode = fastresize::ResizeOptions::CONTAIN;
+        } else {
+            rb_raise(rb_eArgError, "Invalid fit. Use :cover or :contain");
+        }
+    }
+
+    VALUE gravity = rb_hash_aref(options, ID2SYM(rb_intern("gravity")));
+    if (!NIL_P(gravity)) {
+        Check_Type(gravity, T_SYMBOL);
+        ID gravity_id = SYM2ID(gravity);
+
+        if (gravity_id == rb_intern("center")) {
+            opts.gravity = fastresize::ResizeOptions::CENTER;
+        } else if (gravity_id == rb_intern("north")) {
+            opts.gravity = fastresize::ResizeOptions::NORTH;
+        } else if (gravity_id == rb_intern("south")) {
+            opts.gravity = fastresize::ResizeOptions::SOUTH;
+        } else if (gravity_id == rb_intern("east")) {
+            opts.gravity = fastresize::ResizeOptions::EAST;
+        } else if (gravity_id == rb_intern("west")) {
+            opts.gravity = fastresize::ResizeOptions::WEST;
+        } else if (gravity_id == rb_intern("north_east")) {
+            opts.gravity = fastresize::ResizeOptions::NORTH_EAST;
+        } else if (gravity_id == rb_intern("north_west")) {
+            opts.gravity = fastresize::ResizeOptions::NORTH_WEST;
+        } else if (gravity_id == rb_intern("south_east")) {
+            opts.gravity = fastresize::ResizeOptions::SOUTH_EAST;
+        } else if (gravity_id == rb_intern("south_west")) {
+            opts.gravity = fastresize::ResizeOptions::SOUTH_WEST;
+        } else {
+            rb_raise(rb_eArgError, "Invalid gravity. Use :center, :north, :south, :east, :west, "
+                                   ":north_east, :north_west, :south_east, or :south_west");
+        }
+    }
+
+    VALUE png_filter = rb_hash_aref(options, ID2SYM(rb_intern("png_filter")));
+    if (!NIL_P(png_filter)) {
+        Check_Type(png_filter, T_SYMBOL);
+        ID png_filter_id = SYM2ID(png_filter);
+
+        if (png_filter_id == rb_intern("adaptive")) {
+            opts.png_filter = fastresize::ResizeOptions::PNG_ADAPTIVE;
+        } else if (png_filter_id == rb_intern("none")) {
+            opts.png_filter = fastresize::ResizeOptions::PNG_NONE;
+        } else if (png_filter_id == rb_intern("sub")) {
+            opts.png_filter = fastresize::ResizeOptions::PNG_SUB;
+        } else if (png_filter_id == rb_intern("up")) {
+            opts.png_filter = fastresize::ResizeOptions::PNG_UP;
+        } else if (png_filter_id == rb_intern("average")) {
+            opts.png_filter = fastresize::ResizeOptions::PNG_AVERAGE;
+        } else if (png_filter_id == rb_intern("paeth")) {
+            opts.png_filter = fastresize::ResizeOptions::PNG_PAETH;
+        } else {
+            rb_raise(rb_eArgError, "Invalid PNG filter. Use :adaptive, :none, :sub, :up, :average, or :paeth");
+        }
+    }
+
+    VALUE png_strategy = rb_hash_aref(options, ID2SYM(rb_intern("png_strategy")));
+    if (!NIL_P(png_strategy)) {
+        Check_Type(png_strategy, T_SYMBOL);
+        ID png_strategy_id = SYM2ID(png_strategy);
+
+        if (png_strategy_id == rb_intern("default")) {
+            opts.png_strategy = fastresize::ResizeOptions::PNG_STRATEGY_DEFAULT;
+        } else if (png_strategy_id == rb_intern("filtered")) {
+            opts.png_strategy = fastresize::ResizeOptions::PNG_STRATEGY_FILTERED;
+        } else if (png_strategy_id == rb_intern("rle")) {
+            opts.png_strategy = fastresize::ResizeOptions::PNG_STRATEGY_RLE;
+        } else if (png_strategy_id == rb_intern("huffman")) {
+            opts.png_strategy = fastresize::ResizeOptions::PNG_STRATEGY_HUFFMAN;
+        } else {
+            rb_raise(rb_eArgError, "Invalid PNG strategy. Use :default, :filtered, :rle, or :huffman");
+        }
+    }
+
+    VALUE png_window = rb_hash_aref(options, ID2SYM(rb_intern("png_window_bits")));
+    if (!NIL_P(png_window)) {
+        opts.png_window_bits = NUM2INT(png_window);
+        if (opts.png_window_bits < 9 || opts.png_window_bits > 15) {
+            rb_raise(rb_eArgError, "PNG window bits must be between 9 and 15");
+        }
+    }
+
+    VALUE png_mem_level = rb_hash_aref(options, ID2SYM(rb_intern("png_mem_level")));
+    if (!NIL_P(png_mem_level)) {
+        opts.png_mem_level = NUM2INT(png_mem_level);
+        if (opts.png_mem_level < 1 || opts.png_mem_level > 9) {
+            rb_raise(rb_eArgError, "PNG memory level must be between 1 and 9");
+        }
+    }
+
+    VALUE background = rb_hash_aref(options, ID2SYM(rb_intern("background")));
+    if (!NIL_P(background)) {
+        opts.background_color = NUM2UINT(background);
+    }
+
     VALUE quality = rb_hash_aref(options, ID2SYM(rb_intern("quality")));
     if (!NIL_P(quality)) {
         opts.quality = NUM2INT(quality);
@@ -93,11 +201,60 @@ static fastresize::ResizeOptions parse_resize_options(VALUE options) {
         }
     }
 
+    VALUE webp_effort = rb_hash_aref(options, ID2SYM(rb_intern("webp_effort")));
+    if (!NIL_P(webp_effort)) {
+        opts.webp_effort = NUM2INT(webp_effort);
+        if (opts.webp_effort < 0 || opts.webp_effort > 6) {
+            rb_raise(rb_eArgError, "WebP effort must be between 0 and 6");
+        }
+    }
+
+    VALUE webp_lossless = rb_hash_aref(options, ID2SYM(rb_intern("webp_lossless")));
+    if (!NIL_P(webp_lossless)) {
+        opts.webp_lossless = RTEST(webp_lossless);
+    }
+
+    VALUE webp_near_lossless = rb_hash_aref(options, ID2SYM(rb_intern("webp_near_lossless")));
+    if (!NIL_P(webp_near_lossless)) {
+        opts.webp_near_lossless = NUM2INT(webp_near_lossless);
+        if (opts.webp_near_lossless < 0 || opts.webp_near_lossless > 100) {
+            rb_raise(rb_eArgError, "WebP near-lossless must be between 0 and 100");
+        }
+    }
+
+    VALUE webp_alpha_quality = rb_hash_aref(options, ID2SYM(rb_intern("webp_alpha_quality")));
+    if (!NIL_P(webp_alpha_quality)) {
+        opts.webp_alpha_quality = NUM2INT(webp_alpha_quality);
+        if (opts.webp_alpha_quality < 0 || opts.webp_alpha_quality > 100) {
+            rb_raise(rb_eArgError, "WebP alpha quality must be between 0 and 100");
+        }
+    }
+
     VALUE keep_aspect = rb_hash_aref(options, ID2SYM(rb_intern("keep_aspect_ratio")));
     if (!NIL_P(keep_aspect)) {
         opts.keep_aspect_ratio = RTEST(keep_aspect);
     }
 
+    VALUE auto_orient = rb_hash_aref(options, ID2SYM(rb_intern("auto_orient")));
+    if (!NIL_P(auto_orient)) {
+        opts.auto_orient = RTEST(auto_orient);
+    }
+
+    VALUE no_enlarge = rb_hash_aref(options, ID2SYM(rb_intern("no_enlarge")));
+    if (!NIL_P(no_enlarge)) {
+        opts.no_enlarge = RTEST(no_enlarge);
+    }
+
+    VALUE embedded_thumbnail = rb_hash_aref(options, ID2SYM(rb_intern("embedded_thumbnail")));
+    if (!NIL_P(embedded_thumbnail)) {
+        opts.use_embedded_thumbnail = RTEST(embedded_thumbnail);
+    }
+
+    VALUE atomic_write = rb_hash_aref(options, ID2SYM(rb_intern("atomic_write")));
+    if (!NIL_P(atomic_write)) {
+        opts.atomic_write = RTEST(atomic_write);
+    }
+
     VALUE overwrite = rb_hash_aref(options, ID2SYM(rb_intern("overwrite")));
     if (!NIL_P(overwrite)) {
         opts.overwrite_input = RTEST(overwrite);
@@ -238,6 +395,153 @@ static VALUE rb_fastresize_image_info(VALUE self, VALUE path) {
     }
 }
 
+static VALUE rb_fastresize_enable_output_cache(VALUE self, VALUE cache_dir, VALUE max_bytes) {
+    std::string dir = rb_string_to_cpp(cache_dir);
+    if (!fastresize::enable_output_cache(dir, NUM2SIZET(max_bytes))) {
+        rb_raise(rb_eRuntimeError, "Enable output cache failed: %s", fastresize::get_last_error().c_str());
+    }
+    return Qtrue;
+}
+
+static VALUE rb_fastresize_disable_output_cache(VALUE self) {
+    fastresize::disable_output_cache();
+    return Qnil;
+}
+
+static VALUE rb_fastresize_output_cache_stats(VALUE self) {
+    fastresize::OutputCacheStats stats = fastresize::get_output_cache_stats();
+
+    VALUE result = rb_hash_new();
+    rb_hash_aset(result, ID2SYM(rb_intern("hits")), ULL2NUM(stats.hits));
+    rb_hash_aset(result, ID2SYM(rb_intern("misses")), ULL2NUM(stats.misses));
+    rb_hash_aset(result, ID2SYM(rb_intern("entries")), SIZET2NUM(stats.entries));
+    rb_hash_aset(result, ID2SYM(rb_intern("bytes")), SIZET2NUM(stats.bytes));
+    return result;
+}
+
+static VALUE rb_fastresize_enable_decode_cache(VALUE self, VALUE max_bytes) {
+    fastresize::enable_decode_cache(NUM2SIZET(max_bytes));
+    return Qtrue;
+}
+
+static VALUE rb_fastresize_disable_decode_cache(VALUE self) {
+    fastresize::disable_decode_cache();
+    return Qnil;
+}
+
+static VALUE rb_fastresize_decode_cache_stats(VALUE self) {
+    fastresize::DecodeCacheStats stats = fastresize::get_decode_cache_stats();
+
+    VALUE result = rb_hash_new();
+    rb_hash_aset(result, ID2SYM(rb_intern("hits")), ULL2NUM(stats.hits));
+    rb_hash_aset(result, ID2SYM(rb_intern("misses")), ULL2NUM(stats.misses));
+    rb_hash_aset(result, ID2SYM(rb_intern("entries")), SIZET2NUM(stats.entries));
+    rb_hash_aset(result, ID2SYM(rb_intern("bytes")), SIZET2NUM(stats.bytes));
+    return result;
+}
+
+static VALUE rb_fastresize_memory_stats(VALUE self) {
+    fastresize::MemoryStats stats = fastresize::get_memory_stats();
+
+    VALUE result = rb_hash_new();
+    rb_hash_aset(result, ID2SYM(rb_intern("current_bytes")), ULL2NUM(stats.current_bytes));
+    rb_hash_aset(result, ID2SYM(rb_intern("peak_bytes")), ULL2NUM(stats.peak_bytes));
+    return result;
+}
+
+static VALUE rb_fastresize_reset_peak_memory(VALUE self) {
+    fastresize::reset_peak_memory();
+    return Qnil;
+}
+
+static VALUE rb_fastresize_metrics_text(VALUE self) {
+    std::string text = fastresize::metrics_text();
+    return rb_str_new(text.data(), text.size());
+}
+
+struct CompareParams {
+    std::string input;
+    std::string reference;      // Empty: compare with the reference resampler
+    fastresize::ResizeOptions opts;
+    fastresize::QualityReport report;
+    bool success;
+    std::string error;
+};
+
+static void* compare_without_gvl(void* data) {
+    CompareParams* params = static_cast<CompareParams*>(data);
+    try {
+        params->success = params->reference.empty()
+            ? fastresize::compare_resize(params->input, params->opts, params->report)
+            : fastresize::compare_images(params->input, params->reference, params->report);
+        if (!params->success) {
+            params->error = fastresize::get_last_error();
+        }
+    } catch (const std::exception& e) {
+        params->success = false;
+        params->error = std::string("Exception: ") + e.what();
+    }
+    return nullptr;
+}
+
+static VALUE rb_quality_report(CompareParams& params) {
+    rb_thread_call_without_gvl(compare_without_gvl, &params, RUBY_UBF_IO, nullptr);
+
+    if (!params.success) {
+        rb_raise(rb_eRuntimeError, "Compare failed: %s", params.error.c_str());
+    }
+
+    VALUE result = rb_hash_new();
+    rb_hash_aset(result, ID2SYM(rb_intern("width")), INT2NUM(params.report.width));
+    rb_hash_aset(result, ID2SYM(rb_intern("height")), INT2NUM(params.report.height));
+    rb_hash_aset(result, ID2SYM(rb_intern("psnr")), DBL2NUM(params.report.psnr));
+    rb_hash_aset(result, ID2SYM(rb_intern("ssim")), DBL2NUM(params.report.ssim));
+    rb_hash_aset(result, ID2SYM(rb_intern("max_error")), INT2NUM(params.report.max_error));
+    return result;
+}
+
+static VALUE rb_fastresize_compare(int argc, VALUE* argv, VALUE self) {
+    VALUE input_path, options;
+    rb_scan_args(argc, argv, "11", &input_path, &options);
+
+    CompareParams params;
+    params.input = rb_string_to_cpp(input_path);
+    params.opts = parse_resize_options(options);
+    return rb_quality_report(params);
+}
+
+static VALUE rb_fastresize_compare_images(VALUE self, VALUE path_a, VALUE path_b) {
+    CompareParams params;
+    params.input = rb_string_to_cpp(path_a);
+    params.reference = rb_string_to_cpp(path_b);
+    return rb_quality_report(params);
+}
+
+static VALUE rb_item_results(const std::vector<fastresize::ItemResult>& items) {
+    static const char* const outcomes[] = {"not_run", "resized", "copied", "cached", "skipped", "failed"};
+
+    VALUE results = rb_ary_new2(items.size());
+    for (const fastresize::ItemResult& item : items) {
+        VALUE entry = rb_hash_new();
+        rb_hash_aset(entry, ID2SYM(rb_intern("outcome")), ID2SYM(rb_intern(outcomes[item.outcome])));
+        rb_hash_aset(entry, ID2SYM(rb_intern("status")), INT2NUM(item.status));
+        rb_hash_aset(entry, ID2SYM(rb_intern("input_width")), INT2NUM(item.input_width));
+        rb_hash_aset(entry, ID2SYM(rb_intern("input_height")), INT2NUM(item.input_height));
+        rb_hash_aset(entry, ID2SYM(rb_intern("output_width")), INT2NUM(item.output_width));
+        rb_hash_aset(entry, ID2SYM(rb_intern("output_height")), INT2NUM(item.output_height));
+        rb_hash_aset(entry, ID2SYM(rb_intern("decode_scale")), INT2NUM(item.decode_scale));
+        rb_hash_aset(entry, ID2SYM(rb_intern("bytes_read")), ULL2NUM(item.bytes_read));
+        rb_hash_aset(entry, ID2SYM(rb_intern("bytes_written")), ULL2NUM(item.bytes_written));
+        rb_hash_aset(entry, ID2SYM(rb_intern("probe_us")), ULL2NUM(item.probe_us));
+        rb_hash_aset(entry, ID2SYM(rb_intern("decode_us")), ULL2NUM(item.decode_us));
+        rb_hash_aset(entry, ID2SYM(rb_intern("resize_us")), ULL2NUM(item.resize_us));
+        rb_hash_aset(entry, ID2SYM(rb_intern("encode_us")), ULL2NUM(item.encode_us));
+        rb_hash_aset(entry, ID2SYM(rb_intern("total_us")), ULL2NUM(item.total_us));
+        rb_ary_push(results, entry);
+    }
+    return results;
+}
+
 static VALUE rb_fastresize_batch_resize(int argc, VALUE* argv, VALUE self) {
     VALUE input_paths, output_dir, options;
     rb_scan_args(argc, argv, "21", &input_paths, &output_dir, &options);
@@ -271,6 +575,22 @@ static VALUE rb_fastresize_batch_resize(int argc, VALUE* argv, VALUE self) {
             if (!NIL_P(max_speed)) {
                 batch_opts.max_speed = RTEST(max_speed);
             }
+
+            VALUE incremental = rb_hash_aref(options, ID2SYM(rb_intern("incremental")));
+            if (!NIL_P(incremental)) {
+                batch_opts.incremental = RTEST(incremental);
+            }
+
+            VALUE manifest = rb_hash_aref(options, ID2SYM(rb_intern("manifest")));
+            if (!NIL_P(manifest)) {
+                batch_opts.incremental = true;
+                batch_opts.manifest_path = StringValueCStr(manifest);
+            }
+
+            VALUE trace = rb_hash_aref(options, ID2SYM(rb_intern("trace")));
+            if (!NIL_P(trace)) {
+                batch_opts.trace_path = StringValueCStr(trace);
+            }
         }
 
         fastresize::BatchResult result = fastresize::batch_resize(inputs, out_dir, resize_opts, batch_opts);
@@ -279,12 +599,15 @@ static VALUE rb_fastresize_batch_resize(int argc, VALUE* argv, VALUE self) {
         rb_hash_aset(rb_result, ID2SYM(rb_intern("total")), INT2NUM(result.total));
         rb_hash_aset(rb_result, ID2SYM(rb_intern("success")), INT2NUM(result.success));
         rb_hash_aset(rb_result, ID2SYM(rb_intern("failed")), INT2NUM(result.failed));
+        rb_hash_aset(rb_result, ID2SYM(rb_intern("skipped")), INT2NUM(result.skipped));
+        rb_hash_aset(rb_result, ID2SYM(rb_intern("peak_memory_bytes")), ULL2NUM(result.peak_memory_bytes));
 
         VALUE errors = rb_ary_new();
         for (const auto& error : result.errors) {
             rb_ary_push(errors, rb_str_new_cstr(error.c_str()));
         }
         rb_hash_aset(rb_result, ID2SYM(rb_intern("errors")), errors);
+        rb_hash_aset(rb_result, ID2SYM(rb_intern("items")), rb_item_results(result.items));
 
         return rb_result;
     } catch (const std::exception& e) {
@@ -340,6 +663,22 @@ static VALUE rb_fastresize_batch_resize_custom(int argc, VALUE* argv, VALUE self
             if (!NIL_P(max_speed)) {
                 batch_opts.max_speed = RTEST(max_speed);
             }
+
+            VALUE incremental = rb_hash_aref(options, ID2SYM(rb_intern("incremental")));
+            if (!NIL_P(incremental)) {
+                batch_opts.incremental = RTEST(incremental);
+            }
+
+            VALUE manifest = rb_hash_aref(options, ID2SYM(rb_intern("manifest")));
+            if (!NIL_P(manifest)) {
+                batch_opts.incremental = true;
+                batch_opts.manifest_path = StringValueCStr(manifest);
+            }
+
+            VALUE trace = rb_hash_aref(options, ID2SYM(rb_intern("trace")));
+            if (!NIL_P(trace)) {
+                batch_opts.trace_path = StringValueCStr(trace);
+            }
         }
 
         fastresize::BatchResult result = fastresize::batch_resize_custom(batch_items, batch_opts);
@@ -348,12 +687,15 @@ static VALUE rb_fastresize_batch_resize_custom(int argc, VALUE* argv, VALUE self
         rb_hash_aset(rb_result, ID2SYM(rb_intern("total")), INT2NUM(result.total));
         rb_hash_aset(rb_result, ID2SYM(rb_intern("success")), INT2NUM(result.success));
         rb_hash_aset(rb_result, ID2SYM(rb_intern("failed")), INT2NUM(result.failed));
+        rb_hash_aset(rb_result, ID2SYM(rb_intern("skipped")), INT2NUM(result.skipped));
+        rb_hash_aset(rb_result, ID2SYM(rb_intern("peak_memory_bytes")), ULL2NUM(result.peak_memory_bytes));
 
         VALUE errors = rb_ary_new();
         for (const auto& error : result.errors) {
             rb_ary_push(errors, rb_str_new_cstr(error.c_str()));
         }
         rb_hash_aset(rb_result, ID2SYM(rb_intern("errors")), errors);
+        rb_hash_aset(rb_result, ID2SYM(rb_intern("items")), rb_item_results(result.items));
 
         return rb_result;
     } catch (const std::exception& e) {
@@ -374,4 +716,26 @@ extern "C" void Init_fastresize_ext(void) {
         RUBY_METHOD_FUNC(rb_fastresize_batch_resize), -1);
     rb_define_singleton_method(rb_mFastResize, "batch_resize_custom",
         RUBY_METHOD_FUNC(rb_fastresize_batch_resize_custom), -1);
+    rb_define_singleton_method(rb_mFastResize, "enable_output_cache",
+        RUBY_METHOD_FUNC(rb_fastresize_enable_output_cache), 2);
+    rb_define_singleton_method(rb_mFastResize, "disable_output_cache",
+        RUBY_METHOD_FUNC(rb_fastresize_disable_output_cache), 0);
+    rb_define_singleton_method(rb_mFastResize, "output_cache_stats",
+        RUBY_METHOD_FUNC(rb_fastresize_output_cache_stats), 0);
+    rb_define_singleton_method(rb_mFastResize, "enable_decode_cache",
+        RUBY_METHOD_FUNC(rb_fastresize_enable_decode_cache), 1);
+    rb_define_singleton_method(rb_mFastResize, "disable_decode_cache",
+        RUBY_METHOD_FUNC(rb_fastresize_disable_decode_cache), 0);
+    rb_define_singleton_method(rb_mFastResize, "decode_cache_stats",
+        RUBY_METHOD_FUNC(rb_fastresize_decode_cache_stats), 0);
+    rb_define_singleton_method(rb_mFastResize, "memory_stats",
+        RUBY_METHOD_FUNC(rb_fastresize_memory_stats), 0);
+    rb_define_singleton_method(rb_mFastResize, "reset_peak_memory",
+        RUBY_METHOD_FUNC(rb_fastresize_reset_peak_memory), 0);
+    rb_define_singleton_method(rb_mFastResize, "metrics_text",
+        RUBY_METHOD_FUNC(rb_fastresize_metrics_text), 0);
+    rb_define_singleton_method(rb_mFastResize, "compare",
+        RUBY_METHOD_FUNC(rb_fastresize_compare), -1);
+    rb_define_singleton_method(rb_mFastResize, "compare_images",
+        RUBY_METHOD_FUNC(rb_fastresize_compare_images), 2);
 }
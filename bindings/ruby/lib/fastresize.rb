@@ -94,9 +94,28 @@ module FastResize
   # @option options [Integer] :height Target height in pixels
   # @option options [Float] :scale Scale factor (e.g., 0.5 = 50%, 2.0 = 200%)
   # @option options [Integer] :quality JPEG/WebP quality 1-100 (default: 85)
+  # @option options [Integer] :webp_effort WebP effort 0 (fastest) to 6 (smallest) (default: 4)
+  # @option options [Boolean] :webp_lossless Lossless WebP; quality sets compression effort (default: false)
+  # @option options [Integer] :webp_near_lossless Near-lossless WebP 0-100, 100 = off (default: 100)
+  # @option options [Integer] :webp_alpha_quality WebP alpha quality 0-100 (default: 100)
+  # @option options [Symbol] :png_filter PNG row filter: :adaptive, :none, :sub, :up, :average, :paeth
+  #   (default: :adaptive)
+  # @option options [Symbol] :png_strategy zlib strategy: :default, :filtered, :rle, :huffman
+  # @option options [Integer] :png_window_bits zlib window 9-15 (default: 15)
+  # @option options [Integer] :png_mem_level zlib memory level 1-9 (default: 8)
   # @option options [Symbol] :filter Resize filter: :mitchell, :catmull_rom, :box, :triangle
   # @option options [Boolean] :keep_aspect_ratio Maintain aspect ratio (default: true)
   # @option options [Boolean] :overwrite Overwrite input file (default: false)
+  # @option options [Boolean] :auto_orient Apply EXIF orientation (default: true)
+  # @option options [Boolean] :no_enlarge Keep images already smaller than the target (default: false)
+  # @option options [Boolean] :embedded_thumbnail Use the JPEG EXIF thumbnail when large enough (default: false)
+  # @option options [Boolean] :atomic_write Write to a temp file and rename it into place (default: false)
+  # @option options [String] :cache_dir Reuse outputs for repeated inputs and options from this directory
+  # @option options [Integer] :cache_size Output cache size limit in MB, 0 = none (default: 1024)
+  # @option options [Symbol] :fit Fill width x height box: :cover (crop) or :contain (pad)
+  # @option options [Symbol] :gravity Crop/pad anchor: :center, :north, :south, :east, :west,
+  #   :north_east, :north_west, :south_east, :south_west (default: :center)
+  # @option options [Integer] :background Padding color for :contain as 0xRRGGBBAA
   # @return [Boolean] true if successful
   #
   # @example Basic resize by width
@@ -108,6 +127,9 @@ module FastResize
   # @example Scale to 50%
   #   FastResize.resize("input.jpg", "output.jpg", scale: 0.5)
   #
+  # @example Square thumbnail cropped from the top
+  #   FastResize.resize("input.jpg", "thumb.jpg", width: 200, height: 200, fit: :cover, gravity: :north)
+  #
   # @example With quality and filter
   #   FastResize.resize("input.jpg", "output.jpg",
   #     width: 800,
@@ -164,7 +186,13 @@ module FastResize
   # @option options [Integer] :threads Number of threads (default: auto)
   # @option options [Boolean] :stop_on_error Stop on first error (default: false)
   # @option options [Boolean] :max_speed Enable pipeline mode (default: false)
-  # @return [Hash] Result with :total, :success, :failed, :errors
+  # @option options [Boolean] :incremental Skip images whose output is newer than the input; option
+  #   changes are not detected, use :manifest for that (default: false)
+  # @option options [String] :manifest Incremental, tracking input hashes and options in this file
+  # @option options [String] :trace Write per-stage timings as Chrome trace JSON to this file
+  # @option options [String] :metrics Write Prometheus metrics of the run to this file
+  # @return [Hash] Result with :total, :success, :failed, :skipped, :errors and
+  #   :peak_memory_bytes, the most pixel-buffer memory the batch held at once (to 0.1 MB)
   #
   # @example Batch resize
   #   files = Dir["photos/*.jpg"]
@@ -191,6 +219,7 @@ module FastResize
     # Actually, use the batch command directly
     args = ['batch']
     args += build_batch_args(options)
+    args << '--stats'
 
     # Get the input directory from the first file
     input_dir = File.dirname(input_paths.first)
@@ -205,6 +234,8 @@ module FastResize
       total: input_paths.length,
       success: 0,
       failed: 0,
+      skipped: 0,
+      peak_memory_bytes: 0,
       errors: []
     }
 
@@ -216,6 +247,12 @@ module FastResize
       if output =~ /(\d+) failed/
         result[:failed] = $1.to_i
       end
+      if output =~ /(\d+) skipped/
+        result[:skipped] = $1.to_i
+      end
+      if output =~ /batch peak ([\d.]+) MB/
+        result[:peak_memory_bytes] = ($1.to_f * 1024 * 1024).round
+      end
     else
       result[:failed] = input_paths.length
       result[:errors] << output.strip
@@ -264,8 +301,91 @@ module FastResize
     result
   end
 
+  # Measure resize quality against a double-precision reference resampler
+  #
+  # Resizes the image as resize would, without encoding, and compares the
+  # pixels with a float resample of the full-resolution source.
+  #
+  # @param input_path [String] Path to input image
+  # @param options [Hash] Resize options that shape the pixels: :width, :height,
+  #   :scale, :filter, :keep_aspect_ratio, :auto_orient, :no_enlarge,
+  #   :embedded_thumbnail, :fit, :gravity, :background
+  # @return [Hash] :width, :height, :psnr (dB), :ssim (0-1), :max_error (0-255)
+  #
+  # @example
+  #   FastResize.compare("photo.jpg", width: 200)
+  #   # => { width: 200, height: 133, psnr: 41.2, ssim: 0.9981, max_error: 9 }
+  def self.compare(input_path, options = {})
+    raise Error, "Input path cannot be empty" if input_path.nil? || input_path.empty?
+    raise Error, "Input file not found: #{input_path}" unless File.exist?(input_path)
+
+    run_compare(build_compare_args(input_path, options))
+  end
+
+  # Compare two images of the same size and channel count
+  #
+  # @param path_a [String] Path to the first image
+  # @param path_b [String] Path to the second image
+  # @return [Hash] :width, :height, :psnr (dB), :ssim (0-1), :max_error (0-255)
+  def self.compare_images(path_a, path_b)
+    [path_a, path_b].each do |path|
+      raise Error, "Image path cannot be empty" if path.nil? || path.empty?
+      raise Error, "Image file not found: #{path}" unless File.exist?(path)
+    end
+
+    run_compare(['compare', path_a, path_b])
+  end
+
   private
 
+  # Run the compare command and parse its report
+  def self.run_compare(args)
+    cli_path = Platform.find_binary
+    output = `#{cli_path} #{args.map { |a| "'#{a}'" }.join(' ')} 2>&1`
+    raise Error, "Failed to compare: #{output}" unless $?.success?
+
+    report = {}
+    output.each_line do |line|
+      case line
+      when /Size:\s*(\d+)x(\d+)/
+        report[:width] = $1.to_i
+        report[:height] = $2.to_i
+      when /PSNR:\s*([\d.]+)/
+        report[:psnr] = $1.to_f
+      when /SSIM:\s*([\d.]+)/
+        report[:ssim] = $1.to_f
+      when /Max error:\s*(\d+)/
+        report[:max_error] = $1.to_i
+      end
+    end
+
+    report
+  end
+
+  # Build CLI arguments for compare; encoder settings don't affect the pixels
+  def self.build_compare_args(input_path, options)
+    args = ['compare', input_path]
+
+    if options[:scale]
+      args += ['-s', options[:scale].to_s]
+    else
+      args += ['-w', options[:width].to_s] if options[:width]
+      args += ['-h', options[:height].to_s] if options[:height]
+    end
+
+    if options[:filter]
+      args += ['-f', options[:filter].to_s.gsub('_', '-')]
+    end
+
+    args << '--no-aspect-ratio' if options[:keep_aspect_ratio] == false
+    args << '--no-auto-orient' if options[:auto_orient] == false
+    args << '--no-enlarge' if options[:no_enlarge]
+    args << '--embedded-thumbnail' if options[:embedded_thumbnail]
+    args += fit_args(options)
+
+    args
+  end
+
   # Build CLI arguments for single resize
   def self.build_resize_args(input_path, output_path, options)
     args = [input_path, output_path]
@@ -283,6 +403,14 @@ module FastResize
     end
 
     args += ['-q', options[:quality].to_s] if options[:quality]
+    args += ['--webp-effort', options[:webp_effort].to_s] if options[:webp_effort]
+    args << '--webp-lossless' if options[:webp_lossless]
+    args += ['--webp-near-lossless', options[:webp_near_lossless].to_s] if options[:webp_near_lossless]
+    args += ['--webp-alpha-quality', options[:webp_alpha_quality].to_s] if options[:webp_alpha_quality]
+    args += ['--png-filter', options[:png_filter].to_s] if options[:png_filter]
+    args += ['--png-strategy', options[:png_strategy].to_s] if options[:png_strategy]
+    args += ['--png-window', options[:png_window_bits].to_s] if options[:png_window_bits]
+    args += ['--png-mem-level', options[:png_mem_level].to_s] if options[:png_mem_level]
 
     if options[:filter]
       filter_name = options[:filter].to_s.gsub('_', '-')
@@ -290,11 +418,27 @@ module FastResize
     end
 
     args << '--no-aspect-ratio' if options[:keep_aspect_ratio] == false
+    args << '--no-auto-orient' if options[:auto_orient] == false
+    args << '--no-enlarge' if options[:no_enlarge]
+    args << '--embedded-thumbnail' if options[:embedded_thumbnail]
+    args << '--atomic-write' if options[:atomic_write]
+    args += ['--cache-dir', options[:cache_dir].to_s] if options[:cache_dir]
+    args += ['--cache-size', options[:cache_size].to_s] if options[:cache_size]
+    args += fit_args(options)
     args << '-o' if options[:overwrite]
 
     args
   end
 
+  # Build CLI arguments for cover/contain fitting
+  def self.fit_args(options)
+    args = []
+    args += ['--fit', options[:fit].to_s] if options[:fit]
+    args += ['--gravity', options[:gravity].to_s] if options[:gravity]
+    args += ['--background', format('%08x', options[:background])] if options[:background]
+    args
+  end
+
   # Build CLI arguments for batch operations
   def self.build_batch_args(options)
     args = []
@@ -312,6 +456,14 @@ module FastResize
     end
 
     args += ['-q', options[:quality].to_s] if options[:quality]
+    args += ['--webp-effort', options[:webp_effort].to_s] if options[:webp_effort]
+    args << '--webp-lossless' if options[:webp_lossless]
+    args += ['--webp-near-lossless', options[:webp_near_lossless].to_s] if options[:webp_near_lossless]
+    args += ['--webp-alpha-quality', options[:webp_alpha_quality].to_s] if options[:webp_alpha_quality]
+    args += ['--png-filter', options[:png_filter].to_s] if options[:png_filter]
+    args += ['--png-strategy', options[:png_strategy].to_s] if options[:png_strategy]
+    args += ['--png-window', options[:png_window_bits].to_s] if options[:png_window_bits]
+    args += ['--png-mem-level', options[:png_mem_level].to_s] if options[:png_mem_level]
 
     if options[:filter]
       filter_name = options[:filter].to_s.gsub('_', '-')
@@ -319,9 +471,20 @@ module FastResize
     end
 
     args << '--no-aspect-ratio' if options[:keep_aspect_ratio] == false
+    args << '--no-auto-orient' if options[:auto_orient] == false
+    args << '--no-enlarge' if options[:no_enlarge]
+    args << '--embedded-thumbnail' if options[:embedded_thumbnail]
+    args << '--atomic-write' if options[:atomic_write]
+    args += ['--cache-dir', options[:cache_dir].to_s] if options[:cache_dir]
+    args += ['--cache-size', options[:cache_size].to_s] if options[:cache_size]
+    args += fit_args(options)
     args += ['-t', options[:threads].to_s] if options[:threads]
     args << '--stop-on-error' if options[:stop_on_error]
     args << '--max-speed' if options[:max_speed]
+    args << '--incremental' if options[:incremental]
+    args += ['--manifest', options[:manifest].to_s] if options[:manifest]
+    args += ['--trace', options[:trace].to_s] if options[:trace]
+    args += ['--metrics', options[:metrics].to_s] if options[:metrics]
 
     args
   end
@@ -41,6 +41,9 @@
 #ifndef FASTRESIZE_H
 #define FASTRESIZE_H
 
+#include <cstdint>
+#include <functional>
+#include <future>
 #include <string>
 #include <vector>
 
@@ -50,13 +53,26 @@ namespace fastresize {
 // Core Structures
 // ============================================
 
+// Error codes
+enum ErrorCode {
+    OK = 0,
+    FILE_NOT_FOUND,
+    UNSUPPORTED_FORMAT,
+    DECODE_ERROR,
+    RESIZE_ERROR,
+    ENCODE_ERROR,
+    WRITE_ERROR
+};
+
 struct ResizeOptions {
     // Resize mode
     enum Mode {
         SCALE_PERCENT,      // Scale by percentage
         FIT_WIDTH,          // Fixed width, height auto
         FIT_HEIGHT,         // Fixed height, width auto
-        EXACT_SIZE          // Exact width & height
+        EXACT_SIZE,         // Exact width & height
+        COVER,              // Fill width & height, crop the overflow
+        CONTAIN             // Fit inside width & height, pad the rest
     } mode;
 
     // Dimensions
@@ -67,10 +83,55 @@ struct ResizeOptions {
     // Options
     bool keep_aspect_ratio; // Preserve aspect ratio (default: true)
     bool overwrite_input;   // Overwrite input file (default: false)
+    bool auto_orient;       // Apply EXIF orientation (default: true)
+    bool use_embedded_thumbnail;  // Decode the EXIF thumbnail when it is large enough (default: false)
+    bool atomic_write;      // Write to a temp file and rename it into place (default: false)
+    bool no_enlarge;        // Keep the source size instead of upscaling (default: false)
+
+    // Anchor for COVER cropping and CONTAIN padding
+    enum Gravity {
+        CENTER,
+        NORTH,
+        SOUTH,
+        EAST,
+        WEST,
+        NORTH_EAST,
+        NORTH_WEST,
+        SOUTH_EAST,
+        SOUTH_WEST
+    } gravity;
+
+    unsigned int background_color;  // CONTAIN padding as 0xRRGGBBAA (default: opaque black)
 
     // Quality
     int quality;            // JPEG/WEBP quality 1-100 (default: 85)
 
+    // WebP encoding
+    int webp_effort;        // 0 (fastest) to 6 (smallest) (default: 4)
+    bool webp_lossless;     // Lossless WebP; quality then trades speed for size (default: false)
+    int webp_near_lossless; // Near-lossless preprocessing 0-100, 100 = off; implies lossless (default: 100)
+    int webp_alpha_quality; // Alpha plane quality 0-100 (default: 100)
+
+    // PNG encoding; a fixed filter and Z_RLE trade a few percent of size for speed
+    enum PngFilter {
+        PNG_ADAPTIVE,       // Best of all five filters per row (libpng default)
+        PNG_NONE,
+        PNG_SUB,
+        PNG_UP,
+        PNG_AVERAGE,
+        PNG_PAETH
+    } png_filter;
+
+    enum PngStrategy {
+        PNG_STRATEGY_DEFAULT,   // Z_FILTERED, or Z_DEFAULT_STRATEGY for unfiltered rows
+        PNG_STRATEGY_FILTERED,
+        PNG_STRATEGY_RLE,
+        PNG_STRATEGY_HUFFMAN
+    } png_strategy;
+
+    int png_window_bits;    // zlib window 9-15 (default: 15)
+    int png_mem_level;      // zlib memory level 1-9 (default: 8)
+
     // Filter
     enum Filter {
         MITCHELL,           // Default, good balance
@@ -87,7 +148,21 @@ struct ResizeOptions {
         , scale_percent(1.0f)
         , keep_aspect_ratio(true)
         , overwrite_input(false)
+        , auto_orient(true)
+        , use_embedded_thumbnail(false)
+        , atomic_write(false)
+        , no_enlarge(false)
+        , gravity(CENTER)
+        , background_color(0x000000FF)
         , quality(85)
+        , webp_effort(4)
+        , webp_lossless(false)
+        , webp_near_lossless(100)
+        , webp_alpha_quality(100)
+        , png_filter(PNG_ADAPTIVE)
+        , png_strategy(PNG_STRATEGY_DEFAULT)
+        , png_window_bits(15)
+        , png_mem_level(8)
         , filter(MITCHELL)
     {}
 };
@@ -135,19 +210,56 @@ struct BatchOptions {
     int num_threads;        // Thread pool size (0 = auto-detect, default: 0)
     bool stop_on_error;     // Stop if any image fails (default: false)
     bool max_speed;         // Enable Phase C pipeline (faster but uses more RAM, default: false)
+    bool incremental;       // Skip items whose output is already current (default: false)
+    std::string manifest_path;  // Incremental: sidecar of input hashes instead of mtimes (default: none)
+    std::string trace_path;     // Write per-stage timings as Chrome trace JSON (default: none)
 
     BatchOptions()
         : num_threads(0)    // Phase A Optimization #7: Auto-detect thread count
         , stop_on_error(false)
         , max_speed(false)  // Phase C: Default to balanced mode (no extra RAM)
+        , incremental(false)
     {}
 };
 
+// What happened to one batch item. Stage times are wall-clock microseconds
+// spent on the item (0 = stage not run); items that share one decode of
+// their source each report the whole decode.
+struct ItemResult {
+    enum Outcome {
+        NOT_RUN,            // Batch stopped first (stop_on_error)
+        RESIZED,            // Decoded, resized and encoded
+        COPIED,             // Identity resize, source file copied
+        CACHED,             // Copied from the output cache
+        SKIPPED,            // Incremental: output already current
+        FAILED              // See status
+    };
+
+    Outcome outcome = NOT_RUN;
+    ErrorCode status = OK;  // Set when FAILED
+    int input_width = 0;    // As stored, before EXIF orientation
+    int input_height = 0;
+    int output_width = 0;
+    int output_height = 0;
+    int decode_scale = 0;   // Source over decoded width: JPEG DCT scale denominator, more for an
+                            // embedded thumbnail (1 = full size, 0 = not decoded)
+    uint64_t bytes_read = 0;        // Input file size
+    uint64_t bytes_written = 0;     // Output file size
+    uint64_t probe_us = 0;  // Format detection, header and cache key
+    uint64_t decode_us = 0;
+    uint64_t resize_us = 0;
+    uint64_t encode_us = 0; // Encode and write, or the copy for COPIED and CACHED
+    uint64_t total_us = 0;
+};
+
 struct BatchResult {
     int total;              // Total images
     int success;            // Successfully processed
     int failed;             // Failed to process
+    int skipped = 0;        // Incremental: outputs that were already current
     std::vector<std::string> errors;  // Error messages
+    std::vector<ItemResult> items;    // One per input, in input order
+    uint64_t peak_memory_bytes = 0;   // Most pixel-buffer bytes the batch held at once
 };
 
 // Batch resize - same options for all images
@@ -164,6 +276,211 @@ BatchResult batch_resize_custom(
     const BatchOptions& batch_opts = BatchOptions()
 );
 
+// ============================================
+// Asynchronous Jobs
+// ============================================
+
+// A persistent decode -> resize -> encode pipeline for services that resize
+// as requests arrive. Stage threads live as long as the queue; each stage
+// hands items on through a bounded queue, so a full pipeline pushes back on
+// submitters instead of buffering without limit.
+class JobQueue;
+
+struct JobQueueOptions {
+    int num_threads;        // Threads per stage (0 = auto-detect, default: 0)
+    int decode_threads;     // Per-stage overrides of num_threads (0 = num_threads)
+    int resize_threads;
+    int encode_threads;
+    size_t queue_capacity;  // Jobs each stage queue holds (default: 64)
+
+    JobQueueOptions()
+        : num_threads(0)
+        , decode_threads(0)
+        , resize_threads(0)
+        , encode_threads(0)
+        , queue_capacity(64)
+    {}
+};
+
+struct JobResult {
+    uint64_t id = 0;
+    ItemResult item;
+    std::string error;      // Set when item.outcome is FAILED
+};
+
+// Runs on an encode thread once the job is done; keep it short and use
+// try_submit_job() to chain work from it, as submit_job() may block on the
+// queue the calling thread drains.
+typedef std::function<void(const JobResult&)> JobCallback;
+
+struct JobHandle {
+    uint64_t id = 0;        // 0 = not submitted
+    std::shared_future<JobResult> result;
+};
+
+enum SubmitStatus {
+    SUBMITTED,
+    QUEUE_FULL,             // Try again later
+    QUEUE_CLOSED            // destroy_job_queue() has started
+};
+
+JobQueue* create_job_queue(const JobQueueOptions& options = JobQueueOptions());
+// Finishes every submitted job, then stops the stage threads
+void destroy_job_queue(JobQueue* queue);
+
+// Never blocks; handle is set only when SUBMITTED
+SubmitStatus try_submit_job(
+    JobQueue* queue,
+    const BatchItem& item,
+    JobHandle& handle,
+    JobCallback callback = nullptr
+);
+
+// Blocks while the submission queue is full; the handle's id is 0 if the
+// queue was closed
+JobHandle submit_job(
+    JobQueue* queue,
+    const BatchItem& item,
+    JobCallback callback = nullptr
+);
+
+// Blocks until every job submitted so far has finished
+void wait_job_queue(JobQueue* queue);
+
+// ============================================
+// Streaming Batches
+// ============================================
+
+// A batch fed one item at a time, for inputs too many to list up front:
+// decoding starts with the first push while the producer keeps finding
+// files. Runs on a job queue sized like batch_resize_custom(): num_threads
+// in total, split across the stages, or with max_speed the pipeline's stage
+// threads and queue depth, sized from the first item. Incremental checks
+// run on the decode threads. stop_on_error refuses pushes after the first
+// failure.
+class BatchSession;
+
+// index counts pushes from 0; error is set when the item FAILED. Called
+// for one item at a time on one of the session's encode threads, skipped
+// items included, never on the pushing thread.
+typedef std::function<void(size_t index, const ItemResult& item, const std::string& error)> BatchItemCallback;
+
+// With on_item, results are streamed to it and BatchResult::items stays
+// empty, so memory does not grow with the batch
+BatchSession* open_batch(
+    const BatchOptions& batch_opts = BatchOptions(),
+    BatchItemCallback on_item = nullptr
+);
+
+// Blocks while the pipeline is full. False once stop_on_error has stopped
+// the batch. Concurrent pushes to one session are not allowed: the first
+// push creates the session's job queue unlocked, so producers on several
+// threads must serialize their calls.
+bool batch_push(BatchSession* session, const BatchItem& item);
+
+// Finishes every pushed item and frees the session
+BatchResult close_batch(BatchSession* session);
+
+// ============================================
+// Output Cache
+// ============================================
+
+// Content-addressed cache of encoded outputs, keyed by a hash of the input
+// bytes, the resize options and the output format. A hit copies the cached
+// file and skips decode, resize and encode entirely. Least recently used
+// entries are evicted beyond max_bytes (0 = no size limit). The cache is
+// process-wide; enable and disable it while no resizes are running. Not
+// available on Windows, where enable_output_cache() returns false.
+struct OutputCacheStats {
+    uint64_t hits;
+    uint64_t misses;
+    size_t entries;
+    size_t bytes;
+};
+
+bool enable_output_cache(const std::string& cache_dir, size_t max_bytes);
+void disable_output_cache();
+OutputCacheStats get_output_cache_stats();
+
+// ============================================
+// Decode Cache
+// ============================================
+
+// In-memory LRU cache of decoded source images, for servers that resize the
+// same originals to many sizes. Keyed by path, file size and mtime; a cached
+// decode also serves smaller requests for the same file. Holds at most
+// max_bytes of pixels. Process-wide and off by default; enable and disable
+// it while no resizes are running.
+struct DecodeCacheStats {
+    uint64_t hits;
+    uint64_t misses;
+    size_t entries;
+    size_t bytes;
+};
+
+void enable_decode_cache(size_t max_bytes);
+void disable_decode_cache();
+DecodeCacheStats get_decode_cache_stats();
+
+// ============================================
+// Memory Accounting
+// ============================================
+
+// Bytes held in pixel buffers: decoded images (decode cache included),
+// resize outputs, colour conversion scratch and encode buffers, WebP's
+// included. Process-wide; BatchResult::peak_memory_bytes has one batch's.
+struct MemoryStats {
+    uint64_t current_bytes;
+    uint64_t peak_bytes;
+};
+
+MemoryStats get_memory_stats();
+// Starts a new peak from the current figure
+void reset_peak_memory();
+
+// ============================================
+// Metrics
+// ============================================
+
+// Process-wide counters and latency histograms in Prometheus text exposition
+// format: images by outcome, bytes read and written, JPEG decode scales,
+// SIMD and stb_image_resize2 resizes, decode/resize/encode time by format
+// and filter, pipeline queue waits and pixel memory. Serve it from a
+// /metrics handler or write it for node_exporter's textfile collector.
+std::string metrics_text();
+
+// ============================================
+// Quality Verification
+// ============================================
+
+// How closely one image matches another of the same size
+struct QualityReport {
+    int width;
+    int height;
+    double psnr;            // dB over all channels, 99 for identical pixels
+    double ssim;            // Mean SSIM of the luma over 8x8 windows, 1 = identical
+    int max_error;          // Largest difference of any channel (0-255)
+};
+
+// Resizes input_path as resize() would, without encoding, and compares the
+// pixels with a double-precision resample of the full-resolution source
+// using the same filter, crop, padding and orientation. Shows what the fast
+// paths (JPEG DCT scaling, planar YCbCr, the large-downscale filter swap)
+// cost in quality.
+bool compare_resize(
+    const std::string& input_path,
+    const ResizeOptions& options,
+    QualityReport& report
+);
+
+// Compares two decoded images of the same size and channel count, e.g. an
+// output with a reference rendered by another tool
+bool compare_images(
+    const std::string& path_a,
+    const std::string& path_b,
+    QualityReport& report
+);
+
 // ============================================
 // Error Handling
 // ============================================
@@ -171,17 +488,6 @@ BatchResult batch_resize_custom(
 // Get last error message
 std::string get_last_error();
 
-// Error codes
-enum ErrorCode {
-    OK = 0,
-    FILE_NOT_FOUND,
-    UNSUPPORTED_FORMAT,
-    DECODE_ERROR,
-    RESIZE_ERROR,
-    ENCODE_ERROR,
-    WRITE_ERROR
-};
-
 ErrorCode get_last_error_code();
 
 } // namespace fastresize
@@ -39,14 +39,25 @@
  */
 
 #include <fastresize.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <iomanip>
 #include <iostream>
+#include <mutex>
+#include <set>
 #include <string>
+#include <thread>
 #include <vector>
+#include <cstdio>
 #include <cstring>
 #include <cstdlib>
 #include <climits>
 #include <sys/stat.h>
 #include <dirent.h>
+#include <fnmatch.h>
 #include <errno.h>
 
 // Version from CMake (passed via -DFASTRESIZE_VERSION)
@@ -58,15 +69,20 @@ static const char* get_version() {
     return FASTRESIZE_VERSION;
 }
 
+static const int DEFAULT_CACHE_SIZE_MB = 1024;
+
 void print_usage(const char* program_name) {
     std::cout << "FastResize v" << get_version() << " - The Fastest Image Resizing Library\n\n";
     std::cout << "Usage: " << program_name << " [OPTIONS] <input> <output> [width] [height]\n";
     std::cout << "       " << program_name << " batch [OPTIONS] <input_dir> <output_dir>\n";
-    std::cout << "       " << program_name << " info <image>\n\n";
+    std::cout << "       " << program_name << " info <image>\n";
+    std::cout << "       " << program_name << " compare [OPTIONS] <input> | <image> <reference>\n\n";
     std::cout << "Commands:\n";
     std::cout << "  (default)     Resize single image\n";
     std::cout << "  batch         Batch resize all images in directory\n";
-    std::cout << "  info          Show image information\n\n";
+    std::cout << "  info          Show image information\n";
+    std::cout << "  compare       PSNR/SSIM of a resize against a float reference, or of\n";
+    std::cout << "                two images\n\n";
     std::cout << "Resize Options:\n";
     std::cout << "  -w, --width WIDTH       Target width in pixels\n";
     std::cout << "  -h, --height HEIGHT     Target height in pixels\n";
@@ -74,12 +90,45 @@ void print_usage(const char* program_name) {
     std::cout << "  -q, --quality QUALITY   JPEG/WebP quality 1-100 (default: 85)\n";
     std::cout << "  -f, --filter FILTER     Resize filter: mitchell, catmull_rom, box, triangle\n";
     std::cout << "                          (default: mitchell)\n";
+    std::cout << "  --webp-effort N         WebP effort 0 (fastest) to 6 (smallest) (default: 4)\n";
+    std::cout << "  --webp-lossless         Lossless WebP (quality sets compression effort)\n";
+    std::cout << "  --webp-near-lossless N  Near-lossless WebP 0-100, 100 = off (default: 100)\n";
+    std::cout << "  --webp-alpha-quality N  WebP alpha quality 0-100 (default: 100)\n";
+    std::cout << "  --png-filter FILTER     PNG row filter: adaptive, none, sub, up, average,\n";
+    std::cout << "                          paeth (default: adaptive)\n";
+    std::cout << "  --png-strategy STRATEGY zlib strategy: default, filtered, rle, huffman\n";
+    std::cout << "  --png-window BITS       zlib window 9-15 (default: 15)\n";
+    std::cout << "  --png-mem-level N       zlib memory level 1-9 (default: 8)\n";
     std::cout << "  --no-aspect-ratio       Don't maintain aspect ratio\n";
+    std::cout << "  --no-auto-orient        Ignore EXIF orientation\n";
+    std::cout << "  --no-enlarge            Keep images that are already smaller than the target\n";
+    std::cout << "  --embedded-thumbnail    Use the JPEG EXIF thumbnail when large enough\n";
+    std::cout << "  --atomic-write          Write to a temp file, then rename into place\n";
+    std::cout << "  --cache-dir DIR         Reuse outputs for repeated inputs and options\n";
+    std::cout << "  --cache-size MB         Output cache size limit, 0 = none (default: 1024)\n";
+    std::cout << "  --fit MODE              Fill box with both width and height: cover, contain\n";
+    std::cout << "                          (cover crops the overflow, contain pads the rest)\n";
+    std::cout << "  --gravity GRAVITY       Crop/pad anchor: center, north, south, east, west,\n";
+    std::cout << "                          north_east, north_west, south_east, south_west\n";
+    std::cout << "  --background COLOR      Padding color for contain, RRGGBB or RRGGBBAA\n";
+    std::cout << "                          (default: 000000)\n";
     std::cout << "  -o, --overwrite         Overwrite input file\n\n";
     std::cout << "Batch Options:\n";
     std::cout << "  -t, --threads NUM       Number of threads (default: auto)\n";
     std::cout << "  --stop-on-error         Stop on first error\n";
-    std::cout << "  --max-speed             Enable pipeline mode (uses more RAM)\n\n";
+    std::cout << "  --max-speed             Enable pipeline mode (uses more RAM)\n";
+    std::cout << "  --incremental           Skip images whose output is newer than the input;\n";
+    std::cout << "                          ignores option changes (use --manifest for that)\n";
+    std::cout << "  --manifest FILE         Incremental, tracking input hashes and options in FILE\n";
+    std::cout << "  --trace FILE            Write per-stage timings as Chrome trace JSON\n";
+    std::cout << "  --stats                 Print peak pixel-buffer memory\n";
+    std::cout << "  --metrics FILE          Write Prometheus metrics to FILE when done\n";
+    std::cout << "  -r, --recursive         Include subdirectories, mirrored under output_dir\n";
+    std::cout << "  --include GLOB          Only files whose relative path matches (repeatable)\n";
+    std::cout << "  --exclude GLOB          Skip files whose relative path matches (repeatable)\n\n";
+    std::cout << "Compare Options:\n";
+    std::cout << "  --min-psnr DB           Fail when PSNR is below DB\n";
+    std::cout << "  --min-ssim N            Fail when SSIM is below N (0-1)\n\n";
     std::cout << "Other Options:\n";
     std::cout << "  --help                  Show this help\n";
     std::cout << "  --version               Show version\n\n";
@@ -90,12 +139,20 @@ void print_usage(const char* program_name) {
     std::cout << "  " << program_name << " input.jpg output.jpg 800 600\n\n";
     std::cout << "  # Resize with options\n";
     std::cout << "  " << program_name << " input.jpg output.jpg -w 800 -q 95 -f catmull_rom\n\n";
+    std::cout << "  # Square thumbnail cropped from the top\n";
+    std::cout << "  " << program_name << " input.jpg thumb.jpg 200 200 --fit cover --gravity north\n\n";
     std::cout << "  # Scale to 50%\n";
     std::cout << "  " << program_name << " input.jpg output.jpg -s 0.5\n\n";
     std::cout << "  # Batch resize directory\n";
     std::cout << "  " << program_name << " batch photos/ thumbnails/ -w 800\n\n";
     std::cout << "  # Batch with max speed\n";
     std::cout << "  " << program_name << " batch photos/ thumbnails/ -w 800 --max-speed\n\n";
+    std::cout << "  # Only resize new or changed photos\n";
+    std::cout << "  " << program_name << " batch photos/ thumbnails/ -w 800 --manifest thumbnails/.manifest\n\n";
+    std::cout << "  # Resize a nested tree, skipping raw exports\n";
+    std::cout << "  " << program_name << " batch photos/ thumbnails/ -w 800 -r --exclude '*/raw/*'\n\n";
+    std::cout << "  # Check a thumbnail size against the float reference\n";
+    std::cout << "  " << program_name << " compare photo.jpg -w 200 --min-psnr 35\n\n";
     std::cout << "  # Show image info\n";
     std::cout << "  " << program_name << " info photo.jpg\n\n";
 }
@@ -136,6 +193,105 @@ bool parse_filter(const char* str, fastresize::ResizeOptions& opts) {
     return true;
 }
 
+bool parse_png_filter(const char* str, fastresize::ResizeOptions& opts) {
+    std::string filter = str;
+    if (filter == "adaptive") {
+        opts.png_filter = fastresize::ResizeOptions::PNG_ADAPTIVE;
+    } else if (filter == "none") {
+        opts.png_filter = fastresize::ResizeOptions::PNG_NONE;
+    } else if (filter == "sub") {
+        opts.png_filter = fastresize::ResizeOptions::PNG_SUB;
+    } else if (filter == "up") {
+        opts.png_filter = fastresize::ResizeOptions::PNG_UP;
+    } else if (filter == "average") {
+        opts.png_filter = fastresize::ResizeOptions::PNG_AVERAGE;
+    } else if (filter == "paeth") {
+        opts.png_filter = fastresize::ResizeOptions::PNG_PAETH;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool parse_png_strategy(const char* str, fastresize::ResizeOptions& opts) {
+    std::string strategy = str;
+    if (strategy == "default") {
+        opts.png_strategy = fastresize::ResizeOptions::PNG_STRATEGY_DEFAULT;
+    } else if (strategy == "filtered") {
+        opts.png_strategy = fastresize::ResizeOptions::PNG_STRATEGY_FILTERED;
+    } else if (strategy == "rle") {
+        opts.png_strategy = fastresize::ResizeOptions::PNG_STRATEGY_RLE;
+    } else if (strategy == "huffman") {
+        opts.png_strategy = fastresize::ResizeOptions::PNG_STRATEGY_HUFFMAN;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool parse_fit(const char* str, fastresize::ResizeOptions::Mode& mode) {
+    std::string fit = str;
+    if (fit == "cover") {
+        mode = fastresize::ResizeOptions::COVER;
+    } else if (fit == "contain") {
+        mode = fastresize::ResizeOptions::CONTAIN;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool parse_gravity(const char* str, fastresize::ResizeOptions& opts) {
+    std::string gravity = str;
+    for (char& c : gravity) {
+        c = tolower(c);
+        if (c == '-') c = '_';
+    }
+
+    if (gravity == "center" || gravity == "centre") {
+        opts.gravity = fastresize::ResizeOptions::CENTER;
+    } else if (gravity == "north") {
+        opts.gravity = fastresize::ResizeOptions::NORTH;
+    } else if (gravity == "south") {
+        opts.gravity = fastresize::ResizeOptions::SOUTH;
+    } else if (gravity == "east") {
+        opts.gravity = fastresize::ResizeOptions::EAST;
+    } else if (gravity == "west") {
+        opts.gravity = fastresize::ResizeOptions::WEST;
+    } else if (gravity == "north_east") {
+        opts.gravity = fastresize::ResizeOptions::NORTH_EAST;
+    } else if (gravity == "north_west") {
+        opts.gravity = fastresize::ResizeOptions::NORTH_WEST;
+    } else if (gravity == "south_east") {
+        opts.gravity = fastresize::ResizeOptions::SOUTH_EAST;
+    } else if (gravity == "south_west") {
+        opts.gravity = fastresize::ResizeOptions::SOUTH_WEST;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Parse RRGGBB or RRGGBBAA (optional leading '#') into 0xRRGGBBAA
+bool parse_color(const char* str, unsigned int& color) {
+    if (*str == '#') str++;
+
+    size_t len = strlen(str);
+    if (len != 6 && len != 8) {
+        return false;
+    }
+
+    char* end;
+    unsigned long val = strtoul(str, &end, 16);
+    if (*end != '\0') {
+        return false;
+    }
+
+    color = (len == 6) ? static_cast<unsigned int>((val << 8) | 0xFF)
+                       : static_cast<unsigned int>(val);
+    return true;
+}
+
 // Create directory recursively
 bool mkdir_p(const std::string& path) {
     struct stat st;
@@ -165,33 +321,164 @@ bool mkdir_p(const std::string& path) {
     return mkdir(path.c_str(), 0755) == 0;
 }
 
-// Get all image files in directory
-bool get_image_files(const std::string& dir, std::vector<std::string>& files) {
+bool is_image_file(const std::string& name) {
+    size_t dot = name.find_last_of('.');
+    if (dot == std::string::npos) return false;
+
+    std::string ext = name.substr(dot);
+    // Convert to lowercase
+    for (char& c : ext) c = tolower(c);
+
+    return ext == ".jpg" || ext == ".jpeg" || ext == ".png" ||
+           ext == ".webp" || ext == ".bmp";
+}
+
+// --include/--exclude globs, matched against the path relative to the
+// input directory; * also matches across '/'
+struct FileFilter {
+    std::vector<std::string> include;   // Empty = every image
+    std::vector<std::string> exclude;
+
+    bool matches(const std::string& relative_path) const {
+        for (const std::string& pattern : exclude) {
+            if (fnmatch(pattern.c_str(), relative_path.c_str(), 0) == 0) return false;
+        }
+        if (include.empty()) return true;
+        for (const std::string& pattern : include) {
+            if (fnmatch(pattern.c_str(), relative_path.c_str(), 0) == 0) return true;
+        }
+        return false;
+    }
+};
+
+// Directory reads are round trips on network storage, so a recursive walk
+// reads several directories at once
+static const size_t WALK_THREADS = 8;
+
+// Directories still to read, relative to the walk root ("" = the root).
+// Each walker takes from the back of its own queue (depth first) and
+// steals from the front of the others' when it runs dry.
+struct WalkQueue {
+    std::mutex mutex;
+    std::deque<std::string> dirs;
+};
+
+typedef std::function<bool(const std::string& path, const std::string& relative_path)> WalkVisitor;
+
+struct DirectoryWalk {
+    std::string root;
+    bool recursive;
+    const FileFilter* filter;
+    const WalkVisitor* visit;
+    std::string skip_dir;               // Output directory inside the input tree, relative to root
+
+    std::vector<WalkQueue> queues;
+    std::atomic<bool> stopped{false};
+    std::mutex visit_mutex;             // visit is called one file at a time
+
+    // Idle walkers sleep until a directory is queued or the walk ends
+    std::mutex idle_mutex;
+    std::condition_variable idle_cv;
+    size_t queued = 0;                  // Directories in the queues
+    size_t pending = 0;                 // Directories queued or being read
+};
+
+// Counted before the directory is visible to other walkers, so one that
+// takes and finishes it straight away can't take the counts below zero
+static void queue_dir(DirectoryWalk& walk, size_t worker, const std::string& relative_dir) {
+    {
+        std::lock_guard<std::mutex> idle_lock(walk.idle_mutex);
+        walk.queued++;
+        walk.pending++;
+        std::lock_guard<std::mutex> queue_lock(walk.queues[worker].mutex);
+        walk.queues[worker].dirs.push_back(relative_dir);
+    }
+    walk.idle_cv.notify_one();
+}
+
+// A directory has been read; the walk is over when none are left
+static void finish_dir(DirectoryWalk& walk) {
+    std::lock_guard<std::mutex> lock(walk.idle_mutex);
+    if (--walk.pending == 0) {
+        walk.idle_cv.notify_all();
+    }
+}
+
+static void stop_walk(DirectoryWalk& walk) {
+    std::lock_guard<std::mutex> lock(walk.idle_mutex);
+    walk.stopped = true;
+    walk.idle_cv.notify_all();
+}
+
+static bool take_queued_dir(DirectoryWalk& walk, size_t worker, std::string& relative_dir) {
+    {
+        WalkQueue& own = walk.queues[worker];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.dirs.empty()) {
+            relative_dir = std::move(own.dirs.back());
+            own.dirs.pop_back();
+            return true;
+        }
+    }
+
+    for (size_t i = 1; i < walk.queues.size(); ++i) {
+        WalkQueue& victim = walk.queues[(worker + i) % walk.queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.dirs.empty()) {
+            relative_dir = std::move(victim.dirs.front());
+            victim.dirs.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool take_dir(DirectoryWalk& walk, size_t worker, std::string& relative_dir) {
+    if (!take_queued_dir(walk, worker, relative_dir)) return false;
+    std::lock_guard<std::mutex> lock(walk.idle_mutex);
+    walk.queued--;
+    return true;
+}
+
+// Symlinked directories are never entered, so below the resolved root a
+// directory's relative path is its real path
+static bool is_skipped_dir(const DirectoryWalk& walk, const std::string& relative_path) {
+    return !walk.skip_dir.empty() && relative_path == walk.skip_dir;
+}
+
+// Reads one directory; d_type saves a stat() per entry where the
+// filesystem fills it in. Symlinked directories are not followed.
+static bool read_dir(DirectoryWalk& walk, size_t worker, const std::string& relative_dir) {
+    std::string dir = relative_dir.empty() ? walk.root : walk.root + "/" + relative_dir;
     DIR* dp = opendir(dir.c_str());
     if (!dp) {
-        std::cerr << "Error: Cannot open directory: " << dir << std::endl;
         return false;
     }
 
     struct dirent* entry;
-    while ((entry = readdir(dp)) != nullptr) {
+    while (!walk.stopped && (entry = readdir(dp)) != nullptr) {
         std::string name = entry->d_name;
         if (name == "." || name == "..") continue;
 
-        // Check if it's an image file
-        size_t dot = name.find_last_of('.');
-        if (dot == std::string::npos) continue;
+        std::string relative_path = relative_dir.empty() ? name : relative_dir + "/" + name;
+        std::string path = dir + "/" + name;
 
-        std::string ext = name.substr(dot);
-        // Convert to lowercase
-        for (char& c : ext) c = tolower(c);
+        bool is_dir = entry->d_type == DT_DIR;
+        bool is_file = entry->d_type == DT_REG || entry->d_type == DT_LNK;
+        if (entry->d_type == DT_UNKNOWN) {
+            struct stat st;
+            if (lstat(path.c_str(), &st) != 0) continue;
+            is_dir = S_ISDIR(st.st_mode);
+            is_file = !is_dir;
+        }
 
-        if (ext == ".jpg" || ext == ".jpeg" || ext == ".png" ||
-            ext == ".webp" || ext == ".bmp") {
-            std::string full_path = dir;
-            if (full_path.back() != '/') full_path += '/';
-            full_path += name;
-            files.push_back(full_path);
+        if (is_dir) {
+            if (walk.recursive && !is_skipped_dir(walk, relative_path)) queue_dir(walk, worker, relative_path);
+        } else if (is_file && is_image_file(name) && walk.filter->matches(relative_path)) {
+            std::lock_guard<std::mutex> lock(walk.visit_mutex);
+            if (!walk.stopped && !(*walk.visit)(path, relative_path)) {
+                stop_walk(walk);
+            }
         }
     }
 
@@ -199,6 +486,74 @@ bool get_image_files(const std::string& dir, std::vector<std::string>& files) {
     return true;
 }
 
+static void walk_worker(DirectoryWalk& walk, size_t worker) {
+    std::string relative_dir;
+    while (!walk.stopped) {
+        if (!take_dir(walk, worker, relative_dir)) {
+            // Directories being read may still queue more
+            std::unique_lock<std::mutex> lock(walk.idle_mutex);
+            walk.idle_cv.wait(lock, [&]() { return walk.queued > 0 || walk.pending == 0 || walk.stopped; });
+            if (walk.queued == 0) break;
+            continue;
+        }
+
+        if (!read_dir(walk, worker, relative_dir)) {
+            std::cerr << "Warning: Cannot open directory: " << walk.root << "/" << relative_dir << std::endl;
+        }
+        finish_dir(walk);
+    }
+}
+
+// Calls visit for each image file under dir as it is found, with its path
+// relative to dir; visit returns false to stop early. skip_dir, if it exists,
+// is left out so outputs written under the input tree aren't read back.
+bool walk_image_files(const std::string& dir, bool recursive, const FileFilter& filter,
+                      const std::string& skip_dir, const WalkVisitor& visit) {
+    std::string root = dir;
+    while (root.size() > 1 && root.back() == '/') root.pop_back();
+
+    DirectoryWalk walk;
+
+    // Resolved once: only an output directory under the input tree needs
+    // looking out for, and then by relative path rather than a stat() per
+    // directory
+    char real_root[PATH_MAX];
+    char real_skip[PATH_MAX];
+    if (recursive && !skip_dir.empty() && realpath(root.c_str(), real_root) &&
+        realpath(skip_dir.c_str(), real_skip)) {
+        std::string resolved_root = real_root;
+        std::string resolved_skip = real_skip;
+        std::string prefix = resolved_root == "/" ? resolved_root : resolved_root + "/";
+        if (resolved_skip.size() > prefix.size() && resolved_skip.compare(0, prefix.size(), prefix) == 0) {
+            walk.skip_dir = resolved_skip.substr(prefix.size());
+        }
+    }
+
+    walk.root = root;
+    walk.recursive = recursive;
+    walk.filter = &filter;
+    walk.visit = &visit;
+    walk.queues = std::vector<WalkQueue>(recursive ? WALK_THREADS : 1);
+
+    // The root is read up front so a bad input directory is an error
+    walk.pending = 1;
+    if (!read_dir(walk, 0, "")) {
+        std::cerr << "Error: Cannot open directory: " << dir << std::endl;
+        return false;
+    }
+    finish_dir(walk);
+
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < walk.queues.size(); ++i) {
+        workers.emplace_back(walk_worker, std::ref(walk), i);
+    }
+    walk_worker(walk, 0);
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    return true;
+}
+
 // Extract filename from path
 std::string get_filename(const std::string& path) {
     size_t pos = path.find_last_of('/');
@@ -208,6 +563,31 @@ std::string get_filename(const std::string& path) {
     return path.substr(pos + 1);
 }
 
+bool enable_cache(const std::string& cache_dir, int size_mb) {
+    if (!fastresize::enable_output_cache(cache_dir, static_cast<size_t>(size_mb) * 1024 * 1024)) {
+        std::cerr << "Error: " << fastresize::get_last_error() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+double bytes_to_mb(uint64_t bytes) {
+    return bytes / (1024.0 * 1024.0);
+}
+
+// Written whole, then renamed, so a textfile collector never reads half of it
+bool write_metrics(const std::string& path) {
+    std::string temp_path = path + ".tmp";
+    std::ofstream out(temp_path);
+    out << fastresize::metrics_text();
+    out.close();
+    if (!out || rename(temp_path.c_str(), path.c_str()) != 0) {
+        std::cerr << "Error: Cannot write metrics to " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
 // Command: info
 int cmd_info(const std::string& image_path) {
     fastresize::ImageInfo info = fastresize::get_image_info(image_path);
@@ -228,6 +608,177 @@ int cmd_info(const std::string& image_path) {
     return 0;
 }
 
+// Command: compare resize quality against the reference resampler, or two images
+int cmd_compare(int argc, char* argv[]) {
+    fastresize::ResizeOptions opts;
+    std::vector<std::string> paths;
+    fastresize::ResizeOptions::Mode fit_mode = fastresize::ResizeOptions::EXACT_SIZE;
+    bool has_fit = false;
+    float min_psnr = 0.0f;
+    float min_ssim = 0.0f;
+
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+
+        if (arg == "-w" || arg == "--width") {
+            if (++i >= argc) {
+                std::cerr << "Error: " << arg << " requires an argument\n";
+                return 1;
+            }
+            if (!parse_int(argv[i], opts.target_width)) {
+                std::cerr << "Error: Invalid width\n";
+                return 1;
+            }
+        } else if (arg == "-h" || arg == "--height") {
+            if (++i >= argc) {
+                std::cerr << "Error: " << arg << " requires an argument\n";
+                return 1;
+            }
+            if (!parse_int(argv[i], opts.target_height)) {
+                std::cerr << "Error: Invalid height\n";
+                return 1;
+            }
+        } else if (arg == "-s" || arg == "--scale") {
+            if (++i >= argc) {
+                std::cerr << "Error: " << arg << " requires an argument\n";
+                return 1;
+            }
+            if (!parse_float(argv[i], opts.scale_percent)) {
+                std::cerr << "Error: Invalid scale\n";
+                return 1;
+            }
+            opts.mode = fastresize::ResizeOptions::SCALE_PERCENT;
+        } else if (arg == "-f" || arg == "--filter") {
+            if (++i >= argc) {
+                std::cerr << "Error: " << arg << " requires an argument\n";
+                return 1;
+            }
+            if (!parse_filter(argv[i], opts)) {
+                std::cerr << "Error: Invalid filter. Use mitchell, catmull_rom, box, or triangle\n";
+                return 1;
+            }
+        } else if (arg == "--no-aspect-ratio") {
+            opts.keep_aspect_ratio = false;
+        } else if (arg == "--no-auto-orient") {
+            opts.auto_orient = false;
+        } else if (arg == "--no-enlarge") {
+            opts.no_enlarge = true;
+        } else if (arg == "--embedded-thumbnail") {
+            opts.use_embedded_thumbnail = true;
+        } else if (arg == "--fit") {
+            if (++i >= argc) {
+                std::cerr << "Error: " << arg << " requires an argument\n";
+                return 1;
+            }
+            if (!parse_fit(argv[i], fit_mode)) {
+                std::cerr << "Error: Invalid fit. Use cover or contain\n";
+                return 1;
+            }
+            has_fit = true;
+        } else if (arg == "--gravity") {
+            if (++i >= argc) {
+                std::cerr << "Error: " << arg << " requires an argument\n";
+                return 1;
+            }
+            if (!parse_gravity(argv[i], opts)) {
+                std::cerr << "Error: Invalid gravity\n";
+                return 1;
+            }
+        } else if (arg == "--background") {
+            if (++i >= argc) {
+                std::cerr << "Error: " << arg << " requires an argument\n";
+                return 1;
+            }
+            if (!parse_color(argv[i], opts.background_color)) {
+                std::cerr << "Error: Invalid background color. Use RRGGBB or RRGGBBAA\n";
+                return 1;
+            }
+        } else if (arg == "--min-psnr") {
+            if (++i >= argc) {
+                std::cerr << "Error: " << arg << " requires an argument\n";
+                return 1;
+            }
+            if (!parse_float(argv[i], min_psnr)) {
+                std::cerr << "Error: Invalid PSNR\n";
+                return 1;
+            }
+        } else if (arg == "--min-ssim") {
+            if (++i >= argc) {
+                std::cerr << "Error: " << arg << " requires an argument\n";
+                return 1;
+            }
+            if (!parse_float(argv[i], min_ssim) || min_ssim > 1.0f) {
+                std::cerr << "Error: SSIM must be between 0 and 1\n";
+                return 1;
+            }
+        } else if (arg[0] == '-') {
+            std::cerr << "Error: Unknown option: " << arg << std::endl;
+            return 1;
+        } else if (paths.size() < 2) {
+            paths.push_back(arg);
+        } else {
+            std::cerr << "Error: Too many arguments\n";
+            return 1;
+        }
+    }
+
+    if (paths.empty()) {
+        std::cerr << "Error: compare command requires an image\n";
+        std::cerr << "Usage: " << argv[0] << " compare [OPTIONS] <input>\n";
+        std::cerr << "       " << argv[0] << " compare [OPTIONS] <image> <reference>\n";
+        return 1;
+    }
+
+    fastresize::QualityReport report;
+    if (paths.size() == 2) {
+        if (!fastresize::compare_images(paths[0], paths[1], report)) {
+            std::cerr << "Error: " << fastresize::get_last_error() << std::endl;
+            return 1;
+        }
+        std::cout << "Compare: " << paths[0] << " vs " << paths[1] << std::endl;
+    } else {
+        // Same mode rules as a plain resize
+        if (has_fit) {
+            if (opts.mode == fastresize::ResizeOptions::SCALE_PERCENT ||
+                opts.target_width <= 0 || opts.target_height <= 0) {
+                std::cerr << "Error: --fit requires both width and height\n";
+                return 1;
+            }
+            opts.mode = fit_mode;
+        } else if (opts.mode != fastresize::ResizeOptions::SCALE_PERCENT) {
+            if (opts.target_width > 0 && opts.target_height > 0) {
+                opts.mode = fastresize::ResizeOptions::EXACT_SIZE;
+            } else if (opts.target_width > 0) {
+                opts.mode = fastresize::ResizeOptions::FIT_WIDTH;
+            } else if (opts.target_height > 0) {
+                opts.mode = fastresize::ResizeOptions::FIT_HEIGHT;
+            } else {
+                std::cerr << "Error: Must specify width, height, or scale\n";
+                return 1;
+            }
+        }
+
+        if (!fastresize::compare_resize(paths[0], opts, report)) {
+            std::cerr << "Error: " << fastresize::get_last_error() << std::endl;
+            return 1;
+        }
+        std::cout << "Compare: " << paths[0] << " against the reference resampler" << std::endl;
+    }
+
+    std::cout << "  Size: " << report.width << "x" << report.height << std::endl;
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "  PSNR: " << report.psnr << " dB" << std::endl;
+    std::cout << std::setprecision(4);
+    std::cout << "  SSIM: " << report.ssim << std::endl;
+    std::cout << "  Max error: " << report.max_error << std::endl;
+
+    if (report.psnr < min_psnr || report.ssim < min_ssim) {
+        std::cerr << "✗ Below the minimum quality" << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
 // Command: batch resize
 int cmd_batch(int argc, char* argv[]) {
     if (argc < 4) {
@@ -238,6 +789,14 @@ int cmd_batch(int argc, char* argv[]) {
 
     fastresize::ResizeOptions resize_opts;
     fastresize::BatchOptions batch_opts;
+    fastresize::ResizeOptions::Mode fit_mode = fastresize::ResizeOptions::EXACT_SIZE;
+    bool has_fit = false;
+    std::string cache_dir;
+    int cache_size_mb = DEFAULT_CACHE_SIZE_MB;
+    bool show_stats = false;
+    std::string metrics_path;
+    bool recursive = false;
+    FileFilter filter;
     std::string input_dir;
     std::string output_dir;
 
@@ -294,6 +853,127 @@ int cmd_batch(int argc, char* argv[]) {
             }
         } else if (arg == "--no-aspect-ratio") {
             resize_opts.keep_aspect_ratio = false;
+        } else if (arg == "--no-auto-orient") {
+            resize_opts.auto_orient = false;
+        } else if (arg == "--no-enlarge") {
+            resize_opts.no_enlarge = true;
+        } else if (arg == "--embedded-thumbnail") {
+            resize_opts.use_embedded_thumbnail = true;
+        } else if (arg == "--atomic-write") {
+            resize_opts.atomic_write = true;
+        } else if (arg == "--cache-dir") {
+            if (++i >= argc) {
+                std::cerr << "Error: " << arg << " requires an argument\n";
+                return 1;
+            }
+            cache_dir = argv[i];
+        } else if (arg == "--cache-size") {
+            if (++i >= argc) {
+                std::cerr << "Error: " << arg << " requires an argument\n";
+                return 1;
+            }
+            if (!parse_int(argv[i], cache_size_mb) || cache_size_mb < 0) {
+                std::cerr << "Error: Invalid cache size\n";
+                return 1;
+            }
+        } else if (arg == "--webp-effort") {
+            if (++i >= argc) {
+                std::cerr << "Error: " << arg << " requires an argument\n";
+                return 1;
+            }
+            if (!parse_int(argv[i], resize_opts.webp_effort) ||
+                resize_opts.webp_effort < 0 || resize_opts.webp_effort > 6) {
+                std::cerr << "Error: WebP effort must be between 0 and 6\n";
+                return 1;
+            }
+        } else if (arg == "--webp-lossless") {
+            resize_opts.webp_lossless = true;
+        } else if (arg == "--png-filter") {
+            if (++i >= argc) {
+                std::cerr << "Error: " << arg << " requires an argument\n";
+                return 1;
+            }
+            if (!parse_png_filter(argv[i], resize_opts)) {
+                std::cerr << "Error: Invalid PNG filter. Use adaptive, none, sub, up, average, or paeth\n";
+                return 1;
+            }
+        } else if (arg == "--png-strategy") {
+            if (++i >= argc) {
+                std::cerr << "Error: " << arg << " requires an argument\n";
+                return 1;
+            }
+            if (!parse_png_strategy(argv[i], resize_opts)) {
+                std::cerr << "Error: Invalid PNG strategy. Use default, filtered, rle, or huffman\n";
+                return 1;
+            }
+        } else if (arg == "--png-window") {
+            if (++i >= argc) {
+                std::cerr << "Error: " << arg << " requires an argument\n";
+                return 1;
+            }
+            if (!parse_int(argv[i], resize_opts.png_window_bits) ||
+                resize_opts.png_window_bits < 9 || resize_opts.png_window_bits > 15) {
+                std::cerr << "Error: PNG window bits must be between 9 and 15\n";
+                return 1;
+            }
+        } else if (arg == "--png-mem-level") {
+            if (++i >= argc) {
+                std::cerr << "Error: " << arg << " requires an argument\n";
+                return 1;
+            }
+            if (!parse_int(argv[i], resize_opts.png_mem_level) ||
+                resize_opts.png_mem_level < 1 || resize_opts.png_mem_level > 9) {
+                std::cerr << "Error: PNG memory level must be between 1 and 9\n";
+                return 1;
+            }
+        } else if (arg == "--webp-near-lossless") {
+            if (++i >= argc) {
+                std::cerr << "Error: " << arg << " requires an argument\n";
+                return 1;
+            }
+            if (!parse_int(argv[i], resize_opts.webp_near_lossless) ||
+                resize_opts.webp_near_lossless < 0 || resize_opts.webp_near_lossless > 100) {
+                std::cerr << "Error: WebP near-lossless must be between 0 and 100\n";
+                return 1;
+            }
+        } else if (arg == "--webp-alpha-quality") {
+            if (++i >= argc) {
+                std::cerr << "Error: " << arg << " requires an argument\n";
+                return 1;
+            }
+            if (!parse_int(argv[i], resize_opts.webp_alpha_quality) ||
+                resize_opts.webp_alpha_quality < 0 || resize_opts.webp_alpha_quality > 100) {
+                std::cerr << "Error: WebP alpha quality must be between 0 and 100\n";
+                return 1;
+            }
+        } else if (arg == "--fit") {
+            if (++i >= argc) {
+                std::cerr << "Error: " << arg << " requires an argument\n";
+                return 1;
+            }
+            if (!parse_fit(argv[i], fit_mode)) {
+                std::cerr << "Error: Invalid fit. Use cover or contain\n";
+                return 1;
+            }
+            has_fit = true;
+        } else if (arg == "--gravity") {
+            if (++i >= argc) {
+                std::cerr << "Error: " << arg << " requires an argument\n";
+                return 1;
+            }
+            if (!parse_gravity(argv[i], resize_opts)) {
+                std::cerr << "Error: Invalid gravity\n";
+                return 1;
+            }
+        } else if (arg == "--background") {
+            if (++i >= argc) {
+                std::cerr << "Error: " << arg << " requires an argument\n";
+                return 1;
+            }
+            if (!parse_color(argv[i], resize_opts.background_color)) {
+                std::cerr << "Error: Invalid background color. Use RRGGBB or RRGGBBAA\n";
+                return 1;
+            }
         } else if (arg == "-t" || arg == "--threads") {
             if (++i >= argc) {
                 std::cerr << "Error: " << arg << " requires an argument\n";
@@ -307,6 +987,43 @@ int cmd_batch(int argc, char* argv[]) {
             batch_opts.stop_on_error = true;
         } else if (arg == "--max-speed") {
             batch_opts.max_speed = true;
+        } else if (arg == "--incremental") {
+            batch_opts.incremental = true;
+        } else if (arg == "--manifest") {
+            if (++i >= argc) {
+                std::cerr << "Error: " << arg << " requires an argument\n";
+                return 1;
+            }
+            batch_opts.incremental = true;
+            batch_opts.manifest_path = argv[i];
+        } else if (arg == "--trace") {
+            if (++i >= argc) {
+                std::cerr << "Error: " << arg << " requires an argument\n";
+                return 1;
+            }
+            batch_opts.trace_path = argv[i];
+        } else if (arg == "--stats") {
+            show_stats = true;
+        } else if (arg == "--metrics") {
+            if (++i >= argc) {
+                std::cerr << "Error: " << arg << " requires an argument\n";
+                return 1;
+            }
+            metrics_path = argv[i];
+        } else if (arg == "-r" || arg == "--recursive") {
+            recursive = true;
+        } else if (arg == "--include") {
+            if (++i >= argc) {
+                std::cerr << "Error: " << arg << " requires an argument\n";
+                return 1;
+            }
+            filter.include.push_back(argv[i]);
+        } else if (arg == "--exclude") {
+            if (++i >= argc) {
+                std::cerr << "Error: " << arg << " requires an argument\n";
+                return 1;
+            }
+            filter.exclude.push_back(argv[i]);
         } else if (arg[0] == '-') {
             std::cerr << "Error: Unknown option: " << arg << std::endl;
             return 1;
@@ -329,7 +1046,14 @@ int cmd_batch(int argc, char* argv[]) {
     }
 
     // Determine resize mode based on what was specified
-    if (resize_opts.mode != fastresize::ResizeOptions::SCALE_PERCENT) {
+    if (has_fit) {
+        if (resize_opts.mode == fastresize::ResizeOptions::SCALE_PERCENT ||
+            resize_opts.target_width <= 0 || resize_opts.target_height <= 0) {
+            std::cerr << "Error: --fit requires both width and height\n";
+            return 1;
+        }
+        resize_opts.mode = fit_mode;
+    } else if (resize_opts.mode != fastresize::ResizeOptions::SCALE_PERCENT) {
         if (resize_opts.target_width > 0 && resize_opts.target_height > 0) {
             resize_opts.mode = fastresize::ResizeOptions::EXACT_SIZE;
         } else if (resize_opts.target_width > 0) {
@@ -342,25 +1066,67 @@ int cmd_batch(int argc, char* argv[]) {
         }
     }
 
-    // Get all image files
-    std::vector<std::string> input_files;
-    if (!get_image_files(input_dir, input_files)) {
+    if (!cache_dir.empty() && !enable_cache(cache_dir, cache_size_mb)) {
         return 1;
     }
 
-    if (input_files.empty()) {
-        std::cerr << "Error: No image files found in " << input_dir << std::endl;
+    // Created up front so the walk can recognise it inside input_dir
+    if (!mkdir_p(output_dir)) {
+        std::cerr << "Error: Cannot create directory: " << output_dir << std::endl;
         return 1;
     }
 
-    std::cout << "Processing " << input_files.size() << " images..." << std::endl;
+    std::cout << "Processing images in " << input_dir << "..." << std::endl;
 
-    // Perform batch resize
-    fastresize::BatchResult result = fastresize::batch_resize(
-        input_files, output_dir, resize_opts, batch_opts);
+    // Resizing starts with the first file found, while directories are still being read.
+    // Subdirectories are mirrored under output_dir. Only the totals are reported, which the
+    // session counts anyway; streaming items to a callback keeps it from holding an
+    // ItemResult per file for the whole walk.
+    fastresize::BatchSession* session = fastresize::open_batch(batch_opts,
+        [](size_t, const fastresize::ItemResult&, const std::string&) {});
+    std::set<std::string> output_subdirs;
+    bool walked = walk_image_files(input_dir, recursive, filter, output_dir,
+                                   [&](const std::string& input_path, const std::string& relative_path) {
+        fastresize::BatchItem item;
+        item.input_path = input_path;
+        item.output_path = output_dir + "/" + relative_path;
+        item.options = resize_opts;
+
+        size_t slash = item.output_path.find_last_of('/');
+        std::string subdir = item.output_path.substr(0, slash);
+        if (relative_path.find('/') != std::string::npos && output_subdirs.insert(subdir).second &&
+            !mkdir_p(subdir)) {
+            std::cerr << "Warning: Cannot create directory: " << subdir << std::endl;
+        }
+        return fastresize::batch_push(session, item);
+    });
+    fastresize::BatchResult result = fastresize::close_batch(session);
+
+    if (!walked) {
+        return 1;
+    }
+
+    if (result.total == 0) {
+        std::cerr << "Error: No image files found in " << input_dir << std::endl;
+        return 1;
+    }
 
     std::cout << "Done: " << result.success << " success, "
-              << result.failed << " failed" << std::endl;
+              << result.failed << " failed";
+    if (batch_opts.incremental) {
+        std::cout << ", " << result.skipped << " skipped";
+    }
+    std::cout << std::endl;
+
+    if (show_stats) {
+        fastresize::MemoryStats memory = fastresize::get_memory_stats();
+        std::cout << std::fixed << std::setprecision(1)
+                  << "Memory: batch peak " << bytes_to_mb(result.peak_memory_bytes) << " MB, "
+                  << "process peak " << bytes_to_mb(memory.peak_bytes) << " MB, "
+                  << "current " << bytes_to_mb(memory.current_bytes) << " MB" << std::endl;
+    }
+
+    bool metrics_ok = metrics_path.empty() || write_metrics(metrics_path);
 
     if (!result.errors.empty()) {
         std::cerr << "\nErrors:" << std::endl;
@@ -369,7 +1135,7 @@ int cmd_batch(int argc, char* argv[]) {
         }
     }
 
-    return result.failed > 0 ? 1 : 0;
+    return (result.failed > 0 || !metrics_ok) ? 1 : 0;
 }
 
 // Command: single image resize
@@ -380,6 +1146,10 @@ int cmd_resize(int argc, char* argv[]) {
     int positional_width = 0;
     int positional_height = 0;
     bool has_positional_args = false;
+    fastresize::ResizeOptions::Mode fit_mode = fastresize::ResizeOptions::EXACT_SIZE;
+    bool has_fit = false;
+    std::string cache_dir;
+    int cache_size_mb = DEFAULT_CACHE_SIZE_MB;
 
     // Parse arguments
     for (int i = 1; i < argc; i++) {
@@ -440,6 +1210,127 @@ int cmd_resize(int argc, char* argv[]) {
             }
         } else if (arg == "--no-aspect-ratio") {
             opts.keep_aspect_ratio = false;
+        } else if (arg == "--no-auto-orient") {
+            opts.auto_orient = false;
+        } else if (arg == "--no-enlarge") {
+            opts.no_enlarge = true;
+        } else if (arg == "--embedded-thumbnail") {
+            opts.use_embedded_thumbnail = true;
+        } else if (arg == "--atomic-write") {
+            opts.atomic_write = true;
+        } else if (arg == "--cache-dir") {
+            if (++i >= argc) {
+                std::cerr << "Error: " << arg << " requires an argument\n";
+                return 1;
+            }
+            cache_dir = argv[i];
+        } else if (arg == "--cache-size") {
+            if (++i >= argc) {
+                std::cerr << "Error: " << arg << " requires an argument\n";
+                return 1;
+            }
+            if (!parse_int(argv[i], cache_size_mb) || cache_size_mb < 0) {
+                std::cerr << "Error: Invalid cache size\n";
+                return 1;
+            }
+        } else if (arg == "--webp-effort") {
+            if (++i >= argc) {
+                std::cerr << "Error: " << arg << " requires an argument\n";
+                return 1;
+            }
+            if (!parse_int(argv[i], opts.webp_effort) ||
+                opts.webp_effort < 0 || opts.webp_effort > 6) {
+                std::cerr << "Error: WebP effort must be between 0 and 6\n";
+                return 1;
+            }
+        } else if (arg == "--webp-lossless") {
+            opts.webp_lossless = true;
+        } else if (arg == "--png-filter") {
+            if (++i >= argc) {
+                std::cerr << "Error: " << arg << " requires an argument\n";
+                return 1;
+            }
+            if (!parse_png_filter(argv[i], opts)) {
+                std::cerr << "Error: Invalid PNG filter. Use adaptive, none, sub, up, average, or paeth\n";
+                return 1;
+            }
+        } else if (arg == "--png-strategy") {
+            if (++i >= argc) {
+                std::cerr << "Error: " << arg << " requires an argument\n";
+                return 1;
+            }
+            if (!parse_png_strategy(argv[i], opts)) {
+                std::cerr << "Error: Invalid PNG strategy. Use default, filtered, rle, or huffman\n";
+                return 1;
+            }
+        } else if (arg == "--png-window") {
+            if (++i >= argc) {
+                std::cerr << "Error: " << arg << " requires an argument\n";
+                return 1;
+            }
+            if (!parse_int(argv[i], opts.png_window_bits) ||
+                opts.png_window_bits < 9 || opts.png_window_bits > 15) {
+                std::cerr << "Error: PNG window bits must be between 9 and 15\n";
+                return 1;
+            }
+        } else if (arg == "--png-mem-level") {
+            if (++i >= argc) {
+                std::cerr << "Error: " << arg << " requires an argument\n";
+                return 1;
+            }
+            if (!parse_int(argv[i], opts.png_mem_level) ||
+                opts.png_mem_level < 1 || opts.png_mem_level > 9) {
+                std::cerr << "Error: PNG memory level must be between 1 and 9\n";
+                return 1;
+            }
+        } else if (arg == "--webp-near-lossless") {
+            if (++i >= argc) {
+                std::cerr << "Error: " << arg << " requires an argument\n";
+                return 1;
+            }
+            if (!parse_int(argv[i], opts.webp_near_lossless) ||
+                opts.webp_near_lossless < 0 || opts.webp_near_lossless > 100) {
+                std::cerr << "Error: WebP near-lossless must be between 0 and 100\n";
+                return 1;
+            }
+        } else if (arg == "--webp-alpha-quality") {
+            if (++i >= argc) {
+                std::cerr << "Error: " << arg << " requires an argument\n";
+                return 1;
+            }
+            if (!parse_int(argv[i], opts.webp_alpha_quality) ||
+                opts.webp_alpha_quality < 0 || opts.webp_alpha_quality > 100) {
+                std::cerr << "Error: WebP alpha quality must be between 0 and 100\n";
+                return 1;
+            }
+        } else if (arg == "--fit") {
+            if (++i >= argc) {
+                std::cerr << "Error: " << arg << " requires an argument\n";
+                return 1;
+            }
+            if (!parse_fit(argv[i], fit_mode)) {
+                std::cerr << "Error: Invalid fit. Use cover or contain\n";
+                return 1;
+            }
+            has_fit = true;
+        } else if (arg == "--gravity") {
+            if (++i >= argc) {
+                std::cerr << "Error: " << arg << " requires an argument\n";
+                return 1;
+            }
+            if (!parse_gravity(argv[i], opts)) {
+                std::cerr << "Error: Invalid gravity\n";
+                return 1;
+            }
+        } else if (arg == "--background") {
+            if (++i >= argc) {
+                std::cerr << "Error: " << arg << " requires an argument\n";
+                return 1;
+            }
+            if (!parse_color(argv[i], opts.background_color)) {
+                std::cerr << "Error: Invalid background color. Use RRGGBB or RRGGBBAA\n";
+                return 1;
+            }
         } else if (arg == "-o" || arg == "--overwrite") {
             opts.overwrite_input = true;
         } else if (arg[0] == '-') {
@@ -484,7 +1375,14 @@ int cmd_resize(int argc, char* argv[]) {
     }
 
     // Determine resize mode
-    if (opts.mode != fastresize::ResizeOptions::SCALE_PERCENT) {
+    if (has_fit) {
+        if (opts.mode == fastresize::ResizeOptions::SCALE_PERCENT ||
+            opts.target_width <= 0 || opts.target_height <= 0) {
+            std::cerr << "Error: --fit requires both width and height\n";
+            return 1;
+        }
+        opts.mode = fit_mode;
+    } else if (opts.mode != fastresize::ResizeOptions::SCALE_PERCENT) {
         if (opts.target_width > 0 && opts.target_height > 0) {
             opts.mode = fastresize::ResizeOptions::EXACT_SIZE;
         } else if (opts.target_width > 0) {
@@ -497,6 +1395,10 @@ int cmd_resize(int argc, char* argv[]) {
         }
     }
 
+    if (!cache_dir.empty() && !enable_cache(cache_dir, cache_size_mb)) {
+        return 1;
+    }
+
     // Perform resize
     if (!fastresize::resize(input_path, output_path, opts)) {
         std::cerr << "Error: " << fastresize::get_last_error() << std::endl;
@@ -527,6 +1429,8 @@ int main(int argc, char* argv[]) {
     // Check for commands
     if (command == "batch") {
         return cmd_batch(argc, argv);
+    } else if (command == "compare") {
+        return cmd_compare(argc, argv);
     } else if (command == "info") {
         if (argc < 3) {
             std::cerr << "Error: info command requires image path\n";
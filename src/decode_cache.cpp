@@ -0,0 +1,287 @@
+/*
+ * FastResize - The Fastest Image Resizing Library On The Planet
+ * Copyright (C) 2025 Tran Huu Canh (0xTh3OKrypt) and FastResize Contributors
+ *
+ * Resize 1,000 images in 2 seconds. Up to 2.9x faster than libvips,
+ * 3.1x faster than imageflow. Uses 3-4x less RAM than alternatives.
+ *
+ * Author: Tran Huu Canh (0xTh3OKrypt)
+ * Email: tranhuucanh39@gmail.com
+ * Homepage: https://github.com/tranhuucanh/fast_resize
+ *
+ * BSD 3-Clause License
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "internal.h"
+#include <algorithm>
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include <sys/stat.h>
+
+namespace fastresize {
+namespace internal {
+
+// ============================================
+// Decode Cache
+// ============================================
+
+// Decoded sources keyed by path, size and mtime, split over shards by path
+// so concurrent resizes of different files don't share a lock. Each shard
+// keeps its own LRU list; the byte budget is global, so an insert evicts
+// from its own shard first and then from the others' tails. Images are
+// handed out as shared_ptr, so an evicted bitmap stays valid until the
+// resizes still reading it finish.
+
+static const size_t DECODE_CACHE_SHARDS = 16;
+
+struct DecodeCacheEntry {
+    std::string path;
+    int64_t size;
+    int64_t mtime;          // Nanoseconds
+    int scale;              // JPEG DCT scale, 1 = full size
+    size_t bytes;
+    std::shared_ptr<const ImageData> image;
+};
+
+struct DecodeCacheShard {
+    std::mutex mutex;
+    std::list<DecodeCacheEntry> lru;    // Most recently used first
+    std::unordered_map<std::string, std::vector<std::list<DecodeCacheEntry>::iterator>> by_path;
+    size_t bytes = 0;
+};
+
+class DecodeCache {
+public:
+    size_t max_bytes;
+    std::atomic<size_t> bytes;
+    DecodeCacheShard shards[DECODE_CACHE_SHARDS];
+    std::atomic<uint64_t> hits;
+    std::atomic<uint64_t> misses;
+};
+
+// Only replaced by enable/disable, which must not race in-flight resizes
+static std::atomic<DecodeCache*> g_decode_cache(nullptr);
+
+static bool stat_source(const std::string& path, int64_t& size, int64_t& mtime) {
+#ifdef _WIN32
+    struct _stat64 st;
+    if (_stat64(path.c_str(), &st) != 0) return false;
+
+    size = st.st_size;
+    mtime = (int64_t)st.st_mtime * 1000000000LL;
+#else
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) return false;
+
+    size = st.st_size;
+#ifdef __APPLE__
+    mtime = (int64_t)st.st_mtimespec.tv_sec * 1000000000LL + st.st_mtimespec.tv_nsec;
+#else
+    mtime = (int64_t)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+#endif
+#endif
+    return true;
+}
+
+static DecodeCacheShard& shard_for(DecodeCache* cache, const std::string& path) {
+    return cache->shards[std::hash<std::string>()(path) % DECODE_CACHE_SHARDS];
+}
+
+static size_t image_bytes(const ImageData& data) {
+    if (data.planar) {
+        return static_cast<size_t>(data.width) * data.height +
+               2 * static_cast<size_t>(data.chroma_width) * data.chroma_height;
+    }
+    return static_cast<size_t>(data.width) * data.height * data.channels;
+}
+
+// Caller holds the shard mutex
+static void remove_entry(DecodeCache* cache, DecodeCacheShard& shard, std::list<DecodeCacheEntry>::iterator it) {
+    auto found = shard.by_path.find(it->path);
+    if (found != shard.by_path.end()) {
+        std::vector<std::list<DecodeCacheEntry>::iterator>& entries = found->second;
+        entries.erase(std::remove(entries.begin(), entries.end(), it), entries.end());
+        if (entries.empty()) {
+            shard.by_path.erase(found);
+        }
+    }
+    shard.bytes -= it->bytes;
+    cache->bytes.fetch_sub(it->bytes, std::memory_order_relaxed);
+    shard.lru.erase(it);
+}
+
+// Caller holds the shard mutex. Drops decodes of older versions of the file.
+static void remove_stale(DecodeCache* cache, DecodeCacheShard& shard, const std::string& path,
+                         int64_t size, int64_t mtime) {
+    auto found = shard.by_path.find(path);
+    if (found == shard.by_path.end()) return;
+
+    std::vector<std::list<DecodeCacheEntry>::iterator> stale;
+    for (auto it : found->second) {
+        if (it->size != size || it->mtime != mtime) stale.push_back(it);
+    }
+    for (auto it : stale) {
+        remove_entry(cache, shard, it);
+    }
+}
+
+std::shared_ptr<const ImageData> decode_cache_find(const std::string& path, int scale, PlanarDecode planar) {
+    DecodeCache* cache = g_decode_cache.load(std::memory_order_acquire);
+    if (!cache) return nullptr;
+
+    int64_t size, mtime;
+    if (!stat_source(path, size, mtime)) return nullptr;
+
+    DecodeCacheShard& shard = shard_for(cache, path);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    remove_stale(cache, shard, path, size, mtime);
+
+    // The smallest cached decode that is still at least as large as asked
+    // for; planar decodes only serve callers that can resize planes
+    auto found = shard.by_path.find(path);
+    if (found != shard.by_path.end()) {
+        std::list<DecodeCacheEntry>::iterator best = shard.lru.end();
+        for (auto it : found->second) {
+            if (it->scale > scale) continue;
+            if (it->image->planar && planar == PLANAR_NONE) continue;
+            if (best == shard.lru.end() || it->scale > best->scale) best = it;
+        }
+
+        if (best != shard.lru.end()) {
+            shard.lru.splice(shard.lru.begin(), shard.lru, best);
+            cache->hits.fetch_add(1, std::memory_order_relaxed);
+            return best->image;
+        }
+    }
+
+    cache->misses.fetch_add(1, std::memory_order_relaxed);
+    return nullptr;
+}
+
+std::shared_ptr<const ImageData> decode_cache_insert(const std::string& path, int scale, ImageData& data) {
+    std::shared_ptr<const ImageData> image(new ImageData(data), [](const ImageData* owned) {
+        ImageData copy = *owned;
+        free_image_data(copy);
+        delete owned;
+    });
+    data.pixels = nullptr;
+
+    DecodeCache* cache = g_decode_cache.load(std::memory_order_acquire);
+    if (!cache) return image;
+
+    size_t bytes = image_bytes(*image);
+    int64_t size, mtime;
+    if (bytes > cache->max_bytes || !stat_source(path, size, mtime)) return image;
+
+    DecodeCacheShard& home = shard_for(cache, path);
+    {
+        std::lock_guard<std::mutex> lock(home.mutex);
+        remove_stale(cache, home, path, size, mtime);
+
+        // Another thread may have decoded the same request meanwhile
+        auto found = home.by_path.find(path);
+        if (found != home.by_path.end()) {
+            for (auto it : found->second) {
+                if (it->scale == scale && it->image->planar == image->planar) return image;
+            }
+        }
+
+        while (cache->bytes.load(std::memory_order_relaxed) + bytes > cache->max_bytes &&
+               !home.lru.empty()) {
+            remove_entry(cache, home, std::prev(home.lru.end()));
+        }
+
+        // Cached pixels outlive the batch that decoded them
+        detach_pixels(image->pixels);
+        home.lru.push_front(DecodeCacheEntry{path, size, mtime, scale, bytes, image});
+        home.by_path[path].push_back(home.lru.begin());
+        home.bytes += bytes;
+        cache->bytes.fetch_add(bytes, std::memory_order_relaxed);
+    }
+
+    // Still over budget: take the oldest entry of each other shard in turn,
+    // one lock at a time
+    bool evicted = true;
+    while (evicted && cache->bytes.load(std::memory_order_relaxed) > cache->max_bytes) {
+        evicted = false;
+        for (DecodeCacheShard& shard : cache->shards) {
+            if (&shard == &home) continue;
+            if (cache->bytes.load(std::memory_order_relaxed) <= cache->max_bytes) break;
+
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            if (!shard.lru.empty()) {
+                remove_entry(cache, shard, std::prev(shard.lru.end()));
+                evicted = true;
+            }
+        }
+    }
+    return image;
+}
+
+} // namespace internal
+
+void enable_decode_cache(size_t max_bytes) {
+    internal::DecodeCache* cache = new internal::DecodeCache();
+    cache->max_bytes = max_bytes;
+    cache->bytes.store(0);
+    cache->hits.store(0);
+    cache->misses.store(0);
+
+    delete internal::g_decode_cache.exchange(cache, std::memory_order_acq_rel);
+}
+
+void disable_decode_cache() {
+    delete internal::g_decode_cache.exchange(nullptr, std::memory_order_acq_rel);
+}
+
+DecodeCacheStats get_decode_cache_stats() {
+    DecodeCacheStats stats;
+    stats.hits = 0;
+    stats.misses = 0;
+    stats.entries = 0;
+    stats.bytes = 0;
+
+    internal::DecodeCache* cache = internal::g_decode_cache.load(std::memory_order_acquire);
+    if (!cache) return stats;
+
+    stats.hits = cache->hits.load(std::memory_order_relaxed);
+    stats.misses = cache->misses.load(std::memory_order_relaxed);
+    for (internal::DecodeCacheShard& shard : cache->shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        stats.entries += shard.lru.size();
+        stats.bytes += shard.bytes;
+    }
+    return stats;
+}
+
+} // namespace fastresize
@@ -39,9 +39,16 @@
  */
 
 #include "internal.h"
+#include "metrics.h"
+#include "trace.h"
 #include <cstdio>
 #include <cstring>
+#include <cmath>
 #include <csetjmp>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
 
 #include <jpeglib.h>
 #include <png.h>
@@ -170,6 +177,7 @@ struct MappedFile {
 // ============================================
 
 ImageFormat detect_format(const std::string& path) {
+    FASTRESIZE_TRACE_SCOPE("detect");
     FILE* f = fopen(path.c_str(), "rb");
     if (!f) return FORMAT_UNKNOWN;
 
@@ -217,6 +225,155 @@ ImageFormat string_to_format(const std::string& str) {
     return FORMAT_UNKNOWN;
 }
 
+// ============================================
+// JPEG Header Scanning
+// ============================================
+
+static unsigned int read_u16(const unsigned char* p, bool little_endian) {
+    return little_endian ? (p[0] | (p[1] << 8)) : ((p[0] << 8) | p[1]);
+}
+
+static unsigned int read_u32(const unsigned char* p, bool little_endian) {
+    return little_endian
+        ? (p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24))
+        : (((unsigned int)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3]);
+}
+
+struct ExifInfo {
+    int orientation;                  // Orientation tag, 1 when absent
+    const unsigned char* thumbnail;   // Embedded JPEG thumbnail (IFD1), or nullptr
+    size_t thumbnail_size;
+};
+
+// Parse an APP1 Exif payload: the Orientation tag (0x0112) from IFD0 and the
+// JPEGInterchangeFormat/Length tags (0x0201/0x0202) from IFD1.
+static void parse_exif(const unsigned char* data, size_t size, ExifInfo& info) {
+    info.orientation = 1;
+    info.thumbnail = nullptr;
+    info.thumbnail_size = 0;
+
+    if (size < 14 || memcmp(data, "Exif\0\0", 6) != 0) return;
+
+    const unsigned char* tiff = data + 6;
+    size_t tiff_size = size - 6;
+
+    bool little_endian;
+    if (tiff[0] == 'I' && tiff[1] == 'I') {
+        little_endian = true;
+    } else if (tiff[0] == 'M' && tiff[1] == 'M') {
+        little_endian = false;
+    } else {
+        return;
+    }
+
+    if (read_u16(tiff + 2, little_endian) != 42) return;
+
+    size_t ifd = read_u32(tiff + 4, little_endian);
+    size_t thumbnail_offset = 0;
+
+    for (int ifd_index = 0; ifd_index < 2 && ifd != 0; ifd_index++) {
+        if (ifd + 2 > tiff_size) return;
+
+        unsigned int entries = read_u16(tiff + ifd, little_endian);
+        size_t next = ifd + 2 + entries * 12;
+
+        for (unsigned int i = 0; i < entries; i++) {
+            size_t entry = ifd + 2 + i * 12;
+            if (entry + 12 > tiff_size) return;
+
+            unsigned int tag = read_u16(tiff + entry, little_endian);
+            if (ifd_index == 0 && tag == 0x0112) {
+                unsigned int value = read_u16(tiff + entry + 8, little_endian);
+                info.orientation = (value >= 1 && value <= 8) ? (int)value : 1;
+            } else if (ifd_index == 1 && tag == 0x0201) {
+                thumbnail_offset = read_u32(tiff + entry + 8, little_endian);
+            } else if (ifd_index == 1 && tag == 0x0202) {
+                info.thumbnail_size = read_u32(tiff + entry + 8, little_endian);
+            }
+        }
+
+        if (next + 4 > tiff_size) break;
+        ifd = read_u32(tiff + next, little_endian);
+    }
+
+    if (thumbnail_offset > 0 && info.thumbnail_size > 0 &&
+        thumbnail_offset + info.thumbnail_size <= tiff_size) {
+        info.thumbnail = tiff + thumbnail_offset;
+    } else {
+        info.thumbnail_size = 0;
+    }
+}
+
+// Walk the marker segments up to the frame header. Reads the dimensions from
+// SOFn and the EXIF data from APP1 without touching entropy-coded data.
+static bool scan_jpeg_header(const unsigned char* data, size_t size,
+                             int& width, int& height, int& channels, ExifInfo& exif) {
+    exif.orientation = 1;
+    exif.thumbnail = nullptr;
+    exif.thumbnail_size = 0;
+    if (size < 4 || data[0] != 0xFF || data[1] != 0xD8) return false;
+
+    bool have_exif = false;
+    size_t pos = 2;
+
+    while (pos + 4 <= size) {
+        if (data[pos] != 0xFF) return false;
+
+        unsigned char marker = data[pos + 1];
+        if (marker == 0xFF) {
+            pos++;
+            continue;
+        }
+        pos += 2;
+
+        if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD8)) continue;
+        if (marker == 0xD9 || marker == 0xDA) return false;
+
+        size_t length = (data[pos] << 8) | data[pos + 1];
+        if (length < 2 || pos + length > size) return false;
+
+        const unsigned char* segment = data + pos + 2;
+        size_t segment_size = length - 2;
+
+        if (marker == 0xE1 && !have_exif && segment_size >= 6 &&
+            memcmp(segment, "Exif\0\0", 6) == 0) {
+            parse_exif(segment, segment_size, exif);
+            have_exif = true;
+        } else if (marker >= 0xC0 && marker <= 0xCF &&
+                   marker != 0xC4 && marker != 0xC8 && marker != 0xCC) {
+            if (segment_size < 6) return false;
+            height = (segment[1] << 8) | segment[2];
+            width = (segment[3] << 8) | segment[4];
+            channels = segment[5];
+            return width > 0 && height > 0;
+        }
+
+        pos += length;
+    }
+
+    return false;
+}
+
+// The embedded thumbnail is usable when it covers the requested size and has
+// the same aspect ratio as the main image (cameras letterbox mismatched ones).
+static bool thumbnail_covers_target(const ExifInfo& exif, int image_w, int image_h,
+                                    int target_width, int target_height) {
+    if (!exif.thumbnail || target_width <= 0 || target_height <= 0) return false;
+
+    int thumb_w, thumb_h, thumb_c;
+    ExifInfo thumb_exif;
+    if (!scan_jpeg_header(exif.thumbnail, exif.thumbnail_size,
+                          thumb_w, thumb_h, thumb_c, thumb_exif)) {
+        return false;
+    }
+
+    if (thumb_w < target_width || thumb_h < target_height) return false;
+
+    double image_aspect = (double)image_w / image_h;
+    double thumb_aspect = (double)thumb_w / thumb_h;
+    return std::fabs(thumb_aspect - image_aspect) <= image_aspect * 0.02;
+}
+
 // ============================================
 // JPEG Decoding
 // ============================================
@@ -231,7 +388,419 @@ static void jpeg_error_exit(j_common_ptr cinfo) {
     longjmp(myerr->setjmp_buffer, 1);
 }
 
-ImageData decode_jpeg(const std::string& path, int target_width = 0, int target_height = 0) {
+// Enough rows for a full iMCU row group at 1:1 (v_samp 2 x 8); libjpeg hands
+// back as many as its current row group holds.
+static const int JPEG_SCANLINE_BATCH = 16;
+
+static void read_jpeg_scanlines(jpeg_decompress_struct* cinfo, unsigned char* dst, size_t row_stride) {
+    JSAMPROW row_pointers[JPEG_SCANLINE_BATCH];
+    while (cinfo->output_scanline < cinfo->output_height) {
+        JDIMENSION first = cinfo->output_scanline;
+        JDIMENSION count = std::min<JDIMENSION>(JPEG_SCANLINE_BATCH, cinfo->output_height - first);
+        for (JDIMENSION i = 0; i < count; ++i) {
+            row_pointers[i] = dst + (first + i) * row_stride;
+        }
+        jpeg_read_scanlines(cinfo, row_pointers, count);
+    }
+}
+
+#if JPEG_LIB_VERSION >= 70
+#define JPEG_COMP_SCALED_SIZE(comp) ((comp)->DCT_v_scaled_size)
+#define JPEG_MIN_SCALED_SIZE(cinfo) ((cinfo)->min_DCT_v_scaled_size)
+#else
+#define JPEG_COMP_SCALED_SIZE(comp) ((comp)->DCT_scaled_size)
+#define JPEG_MIN_SCALED_SIZE(cinfo) ((cinfo)->min_DCT_scaled_size)
+#endif
+
+// YCbCr with 1x1 chroma (4:4:4, 4:2:2, 4:4:0, 4:2:0) can be handed to the
+// resizer as planes. Call after the output scale is set: when decoding below
+// 1:1, libjpeg IDCT-scales chroma up to luma size, which only pays off if the
+// output stays YCbCr as well (PLANAR_ALWAYS).
+static bool jpeg_supports_planar(jpeg_decompress_struct* cinfo, PlanarDecode planar) {
+    if (planar == PLANAR_NONE) return false;
+    if (cinfo->jpeg_color_space != JCS_YCbCr || cinfo->num_components != 3) return false;
+
+    const jpeg_component_info* comp = cinfo->comp_info;
+    if (comp[0].h_samp_factor > 2 || comp[0].v_samp_factor > 2) return false;
+    for (int i = 1; i < 3; ++i) {
+        if (comp[i].h_samp_factor != 1 || comp[i].v_samp_factor != 1) return false;
+    }
+    if (planar == PLANAR_ALWAYS) return true;
+
+    jpeg_calc_output_dimensions(cinfo);
+    return comp[1].downsampled_width < cinfo->output_width ||
+           comp[1].downsampled_height < cinfo->output_height;
+}
+
+// Read raw downsampled Y/Cb/Cr (no upsampling, no colour conversion) into
+// one allocation. Planes are padded to whole DCT blocks; only
+// downsampled_width x downsampled_height of each is image data.
+static void read_jpeg_raw_planes(jpeg_decompress_struct* cinfo, ImageData& data) {
+    size_t offsets[3];
+    size_t total = 0;
+    for (int c = 0; c < 3; ++c) {
+        jpeg_component_info* comp = &cinfo->comp_info[c];
+        int block = JPEG_COMP_SCALED_SIZE(comp);
+        data.strides[c] = comp->width_in_blocks * block;
+        offsets[c] = total;
+        total += (size_t)data.strides[c] * cinfo->total_iMCU_rows * comp->v_samp_factor * block;
+    }
+
+    data.pixels = alloc_pixels(total);
+    data.width = cinfo->output_width;
+    data.height = cinfo->output_height;
+    data.channels = 3;
+    data.planar = true;
+    data.chroma_width = cinfo->comp_info[1].downsampled_width;
+    data.chroma_height = cinfo->comp_info[1].downsampled_height;
+    for (int c = 0; c < 3; ++c) {
+        data.planes[c] = data.pixels + offsets[c];
+    }
+
+    // One iMCU row per call: v_samp_factor * block rows for each component.
+    // Chroma may be IDCT-scaled up to luma size when decoding below 1:1.
+    JSAMPROW rows[3][2 * DCTSIZE];
+    JSAMPARRAY plane_rows[3] = { rows[0], rows[1], rows[2] };
+    for (JDIMENSION imcu = 0; imcu < cinfo->total_iMCU_rows; ++imcu) {
+        for (int c = 0; c < 3; ++c) {
+            jpeg_component_info* comp = &cinfo->comp_info[c];
+            int lines = comp->v_samp_factor * JPEG_COMP_SCALED_SIZE(comp);
+            for (int i = 0; i < lines; ++i) {
+                rows[c][i] = data.planes[c] + ((size_t)imcu * lines + i) * data.strides[c];
+            }
+        }
+        jpeg_read_raw_data(cinfo, plane_rows, cinfo->max_v_samp_factor * JPEG_MIN_SCALED_SIZE(cinfo));
+    }
+}
+
+static void set_jpeg_decode_scale(jpeg_decompress_struct* cinfo, int target_width, int target_height) {
+    int scale = jpeg_decode_scale((int)cinfo->image_width, (int)cinfo->image_height,
+                                  target_width, target_height);
+    if (scale > 1) {
+        cinfo->scale_num = 1;
+        cinfo->scale_denom = scale;
+    }
+
+    cinfo->dct_method = JDCT_IFAST;
+    cinfo->do_fancy_upsampling = FALSE;
+}
+
+static bool decode_jpeg_memory(const unsigned char* buffer, size_t size,
+                               int target_width, int target_height, PlanarDecode planar, ImageData& data) {
+    struct jpeg_decompress_struct cinfo;
+    struct jpeg_error_mgr_ext jerr;
+
+    cinfo.err = jpeg_std_error(&jerr.pub);
+    jerr.pub.error_exit = jpeg_error_exit;
+
+    if (setjmp(jerr.setjmp_buffer)) {
+        jpeg_destroy_decompress(&cinfo);
+        if (data.pixels) free_pixels(data.pixels);
+        data.pixels = nullptr;
+        data.width = 0;
+        data.height = 0;
+        data.channels = 0;
+        data.planar = false;
+        return false;
+    }
+
+    jpeg_create_decompress(&cinfo);
+    jpeg_mem_src(&cinfo, (unsigned char*)buffer, size);
+    jpeg_read_header(&cinfo, TRUE);
+
+    set_jpeg_decode_scale(&cinfo, target_width, target_height);
+
+    if (jpeg_supports_planar(&cinfo, planar)) {
+        cinfo.raw_data_out = TRUE;
+        jpeg_start_decompress(&cinfo);
+        read_jpeg_raw_planes(&cinfo, data);
+        jpeg_finish_decompress(&cinfo);
+        jpeg_destroy_decompress(&cinfo);
+        return true;
+    }
+
+    jpeg_start_decompress(&cinfo);
+
+    data.width = cinfo.output_width;
+    data.height = cinfo.output_height;
+    data.channels = cinfo.output_components;
+
+    size_t row_stride = data.width * data.channels;
+    data.pixels = alloc_pixels(data.height * row_stride);
+
+    read_jpeg_scanlines(&cinfo, data.pixels, row_stride);
+
+    jpeg_finish_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+
+    return true;
+}
+
+
+// ============================================
+// Parallel JPEG Decoding (restart markers)
+// ============================================
+
+// Baseline JPEGs written with a restart interval (DRI) can be cut at RSTn
+// markers into independently decodable pieces. Each strip is re-wrapped as a
+// standalone JPEG (original headers, patched height, renumbered RSTs) and
+// decoded straight into its rows of the shared output buffer.
+
+static const size_t JPEG_PARALLEL_MIN_PIXELS = 8 * 1024 * 1024;
+
+struct JpegScanLayout {
+    size_t sof_offset;       // Offset of the SOF marker
+    size_t entropy_start;    // First byte after the SOS header
+    size_t entropy_end;      // Offset of the marker ending the scan
+    int width;
+    int height;
+    int mcu_height;
+    int mcus_per_row;
+    int mcu_rows;
+    int restart_interval;
+    std::vector<size_t> segments;  // Start offset of every restart interval
+};
+
+static bool scan_jpeg_restart_layout(const unsigned char* data, size_t size, JpegScanLayout& layout) {
+    if (size < 4 || data[0] != 0xFF || data[1] != 0xD8) return false;
+
+    size_t pos = 2;
+    size_t sof = 0;
+    int components = 0;
+    int max_h = 1, max_v = 1;
+    int restart_interval = 0;
+
+    while (pos + 4 <= size) {
+        if (data[pos] != 0xFF) return false;
+        unsigned char marker = data[pos + 1];
+        if (marker == 0xFF) {
+            pos++;
+            continue;
+        }
+        size_t len = (data[pos + 2] << 8) | data[pos + 3];
+        if (len < 2 || pos + 2 + len > size) return false;
+        const unsigned char* seg = data + pos + 4;
+
+        if (marker == 0xC0 || marker == 0xC1) {
+            if (len < 8) return false;
+            sof = pos;
+            layout.height = (seg[1] << 8) | seg[2];
+            layout.width = (seg[3] << 8) | seg[4];
+            components = seg[5];
+            if (components < 1 || len < 8 + (size_t)components * 3) return false;
+            for (int i = 0; i < components; ++i) {
+                int h = seg[6 + i * 3 + 1] >> 4;
+                int v = seg[6 + i * 3 + 1] & 0x0F;
+                if (h > max_h) max_h = h;
+                if (v > max_v) max_v = v;
+            }
+        } else if (marker >= 0xC2 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC) {
+            return false;  // Progressive, lossless or arithmetic coded
+        } else if (marker == 0xDD) {
+            if (len < 4) return false;
+            restart_interval = (seg[0] << 8) | seg[1];
+        } else if (marker == 0xDA) {
+            // Only a single interleaved scan covering every component qualifies
+            if (!sof || seg[0] != components) return false;
+            layout.entropy_start = pos + 2 + len;
+            break;
+        }
+        pos += 2 + len;
+    }
+
+    if (!sof || !layout.entropy_start || restart_interval <= 0) return false;
+    if (layout.width <= 0 || layout.height <= 0) return false;
+
+    int mcu_w = components == 1 ? 8 : 8 * max_h;
+    layout.mcu_height = components == 1 ? 8 : 8 * max_v;
+    layout.mcus_per_row = (layout.width + mcu_w - 1) / mcu_w;
+    layout.mcu_rows = (layout.height + layout.mcu_height - 1) / layout.mcu_height;
+    layout.restart_interval = restart_interval;
+    layout.sof_offset = sof;
+
+    // Record every restart boundary; markers must appear in sequence
+    layout.segments.clear();
+    layout.segments.push_back(layout.entropy_start);
+    pos = layout.entropy_start;
+    layout.entropy_end = 0;
+    while (pos + 1 < size) {
+        const unsigned char* ff = (const unsigned char*)memchr(data + pos, 0xFF, size - pos - 1);
+        if (!ff) break;
+        pos = ff - data;
+        unsigned char next = data[pos + 1];
+        if (next == 0x00) {
+            pos += 2;
+        } else if (next == 0xFF) {
+            pos += 1;
+        } else if (next >= 0xD0 && next <= 0xD7) {
+            if ((next & 7) != (int)((layout.segments.size() - 1) & 7)) return false;
+            pos += 2;
+            layout.segments.push_back(pos);
+        } else {
+            layout.entropy_end = pos;
+            break;
+        }
+    }
+
+    // Anything but EOI (DNL, another scan) means a layout we don't handle
+    if (!layout.entropy_end || data[layout.entropy_end + 1] != 0xD9) return false;
+
+    size_t total_mcus = (size_t)layout.mcus_per_row * layout.mcu_rows;
+    size_t expected = (total_mcus + restart_interval - 1) / restart_interval;
+    return layout.segments.size() == expected && expected > 1;
+}
+
+// Decode restart segments [first, last) as a standalone JPEG into dst.
+static bool decode_jpeg_strip(const unsigned char* data, const JpegScanLayout& layout,
+                              size_t first, size_t last, int strip_height,
+                              unsigned int scale_denom, unsigned char* dst,
+                              size_t row_stride, int expected_rows) {
+    size_t end = last < layout.segments.size() ? layout.segments[last] - 2 : layout.entropy_end;
+
+    std::vector<unsigned char> jpeg;
+    jpeg.reserve(layout.entropy_start + (end - layout.segments[first]) + 2);
+    jpeg.insert(jpeg.end(), data, data + layout.entropy_start);
+    jpeg[layout.sof_offset + 5] = (unsigned char)(strip_height >> 8);
+    jpeg[layout.sof_offset + 6] = (unsigned char)(strip_height & 0xFF);
+
+    for (size_t i = first; i < last; ++i) {
+        size_t seg_end = i + 1 < layout.segments.size() ? layout.segments[i + 1] - 2 : layout.entropy_end;
+        jpeg.insert(jpeg.end(), data + layout.segments[i], data + seg_end);
+        if (i + 1 < last) {
+            jpeg.push_back(0xFF);
+            jpeg.push_back((unsigned char)(0xD0 + ((i - first) & 7)));
+        }
+    }
+    jpeg.push_back(0xFF);
+    jpeg.push_back(0xD9);
+
+    struct jpeg_decompress_struct cinfo;
+    struct jpeg_error_mgr_ext jerr;
+
+    cinfo.err = jpeg_std_error(&jerr.pub);
+    jerr.pub.error_exit = jpeg_error_exit;
+
+    if (setjmp(jerr.setjmp_buffer)) {
+        jpeg_destroy_decompress(&cinfo);
+        return false;
+    }
+
+    jpeg_create_decompress(&cinfo);
+    jpeg_mem_src(&cinfo, jpeg.data(), jpeg.size());
+    jpeg_read_header(&cinfo, TRUE);
+
+    cinfo.scale_num = 1;
+    cinfo.scale_denom = scale_denom;
+    cinfo.dct_method = JDCT_IFAST;
+    cinfo.do_fancy_upsampling = FALSE;
+
+    jpeg_start_decompress(&cinfo);
+
+    if ((int)cinfo.output_height != expected_rows) {
+        jpeg_destroy_decompress(&cinfo);
+        return false;
+    }
+
+    read_jpeg_scanlines(&cinfo, dst, row_stride);
+
+    jpeg_finish_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+    return true;
+}
+
+// Most strips worth cutting a width x height JPEG into, or 0 to decode it
+// in one piece
+static size_t jpeg_strip_limit(int width, int height) {
+    // Batch workers already keep every core busy; don't nest pools
+    if (thread_pool_is_worker()) return 0;
+
+    unsigned int hw_threads = std::thread::hardware_concurrency();
+    if (hw_threads < 2) return 0;
+    if ((size_t)width * height < JPEG_PARALLEL_MIN_PIXELS) return 0;
+
+    // Two strips per thread evens out segments of different complexity
+    return hw_threads * 2;
+}
+
+static bool decode_jpeg_parallel(const unsigned char* buffer, size_t size,
+                                 int target_width, int target_height, size_t max_strips, ImageData& data) {
+    if (max_strips < 2) return false;
+
+    JpegScanLayout layout{};
+    if (!scan_jpeg_restart_layout(buffer, size, layout)) return false;
+
+    // Strips can only start at restart boundaries that begin an MCU row
+    std::vector<size_t> row_starts;
+    for (size_t i = 0; i < layout.segments.size(); ++i) {
+        if (((size_t)layout.restart_interval * i) % layout.mcus_per_row == 0) {
+            row_starts.push_back(i);
+        }
+    }
+    if (row_starts.size() < 2) return false;
+
+    // Output geometry of the whole image decides the DCT scale for all strips
+    struct jpeg_decompress_struct cinfo;
+    struct jpeg_error_mgr_ext jerr;
+    cinfo.err = jpeg_std_error(&jerr.pub);
+    jerr.pub.error_exit = jpeg_error_exit;
+    if (setjmp(jerr.setjmp_buffer)) {
+        jpeg_destroy_decompress(&cinfo);
+        return false;
+    }
+    jpeg_create_decompress(&cinfo);
+    jpeg_mem_src(&cinfo, (unsigned char*)buffer, size);
+    jpeg_read_header(&cinfo, TRUE);
+    set_jpeg_decode_scale(&cinfo, target_width, target_height);
+    jpeg_calc_output_dimensions(&cinfo);
+    unsigned int scale_denom = cinfo.scale_denom;
+    int out_w = cinfo.output_width;
+    int out_h = cinfo.output_height;
+    int channels = cinfo.output_components;
+    jpeg_destroy_decompress(&cinfo);
+
+    size_t strip_count = std::min<size_t>(row_starts.size(), max_strips);
+    std::vector<size_t> cuts;
+    for (size_t i = 0; i < strip_count; ++i) {
+        size_t cut = row_starts[i * row_starts.size() / strip_count];
+        if (cuts.empty() || cut != cuts.back()) cuts.push_back(cut);
+    }
+    cuts.push_back(layout.segments.size());
+
+    size_t row_stride = (size_t)out_w * channels;
+    unsigned char* pixels = alloc_pixels((size_t)out_h * row_stride);
+    std::atomic<bool> ok(true);
+
+    thread_pool_run(shared_strip_pool(), cuts.size() - 1, [&](size_t i) {
+        size_t first = cuts[i];
+        size_t last = cuts[i + 1];
+        int row0 = (int)(((size_t)layout.restart_interval * first / layout.mcus_per_row) * layout.mcu_height);
+        int row1 = last < layout.segments.size()
+            ? (int)(((size_t)layout.restart_interval * last / layout.mcus_per_row) * layout.mcu_height)
+            : layout.height;
+        int strip_height = row1 - row0;
+        int out_row0 = row0 / (int)scale_denom;
+        int out_rows = (last < layout.segments.size() ? row1 / (int)scale_denom : out_h) - out_row0;
+
+        if (ok && !decode_jpeg_strip(buffer, layout, first, last, strip_height, scale_denom,
+                                     pixels + (size_t)out_row0 * row_stride, row_stride, out_rows)) {
+            ok = false;
+        }
+    });
+
+    if (!ok) {
+        free_pixels(pixels);
+        return false;
+    }
+
+    data.pixels = pixels;
+    data.width = out_w;
+    data.height = out_h;
+    data.channels = channels;
+    return true;
+}
+
+ImageData decode_jpeg(const std::string& path, int target_width = 0, int target_height = 0,
+                      bool use_thumbnail = false, PlanarDecode planar = PLANAR_NONE) {
     ImageData data;
     data.pixels = nullptr;
     data.width = 0;
@@ -257,36 +826,20 @@ ImageData decode_jpeg(const std::string& path, int target_width = 0, int target_
 
         jpeg_create_decompress(&cinfo);
         jpeg_stdio_src(&cinfo, infile);
+        jpeg_save_markers(&cinfo, JPEG_APP0 + 1, 0xFFFF);
         jpeg_read_header(&cinfo, TRUE);
 
-        if (target_width > 0 && target_width < (int)cinfo.image_width) {
-            int scale_factor = cinfo.image_width / target_width;
-            if (scale_factor >= 8) {
-                cinfo.scale_num = 1;
-                cinfo.scale_denom = 8;
-            } else if (scale_factor >= 4) {
-                cinfo.scale_num = 1;
-                cinfo.scale_denom = 4;
-            } else if (scale_factor >= 2) {
-                cinfo.scale_num = 1;
-                cinfo.scale_denom = 2;
-            }
-        } else if (target_height > 0 && target_height < (int)cinfo.image_height) {
-            int scale_factor = cinfo.image_height / target_height;
-            if (scale_factor >= 8) {
-                cinfo.scale_num = 1;
-                cinfo.scale_denom = 8;
-            } else if (scale_factor >= 4) {
-                cinfo.scale_num = 1;
-                cinfo.scale_denom = 4;
-            } else if (scale_factor >= 2) {
-                cinfo.scale_num = 1;
-                cinfo.scale_denom = 2;
+        for (jpeg_saved_marker_ptr m = cinfo.marker_list; m; m = m->next) {
+            if (m->marker == JPEG_APP0 + 1 && m->data_length >= 6 &&
+                memcmp(m->data, "Exif\0\0", 6) == 0) {
+                ExifInfo exif;
+                parse_exif(m->data, m->data_length, exif);
+                data.orientation = exif.orientation;
+                break;
             }
         }
 
-        cinfo.dct_method = JDCT_IFAST;
-        cinfo.do_fancy_upsampling = FALSE;
+        set_jpeg_decode_scale(&cinfo, target_width, target_height);
 
         jpeg_start_decompress(&cinfo);
 
@@ -295,13 +848,9 @@ ImageData decode_jpeg(const std::string& path, int target_width = 0, int target_
         data.channels = cinfo.output_components;
 
         size_t row_stride = data.width * data.channels;
-        data.pixels = new unsigned char[data.height * row_stride];
+        data.pixels = alloc_pixels(data.height * row_stride);
 
-        JSAMPROW row_pointer[1];
-        while (cinfo.output_scanline < cinfo.output_height) {
-            row_pointer[0] = &data.pixels[cinfo.output_scanline * row_stride];
-            jpeg_read_scanlines(&cinfo, row_pointer, 1);
-        }
+        read_jpeg_scanlines(&cinfo, data.pixels, row_stride);
 
         jpeg_finish_decompress(&cinfo);
         jpeg_destroy_decompress(&cinfo);
@@ -310,68 +859,42 @@ ImageData decode_jpeg(const std::string& path, int target_width = 0, int target_
         return data;
     }
 
-    struct jpeg_decompress_struct cinfo;
-    struct jpeg_error_mgr_ext jerr;
-
-    cinfo.err = jpeg_std_error(&jerr.pub);
-    jerr.pub.error_exit = jpeg_error_exit;
-
-    if (setjmp(jerr.setjmp_buffer)) {
-        jpeg_destroy_decompress(&cinfo);
+    ExifInfo exif;
+    int header_w = 0, header_h = 0, header_c = 0;
+    scan_jpeg_header((const unsigned char*)mapped.data, mapped.size,
+                     header_w, header_h, header_c, exif);
+    data.orientation = exif.orientation;
+
+    // Small outputs can come straight from the camera's embedded thumbnail;
+    // fall back to the main image if it doesn't fit or fails to decode.
+    if (use_thumbnail &&
+        thumbnail_covers_target(exif, header_w, header_h, target_width, target_height) &&
+        decode_jpeg_memory(exif.thumbnail, exif.thumbnail_size, target_width, target_height, planar, data)) {
         return data;
     }
 
-    jpeg_create_decompress(&cinfo);
-    jpeg_mem_src(&cinfo, (unsigned char*)mapped.data, mapped.size);
-    jpeg_read_header(&cinfo, TRUE);
-
-    if (target_width > 0 && target_width < (int)cinfo.image_width) {
-        int scale_factor = cinfo.image_width / target_width;
-        if (scale_factor >= 8) {
-            cinfo.scale_num = 1;
-            cinfo.scale_denom = 8;
-        } else if (scale_factor >= 4) {
-            cinfo.scale_num = 1;
-            cinfo.scale_denom = 4;
-        } else if (scale_factor >= 2) {
-            cinfo.scale_num = 1;
-            cinfo.scale_denom = 2;
-        }
-    } else if (target_height > 0 && target_height < (int)cinfo.image_height) {
-        int scale_factor = cinfo.image_height / target_height;
-        if (scale_factor >= 8) {
-            cinfo.scale_num = 1;
-            cinfo.scale_denom = 8;
-        } else if (scale_factor >= 4) {
-            cinfo.scale_num = 1;
-            cinfo.scale_denom = 4;
-        } else if (scale_factor >= 2) {
-            cinfo.scale_num = 1;
-            cinfo.scale_denom = 2;
-        }
+    if (decode_jpeg_parallel((const unsigned char*)mapped.data, mapped.size, target_width, target_height,
+                             jpeg_strip_limit(header_w, header_h), data)) {
+        return data;
     }
 
-    cinfo.dct_method = JDCT_IFAST;
-    cinfo.do_fancy_upsampling = FALSE;
-
-    jpeg_start_decompress(&cinfo);
-
-    data.width = cinfo.output_width;
-    data.height = cinfo.output_height;
-    data.channels = cinfo.output_components;
+    decode_jpeg_memory((const unsigned char*)mapped.data, mapped.size,
+                       target_width, target_height, planar, data);
+    return data;
+}
 
-    size_t row_stride = data.width * data.channels;
-    data.pixels = new unsigned char[data.height * row_stride];
+ImageData decode_jpeg_strips(const std::string& path, int target_width, int target_height, size_t strip_count) {
+    ImageData data;
+    data.pixels = nullptr;
+    data.width = 0;
+    data.height = 0;
+    data.channels = 0;
 
-    JSAMPROW row_pointer[1];
-    while (cinfo.output_scanline < cinfo.output_height) {
-        row_pointer[0] = &data.pixels[cinfo.output_scanline * row_stride];
-        jpeg_read_scanlines(&cinfo, row_pointer, 1);
+    MappedFile mapped;
+    if (mapped.map(path)) {
+        decode_jpeg_parallel((const unsigned char*)mapped.data, mapped.size,
+                             target_width, target_height, strip_count, data);
     }
-
-    jpeg_finish_decompress(&cinfo);
-    jpeg_destroy_decompress(&cinfo);
-
     return data;
 }
 
@@ -432,7 +955,7 @@ ImageData decode_png(const std::string& path) {
     if (setjmp(png_jmpbuf(png))) {
         png_destroy_read_struct(&png, &info, nullptr);
         if (fp) fclose(fp);
-        if (data.pixels) delete[] data.pixels;
+        if (data.pixels) free_pixels(data.pixels);
         data.pixels = nullptr;
         return data;
     }
@@ -482,7 +1005,7 @@ ImageData decode_png(const std::string& path) {
     }
 
     size_t row_bytes = png_get_rowbytes(png, info);
-    data.pixels = new unsigned char[data.height * row_bytes];
+    data.pixels = alloc_pixels(data.height * row_bytes);
 
     png_bytep* row_pointers = new png_bytep[data.height];
     for (int y = 0; y < data.height; y++) {
@@ -560,9 +1083,11 @@ ImageData decode_webp(const std::string& path) {
         }
 
         size_t pixel_count = data.width * data.height * data.channels;
-        data.pixels = new unsigned char[pixel_count];
+        track_external_memory(static_cast<int64_t>(pixel_count));
+        data.pixels = alloc_pixels(pixel_count);
         fast_copy_aligned(data.pixels, webp_pixels, pixel_count);
         WebPFree(webp_pixels);
+        track_external_memory(-static_cast<int64_t>(pixel_count));
 
         return data;
     }
@@ -593,9 +1118,11 @@ ImageData decode_webp(const std::string& path) {
     }
 
     size_t pixel_count = data.width * data.height * data.channels;
-    data.pixels = new unsigned char[pixel_count];
+    track_external_memory(static_cast<int64_t>(pixel_count));
+    data.pixels = alloc_pixels(pixel_count);
     fast_copy_aligned(data.pixels, webp_pixels, pixel_count);
     WebPFree(webp_pixels);
+    track_external_memory(-static_cast<int64_t>(pixel_count));
 
     return data;
 }
@@ -604,7 +1131,34 @@ ImageData decode_webp(const std::string& path) {
 // Image Decoding
 // ============================================
 
-ImageData decode_image(const std::string& path, ImageFormat format, int target_width, int target_height) {
+// BMP and anything else stb_image reads. stb_image allocates with malloc, so
+// its pixels are copied into an accounted buffer.
+static ImageData decode_stb(const std::string& path) {
+    ImageData data;
+    data.pixels = nullptr;
+    data.width = 0;
+    data.height = 0;
+    data.channels = 0;
+
+    unsigned char* stb_pixels = stbi_load(path.c_str(), &data.width, &data.height, &data.channels, 0);
+    if (!stb_pixels) {
+        return data;
+    }
+
+    size_t pixel_count = static_cast<size_t>(data.width) * data.height * data.channels;
+    track_external_memory(static_cast<int64_t>(pixel_count));
+    data.pixels = alloc_pixels(pixel_count);
+    fast_copy_aligned(data.pixels, stb_pixels, pixel_count);
+    stbi_image_free(stb_pixels);
+    track_external_memory(-static_cast<int64_t>(pixel_count));
+
+    return data;
+}
+
+ImageData decode_image(const std::string& path, ImageFormat format, int target_width, int target_height,
+                       bool use_thumbnail, PlanarDecode planar) {
+    FASTRESIZE_TRACE_SCOPE("decode");
+    StageTimer timer(decode_histogram(format));
     ImageData data;
     data.pixels = nullptr;
     data.width = 0;
@@ -613,31 +1167,20 @@ ImageData decode_image(const std::string& path, ImageFormat format, int target_w
 
     switch (format) {
         case FORMAT_JPEG:
-            return decode_jpeg(path, target_width, target_height);
+            return decode_jpeg(path, target_width, target_height, use_thumbnail, planar);
         case FORMAT_PNG:
             return decode_png(path);
         case FORMAT_WEBP:
             return decode_webp(path);
         case FORMAT_BMP:
-            data.pixels = stbi_load(path.c_str(),
-                                   &data.width,
-                                   &data.height,
-                                   &data.channels,
-                                   0);
-            return data;
         default:
-            data.pixels = stbi_load(path.c_str(),
-                                   &data.width,
-                                   &data.height,
-                                   &data.channels,
-                                   0);
-            return data;
+            return decode_stb(path);
     }
 }
 
 void free_image_data(ImageData& data) {
     if (data.pixels) {
-        delete[] data.pixels;
+        free_pixels(data.pixels);
         data.pixels = nullptr;
     }
 }
@@ -646,9 +1189,23 @@ void free_image_data(ImageData& data) {
 // Image Info
 // ============================================
 
-bool get_image_dimensions(const std::string& path, int& width, int& height, int& channels) {
+bool get_image_dimensions(const std::string& path, int& width, int& height, int& channels, int* orientation) {
+    FASTRESIZE_TRACE_SCOPE("probe");
     ImageFormat format = detect_format(path);
 
+    if (orientation) *orientation = 1;
+
+    if (format == FORMAT_JPEG) {
+        MappedFile mapped;
+        ExifInfo exif;
+        if (mapped.map(path) &&
+            scan_jpeg_header((const unsigned char*)mapped.data, mapped.size,
+                             width, height, channels, exif)) {
+            if (orientation) *orientation = exif.orientation;
+            return true;
+        }
+    }
+
     if (format == FORMAT_WEBP) {
         FILE* fp = fopen(path.c_str(), "rb");
         if (!fp) return false;
@@ -39,16 +39,49 @@
  */
 
 #include "internal.h"
+#include "metrics.h"
+#include "trace.h"
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <csetjmp>
+#include <cerrno>
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include <jpeglib.h>
 #include <png.h>
+#include <zlib.h>
 #include <webp/encode.h>
 
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "stb_image_write.h"
 
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#else
+#include <windows.h>
+#endif
+
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <linux/fs.h>
+#endif
+
+#ifdef __APPLE__
+#include <copyfile.h>
+#endif
+
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 27))
+#define HAVE_COPY_FILE_RANGE 1
+#endif
+
 #if defined(__ARM_NEON) || defined(__aarch64__)
     #define USE_NEON 1
     #include <arm_neon.h>
@@ -136,6 +169,283 @@ struct jpeg_error_mgr_ext {
     jmp_buf setjmp_buffer;
 };
 
+// ============================================
+// Output Sink
+// ============================================
+
+// Encoders write into a growable memory buffer and the file is emitted with
+// a single write() at the end. Storage comes from the caller's BufferPool
+// when there is one, so batch workers reuse it across images.
+struct MemorySink {
+    unsigned char* data;
+    size_t size;
+    size_t capacity;
+    BufferPool* pool;
+};
+
+static void sink_init(MemorySink& sink, BufferPool* pool, size_t initial_capacity) {
+    sink.pool = pool;
+    sink.size = 0;
+    sink.capacity = initial_capacity;
+    sink.data = buffer_pool_acquire(pool, initial_capacity);
+}
+
+static void sink_reserve(MemorySink& sink, size_t needed) {
+    if (needed <= sink.capacity) return;
+
+    size_t capacity = std::max(needed, sink.capacity * 2);
+    unsigned char* data = buffer_pool_acquire(sink.pool, capacity);
+    if (sink.size > 0) memcpy(data, sink.data, sink.size);
+    buffer_pool_release(sink.pool, sink.data, sink.capacity);
+    sink.data = data;
+    sink.capacity = capacity;
+}
+
+static void sink_append(MemorySink& sink, const void* bytes, size_t count) {
+    sink_reserve(sink, sink.size + count);
+    memcpy(sink.data + sink.size, bytes, count);
+    sink.size += count;
+}
+
+static void sink_free(MemorySink& sink) {
+    buffer_pool_release(sink.pool, sink.data, sink.capacity);
+    sink.data = nullptr;
+    sink.size = 0;
+    sink.capacity = 0;
+}
+
+// Compressed output rarely exceeds a quarter of the raw pixels
+static size_t estimate_encoded_size(const ImageData& data) {
+    return static_cast<size_t>(data.width) * data.height * data.channels / 4 + 16384;
+}
+
+static bool write_whole_file(const std::string& path, const unsigned char* bytes, size_t size) {
+#ifdef _WIN32
+    FILE* fp = fopen(path.c_str(), "wb");
+    if (!fp) return false;
+    size_t written = fwrite(bytes, 1, size, fp);
+    return fclose(fp) == 0 && written == size;
+#else
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (fd < 0) return false;
+
+    while (size > 0) {
+        ssize_t n = write(fd, bytes, size);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            close(fd);
+            return false;
+        }
+        bytes += n;
+        size -= static_cast<size_t>(n);
+    }
+
+    return close(fd) == 0;
+#endif
+}
+
+static bool replace_file(const std::string& from, const std::string& to) {
+#ifdef _WIN32
+    return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    return rename(from.c_str(), to.c_str()) == 0;
+#endif
+}
+
+// Unique sibling of path, so the final rename stays on one filesystem
+static std::string temp_path_for(const std::string& path) {
+    static std::atomic<unsigned int> temp_counter(0);
+#ifdef _WIN32
+    unsigned long pid = GetCurrentProcessId();
+#else
+    unsigned long pid = static_cast<unsigned long>(getpid());
+#endif
+    return path + ".tmp-" + std::to_string(pid) + "-" + std::to_string(temp_counter.fetch_add(1));
+}
+
+// With atomic set the bytes go to a temporary file next to the target and
+// are renamed over it, so readers never observe a partial image.
+static bool write_output_file(const std::string& path, const MemorySink& sink, bool atomic) {
+    FASTRESIZE_TRACE_SCOPE("write");
+    if (!atomic) {
+        if (!write_whole_file(path, sink.data, sink.size)) {
+            set_last_error(ENCODE_ERROR, "Failed to write output file: " + path);
+            return false;
+        }
+        return true;
+    }
+
+    std::string temp_path = temp_path_for(path);
+
+    if (!write_whole_file(temp_path, sink.data, sink.size) || !replace_file(temp_path, path)) {
+        remove(temp_path.c_str());
+        set_last_error(ENCODE_ERROR, "Failed to write output file: " + path);
+        return false;
+    }
+
+    return true;
+}
+
+#ifndef _WIN32
+// Kernel-side copy where the platform has one, pread/write otherwise. Each
+// fallback only runs if the previous method copied nothing.
+static bool copy_fd_data(int in_fd, int out_fd, off_t size) {
+    off_t offset = 0;
+
+#ifdef HAVE_COPY_FILE_RANGE
+    while (offset < size) {
+        ssize_t n = copy_file_range(in_fd, nullptr, out_fd, nullptr, static_cast<size_t>(size - offset), 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && offset > 0) return false;
+        if (n <= 0) break;
+        offset += n;
+    }
+    if (offset == size) return true;
+    if (offset > 0) return false;
+#endif
+
+#ifdef __linux__
+    while (offset < size) {
+        ssize_t n = sendfile(out_fd, in_fd, &offset, static_cast<size_t>(size - offset));
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && offset > 0) return false;
+        if (n <= 0) break;
+    }
+    if (offset == size) return true;
+    if (offset > 0) return false;
+#endif
+
+    unsigned char buffer[64 * 1024];
+    while (offset < size) {
+        ssize_t n = pread(in_fd, buffer, sizeof(buffer), offset);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+
+        for (ssize_t done = 0; done < n; ) {
+            ssize_t w = write(out_fd, buffer + done, static_cast<size_t>(n - done));
+            if (w < 0 && errno == EINTR) continue;
+            if (w <= 0) return false;
+            done += w;
+        }
+        offset += n;
+    }
+
+    return true;
+}
+#endif
+
+static bool copy_whole_file(const std::string& from, const std::string& to) {
+#ifdef _WIN32
+    return CopyFileA(from.c_str(), to.c_str(), FALSE) != 0;
+#else
+    int in_fd = open(from.c_str(), O_RDONLY | O_CLOEXEC);
+    if (in_fd < 0) return false;
+
+    struct stat st;
+    if (fstat(in_fd, &st) != 0) {
+        close(in_fd);
+        return false;
+    }
+
+    int out_fd = open(to.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (out_fd < 0) {
+        close(in_fd);
+        return false;
+    }
+
+    bool copied = false;
+#if defined(__linux__) && defined(FICLONE)
+    // Reflink: shares extents on btrfs/XFS, no data is copied at all
+    copied = ioctl(out_fd, FICLONE, in_fd) == 0;
+#endif
+#ifdef __APPLE__
+    if (!copied) copied = fcopyfile(in_fd, out_fd, nullptr, COPYFILE_DATA) == 0;
+#endif
+    if (!copied) copied = copy_fd_data(in_fd, out_fd, st.st_size);
+
+    close(in_fd);
+    return close(out_fd) == 0 && copied;
+#endif
+}
+
+bool copy_image_file(const std::string& input_path, const std::string& output_path, bool atomic) {
+    FASTRESIZE_TRACE_SCOPE("copy");
+#ifndef _WIN32
+    // Copying a file onto itself would truncate it first
+    struct stat in_st, out_st;
+    if (stat(input_path.c_str(), &in_st) == 0 && stat(output_path.c_str(), &out_st) == 0 &&
+        in_st.st_dev == out_st.st_dev && in_st.st_ino == out_st.st_ino) {
+        return true;
+    }
+#endif
+
+    std::string target = atomic ? temp_path_for(output_path) : output_path;
+    if (!copy_whole_file(input_path, target) || (atomic && !replace_file(target, output_path))) {
+        if (atomic) remove(target.c_str());
+        set_last_error(ENCODE_ERROR, "Failed to copy " + input_path + " to " + output_path);
+        return false;
+    }
+
+    return true;
+}
+
+// libjpeg destination manager appending to a MemorySink
+struct JpegSinkDestination {
+    struct jpeg_destination_mgr pub;
+    MemorySink* sink;
+};
+
+static const size_t JPEG_SINK_CHUNK = 64 * 1024;
+
+static void jpeg_sink_point(JpegSinkDestination* dest) {
+    dest->pub.next_output_byte = dest->sink->data + dest->sink->size;
+    dest->pub.free_in_buffer = dest->sink->capacity - dest->sink->size;
+}
+
+static void jpeg_sink_init(j_compress_ptr cinfo) {
+    JpegSinkDestination* dest = (JpegSinkDestination*)cinfo->dest;
+    sink_reserve(*dest->sink, dest->sink->size + JPEG_SINK_CHUNK);
+    jpeg_sink_point(dest);
+}
+
+static boolean jpeg_sink_empty(j_compress_ptr cinfo) {
+    // libjpeg filled everything up to capacity
+    JpegSinkDestination* dest = (JpegSinkDestination*)cinfo->dest;
+    dest->sink->size = dest->sink->capacity;
+    sink_reserve(*dest->sink, dest->sink->size + JPEG_SINK_CHUNK);
+    jpeg_sink_point(dest);
+    return TRUE;
+}
+
+static void jpeg_sink_term(j_compress_ptr cinfo) {
+    JpegSinkDestination* dest = (JpegSinkDestination*)cinfo->dest;
+    dest->sink->size = dest->sink->capacity - dest->pub.free_in_buffer;
+}
+
+static void jpeg_sink_dest(j_compress_ptr cinfo, JpegSinkDestination* dest, MemorySink* sink) {
+    dest->pub.init_destination = jpeg_sink_init;
+    dest->pub.empty_output_buffer = jpeg_sink_empty;
+    dest->pub.term_destination = jpeg_sink_term;
+    dest->sink = sink;
+    cinfo->dest = &dest->pub;
+}
+
+static void png_sink_write(png_structp png, png_bytep bytes, png_size_t length) {
+    sink_append(*static_cast<MemorySink*>(png_get_io_ptr(png)), bytes, length);
+}
+
+static void png_sink_flush(png_structp) {
+}
+
+static int webp_sink_write(const uint8_t* bytes, size_t size, const WebPPicture* picture) {
+    sink_append(*static_cast<MemorySink*>(picture->custom_ptr), bytes, size);
+    return 1;
+}
+
+static void stbi_sink_write(void* context, void* bytes, int size) {
+    sink_append(*static_cast<MemorySink*>(context), bytes, static_cast<size_t>(size));
+}
+
 static void jpeg_encode_error_exit(j_common_ptr cinfo) {
     jpeg_error_mgr_ext* myerr = (jpeg_error_mgr_ext*)cinfo->err;
     longjmp(myerr->setjmp_buffer, 1);
@@ -143,10 +453,88 @@ static void jpeg_encode_error_exit(j_common_ptr cinfo) {
 
 static const int JPEG_SCANLINE_BATCH = 8;
 
-bool encode_jpeg(const std::string& path, const ImageData& data, int quality, BufferPool* buffer_pool = nullptr) {
-    FILE* outfile = fopen(path.c_str(), "wb");
-    if (!outfile) return false;
+// Planar YCbCr straight from resize_planar(): no colour conversion or
+// downsampling, jpeg_write_raw_data takes one iMCU row per call. libjpeg
+// reads whole DCT blocks, so each strip is padded by replicating the edge.
+static bool encode_jpeg_planar(const ImageData& data, int quality, MemorySink& sink) {
+    unsigned char* strip = nullptr;
+    JpegSinkDestination dest;
+
+    struct jpeg_compress_struct cinfo;
+    struct jpeg_error_mgr_ext jerr;
+
+    cinfo.err = jpeg_std_error(&jerr.pub);
+    jerr.pub.error_exit = jpeg_encode_error_exit;
+
+    if (setjmp(jerr.setjmp_buffer)) {
+        jpeg_destroy_compress(&cinfo);
+        free_pixels(strip);
+        return false;
+    }
+
+    jpeg_create_compress(&cinfo);
+    jpeg_sink_dest(&cinfo, &dest, &sink);
+
+    cinfo.image_width = data.width;
+    cinfo.image_height = data.height;
+    cinfo.input_components = 3;
+    cinfo.in_color_space = JCS_YCbCr;
+
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, quality, TRUE);
+
+    cinfo.dct_method = JDCT_IFAST;
+    cinfo.raw_data_in = TRUE;
+    cinfo.comp_info[0].h_samp_factor = (data.width + data.chroma_width - 1) / data.chroma_width;
+    cinfo.comp_info[0].v_samp_factor = (data.height + data.chroma_height - 1) / data.chroma_height;
+    for (int c = 1; c < 3; ++c) {
+        cinfo.comp_info[c].h_samp_factor = 1;
+        cinfo.comp_info[c].v_samp_factor = 1;
+    }
+
+    jpeg_start_compress(&cinfo, TRUE);
+
+    int plane_w[3] = { data.width, data.chroma_width, data.chroma_width };
+    int plane_h[3] = { data.height, data.chroma_height, data.chroma_height };
+    int padded_w[3];
+    int strip_rows[3];
+    size_t strip_offset[3];
+    size_t strip_size = 0;
+    for (int c = 0; c < 3; ++c) {
+        padded_w[c] = cinfo.comp_info[c].width_in_blocks * DCTSIZE;
+        strip_rows[c] = cinfo.comp_info[c].v_samp_factor * DCTSIZE;
+        strip_offset[c] = strip_size;
+        strip_size += static_cast<size_t>(padded_w[c]) * strip_rows[c];
+    }
+    strip = alloc_pixels(strip_size);
+
+    JSAMPROW rows[3][2 * DCTSIZE];
+    JSAMPARRAY plane_rows[3] = { rows[0], rows[1], rows[2] };
+    int imcu_rows = cinfo.max_v_samp_factor * DCTSIZE;
+
+    for (int imcu = 0; cinfo.next_scanline < cinfo.image_height; ++imcu) {
+        for (int c = 0; c < 3; ++c) {
+            for (int i = 0; i < strip_rows[c]; ++i) {
+                int src_row = std::min(imcu * strip_rows[c] + i, plane_h[c] - 1);
+                const unsigned char* src = data.planes[c] + static_cast<size_t>(src_row) * data.strides[c];
+                unsigned char* dst = strip + strip_offset[c] + static_cast<size_t>(i) * padded_w[c];
+                memcpy(dst, src, plane_w[c]);
+                memset(dst + plane_w[c], src[plane_w[c] - 1], padded_w[c] - plane_w[c]);
+                rows[c][i] = dst;
+            }
+        }
+        jpeg_write_raw_data(&cinfo, plane_rows, imcu_rows);
+    }
 
+    jpeg_finish_compress(&cinfo);
+    jpeg_destroy_compress(&cinfo);
+    free_pixels(strip);
+
+    return true;
+}
+
+bool encode_jpeg(const ImageData& data, int quality, BufferPool* buffer_pool, MemorySink& sink) {
+    JpegSinkDestination dest;
     unsigned char* rgb_buffer = nullptr;
     size_t rgb_buffer_capacity = 0;
 
@@ -158,19 +546,18 @@ bool encode_jpeg(const std::string& path, const ImageData& data, int quality, Bu
 
     if (setjmp(jerr.setjmp_buffer)) {
         jpeg_destroy_compress(&cinfo);
-        fclose(outfile);
         if (rgb_buffer) {
             if (rgb_buffer_capacity > 0 && buffer_pool) {
                 buffer_pool_release(buffer_pool, rgb_buffer, rgb_buffer_capacity);
             } else {
-                delete[] rgb_buffer;
+                free_pixels(rgb_buffer);
             }
         }
         return false;
     }
 
     jpeg_create_compress(&cinfo);
-    jpeg_stdio_dest(&cinfo, outfile);
+    jpeg_sink_dest(&cinfo, &dest, &sink);
 
     cinfo.image_width = data.width;
     cinfo.image_height = data.height;
@@ -194,7 +581,7 @@ bool encode_jpeg(const std::string& path, const ImageData& data, int quality, Bu
             rgb_buffer = buffer_pool_acquire(buffer_pool, rgb_size);
             rgb_buffer_capacity = rgb_size;
         } else {
-            rgb_buffer = new unsigned char[rgb_size];
+            rgb_buffer = alloc_pixels(rgb_size);
             rgb_buffer_capacity = 0;
         }
 
@@ -202,7 +589,6 @@ bool encode_jpeg(const std::string& path, const ImageData& data, int quality, Bu
         encode_pixels = rgb_buffer;
     } else {
         jpeg_destroy_compress(&cinfo);
-        fclose(outfile);
         return false;
     }
 
@@ -231,48 +617,397 @@ bool encode_jpeg(const std::string& path, const ImageData& data, int quality, Bu
 
     jpeg_finish_compress(&cinfo);
     jpeg_destroy_compress(&cinfo);
-    fclose(outfile);
 
     if (rgb_buffer) {
         if (rgb_buffer_capacity > 0 && buffer_pool) {
             buffer_pool_release(buffer_pool, rgb_buffer, rgb_buffer_capacity);
         } else {
-            delete[] rgb_buffer;
+            free_pixels(rgb_buffer);
         }
     }
 
     return true;
 }
 
-bool encode_png(const std::string& path, const ImageData& data, int quality) {
-    FILE* fp = fopen(path.c_str(), "wb");
-    if (!fp) return false;
+// ============================================
+// Parallel PNG Encoding
+// ============================================
+
+// Large PNGs are filtered and deflated in horizontal strips on worker
+// threads, pigz style: each strip is primed with the previous 32 KB of
+// filtered rows as its dictionary and ends on a sync flush, so the raw
+// deflate pieces concatenate into a single zlib stream. The Adler-32
+// trailer is combined from per-strip checksums.
+
+static const size_t PNG_PARALLEL_MIN_PIXELS = 4 * 1024 * 1024;
+static const size_t PNG_MIN_STRIP_BYTES = 256 * 1024;
+
+// zlib and filter settings shared by the libpng and parallel writers
+struct PngParams {
+    int level;
+    int strategy;       // Z_* strategy
+    int window_bits;
+    int mem_level;
+    int filter;         // Fixed filter type 0-4, or -1 for adaptive
+};
+
+static PngParams png_params(const ResizeOptions& opts) {
+    PngParams params;
+
+    params.level = 9 - ((opts.quality - 1) * 9 / 99);
+    if (params.level < 0) params.level = 0;
+    if (params.level > 9) params.level = 9;
+
+    switch (opts.png_filter) {
+        case ResizeOptions::PNG_NONE:    params.filter = 0; break;
+        case ResizeOptions::PNG_SUB:     params.filter = 1; break;
+        case ResizeOptions::PNG_UP:      params.filter = 2; break;
+        case ResizeOptions::PNG_AVERAGE: params.filter = 3; break;
+        case ResizeOptions::PNG_PAETH:   params.filter = 4; break;
+        default:                         params.filter = -1; break;
+    }
+
+    // Like libpng, default to Z_FILTERED unless rows go out unfiltered
+    switch (opts.png_strategy) {
+        case ResizeOptions::PNG_STRATEGY_FILTERED: params.strategy = Z_FILTERED; break;
+        case ResizeOptions::PNG_STRATEGY_RLE:      params.strategy = Z_RLE; break;
+        case ResizeOptions::PNG_STRATEGY_HUFFMAN:  params.strategy = Z_HUFFMAN_ONLY; break;
+        default:
+            params.strategy = params.filter == 0 ? Z_DEFAULT_STRATEGY : Z_FILTERED;
+            break;
+    }
+
+    params.window_bits = opts.png_window_bits;
+    params.mem_level = opts.png_mem_level;
+    return params;
+}
+
+static void png_filter_candidate(int type, const unsigned char* row, const unsigned char* prev,
+                                 size_t row_bytes, size_t bpp, unsigned char* out) {
+    size_t i = 0;
+    switch (type) {
+        case 0:
+            memcpy(out, row, row_bytes);
+            break;
+        case 1:
+            for (; i < bpp; ++i) out[i] = row[i];
+            for (; i < row_bytes; ++i) out[i] = (unsigned char)(row[i] - row[i - bpp]);
+            break;
+        case 2:
+            for (; i < row_bytes; ++i) out[i] = (unsigned char)(row[i] - prev[i]);
+            break;
+        case 3:
+            for (; i < bpp; ++i) out[i] = (unsigned char)(row[i] - (prev[i] >> 1));
+            for (; i < row_bytes; ++i) {
+                out[i] = (unsigned char)(row[i] - ((row[i - bpp] + prev[i]) >> 1));
+            }
+            break;
+        case 4:
+            // Paeth with a = left, b = up, c = upper left; a = c = 0 on the left edge
+            for (; i < bpp; ++i) out[i] = (unsigned char)(row[i] - prev[i]);
+            for (; i < row_bytes; ++i) {
+                int a = row[i - bpp];
+                int b = prev[i];
+                int c = prev[i - bpp];
+                int pa = abs(b - c);
+                int pb = abs(a - c);
+                int pc = abs(a + b - 2 * c);
+                int predictor = (pa <= pb && pa <= pc) ? a : (pb <= pc ? b : c);
+                out[i] = (unsigned char)(row[i] - predictor);
+            }
+            break;
+    }
+}
+
+// Residuals read as signed bytes
+static size_t png_residual_sum(const unsigned char* residuals, size_t count) {
+    size_t sum = 0;
+    for (size_t i = 0; i < count; ++i) {
+        unsigned char v = residuals[i];
+        sum += v < 128 ? v : 256 - v;
+    }
+    return sum;
+}
+
+// A fixed filter type, or libpng's default heuristic when it is -1: the
+// filter with the smallest residual sum. scratch holds row_bytes bytes for
+// the candidate being tried.
+static void png_filter_row(const unsigned char* row, const unsigned char* prev, size_t row_bytes,
+                           size_t bpp, int fixed_type, unsigned char* scratch, unsigned char* out) {
+    if (fixed_type >= 0) {
+        png_filter_candidate(fixed_type, row, prev, row_bytes, bpp, out + 1);
+        out[0] = (unsigned char)fixed_type;
+        return;
+    }
+
+    unsigned char* best = out + 1;
+    unsigned char* candidate = scratch;
+    int best_type = 0;
+
+    png_filter_candidate(0, row, prev, row_bytes, bpp, best);
+    size_t best_sum = png_residual_sum(best, row_bytes);
+
+    for (int type = 1; type < 5; ++type) {
+        png_filter_candidate(type, row, prev, row_bytes, bpp, candidate);
+        size_t sum = png_residual_sum(candidate, row_bytes);
+        if (sum < best_sum) {
+            best_sum = sum;
+            best_type = type;
+            std::swap(best, candidate);
+        }
+    }
+
+    if (best != out + 1) {
+        memcpy(out + 1, best, row_bytes);
+    }
+    out[0] = (unsigned char)best_type;
+}
+
+static bool png_deflate_strip(const unsigned char* filtered, size_t start, size_t length, bool last,
+                              const PngParams& params, std::vector<unsigned char>& out) {
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (deflateInit2(&zs, params.level, Z_DEFLATED, -params.window_bits,
+                     params.mem_level, params.strategy) != Z_OK) {
+        return false;
+    }
+
+    if (start > 0) {
+        size_t dict_length = std::min(start, (size_t)1 << params.window_bits);
+        deflateSetDictionary(&zs, filtered + start - dict_length, (uInt)dict_length);
+    }
+
+    // A sync flush appends an empty stored block on top of the bound
+    out.resize(deflateBound(&zs, (uLong)length) + 16);
+    zs.next_in = const_cast<Bytef*>(filtered + start);
+    zs.avail_in = (uInt)length;
+    zs.next_out = out.data();
+    zs.avail_out = (uInt)out.size();
+
+    int flush = last ? Z_FINISH : Z_SYNC_FLUSH;
+    int ret;
+    while ((ret = deflate(&zs, flush)) == Z_OK && (last || zs.avail_in > 0 || zs.avail_out == 0)) {
+        size_t used = out.size() - zs.avail_out;
+        out.resize(out.size() * 2);
+        zs.next_out = out.data() + used;
+        zs.avail_out = (uInt)(out.size() - used);
+    }
+
+    bool ok = last ? ret == Z_STREAM_END : ret == Z_OK || ret == Z_BUF_ERROR;
+    out.resize(zs.total_out);
+    deflateEnd(&zs);
+    return ok;
+}
+
+static void png_append_u32(MemorySink& sink, uint32_t value) {
+    unsigned char bytes[4] = {
+        (unsigned char)(value >> 24), (unsigned char)(value >> 16),
+        (unsigned char)(value >> 8), (unsigned char)value
+    };
+    sink_append(sink, bytes, 4);
+}
+
+// Chunk data may come in pieces; the CRC covers the type and all of them
+static void png_append_chunk(MemorySink& sink, const char* type,
+                             const unsigned char* const* parts, const size_t* sizes, int count) {
+    size_t length = 0;
+    for (int i = 0; i < count; ++i) length += sizes[i];
+
+    png_append_u32(sink, (uint32_t)length);
+    sink_append(sink, type, 4);
+    uLong crc = crc32(0L, (const Bytef*)type, 4);
+    for (int i = 0; i < count; ++i) {
+        sink_append(sink, parts[i], sizes[i]);
+        crc = crc32(crc, parts[i], (uInt)sizes[i]);
+    }
+    png_append_u32(sink, (uint32_t)crc);
+}
+
+// Strips worth encoding data in, or 0 to leave it to libpng
+static size_t png_strip_count(const ImageData& data) {
+    // Batch workers already keep every core busy; don't nest pools
+    if (thread_pool_is_worker()) return 0;
+
+    unsigned int hw_threads = std::thread::hardware_concurrency();
+    if (hw_threads < 2) return 0;
+    if ((size_t)data.width * data.height < PNG_PARALLEL_MIN_PIXELS) return 0;
+
+    size_t total_bytes = ((size_t)data.width * data.channels + 1) * data.height;
+    return std::min<size_t>(hw_threads * 2, total_bytes / PNG_MIN_STRIP_BYTES);
+}
+
+static bool encode_png_parallel(const ImageData& data, const PngParams& params, size_t strip_count,
+                                MemorySink& sink) {
+    static const unsigned char color_types[5] = {0, 0, 4, 2, 6};
+    if (data.channels < 1 || data.channels > 4) return false;
+
+    size_t row_bytes = (size_t)data.width * data.channels;
+    size_t filtered_stride = row_bytes + 1;
+    size_t total_bytes = filtered_stride * data.height;
+
+    strip_count = std::min<size_t>(strip_count, data.height);
+    if (strip_count < 2) return false;
+
+    unsigned char* filtered = alloc_pixels(total_bytes);
+    unsigned char* zero_row = alloc_pixels(row_bytes);
+    memset(zero_row, 0, row_bytes);
+    std::vector<int> cuts(strip_count + 1);
+    for (size_t i = 0; i <= strip_count; ++i) {
+        cuts[i] = (int)(i * data.height / strip_count);
+    }
+
+    std::vector<std::vector<unsigned char>> compressed(strip_count);
+    std::vector<uLong> checksums(strip_count);
+    std::atomic<bool> ok(true);
+
+    ThreadPool* pool = shared_strip_pool();
+
+    // Filtering reads only source rows, so strips are independent
+    thread_pool_run(pool, strip_count, [&](size_t s) {
+        unsigned char* scratch = alloc_pixels(row_bytes);
+        for (int y = cuts[s]; y < cuts[s + 1]; ++y) {
+            const unsigned char* row = data.pixels + y * row_bytes;
+            const unsigned char* prev = y > 0 ? row - row_bytes : zero_row;
+            png_filter_row(row, prev, row_bytes, data.channels, params.filter, scratch,
+                           filtered + y * filtered_stride);
+        }
+        free_pixels(scratch);
+    });
+
+    // Deflating needs the preceding strip's filtered bytes as dictionary.
+    // Compressed strips are held until the whole image is written, so they
+    // count against the caller's memory account like pixel buffers.
+    std::atomic<int64_t> compressed_bytes(0);
+    thread_pool_run(pool, strip_count, [&](size_t s) {
+        size_t start = (size_t)cuts[s] * filtered_stride;
+        size_t length = (size_t)(cuts[s + 1] - cuts[s]) * filtered_stride;
+        checksums[s] = adler32(1L, filtered + start, (uInt)length);
+        if (!png_deflate_strip(filtered, start, length, s + 1 == strip_count, params, compressed[s])) {
+            ok = false;
+        }
+        int64_t bytes = (int64_t)compressed[s].capacity();
+        track_external_memory(bytes);
+        compressed_bytes += bytes;
+    });
+
+    free_pixels(zero_row);
+
+    if (!ok) {
+        free_pixels(filtered);
+        track_external_memory(-compressed_bytes);
+        return false;
+    }
+
+    uLong adler = checksums[0];
+    for (size_t s = 1; s < strip_count; ++s) {
+        size_t length = (size_t)(cuts[s + 1] - cuts[s]) * filtered_stride;
+        adler = adler32_combine(adler, checksums[s], (z_off_t)length);
+    }
+    free_pixels(filtered);
+
+    static const unsigned char signature[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+    sink_append(sink, signature, 8);
+
+    unsigned char ihdr[13] = {
+        (unsigned char)(data.width >> 24), (unsigned char)(data.width >> 16),
+        (unsigned char)(data.width >> 8), (unsigned char)data.width,
+        (unsigned char)(data.height >> 24), (unsigned char)(data.height >> 16),
+        (unsigned char)(data.height >> 8), (unsigned char)data.height,
+        8, color_types[data.channels], 0, 0, 0
+    };
+    const unsigned char* ihdr_parts[1] = {ihdr};
+    size_t ihdr_sizes[1] = {sizeof(ihdr)};
+    png_append_chunk(sink, "IHDR", ihdr_parts, ihdr_sizes, 1);
+
+    // zlib header (CMF/FLG for this window and level) and trailer wrap the
+    // first and last strips; every strip becomes one IDAT chunk
+    unsigned int cmf = ((params.window_bits - 8) << 4) | 8;
+    unsigned int flg = (params.level < 2 ? 0 : params.level < 6 ? 1 : params.level == 6 ? 2 : 3) << 6;
+    flg += 31 - (cmf * 256 + flg) % 31;
+    unsigned char zlib_header[2] = {(unsigned char)cmf, (unsigned char)flg};
+    unsigned char zlib_trailer[4] = {
+        (unsigned char)(adler >> 24), (unsigned char)(adler >> 16),
+        (unsigned char)(adler >> 8), (unsigned char)adler
+    };
+
+    for (size_t s = 0; s < strip_count; ++s) {
+        const unsigned char* parts[3];
+        size_t sizes[3];
+        int count = 0;
+        if (s == 0) {
+            parts[count] = zlib_header;
+            sizes[count++] = 2;
+        }
+        parts[count] = compressed[s].data();
+        sizes[count++] = compressed[s].size();
+        if (s + 1 == strip_count) {
+            parts[count] = zlib_trailer;
+            sizes[count++] = 4;
+        }
+        png_append_chunk(sink, "IDAT", parts, sizes, count);
+    }
+    track_external_memory(-compressed_bytes);
+
+    png_append_chunk(sink, "IEND", nullptr, nullptr, 0);
+    return true;
+}
+
+bool encode_png_strips(const ImageData& data, const ResizeOptions& opts, size_t strip_count,
+                       std::vector<unsigned char>& png) {
+    MemorySink sink;
+    sink_init(sink, nullptr, estimate_encoded_size(data));
+    bool ok = encode_png_parallel(data, png_params(opts), strip_count, sink);
+    if (ok) {
+        png.assign(sink.data, sink.data + sink.size);
+    }
+    sink_free(sink);
+    return ok;
+}
+
+bool encode_png(const ImageData& data, const ResizeOptions& opts, MemorySink& sink) {
+    PngParams params = png_params(opts);
+
+    // Falls back to libpng below the size where strips pay off
+    if (encode_png_parallel(data, params, png_strip_count(data), sink)) {
+        return true;
+    }
 
     png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
     if (!png) {
-        fclose(fp);
         return false;
     }
 
     png_infop info = png_create_info_struct(png);
     if (!info) {
         png_destroy_write_struct(&png, nullptr);
-        fclose(fp);
         return false;
     }
 
     if (setjmp(png_jmpbuf(png))) {
         png_destroy_write_struct(&png, &info);
-        fclose(fp);
         return false;
     }
 
-    png_init_io(png, fp);
+    png_set_write_fn(png, &sink, png_sink_write, png_sink_flush);
 
-    int compression_level = 9 - ((quality - 1) * 9 / 99);
-    if (compression_level < 0) compression_level = 0;
-    if (compression_level > 9) compression_level = 9;
-    png_set_compression_level(png, compression_level);
+    png_set_compression_level(png, params.level);
+
+    // Non-default knobs only, so libpng keeps shrinking the window for small images
+    if (params.filter >= 0) {
+        static const int filter_masks[5] = {
+            PNG_FILTER_NONE, PNG_FILTER_SUB, PNG_FILTER_UP, PNG_FILTER_AVG, PNG_FILTER_PAETH
+        };
+        png_set_filter(png, 0, filter_masks[params.filter]);
+    }
+    if (opts.png_strategy != ResizeOptions::PNG_STRATEGY_DEFAULT) {
+        png_set_compression_strategy(png, params.strategy);
+    }
+    if (params.window_bits != 15) {
+        png_set_compression_window_bits(png, params.window_bits);
+    }
+    if (params.mem_level != 8) {
+        png_set_compression_mem_level(png, params.mem_level);
+    }
 
     int color_type;
     switch (data.channels) {
@@ -282,7 +1017,6 @@ bool encode_png(const std::string& path, const ImageData& data, int quality) {
         case 4: color_type = PNG_COLOR_TYPE_RGB_ALPHA; break;
         default:
             png_destroy_write_struct(&png, &info);
-            fclose(fp);
             return false;
     }
 
@@ -304,22 +1038,31 @@ bool encode_png(const std::string& path, const ImageData& data, int quality) {
 
     delete[] row_pointers;
     png_destroy_write_struct(&png, &info);
-    fclose(fp);
 
     return true;
 }
 
-bool encode_webp(const std::string& path, const ImageData& data, int quality) {
+bool encode_webp(const ImageData& data, const ResizeOptions& opts, MemorySink& sink) {
     WebPConfig config;
     if (!WebPConfigInit(&config)) {
         set_last_error(ENCODE_ERROR, "Failed to initialize WebP config");
         return false;
     }
 
-    config.quality = quality;
-    config.method = 4;
-    config.thread_level = 1;
+    // For lossless output quality is the compression effort, as in cwebp
+    config.quality = opts.quality;
+    config.method = opts.webp_effort;
+    // libwebp's thread_level runs analysis and the alpha plane on a thread of
+    // its own; batch workers already keep every core busy, so only a lone
+    // encode on a multi-core machine gets it
+    config.thread_level = !thread_pool_is_worker() && std::thread::hardware_concurrency() > 1;
     config.preprocessing = 0;
+    config.alpha_quality = opts.webp_alpha_quality;
+
+    if (opts.webp_lossless || opts.webp_near_lossless < 100) {
+        config.lossless = 1;
+        config.near_lossless = opts.webp_near_lossless;
+    }
 
     if (!WebPValidateConfig(&config)) {
         set_last_error(ENCODE_ERROR, "Invalid WebP config");
@@ -336,10 +1079,8 @@ bool encode_webp(const std::string& path, const ImageData& data, int quality) {
     picture.height = data.height;
     picture.use_argb = 0;
 
-    WebPMemoryWriter writer;
-    WebPMemoryWriterInit(&writer);
-    picture.writer = WebPMemoryWrite;
-    picture.custom_ptr = &writer;
+    picture.writer = webp_sink_write;
+    picture.custom_ptr = &sink;
 
     bool import_success = false;
     if (data.channels == 4) {
@@ -355,68 +1096,79 @@ bool encode_webp(const std::string& path, const ImageData& data, int quality) {
     if (!import_success) {
         set_last_error(ENCODE_ERROR, "Failed to import pixels for WebP encoding");
         WebPPictureFree(&picture);
-        WebPMemoryWriterClear(&writer);
         return false;
     }
 
+    // The imported YUV(A) planes, as libwebp allocates them
+    int64_t picture_bytes = static_cast<int64_t>(data.width) * data.height +
+                            2 * static_cast<int64_t>((data.width + 1) / 2) * ((data.height + 1) / 2);
+    if (data.channels == 4) {
+        picture_bytes += static_cast<int64_t>(data.width) * data.height;
+    }
+    track_external_memory(picture_bytes);
+
     bool encode_success = WebPEncode(&config, &picture);
     WebPPictureFree(&picture);
+    track_external_memory(-picture_bytes);
 
     if (!encode_success) {
         set_last_error(ENCODE_ERROR, "WebP encoding failed");
-        WebPMemoryWriterClear(&writer);
-        return false;
-    }
-
-    FILE* fp = fopen(path.c_str(), "wb");
-    if (!fp) {
-        set_last_error(ENCODE_ERROR, "Failed to open file for writing: " + path);
-        WebPMemoryWriterClear(&writer);
         return false;
     }
 
-    size_t expected_size = writer.size;
-    size_t written = fwrite(writer.mem, 1, writer.size, fp);
-    fclose(fp);
-    WebPMemoryWriterClear(&writer);
+    return true;
+}
 
-    if (written != expected_size) {
-        set_last_error(ENCODE_ERROR, "Failed to write WebP file: " + path);
+bool encode_image(const std::string& path, const ImageData& data, ImageFormat format,
+                  const ResizeOptions& opts, BufferPool* buffer_pool) {
+    if (!data.pixels || data.width <= 0 || data.height <= 0) {
         return false;
     }
 
-    return true;
-}
+    // Includes the nested "write" of the encoded bytes
+    FASTRESIZE_TRACE_SCOPE("encode");
+    StageTimer timer(encode_histogram(format));
 
-bool encode_image(const std::string& path, const ImageData& data, ImageFormat format, int quality, BufferPool* buffer_pool) {
-    if (!data.pixels || data.width <= 0 || data.height <= 0) {
+    if (data.planar && format != FORMAT_JPEG) {
+        set_last_error(ENCODE_ERROR, "Planar YCbCr can only be encoded as JPEG");
         return false;
     }
 
+    MemorySink sink;
+    sink_init(sink, buffer_pool, estimate_encoded_size(data));
+
+    bool encoded;
     switch (format) {
         case FORMAT_JPEG:
-            return encode_jpeg(path, data, quality, buffer_pool);
+            encoded = data.planar
+                ? encode_jpeg_planar(data, opts.quality, sink)
+                : encode_jpeg(data, opts.quality, buffer_pool, sink);
+            break;
 
         case FORMAT_PNG:
-            return encode_png(path, data, quality);
+            encoded = encode_png(data, opts, sink);
+            break;
 
         case FORMAT_WEBP:
-            return encode_webp(path, data, quality);
+            encoded = encode_webp(data, opts, sink);
+            break;
 
         case FORMAT_BMP:
-            {
-                int result = stbi_write_bmp(path.c_str(), data.width, data.height, data.channels, data.pixels);
-                if (!result) {
-                    set_last_error(ENCODE_ERROR, "Failed to encode BMP image");
-                    return false;
-                }
-                return true;
+            encoded = stbi_write_bmp_to_func(stbi_sink_write, &sink, data.width, data.height,
+                                             data.channels, data.pixels) != 0;
+            if (!encoded) {
+                set_last_error(ENCODE_ERROR, "Failed to encode BMP image");
             }
+            break;
 
         default:
             set_last_error(UNSUPPORTED_FORMAT, "Unsupported output format");
-            return false;
+            encoded = false;
     }
+
+    bool ok = encoded && write_output_file(path, sink, opts.atomic_write);
+    sink_free(sink);
+    return ok;
 }
 
 }
@@ -39,9 +39,16 @@
  */
 
 #include "internal.h"
+#include "metrics.h"
 #include "pipeline.h"
+#include "trace.h"
+#include <algorithm>
 #include <cstring>
+#include <functional>
+#include <memory>
 #include <mutex>
+#include <utility>
+#include <sys/stat.h>
 
 namespace fastresize {
 
@@ -49,14 +56,47 @@ namespace {
     std::mutex error_mutex;
     ErrorCode last_error_code = OK;
     std::string last_error_message;
+
+    thread_local ErrorCode thread_error_code = OK;
+    thread_local std::string thread_error_message;
 }
 
 namespace internal {
     void set_last_error(ErrorCode code, const std::string& message) {
+        thread_error_code = code;
+        thread_error_message = message;
+
         std::lock_guard<std::mutex> lock(error_mutex);
         last_error_code = code;
         last_error_message = message;
     }
+
+    ErrorCode thread_last_error_code() {
+        return thread_error_code;
+    }
+
+    std::string thread_last_error() {
+        return thread_error_message;
+    }
+
+    void finish_item_result(const std::string& input_path, const std::string& output_path,
+                            ErrorCode status, uint64_t start_ns, ItemResult& item) {
+        struct stat st;
+        if (stat(input_path.c_str(), &st) == 0) {
+            item.bytes_read = static_cast<uint64_t>(st.st_size);
+        }
+
+        if (status == OK) {
+            if (stat(output_path.c_str(), &st) == 0) {
+                item.bytes_written = static_cast<uint64_t>(st.st_size);
+            }
+        } else {
+            item.outcome = ItemResult::FAILED;
+            item.status = status;
+        }
+        item.total_us = (trace_now() - start_ns) / 1000;
+        metrics_record_item(item);
+    }
 }
 
 std::string get_last_error() {
@@ -69,8 +109,10 @@ ErrorCode get_last_error_code() {
     return last_error_code;
 }
 
+namespace internal {
+
 // Validate resize options
-static bool validate_options(const ResizeOptions& opts) {
+bool validate_options(const ResizeOptions& opts) {
     switch (opts.mode) {
         case ResizeOptions::SCALE_PERCENT:
             if (opts.scale_percent <= 0) {
@@ -91,6 +133,8 @@ static bool validate_options(const ResizeOptions& opts) {
             }
             break;
         case ResizeOptions::EXACT_SIZE:
+        case ResizeOptions::COVER:
+        case ResizeOptions::CONTAIN:
             if (opts.target_width <= 0 || opts.target_height <= 0) {
                 internal::set_last_error(RESIZE_ERROR, "Width and height must be positive");
                 return false;
@@ -103,9 +147,32 @@ static bool validate_options(const ResizeOptions& opts) {
         return false;
     }
 
+    if (opts.webp_effort < 0 || opts.webp_effort > 6) {
+        internal::set_last_error(RESIZE_ERROR, "WebP effort must be between 0 and 6");
+        return false;
+    }
+
+    if (opts.webp_near_lossless < 0 || opts.webp_near_lossless > 100 ||
+        opts.webp_alpha_quality < 0 || opts.webp_alpha_quality > 100) {
+        internal::set_last_error(RESIZE_ERROR, "WebP near-lossless and alpha quality must be between 0 and 100");
+        return false;
+    }
+
+    if (opts.png_window_bits < 9 || opts.png_window_bits > 15) {
+        internal::set_last_error(RESIZE_ERROR, "PNG window bits must be between 9 and 15");
+        return false;
+    }
+
+    if (opts.png_mem_level < 1 || opts.png_mem_level > 9) {
+        internal::set_last_error(RESIZE_ERROR, "PNG memory level must be between 1 and 9");
+        return false;
+    }
+
     return true;
 }
 
+}
+
 ImageInfo get_image_info(const std::string& path) {
     ImageInfo info;
     info.width = 0;
@@ -130,103 +197,390 @@ ImageInfo get_image_info(const std::string& path) {
     return info;
 }
 
-bool resize(
+// Extension-less outputs that don't exist yet come back as FORMAT_UNKNOWN
+static internal::ImageFormat output_format_from_path(const std::string& output_path) {
+    internal::ImageFormat output_format = internal::detect_format(output_path);
+    if (output_format != internal::FORMAT_UNKNOWN) {
+        return output_format;
+    }
+
+    size_t dot_pos = output_path.find_last_of('.');
+    if (dot_pos != std::string::npos) {
+        std::string ext = output_path.substr(dot_pos + 1);
+        for (char& c : ext) {
+            if (c >= 'A' && c <= 'Z') c = c - 'A' + 'a';
+        }
+        output_format = internal::string_to_format(ext);
+    }
+
+    return output_format;
+}
+
+static uint64_t elapsed_us(uint64_t start_ns) {
+    return (internal::trace_now() - start_ns) / 1000;
+}
+
+// Status of a finished batch item, from the error set on its worker thread;
+// failures that leave no error of their own are reported as RESIZE_ERROR
+static ErrorCode item_status(bool success) {
+    if (success) return OK;
+    ErrorCode code = internal::thread_last_error_code();
+    return code != OK ? code : RESIZE_ERROR;
+}
+
+namespace internal {
+
+bool plan_item(
     const std::string& input_path,
-    const std::string& output_path,
-    const ResizeOptions& options
+    internal::ImageFormat output_format,
+    const ResizeOptions& options,
+    ItemPlan& plan
 ) {
-    if (!validate_options(options)) {
+    plan.input_format = internal::detect_format(input_path);
+    if (plan.input_format == internal::FORMAT_UNKNOWN) {
+        internal::set_last_error(UNSUPPORTED_FORMAT, "Unknown input image format");
         return false;
     }
 
-    internal::ImageFormat input_format = internal::detect_format(input_path);
-    if (input_format == internal::FORMAT_UNKNOWN) {
-        internal::set_last_error(UNSUPPORTED_FORMAT, "Unknown input image format");
+    plan.output_format = output_format == internal::FORMAT_UNKNOWN ? plan.input_format : output_format;
+
+    int input_w, input_h, input_channels, exif_orientation;
+    if (!internal::get_image_dimensions(input_path, input_w, input_h, input_channels, &exif_orientation)) {
+        internal::set_last_error(DECODE_ERROR, "Failed to read image dimensions");
         return false;
     }
 
-    internal::ImageFormat output_format = internal::detect_format(output_path);
-    if (output_format == internal::FORMAT_UNKNOWN) {
-        size_t dot_pos = output_path.find_last_of('.');
-        if (dot_pos != std::string::npos) {
-            std::string ext = output_path.substr(dot_pos + 1);
-            for (char& c : ext) {
-                if (c >= 'A' && c <= 'Z') c = c - 'A' + 'a';
-            }
-            output_format = internal::string_to_format(ext);
-        }
+    plan.orientation = options.auto_orient ? exif_orientation : 1;
+    plan.source_w = input_w;
+    plan.source_h = input_h;
+
+    // Sizes are computed in display orientation
+    bool transposed = internal::orientation_swaps_axes(plan.orientation);
+    if (transposed) {
+        std::swap(input_w, input_h);
+    }
 
-        if (output_format == internal::FORMAT_UNKNOWN) {
-            output_format = input_format;
+    internal::calculate_dimensions(input_w, input_h, options, plan.output_w, plan.output_h);
+
+    plan.identity = internal::is_identity_resize(plan.input_format, plan.output_format, exif_orientation,
+                                                 input_w, input_h, plan.output_w, plan.output_h);
+
+    internal::calculate_decode_target(input_w, input_h, options, plan.decode_w, plan.decode_h);
+    if (transposed) {
+        std::swap(plan.decode_w, plan.decode_h);
+    }
+
+    plan.scale = plan.input_format == internal::FORMAT_JPEG
+        ? internal::jpeg_decode_scale(plan.source_w, plan.source_h, plan.decode_w, plan.decode_h)
+        : 1;
+
+    // YCbCr JPEGs skip upsampling and colour conversion when nothing needs rotating or padding
+    plan.planar = internal::choose_planar_decode(
+        plan.input_format, plan.output_format, options, plan.orientation);
+    return true;
+}
+
+void record_plan(const ItemPlan& plan, ItemResult& stats) {
+    stats.input_width = plan.source_w;
+    stats.input_height = plan.source_h;
+    stats.output_width = plan.output_w;
+    stats.output_height = plan.output_h;
+}
+
+bool resize_without_decode(
+    const std::string& input_path,
+    const std::string& output_path,
+    const ResizeOptions& options,
+    ItemPlan& plan,
+    ItemResult& stats,
+    bool* done
+) {
+    *done = true;
+    uint64_t start = internal::trace_now();
+    if (plan.identity) {
+        bool copied = internal::copy_image_file(input_path, output_path, options.atomic_write);
+        stats.encode_us = elapsed_us(start);
+        if (!copied) {
+            return false;
         }
+        stats.outcome = ItemResult::COPIED;
+        internal::set_last_error(OK, "");
+        return true;
     }
 
-    int input_w, input_h, input_channels;
-    if (!internal::get_image_dimensions(input_path, input_w, input_h, input_channels)) {
-        internal::set_last_error(DECODE_ERROR, "Failed to read image dimensions");
-        return false;
+    if (internal::output_cache_key(input_path, plan.output_format, options, plan.cache_key) &&
+        internal::output_cache_fetch(plan.cache_key, output_path, options.atomic_write)) {
+        stats.encode_us = elapsed_us(start);
+        stats.outcome = ItemResult::CACHED;
+        internal::set_last_error(OK, "");
+        return true;
     }
 
-    int output_w, output_h;
-    internal::calculate_dimensions(
-        input_w, input_h,
-        options,
-        output_w, output_h
-    );
+    stats.probe_us += elapsed_us(start);
+    *done = false;
+    return true;
+}
+
+bool decode_planned_source(
+    const std::string& input_path,
+    const ResizeOptions& options,
+    const ItemPlan& plan,
+    int target_w,
+    int target_h,
+    std::shared_ptr<const internal::ImageData>& source
+) {
+    // Embedded thumbnails depend on the target size, so they bypass the decode cache
+    bool cacheable = !options.use_embedded_thumbnail;
+    if (cacheable) {
+        source = internal::decode_cache_find(input_path, plan.scale, plan.planar);
+        if (source) {
+            return true;
+        }
+    }
 
-    internal::ImageData input_data = internal::decode_image(input_path, input_format, output_w, output_h);
+    internal::ImageData input_data = internal::decode_image(
+        input_path, plan.input_format, target_w, target_h,
+        options.use_embedded_thumbnail, plan.planar);
     if (!input_data.pixels) {
         internal::set_last_error(DECODE_ERROR, "Failed to decode input image");
         return false;
     }
 
-    unsigned char* output_pixels = nullptr;
-    bool resize_ok = internal::resize_image(
-        input_data.pixels,
-        input_data.width, input_data.height, input_data.channels,
-        &output_pixels,
-        output_w, output_h,
-        options
-    );
+    if (cacheable) {
+        source = internal::decode_cache_insert(input_path, plan.scale, input_data);
+    } else {
+        source.reset(new internal::ImageData(input_data), [](internal::ImageData* data) {
+            internal::free_image_data(*data);
+            delete data;
+        });
+    }
+    return true;
+}
 
-    if (!resize_ok || !output_pixels) {
-        internal::free_image_data(input_data);
-        if (output_pixels) delete[] output_pixels;
-        return false;
+void decode_shared_source(
+    const std::string& input_path,
+    const std::vector<SharedDecodeItem>& pending,
+    const std::function<void(const std::vector<size_t>&, const std::shared_ptr<const ImageData>&)>& decoded
+) {
+    std::vector<bool> grouped(pending.size(), false);
+    for (size_t first = 0; first < pending.size(); ++first) {
+        if (grouped[first]) continue;
+
+        // Same scale and layout gives every member the image it would have
+        // decoded alone; the largest target keeps that scale. An embedded
+        // thumbnail covers some targets and not others, so those items
+        // decode on their own.
+        const ItemPlan& shared = *pending[first].plan;
+        const ResizeOptions& options = *pending[first].options;
+        int target_w = shared.decode_w;
+        int target_h = shared.decode_h;
+        std::vector<size_t> members(1, first);
+        grouped[first] = true;
+        for (size_t i = first + 1; i < pending.size() && !options.use_embedded_thumbnail; ++i) {
+            const ItemPlan& plan = *pending[i].plan;
+            if (grouped[i] || plan.scale != shared.scale || plan.planar != shared.planar ||
+                pending[i].options->use_embedded_thumbnail) {
+                continue;
+            }
+            target_w = std::max(target_w, plan.decode_w);
+            target_h = std::max(target_h, plan.decode_h);
+            members.push_back(i);
+            grouped[i] = true;
+        }
+
+        uint64_t decode_start = trace_now();
+        std::shared_ptr<const ImageData> source;
+        bool decode_ok = decode_planned_source(input_path, options, shared, target_w, target_h, source);
+        uint64_t decode_us = elapsed_us(decode_start);
+        for (size_t member : members) {
+            pending[member].stats->decode_us = decode_us;
+            if (decode_ok) {
+                pending[member].stats->decode_scale = decoded_scale(pending[member].plan->source_w, *source);
+            }
+        }
+
+        decoded(members, source);
     }
+}
 
-    internal::ImageData output_data;
-    output_data.pixels = output_pixels;
-    output_data.width = output_w;
-    output_data.height = output_h;
+// Resizes a decoded source to the planned size. keep_planar leaves planar
+// JPEG sources as YCbCr planes for the JPEG encoder.
+static bool resize_pixels(
+    const internal::ImageData& input_data,
+    const ResizeOptions& options,
+    const ItemPlan& plan,
+    bool keep_planar,
+    internal::ImageData& output_data
+) {
+    output_data.pixels = nullptr;
+    output_data.width = plan.output_w;
+    output_data.height = plan.output_h;
     output_data.channels = input_data.channels;
 
-    bool encode_ok = internal::encode_image(output_path, output_data, output_format, options.quality);
+    return input_data.planar
+        ? internal::resize_planar(input_data, output_data, plan.output_w, plan.output_h, options, keep_planar)
+        : internal::resize_image(
+              input_data.pixels,
+              input_data.width, input_data.height, input_data.channels,
+              &output_data.pixels,
+              plan.output_w, plan.output_h,
+              options,
+              options.auto_orient ? input_data.orientation : 1
+          );
+}
 
-    internal::free_image_data(input_data);
-    delete[] output_pixels;
+bool resize_decoded_pixels(
+    const internal::ImageData& input_data,
+    const ResizeOptions& options,
+    const ItemPlan& plan,
+    internal::ImageData& output_data,
+    ItemResult& stats
+) {
+    uint64_t start = internal::trace_now();
+    bool resize_ok = resize_pixels(input_data, options, plan,
+                                   plan.output_format == internal::FORMAT_JPEG, output_data);
+
+    stats.resize_us = elapsed_us(start);
+    if (!resize_ok || !output_data.pixels) {
+        if (output_data.pixels) internal::free_pixels(output_data.pixels);
+        output_data.pixels = nullptr;
+        return false;
+    }
+    return true;
+}
+
+bool encode_resized(
+    internal::ImageData& output_data,
+    const std::string& output_path,
+    const ResizeOptions& options,
+    const ItemPlan& plan,
+    internal::BufferPool* buffer_pool,
+    ItemResult& stats
+) {
+    uint64_t start = internal::trace_now();
+    bool encode_ok = internal::encode_image(output_path, output_data, plan.output_format,
+                                            options, buffer_pool);
+    internal::free_pixels(output_data.pixels);
+    output_data.pixels = nullptr;
+    stats.encode_us = elapsed_us(start);
 
     if (!encode_ok) {
         return false;
     }
 
+    internal::output_cache_store(plan.cache_key, output_path);
+    stats.outcome = ItemResult::RESIZED;
     internal::set_last_error(OK, "");
     return true;
 }
 
-bool resize_with_format(
+// Resizes and encodes one item from a decoded source
+static bool resize_decoded(
+    const internal::ImageData& input_data,
+    const std::string& output_path,
+    const ResizeOptions& options,
+    const ItemPlan& plan,
+    internal::BufferPool* buffer_pool,
+    ItemResult& stats
+) {
+    internal::ImageData output_data;
+    return resize_decoded_pixels(input_data, options, plan, output_data, stats) &&
+           encode_resized(output_data, output_path, options, plan, buffer_pool, stats);
+}
+
+// Decode stage of an item: plans it, then copies it, fetches it from the
+// output cache or decodes the source. Sets *done when nothing is left to do.
+static bool decode_planned(
+    const std::string& input_path,
+    const std::string& output_path,
+    internal::ImageFormat output_format,
+    const ResizeOptions& options,
+    ItemPlan& plan,
+    std::shared_ptr<const internal::ImageData>& source,
+    ItemResult& stats,
+    bool* done
+) {
+    *done = true;
+    uint64_t start = internal::trace_now();
+    bool planned = plan_item(input_path, output_format, options, plan);
+    stats.probe_us = elapsed_us(start);
+    if (!planned) {
+        return false;
+    }
+    record_plan(plan, stats);
+
+    bool ok = resize_without_decode(input_path, output_path, options, plan, stats, done);
+    if (*done) {
+        return ok;
+    }
+    *done = true;
+
+    start = internal::trace_now();
+    bool decoded = decode_planned_source(input_path, options, plan, plan.decode_w, plan.decode_h, source);
+    stats.decode_us = elapsed_us(start);
+    if (!decoded) {
+        return false;
+    }
+    stats.decode_scale = internal::decoded_scale(plan.source_w, *source);
+    *done = false;
+    return true;
+}
+
+}
+
+// Shared by resize(), resize_with_format() and the batch workers.
+// FORMAT_UNKNOWN as output_format keeps the input's format.
+static bool resize_to_format(
+    const std::string& input_path,
+    const std::string& output_path,
+    internal::ImageFormat output_format,
+    const ResizeOptions& options,
+    internal::BufferPool* buffer_pool,
+    ItemResult& stats
+) {
+    internal::ItemPlan plan;
+    std::shared_ptr<const internal::ImageData> source;
+    bool done;
+    bool ok = internal::decode_planned(input_path, output_path, output_format, options, plan, source, stats, &done);
+    if (done) {
+        return ok;
+    }
+    return internal::resize_decoded(*source, output_path, options, plan, buffer_pool, stats);
+}
+
+// resize() and resize_with_format(); counted in the metrics like batch items
+static bool resize_single(
+    const std::string& input_path,
+    const std::string& output_path,
+    internal::ImageFormat output_format,
+    const ResizeOptions& options
+) {
+    uint64_t start = internal::trace_now();
+    ItemResult stats;
+    bool success = resize_to_format(input_path, output_path, output_format, options, nullptr, stats);
+    internal::finish_item_result(input_path, output_path, item_status(success), start, stats);
+    return success;
+}
+
+bool resize(
     const std::string& input_path,
     const std::string& output_path,
-    const std::string& output_format_str,
     const ResizeOptions& options
 ) {
-    if (!validate_options(options)) {
+    if (!internal::validate_options(options)) {
         return false;
     }
 
-    internal::ImageFormat input_format = internal::detect_format(input_path);
-    if (input_format == internal::FORMAT_UNKNOWN) {
-        internal::set_last_error(UNSUPPORTED_FORMAT, "Unknown input image format");
+    return resize_single(input_path, output_path, output_format_from_path(output_path), options);
+}
+
+bool resize_with_format(
+    const std::string& input_path,
+    const std::string& output_path,
+    const std::string& output_format_str,
+    const ResizeOptions& options
+) {
+    if (!internal::validate_options(options)) {
         return false;
     }
 
@@ -236,52 +590,61 @@ bool resize_with_format(
         return false;
     }
 
-    int input_w, input_h, input_channels;
-    if (!internal::get_image_dimensions(input_path, input_w, input_h, input_channels)) {
-        internal::set_last_error(DECODE_ERROR, "Failed to read image dimensions");
+    return resize_single(input_path, output_path, output_format, options);
+}
+
+bool compare_resize(
+    const std::string& input_path,
+    const ResizeOptions& options,
+    QualityReport& report
+) {
+    if (!internal::validate_options(options)) {
         return false;
     }
 
-    int output_w, output_h;
-    internal::calculate_dimensions(
-        input_w, input_h,
-        options,
-        output_w, output_h
-    );
+    internal::ItemPlan plan;
+    if (!internal::plan_item(input_path, internal::FORMAT_UNKNOWN, options, plan)) {
+        return false;
+    }
 
-    internal::ImageData input_data = internal::decode_image(input_path, input_format, output_w, output_h);
+    // The fast path, exactly as resize() decodes and resizes it
+    internal::ImageData input_data = internal::decode_image(
+        input_path, plan.input_format, plan.decode_w, plan.decode_h,
+        options.use_embedded_thumbnail, plan.planar);
     if (!input_data.pixels) {
         internal::set_last_error(DECODE_ERROR, "Failed to decode input image");
         return false;
     }
 
-    unsigned char* output_pixels = nullptr;
-    bool resize_ok = internal::resize_image(
-        input_data.pixels,
-        input_data.width, input_data.height, input_data.channels,
-        &output_pixels,
-        output_w, output_h,
-        options
-    );
-
-    if (!resize_ok || !output_pixels) {
-        internal::free_image_data(input_data);
-        if (output_pixels) delete[] output_pixels;
+    internal::ImageData output_data;
+    bool resize_ok = resize_pixels(input_data, options, plan, false, output_data);
+    internal::free_image_data(input_data);
+    if (!resize_ok || !output_data.pixels) {
+        if (output_data.pixels) internal::free_pixels(output_data.pixels);
         return false;
     }
 
-    internal::ImageData output_data;
-    output_data.pixels = output_pixels;
-    output_data.width = output_w;
-    output_data.height = output_h;
-    output_data.channels = input_data.channels;
+    // The reference, from every pixel of the source
+    internal::ImageData source = internal::decode_image(input_path, plan.input_format);
+    if (!source.pixels) {
+        internal::free_pixels(output_data.pixels);
+        internal::set_last_error(DECODE_ERROR, "Failed to decode input image");
+        return false;
+    }
 
-    bool encode_ok = internal::encode_image(output_path, output_data, output_format, options.quality);
+    bool same_layout = source.channels == output_data.channels;
+    if (same_layout) {
+        std::vector<unsigned char> reference = internal::reference_resize(
+            source, plan.orientation, plan.output_w, plan.output_h, options);
+        internal::measure_quality(output_data.pixels, reference.data(),
+                                  plan.output_w, plan.output_h, output_data.channels, report);
+    }
 
-    internal::free_image_data(input_data);
-    delete[] output_pixels;
+    internal::free_image_data(source);
+    internal::free_pixels(output_data.pixels);
 
-    if (!encode_ok) {
+    if (!same_layout) {
+        internal::set_last_error(RESIZE_ERROR, "Resized image and reference have different channel counts");
         return false;
     }
 
@@ -289,6 +652,43 @@ bool resize_with_format(
     return true;
 }
 
+bool compare_images(
+    const std::string& path_a,
+    const std::string& path_b,
+    QualityReport& report
+) {
+    internal::ImageData images[2];
+    const std::string* paths[2] = {&path_a, &path_b};
+    for (int i = 0; i < 2; ++i) {
+        internal::ImageFormat format = internal::detect_format(*paths[i]);
+        if (format == internal::FORMAT_UNKNOWN) {
+            internal::set_last_error(UNSUPPORTED_FORMAT, "Unknown image format: " + *paths[i]);
+            if (i == 1) internal::free_image_data(images[0]);
+            return false;
+        }
+        images[i] = internal::decode_image(*paths[i], format);
+        if (!images[i].pixels) {
+            internal::set_last_error(DECODE_ERROR, "Failed to decode " + *paths[i]);
+            if (i == 1) internal::free_image_data(images[0]);
+            return false;
+        }
+    }
+
+    bool same_layout = images[0].width == images[1].width && images[0].height == images[1].height &&
+                       images[0].channels == images[1].channels;
+    if (same_layout) {
+        internal::measure_quality(images[0].pixels, images[1].pixels,
+                                  images[0].width, images[0].height, images[0].channels, report);
+        internal::set_last_error(OK, "");
+    } else {
+        internal::set_last_error(RESIZE_ERROR, "Images differ in size or channel count");
+    }
+
+    internal::free_image_data(images[0]);
+    internal::free_image_data(images[1]);
+    return same_layout;
+}
+
 namespace {
     size_t calculate_optimal_threads(size_t batch_size, int requested_threads) {
         if (requested_threads > 0) {
@@ -307,22 +707,101 @@ namespace {
     }
 }
 
+// Runs only the items whose outputs aren't current, then records what was written
+static BatchResult batch_resize_incremental(
+    const std::vector<BatchItem>& items,
+    const BatchOptions& batch_opts
+) {
+    internal::IncrementalBatch* incremental = internal::create_incremental_batch(batch_opts.manifest_path);
+
+    std::vector<BatchItem> pending = items;
+    std::vector<size_t> positions;
+    size_t skipped = internal::remove_current_items(
+        incremental, pending, calculate_optimal_threads(items.size(), batch_opts.num_threads), positions);
+
+    BatchOptions pending_opts = batch_opts;
+    pending_opts.incremental = false;
+    BatchResult result = batch_resize_custom(pending, pending_opts);
+
+    std::vector<ItemResult> pending_results;
+    pending_results.swap(result.items);
+    result.items.resize(items.size());
+    for (ItemResult& item : result.items) {
+        item.outcome = ItemResult::SKIPPED;
+    }
+    internal::metrics_add(internal::outcome_counter(ItemResult::SKIPPED), skipped);
+    for (size_t i = 0; i < pending_results.size(); ++i) {
+        result.items[positions[i]] = pending_results[i];
+    }
+
+    if (!internal::finish_incremental_batch(incremental)) {
+        result.errors.push_back("Failed to write manifest: " + batch_opts.manifest_path);
+    }
+    internal::destroy_incremental_batch(incremental);
+
+    result.total = static_cast<int>(items.size());
+    result.skipped = static_cast<int>(skipped);
+    return result;
+}
+
+// Records every stage of one batch and writes them out as a Chrome trace
+static BatchResult traced_batch(
+    const BatchOptions& batch_opts,
+    const std::function<BatchResult(const BatchOptions&)>& run
+) {
+    BatchOptions untraced_opts = batch_opts;
+    untraced_opts.trace_path.clear();
+
+    internal::trace_start();
+    BatchResult result = run(untraced_opts);
+
+    if (!internal::trace_stop(batch_opts.trace_path)) {
+        result.errors.push_back("Failed to write trace: " + get_last_error());
+    }
+    return result;
+}
+
+// Charges every pixel buffer the batch allocates, on any thread, to one
+// account and reports its high-water mark
+static BatchResult accounted_batch(const std::function<BatchResult()>& run) {
+    internal::MemoryAccount account;
+    BatchResult result;
+    {
+        internal::MemoryAccountScope scope(&account);
+        result = run();
+    }
+    result.peak_memory_bytes = static_cast<uint64_t>(account.peak.load());
+    return result;
+}
+
 BatchResult batch_resize(
     const std::vector<std::string>& input_paths,
     const std::string& output_dir,
     const ResizeOptions& options,
     const BatchOptions& batch_opts
 ) {
+    if (!batch_opts.trace_path.empty()) {
+        return traced_batch(batch_opts, [&](const BatchOptions& opts) {
+            return batch_resize(input_paths, output_dir, options, opts);
+        });
+    }
+    if (!internal::current_memory_account()) {
+        return accounted_batch([&]() {
+            return batch_resize(input_paths, output_dir, options, batch_opts);
+        });
+    }
+
     BatchResult result;
     result.total = static_cast<int>(input_paths.size());
     result.success = 0;
     result.failed = 0;
+    result.items.resize(input_paths.size());
 
     if (input_paths.empty()) {
         return result;
     }
 
-    if (batch_opts.max_speed && input_paths.size() >= 20) {
+    if ((batch_opts.max_speed && input_paths.size() >= 20) || batch_opts.incremental) {
         std::vector<BatchItem> items;
         items.reserve(input_paths.size());
 
@@ -351,16 +830,17 @@ BatchResult batch_resize(
     std::mutex result_mutex;
     std::atomic<bool> should_stop(false);
 
-    for (const std::string& input_path : input_paths) {
+    for (size_t index = 0; index < input_paths.size(); ++index) {
         if (should_stop.load()) {
             break;
         }
 
-        internal::thread_pool_enqueue(pool, [&, input_path]() {
+        internal::thread_pool_enqueue(pool, [&, index]() {
             if (should_stop.load()) {
                 return;
             }
 
+            const std::string& input_path = input_paths[index];
             size_t last_slash = input_path.find_last_of("/\\");
             std::string filename = (last_slash != std::string::npos)
                 ? input_path.substr(last_slash + 1)
@@ -368,7 +848,12 @@ BatchResult batch_resize(
 
             std::string output_path = output_dir + "/" + filename;
 
-            bool success = resize(input_path, output_path, options);
+            uint64_t start = internal::trace_now();
+            ItemResult& stats = result.items[index];
+            bool success = internal::validate_options(options) &&
+                resize_to_format(input_path, output_path, output_format_from_path(output_path),
+                                 options, buffer_pool, stats);
+            internal::finish_item_result(input_path, output_path, item_status(success), start, stats);
 
             {
                 std::lock_guard<std::mutex> lock(result_mutex);
@@ -376,7 +861,7 @@ BatchResult batch_resize(
                     result.success++;
                 } else {
                     result.failed++;
-                    result.errors.push_back(input_path + ": " + get_last_error());
+                    result.errors.push_back(input_path + ": " + internal::thread_last_error());
                     if (batch_opts.stop_on_error) {
                         should_stop.store(true);
                     }
@@ -393,19 +878,113 @@ BatchResult batch_resize(
     return result;
 }
 
+// Batch items that read the same file: each distinct decode request is
+// decoded once, then every item's resize and encode runs as its own pool
+// task on a shared reference to the pixels, freed after the last of them
+static void resize_shared_source(
+    const std::vector<BatchItem>& items,
+    const std::vector<size_t>& group,
+    internal::ThreadPool* pool,
+    internal::BufferPool* buffer_pool,
+    const std::atomic<bool>& should_stop,
+    std::vector<ItemResult>& stats,
+    const std::function<void(size_t, bool, uint64_t)>& record
+) {
+    struct PendingItem {
+        size_t index;
+        internal::ItemPlan plan;
+    };
+
+    uint64_t start = internal::trace_now();
+    std::vector<PendingItem> pending;
+    for (size_t index : group) {
+        const BatchItem& item = items[index];
+
+        PendingItem entry;
+        entry.index = index;
+        uint64_t plan_start = internal::trace_now();
+        bool planned = internal::validate_options(item.options) &&
+            internal::plan_item(item.input_path, output_format_from_path(item.output_path),
+                                item.options, entry.plan);
+        stats[index].probe_us = elapsed_us(plan_start);
+        if (!planned) {
+            record(index, false, start);
+            continue;
+        }
+        internal::record_plan(entry.plan, stats[index]);
+
+        bool done;
+        bool ok = internal::resize_without_decode(item.input_path, item.output_path, item.options,
+                                                  entry.plan, stats[index], &done);
+        if (done) {
+            record(index, ok, start);
+            continue;
+        }
+        pending.push_back(entry);
+    }
+
+    std::vector<internal::SharedDecodeItem> shared(pending.size());
+    for (size_t i = 0; i < pending.size(); ++i) {
+        shared[i].plan = &pending[i].plan;
+        shared[i].options = &items[pending[i].index].options;
+        shared[i].stats = &stats[pending[i].index];
+    }
+
+    internal::decode_shared_source(items[group[0]].input_path, shared, [&](
+        const std::vector<size_t>& members, const std::shared_ptr<const internal::ImageData>& source) {
+        if (!source) {
+            for (size_t member : members) {
+                record(pending[member].index, false, start);
+            }
+            return;
+        }
+
+        for (size_t member : members) {
+            size_t index = pending[member].index;
+            internal::ItemPlan plan = pending[member].plan;
+            internal::thread_pool_enqueue(pool, [&items, &should_stop, &stats, &record, buffer_pool,
+                                                 source, index, plan, start]() {
+                if (should_stop.load()) {
+                    return;
+                }
+                const BatchItem& item = items[index];
+                bool success = internal::resize_decoded(*source, item.output_path, item.options, plan,
+                                                        buffer_pool, stats[index]);
+                record(index, success, start);
+            });
+        }
+    });
+}
+
 BatchResult batch_resize_custom(
     const std::vector<BatchItem>& items,
     const BatchOptions& batch_opts
 ) {
+    if (!batch_opts.trace_path.empty()) {
+        return traced_batch(batch_opts, [&](const BatchOptions& opts) {
+            return batch_resize_custom(items, opts);
+        });
+    }
+    if (!internal::current_memory_account()) {
+        return accounted_batch([&]() {
+            return batch_resize_custom(items, batch_opts);
+        });
+    }
+
     BatchResult result;
     result.total = static_cast<int>(items.size());
     result.success = 0;
     result.failed = 0;
+    result.items.resize(items.size());
 
     if (items.empty()) {
         return result;
     }
 
+    if (batch_opts.incremental) {
+        return batch_resize_incremental(items, batch_opts);
+    }
+
     if (batch_opts.max_speed && items.size() >= 20) {
         int total_width = 0;
         int total_height = 0;
@@ -424,7 +1003,9 @@ BatchResult batch_resize_custom(
 
         size_t queue_capacity = internal::calculate_queue_capacity(avg_width, avg_height);
 
-        internal::PipelineProcessor pipeline(4, 8, 4, queue_capacity);
+        size_t encode_threads = internal::calculate_encode_threads(items);
+
+        internal::PipelineProcessor pipeline(4, 8, encode_threads, queue_capacity);
         return pipeline.process_batch(items);
     }
 
@@ -436,30 +1017,51 @@ BatchResult batch_resize_custom(
     std::mutex result_mutex;
     std::atomic<bool> should_stop(false);
 
-    for (const BatchItem& item : items) {
+    std::function<void(size_t, bool, uint64_t)> record = [&](size_t index, bool success, uint64_t start) {
+        const BatchItem& item = items[index];
+        internal::finish_item_result(item.input_path, item.output_path, item_status(success),
+                                     start, result.items[index]);
+
+        std::lock_guard<std::mutex> lock(result_mutex);
+        if (success) {
+            result.success++;
+        } else {
+            result.failed++;
+            result.errors.push_back(item.input_path + ": " + internal::thread_last_error());
+            if (batch_opts.stop_on_error) {
+                should_stop.store(true);
+            }
+        }
+    };
+
+    for (const std::vector<size_t>& group : internal::group_by_source(items)) {
         if (should_stop.load()) {
             break;
         }
 
-        internal::thread_pool_enqueue(pool, [&, item]() {
+        if (group.size() > 1) {
+            internal::thread_pool_enqueue(pool, [&, group]() {
+                if (should_stop.load()) {
+                    return;
+                }
+                resize_shared_source(items, group, pool, buffer_pool, should_stop, result.items, record);
+            });
+            continue;
+        }
+
+        size_t index = group[0];
+        internal::thread_pool_enqueue(pool, [&, index]() {
             if (should_stop.load()) {
                 return;
             }
 
-            bool success = resize(item.input_path, item.output_path, item.options);
-
-            {
-                std::lock_guard<std::mutex> lock(result_mutex);
-                if (success) {
-                    result.success++;
-                } else {
-                    result.failed++;
-                    result.errors.push_back(item.input_path + ": " + get_last_error());
-                    if (batch_opts.stop_on_error) {
-                        should_stop.store(true);
-                    }
-                }
-            }
+            const BatchItem& item = items[index];
+            uint64_t start = internal::trace_now();
+            bool success = internal::validate_options(item.options) &&
+                resize_to_format(item.input_path, item.output_path,
+                                 output_format_from_path(item.output_path),
+                                 item.options, buffer_pool, result.items[index]);
+            record(index, success, start);
         });
     }
 
@@ -471,4 +1073,405 @@ BatchResult batch_resize_custom(
     return result;
 }
 
+// ============================================
+// Asynchronous Jobs
+// ============================================
+
+namespace {
+    // One submitted item on its way through the stages. A stage that
+    // finishes it early (failure, copy, output cache hit) sets done and
+    // later stages pass it through to the encode stage, which completes it.
+    struct Job {
+        uint64_t id = 0;
+        BatchItem item;
+        JobCallback callback;
+        internal::IncrementalBatch* incremental = nullptr;  // Streaming batches: skip current outputs
+        std::promise<JobResult> promise;
+        uint64_t start_ns = 0;
+        internal::ItemPlan plan;
+        ItemResult stats;
+        bool done = false;
+        ErrorCode status = OK;
+        std::string error;
+        std::shared_ptr<const internal::ImageData> source;
+        internal::ImageData output;
+    };
+
+    typedef std::unique_ptr<Job> JobPtr;
+
+    // Finishes a job early with the error set on the calling thread, if any
+    void end_job(Job& job, bool success) {
+        job.done = true;
+        job.source.reset();
+        job.status = item_status(success);
+        if (!success) {
+            job.error = internal::thread_last_error();
+        }
+    }
+}
+
+class JobQueue {
+public:
+    JobQueue(size_t decode_threads, size_t resize_threads, size_t encode_threads, size_t capacity)
+        : decode_pool(internal::create_thread_pool(decode_threads))
+        , resize_pool(internal::create_thread_pool(resize_threads))
+        , encode_pool(internal::create_thread_pool(encode_threads))
+        , buffer_pool(internal::create_buffer_pool())
+        , submitted(capacity, internal::QUEUE_SUBMITTED)
+        , decoded(capacity, internal::QUEUE_DECODED)
+        , resized(capacity, internal::QUEUE_RESIZED)
+        , next_id(1)
+        , closed(false)
+        , pending(0)
+    {}
+
+    internal::ThreadPool* decode_pool;
+    internal::ThreadPool* resize_pool;
+    internal::ThreadPool* encode_pool;
+    internal::BufferPool* buffer_pool;
+
+    internal::BoundedQueue<JobPtr> submitted;
+    internal::BoundedQueue<JobPtr> decoded;
+    internal::BoundedQueue<JobPtr> resized;
+
+    std::atomic<uint64_t> next_id;
+    std::atomic<bool> closed;
+
+    std::mutex pending_mutex;
+    std::condition_variable pending_done;
+    size_t pending;
+};
+
+static void decode_job(Job& job) {
+    const BatchItem& item = job.item;
+    if (job.incremental && !internal::keep_pending_item(job.incremental, item)) {
+        job.done = true;
+        job.stats.outcome = ItemResult::SKIPPED;
+        return;
+    }
+    if (!internal::validate_options(item.options)) {
+        end_job(job, false);
+        return;
+    }
+
+    bool done;
+    bool ok = internal::decode_planned(item.input_path, item.output_path, output_format_from_path(item.output_path),
+                                       item.options, job.plan, job.source, job.stats, &done);
+    if (done) {
+        end_job(job, ok);
+    }
+}
+
+static void resize_job(Job& job) {
+    if (job.done) return;
+    bool ok = internal::resize_decoded_pixels(*job.source, job.item.options, job.plan, job.output, job.stats);
+    job.source.reset();
+    if (!ok) {
+        end_job(job, false);
+    }
+}
+
+static void complete_job(JobQueue* queue, Job& job, internal::BufferPool* buffer_pool) {
+    if (!job.done) {
+        bool ok = internal::encode_resized(job.output, job.item.output_path, job.item.options, job.plan,
+                                           buffer_pool, job.stats);
+        end_job(job, ok);
+    }
+    if (job.stats.outcome == ItemResult::SKIPPED) {
+        internal::metrics_record_item(job.stats);
+    } else {
+        internal::finish_item_result(job.item.input_path, job.item.output_path, job.status,
+                                     job.start_ns, job.stats);
+    }
+
+    JobResult result;
+    result.id = job.id;
+    result.item = job.stats;
+    result.error = job.error;
+
+    if (job.callback) {
+        try {
+            job.callback(result);
+        } catch (...) {
+            // A throwing callback must not take the encode thread down with it
+        }
+    }
+    job.promise.set_value(result);
+
+    std::lock_guard<std::mutex> lock(queue->pending_mutex);
+    if (--queue->pending == 0) {
+        queue->pending_done.notify_all();
+    }
+}
+
+JobQueue* create_job_queue(const JobQueueOptions& options) {
+    size_t threads = options.num_threads > 0
+        ? static_cast<size_t>(options.num_threads)
+        : std::max(1u, std::thread::hardware_concurrency());
+    size_t decode_threads = options.decode_threads > 0 ? static_cast<size_t>(options.decode_threads) : threads;
+    size_t resize_threads = options.resize_threads > 0 ? static_cast<size_t>(options.resize_threads) : threads;
+    size_t encode_threads = options.encode_threads > 0 ? static_cast<size_t>(options.encode_threads) : threads;
+    size_t capacity = std::max<size_t>(1, options.queue_capacity);
+
+    JobQueue* queue = new JobQueue(decode_threads, resize_threads, encode_threads, capacity);
+
+    for (size_t i = 0; i < decode_threads; ++i) {
+        internal::thread_pool_enqueue(queue->decode_pool, [queue]() {
+            JobPtr job;
+            while (queue->submitted.pop(job)) {
+                decode_job(*job);
+                queue->decoded.push(std::move(job));
+            }
+        });
+    }
+    for (size_t i = 0; i < resize_threads; ++i) {
+        internal::thread_pool_enqueue(queue->resize_pool, [queue]() {
+            JobPtr job;
+            while (queue->decoded.pop(job)) {
+                resize_job(*job);
+                queue->resized.push(std::move(job));
+            }
+        });
+    }
+    for (size_t i = 0; i < encode_threads; ++i) {
+        internal::thread_pool_enqueue(queue->encode_pool, [queue]() {
+            JobPtr job;
+            while (queue->resized.pop(job)) {
+                complete_job(queue, *job, queue->buffer_pool);
+                job.reset();
+            }
+        });
+    }
+
+    return queue;
+}
+
+void destroy_job_queue(JobQueue* queue) {
+    if (!queue) return;
+
+    // Each stage drains before the next one is told no more work is coming
+    queue->closed = true;
+    queue->submitted.set_done();
+    internal::thread_pool_wait(queue->decode_pool);
+    queue->decoded.set_done();
+    internal::thread_pool_wait(queue->resize_pool);
+    queue->resized.set_done();
+    internal::thread_pool_wait(queue->encode_pool);
+
+    internal::destroy_thread_pool(queue->decode_pool);
+    internal::destroy_thread_pool(queue->resize_pool);
+    internal::destroy_thread_pool(queue->encode_pool);
+    internal::destroy_buffer_pool(queue->buffer_pool);
+    delete queue;
+}
+
+static JobPtr make_job(const BatchItem& item, JobCallback callback) {
+    JobPtr job(new Job());
+    job->item = item;
+    job->callback = std::move(callback);
+    job->start_ns = internal::trace_now();
+    return job;
+}
+
+// Numbers a job and counts it as pending before it can complete
+static JobHandle accept_job(JobQueue* queue, Job& job) {
+    job.id = queue->next_id++;
+    std::lock_guard<std::mutex> lock(queue->pending_mutex);
+    ++queue->pending;
+
+    JobHandle handle;
+    handle.id = job.id;
+    handle.result = job.promise.get_future().share();
+    return handle;
+}
+
+// Undoes accept_job() for a job the submission queue turned away
+static void reject_job(JobQueue* queue) {
+    std::lock_guard<std::mutex> lock(queue->pending_mutex);
+    if (--queue->pending == 0) {
+        queue->pending_done.notify_all();
+    }
+}
+
+SubmitStatus try_submit_job(
+    JobQueue* queue,
+    const BatchItem& item,
+    JobHandle& handle,
+    JobCallback callback
+) {
+    if (queue->closed) {
+        return QUEUE_CLOSED;
+    }
+
+    JobPtr job = make_job(item, std::move(callback));
+    JobHandle accepted = accept_job(queue, *job);
+    if (!queue->submitted.try_push(std::move(job))) {
+        reject_job(queue);
+        return queue->closed ? QUEUE_CLOSED : QUEUE_FULL;
+    }
+
+    handle = accepted;
+    return SUBMITTED;
+}
+
+// Waits for room in the submission queue
+static JobHandle submit_prepared_job(JobQueue* queue, JobPtr job) {
+    if (queue->closed) {
+        return JobHandle();
+    }
+
+    JobHandle handle = accept_job(queue, *job);
+    if (!queue->submitted.push(std::move(job))) {
+        reject_job(queue);
+        return JobHandle();
+    }
+    return handle;
+}
+
+JobHandle submit_job(
+    JobQueue* queue,
+    const BatchItem& item,
+    JobCallback callback
+) {
+    return submit_prepared_job(queue, make_job(item, std::move(callback)));
+}
+
+void wait_job_queue(JobQueue* queue) {
+    std::unique_lock<std::mutex> lock(queue->pending_mutex);
+    queue->pending_done.wait(lock, [queue]() {
+        return queue->pending == 0;
+    });
+}
+
+// ============================================
+// Streaming Batches
+// ============================================
+
+class BatchSession {
+public:
+    BatchOptions options;
+    BatchItemCallback on_item;
+    internal::MemoryAccount account;
+    JobQueue* queue = nullptr;
+    internal::IncrementalBatch* incremental = nullptr;
+
+    std::mutex mutex;           // Guards result, stopped and on_item calls
+    BatchResult result;
+    size_t pushed = 0;
+    bool stopped = false;
+};
+
+static void record_session_item(BatchSession* session, size_t index, const std::string& input_path,
+                                const ItemResult& item, const std::string& error) {
+    std::lock_guard<std::mutex> lock(session->mutex);
+    BatchResult& result = session->result;
+    if (item.outcome == ItemResult::SKIPPED) {
+        result.skipped++;
+    } else if (item.outcome == ItemResult::FAILED) {
+        result.failed++;
+        result.errors.push_back(input_path + ": " + error);
+        if (session->options.stop_on_error) {
+            session->stopped = true;
+        }
+    } else {
+        result.success++;
+    }
+
+    if (session->on_item) {
+        session->on_item(index, item, error);
+    } else {
+        result.items[index] = item;
+    }
+}
+
+BatchSession* open_batch(const BatchOptions& batch_opts, BatchItemCallback on_item) {
+    BatchSession* session = new BatchSession();
+    session->options = batch_opts;
+    session->on_item = std::move(on_item);
+    session->result.total = 0;
+    session->result.success = 0;
+    session->result.failed = 0;
+
+    if (!batch_opts.trace_path.empty()) {
+        internal::trace_start();
+    }
+    if (batch_opts.incremental) {
+        session->incremental = internal::create_incremental_batch(batch_opts.manifest_path);
+    }
+
+    return session;
+}
+
+// Stage sizes as batch_resize_custom() would pick for a long batch of items
+// like first: the pipeline's for max_speed, otherwise num_threads in total
+static JobQueueOptions session_queue_options(const BatchOptions& batch_opts, const BatchItem& first) {
+    JobQueueOptions queue_opts;
+    if (batch_opts.max_speed) {
+        const ResizeOptions& options = first.options;
+        bool sized = options.target_width > 0 && options.target_height > 0;
+        queue_opts.decode_threads = 4;
+        queue_opts.resize_threads = 8;
+        queue_opts.encode_threads = static_cast<int>(internal::calculate_encode_threads({first}));
+        queue_opts.queue_capacity = internal::calculate_queue_capacity(
+            sized ? options.target_width : 2000, sized ? options.target_height : 2000);
+        return queue_opts;
+    }
+
+    // Each thread holds one image at a time, plus one waiting between stages
+    int threads = static_cast<int>(calculate_optimal_threads(SIZE_MAX, batch_opts.num_threads));
+    queue_opts.decode_threads = std::max(1, (threads + 2) / 3);
+    queue_opts.resize_threads = std::max(1, threads / 3);
+    queue_opts.encode_threads = std::max(1, (threads + 1) / 3);
+    queue_opts.queue_capacity = 1;
+    return queue_opts;
+}
+
+bool batch_push(BatchSession* session, const BatchItem& item) {
+    size_t index;
+    {
+        std::lock_guard<std::mutex> lock(session->mutex);
+        if (session->stopped) {
+            return false;
+        }
+        index = session->pushed++;
+        session->result.total++;
+        if (!session->on_item) {
+            session->result.items.emplace_back();
+        }
+    }
+
+    if (!session->queue) {
+        // Stage threads charge their buffers to the session
+        internal::MemoryAccountScope scope(&session->account);
+        session->queue = create_job_queue(session_queue_options(session->options, item));
+    }
+
+    std::string input_path = item.input_path;
+    JobPtr job = make_job(item, [session, index, input_path](const JobResult& result) {
+        record_session_item(session, index, input_path, result.item, result.error);
+    });
+    job->incremental = session->incremental;
+    submit_prepared_job(session->queue, std::move(job));
+    return true;
+}
+
+BatchResult close_batch(BatchSession* session) {
+    destroy_job_queue(session->queue);      // Null when nothing was pushed
+
+    BatchResult result = std::move(session->result);
+    if (session->incremental) {
+        if (!internal::finish_incremental_batch(session->incremental)) {
+            result.errors.push_back("Failed to write manifest: " + session->options.manifest_path);
+        }
+        internal::destroy_incremental_batch(session->incremental);
+    }
+    if (!session->options.trace_path.empty() && !internal::trace_stop(session->options.trace_path)) {
+        result.errors.push_back("Failed to write trace: " + get_last_error());
+    }
+
+    result.peak_memory_bytes = static_cast<uint64_t>(session->account.peak.load());
+    delete session;
+    return result;
+}
+
 }
@@ -0,0 +1,439 @@
+/*
+ * FastResize - The Fastest Image Resizing Library On The Planet
+ * Copyright (C) 2025 Tran Huu Canh (0xTh3OKrypt) and FastResize Contributors
+ *
+ * Resize 1,000 images in 2 seconds. Up to 2.9x faster than libvips,
+ * 3.1x faster than imageflow. Uses 3-4x less RAM than alternatives.
+ *
+ * Author: Tran Huu Canh (0xTh3OKrypt)
+ * Email: tranhuucanh39@gmail.com
+ * Homepage: https://github.com/tranhuucanh/fast_resize
+ *
+ * BSD 3-Clause License
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "internal.h"
+#include "trace.h"
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include <sys/stat.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#else
+#include <windows.h>
+#endif
+
+namespace fastresize {
+namespace internal {
+
+// ============================================
+// Content Hashing
+// ============================================
+
+// Change detection only, not a cryptographic hash: four independent
+// multiply-rotate lanes over 64-bit words and a murmur3 finalizer.
+
+static inline uint64_t hash_round(uint64_t h, uint64_t v) {
+    h ^= v * 0x9E3779B97F4A7C15ULL;
+    h = (h << 31) | (h >> 33);
+    return h * 0xC2B2AE3D27D4EB4FULL;
+}
+
+static inline uint64_t load_u64(const unsigned char* p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+uint64_t hash_bytes(const void* data, size_t size, uint64_t seed) {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    uint64_t lanes[4] = {
+        seed ^ 0x243F6A8885A308D3ULL, seed ^ 0x13198A2E03707344ULL,
+        seed ^ 0xA4093822299F31D0ULL, seed ^ 0x082EFA98EC4E6C89ULL
+    };
+
+    size_t remaining = size;
+    while (remaining >= 32) {
+        lanes[0] = hash_round(lanes[0], load_u64(p));
+        lanes[1] = hash_round(lanes[1], load_u64(p + 8));
+        lanes[2] = hash_round(lanes[2], load_u64(p + 16));
+        lanes[3] = hash_round(lanes[3], load_u64(p + 24));
+        p += 32;
+        remaining -= 32;
+    }
+
+    uint64_t h = hash_round(hash_round(lanes[0], lanes[1]), hash_round(lanes[2], lanes[3]));
+    while (remaining >= 8) {
+        h = hash_round(h, load_u64(p));
+        p += 8;
+        remaining -= 8;
+    }
+    if (remaining > 0) {
+        uint64_t tail = 0;
+        memcpy(&tail, p, remaining);
+        h = hash_round(h, tail);
+    }
+
+    h ^= size;
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+bool hash_file(const std::string& path, uint64_t& hash) {
+    FASTRESIZE_TRACE_SCOPE("hash");
+#ifdef _WIN32
+    FILE* fp = fopen(path.c_str(), "rb");
+    if (!fp) return false;
+
+    std::vector<unsigned char> bytes;
+    unsigned char buffer[65536];
+    size_t count;
+    while ((count = fread(buffer, 1, sizeof(buffer), fp)) > 0) {
+        bytes.insert(bytes.end(), buffer, buffer + count);
+    }
+    bool ok = !ferror(fp);
+    fclose(fp);
+    if (!ok) return false;
+
+    hash = hash_bytes(bytes.data(), bytes.size());
+    return true;
+#else
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return false;
+    }
+
+    if (st.st_size == 0) {
+        close(fd);
+        hash = hash_bytes(nullptr, 0);
+        return true;
+    }
+
+    void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return false;
+
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+    hash = hash_bytes(data, st.st_size);
+    munmap(data, st.st_size);
+    return true;
+#endif
+}
+
+// Every option that changes the output pixels or bytes. atomic_write and
+// overwrite_input only change how the file gets there.
+uint64_t hash_resize_options(const ResizeOptions& opts) {
+    int64_t fields[] = {
+        opts.mode, opts.target_width, opts.target_height, 0,
+        opts.keep_aspect_ratio, opts.auto_orient, opts.use_embedded_thumbnail, opts.no_enlarge,
+        opts.gravity, opts.background_color, opts.quality, opts.filter,
+        opts.webp_effort, opts.webp_lossless, opts.webp_near_lossless, opts.webp_alpha_quality,
+        opts.png_filter, opts.png_strategy, opts.png_window_bits, opts.png_mem_level
+    };
+
+    uint32_t scale_bits;
+    memcpy(&scale_bits, &opts.scale_percent, sizeof(scale_bits));
+    fields[3] = scale_bits;
+
+    return hash_bytes(fields, sizeof(fields));
+}
+
+// ============================================
+// Incremental Batches
+// ============================================
+
+// Without a manifest an output is current when it exists, is non-empty and
+// is not older than its input, like make; options are not compared, so a
+// re-run with new options skips the old outputs. A manifest records, per
+// output, the input's size, mtime and content hash and the options it was
+// written with. An unchanged size and mtime is trusted as is; otherwise the
+// input is hashed, so re-synced trees whose mtimes were touched are still
+// skipped.
+
+struct ManifestEntry {
+    uint64_t content_hash;
+    uint64_t options_hash;
+    int64_t input_size;
+    int64_t input_mtime;    // Nanoseconds
+};
+
+class IncrementalBatch {
+public:
+    std::string manifest_path;
+    std::unordered_map<std::string, ManifestEntry> entries;
+    std::unordered_map<std::string, ManifestEntry> pending;     // Outputs this run should write
+    std::unordered_map<std::string, ManifestEntry> refreshed;   // Current, but with a new mtime
+    int64_t start_time;     // Nanoseconds
+    std::mutex mutex;       // Guards pending and refreshed in keep_pending_item()
+};
+
+static const char* MANIFEST_HEADER = "fastresize-manifest 1";
+static const size_t INCREMENTAL_CHUNK = 256;
+
+static bool stat_file(const std::string& path, int64_t& size, int64_t& mtime) {
+#ifdef _WIN32
+    struct _stat64 st;
+    if (_stat64(path.c_str(), &st) != 0 || (st.st_mode & _S_IFMT) != _S_IFREG) return false;
+
+    size = st.st_size;
+    mtime = (int64_t)st.st_mtime * 1000000000LL;
+#else
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) return false;
+
+    size = st.st_size;
+#ifdef __APPLE__
+    mtime = (int64_t)st.st_mtimespec.tv_sec * 1000000000LL + st.st_mtimespec.tv_nsec;
+#else
+    mtime = (int64_t)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+#endif
+#endif
+    return true;
+}
+
+static void load_manifest(IncrementalBatch* batch) {
+    FILE* fp = fopen(batch->manifest_path.c_str(), "r");
+    if (!fp) return;
+
+    char line[8192];
+    if (!fgets(line, sizeof(line), fp) || strncmp(line, MANIFEST_HEADER, strlen(MANIFEST_HEADER)) != 0) {
+        fclose(fp);
+        return;
+    }
+
+    while (fgets(line, sizeof(line), fp)) {
+        ManifestEntry entry;
+        int path_offset = 0;
+        if (sscanf(line, "%" SCNx64 " %" SCNx64 " %" SCNd64 " %" SCNd64 " %n",
+                   &entry.content_hash, &entry.options_hash,
+                   &entry.input_size, &entry.input_mtime, &path_offset) != 4 || path_offset == 0) {
+            continue;
+        }
+
+        std::string output_path = line + path_offset;
+        while (!output_path.empty() && (output_path.back() == '\n' || output_path.back() == '\r')) {
+            output_path.pop_back();
+        }
+        if (!output_path.empty()) {
+            batch->entries[output_path] = entry;
+        }
+    }
+
+    fclose(fp);
+}
+
+static bool save_manifest(const IncrementalBatch* batch) {
+#ifdef _WIN32
+    unsigned long pid = GetCurrentProcessId();
+#else
+    unsigned long pid = static_cast<unsigned long>(getpid());
+#endif
+    std::string temp_path = batch->manifest_path + ".tmp-" + std::to_string(pid);
+    FILE* fp = fopen(temp_path.c_str(), "w");
+    if (!fp) return false;
+
+    fprintf(fp, "%s\n", MANIFEST_HEADER);
+    for (const auto& kv : batch->entries) {
+        const ManifestEntry& e = kv.second;
+        fprintf(fp, "%016" PRIx64 " %016" PRIx64 " %" PRId64 " %" PRId64 " %s\n",
+                e.content_hash, e.options_hash, e.input_size, e.input_mtime, kv.first.c_str());
+    }
+
+#ifdef _WIN32
+    bool ok = fclose(fp) == 0 &&
+              MoveFileExA(temp_path.c_str(), batch->manifest_path.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    bool ok = fclose(fp) == 0 && rename(temp_path.c_str(), batch->manifest_path.c_str()) == 0;
+#endif
+    if (!ok) remove(temp_path.c_str());
+    return ok;
+}
+
+IncrementalBatch* create_incremental_batch(const std::string& manifest_path) {
+    IncrementalBatch* batch = new IncrementalBatch();
+    batch->manifest_path = manifest_path;
+    batch->start_time = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+
+    if (!manifest_path.empty()) {
+        load_manifest(batch);
+    }
+
+    return batch;
+}
+
+void destroy_incremental_batch(IncrementalBatch* batch) {
+    delete batch;
+}
+
+enum ItemState {
+    ITEM_PENDING,
+    ITEM_CURRENT,
+    ITEM_REFRESHED      // Current by content hash; the recorded mtime is stale
+};
+
+struct ItemCheck {
+    ItemState state;
+    bool recordable;
+    ManifestEntry entry;
+};
+
+static void check_item(const IncrementalBatch* batch, const BatchItem& item, ItemCheck& check) {
+    check.state = ITEM_PENDING;
+    check.recordable = false;
+
+    int64_t input_size, input_mtime;
+    if (!stat_file(item.input_path, input_size, input_mtime)) return;   // Let processing report it
+
+    int64_t output_size, output_mtime;
+    bool have_output = stat_file(item.output_path, output_size, output_mtime) && output_size > 0;
+
+    if (batch->manifest_path.empty()) {
+        if (have_output && output_mtime >= input_mtime) check.state = ITEM_CURRENT;
+        return;
+    }
+
+    ManifestEntry& entry = check.entry;
+    entry.options_hash = hash_resize_options(item.options);
+    entry.input_size = input_size;
+    entry.input_mtime = input_mtime;
+
+    auto it = batch->entries.find(item.output_path);
+    bool comparable = have_output && it != batch->entries.end() &&
+                      it->second.options_hash == entry.options_hash &&
+                      it->second.input_size == input_size;
+
+    if (comparable && it->second.input_mtime == input_mtime) {
+        check.state = ITEM_CURRENT;
+        return;
+    }
+
+    if (!hash_file(item.input_path, entry.content_hash)) return;
+    check.recordable = true;
+
+    if (comparable && it->second.content_hash == entry.content_hash) {
+        check.state = ITEM_REFRESHED;
+    }
+}
+
+// Records what finish_incremental_batch() needs; true when the item must run
+static bool keep_checked_item(IncrementalBatch* batch, const BatchItem& item, const ItemCheck& check) {
+    if (check.state == ITEM_PENDING) {
+        if (check.recordable) batch->pending[item.output_path] = check.entry;
+        return true;
+    }
+    if (check.state == ITEM_REFRESHED) {
+        batch->refreshed[item.output_path] = check.entry;
+    }
+    return false;
+}
+
+bool keep_pending_item(IncrementalBatch* batch, const BatchItem& item) {
+    ItemCheck check;
+    check_item(batch, item, check);
+    std::lock_guard<std::mutex> lock(batch->mutex);
+    return keep_checked_item(batch, item, check);
+}
+
+size_t remove_current_items(IncrementalBatch* batch, std::vector<BatchItem>& items,
+                            size_t num_threads, std::vector<size_t>& positions) {
+    std::vector<ItemCheck> checks(items.size());
+
+    // stat() and hashing are I/O bound; chunks keep the task count low
+    ThreadPool* pool = create_thread_pool(num_threads > 0 ? num_threads : 1);
+    for (size_t start = 0; start < items.size(); start += INCREMENTAL_CHUNK) {
+        size_t end = std::min(start + INCREMENTAL_CHUNK, items.size());
+        thread_pool_enqueue(pool, [batch, &items, &checks, start, end]() {
+            for (size_t i = start; i < end; ++i) {
+                check_item(batch, items[i], checks[i]);
+            }
+        });
+    }
+    thread_pool_wait(pool);
+    destroy_thread_pool(pool);
+
+    size_t kept = 0;
+    positions.clear();
+    for (size_t i = 0; i < items.size(); ++i) {
+        if (keep_checked_item(batch, items[i], checks[i])) {
+            if (kept != i) items[kept] = std::move(items[i]);
+            positions.push_back(i);
+            ++kept;
+        }
+    }
+
+    size_t skipped = items.size() - kept;
+    items.resize(kept);
+    return skipped;
+}
+
+bool finish_incremental_batch(IncrementalBatch* batch) {
+    if (batch->manifest_path.empty()) return true;
+
+    // Outputs rewritten during this run; whole seconds tolerate coarse
+    // filesystem timestamps
+    int64_t written_after = batch->start_time / 1000000000LL * 1000000000LL;
+    size_t updates = batch->refreshed.size();
+
+    for (const auto& kv : batch->pending) {
+        int64_t output_size, output_mtime;
+        if (stat_file(kv.first, output_size, output_mtime) && output_size > 0 &&
+            output_mtime >= written_after) {
+            batch->entries[kv.first] = kv.second;
+            ++updates;
+        }
+    }
+
+    for (const auto& kv : batch->refreshed) {
+        batch->entries[kv.first] = kv.second;
+    }
+
+    if (updates == 0) return true;
+    return save_manifest(batch);
+}
+
+}
+}
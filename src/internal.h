@@ -42,7 +42,11 @@
 #define FASTRESIZE_INTERNAL_H
 
 #include <fastresize.h>
+#include <atomic>
+#include <cstdint>
+#include <memory>
 #include <string>
+#include <vector>
 #include <functional>
 
 namespace fastresize {
@@ -50,6 +54,7 @@ namespace internal {
 
 class ThreadPool;
 class BufferPool;
+class IncrementalBatch;
 
 enum ImageFormat {
     FORMAT_UNKNOWN,
@@ -68,13 +73,96 @@ struct ImageData {
     int width;
     int height;
     int channels;
+    int orientation = 1;    // EXIF orientation 1-8 of the stored pixels
+
+    // Planar YCbCr straight from the JPEG decoder: planes[] point into
+    // pixels, chroma planes are chroma_width x chroma_height.
+    bool planar = false;
+    unsigned char* planes[3] = { nullptr, nullptr, nullptr };
+    int strides[3] = { 0, 0, 0 };
+    int chroma_width = 0;
+    int chroma_height = 0;
+};
+
+// Point planes[] at tightly packed Y, Cb and Cr planes inside pixels.
+inline void set_planar_layout(ImageData& data, int chroma_width, int chroma_height) {
+    size_t luma_size = static_cast<size_t>(data.width) * data.height;
+    size_t chroma_size = static_cast<size_t>(chroma_width) * chroma_height;
+    data.planar = true;
+    data.chroma_width = chroma_width;
+    data.chroma_height = chroma_height;
+    data.planes[0] = data.pixels;
+    data.planes[1] = data.pixels + luma_size;
+    data.planes[2] = data.pixels + luma_size + chroma_size;
+    data.strides[0] = data.width;
+    data.strides[1] = chroma_width;
+    data.strides[2] = chroma_width;
+}
+
+// When decode_image may return a YCbCr JPEG as planes
+enum PlanarDecode {
+    PLANAR_NONE,        // Always interleaved
+    PLANAR_SUBSAMPLED,  // Only while chroma stays subsampled at the decode scale
+    PLANAR_ALWAYS       // Any YCbCr JPEG
 };
 
-ImageData decode_image(const std::string& path, ImageFormat format, int target_width = 0, int target_height = 0);
+// EXIF orientations 5-8 store the image transposed
+inline bool orientation_swaps_axes(int orientation) {
+    return orientation >= 5 && orientation <= 8;
+}
+
+// use_thumbnail: decode the JPEG's embedded EXIF thumbnail instead when it
+// covers target_width x target_height at the same aspect ratio.
+// planar: whether YCbCr JPEGs may come back as planes (ImageData::planar);
+// other inputs are always interleaved.
+ImageData decode_image(const std::string& path, ImageFormat format, int target_width = 0, int target_height = 0,
+                       bool use_thumbnail = false, PlanarDecode planar = PLANAR_NONE);
 void free_image_data(ImageData& data);
-bool get_image_dimensions(const std::string& path, int& width, int& height, int& channels);
+// The restart-marker JPEG decoder behind decode_image(), cut into at most
+// strip_count strips whatever the image size and core count. No pixels when
+// the file has no restart layout it can split.
+ImageData decode_jpeg_strips(const std::string& path, int target_width, int target_height, size_t strip_count);
+bool get_image_dimensions(const std::string& path, int& width, int& height, int& channels, int* orientation = nullptr);
+
+// Encodes into memory (pooled when buffer_pool is given) and writes the file
+// in one go; ResizeOptions supplies quality and the write mode.
+bool encode_image(const std::string& path, const ImageData& data, ImageFormat format,
+                  const ResizeOptions& opts, BufferPool* buffer_pool = nullptr);
 
-bool encode_image(const std::string& path, const ImageData& data, ImageFormat format, int quality, BufferPool* buffer_pool = nullptr);
+// The parallel PNG writer behind encode_image() with the number of deflate
+// strips forced (at least 2), whatever the image size and core count.
+bool encode_png_strips(const ImageData& data, const ResizeOptions& opts, size_t strip_count,
+                       std::vector<unsigned char>& png);
+
+// Byte copy of input_path (reflink or in-kernel copy where available), for
+// operations that would reproduce the source image
+bool copy_image_file(const std::string& input_path, const std::string& output_path, bool atomic);
+
+// enable_output_cache(). output_cache_key() is false while the cache is off.
+struct OutputCacheKey {
+    uint64_t content = 0;
+    uint64_t options = 0;
+    ImageFormat format = FORMAT_UNKNOWN;    // FORMAT_UNKNOWN: nothing to store
+};
+
+bool output_cache_key(const std::string& input_path, ImageFormat output_format,
+                      const ResizeOptions& opts, OutputCacheKey& key);
+bool output_cache_fetch(const OutputCacheKey& key, const std::string& output_path, bool atomic);
+void output_cache_store(const OutputCacheKey& key, const std::string& output_path);
+
+// enable_decode_cache(). find returns a decode of path at a JPEG DCT scale
+// of at most scale, i.e. at least as large as requested. insert takes over
+// data's pixels and returns them shared, cached while the cache is on.
+std::shared_ptr<const ImageData> decode_cache_find(const std::string& path, int scale, PlanarDecode planar);
+std::shared_ptr<const ImageData> decode_cache_insert(const std::string& path, int scale, ImageData& data);
+
+// Same size and format with no EXIF rotation to bake in: decoding and
+// re-encoding would only lose quality. Sizes are in display orientation.
+inline bool is_identity_resize(ImageFormat input_format, ImageFormat output_format, int exif_orientation,
+                               int in_w, int in_h, int out_w, int out_h) {
+    return input_format == output_format && exif_orientation == 1 &&
+           in_w == out_w && in_h == out_h;
+}
 
 void calculate_dimensions(
     int in_w, int in_h,
@@ -82,26 +170,236 @@ void calculate_dimensions(
     int& out_w, int& out_h
 );
 
+// Size the whole source is scaled to before COVER cropping or CONTAIN padding.
+// Used as the decoder's downscale hint.
+void calculate_decode_target(
+    int in_w, int in_h,
+    const ResizeOptions& opts,
+    int& target_w, int& target_h
+);
+
+// Source rectangle read by the resize kernels and the destination rectangle
+// they write inside the output. Pixels outside the destination are padding.
+struct ResizeWindow {
+    int src_x, src_y, src_w, src_h;
+    int dst_x, dst_y, dst_w, dst_h;
+};
+
+void calculate_window(
+    int in_w, int in_h,
+    int out_w, int out_h,
+    const ResizeOptions& opts,
+    ResizeWindow& win
+);
+
+// output_w/output_h are in display orientation; the kernels write the stored
+// pixels straight into their rotated/mirrored positions.
 bool resize_image(
     const unsigned char* input_pixels,
     int input_w, int input_h, int channels,
     unsigned char** output_pixels,
     int output_w, int output_h,
-    const ResizeOptions& opts
+    const ResizeOptions& opts,
+    int orientation = 1
 );
 
+// DCT scale (1, 2, 4 or 8) libjpeg decodes at for a decode target
+inline int jpeg_decode_scale(int image_w, int image_h, int target_w, int target_h) {
+    int scale_factor = 1;
+    if (target_w > 0 && target_w < image_w) {
+        scale_factor = image_w / target_w;
+    } else if (target_h > 0 && target_h < image_h) {
+        scale_factor = image_h / target_h;
+    }
+    return scale_factor >= 8 ? 8 : scale_factor >= 4 ? 4 : scale_factor >= 2 ? 2 : 1;
+}
+
+// Stored source width over the width of the image a resize actually used:
+// the DCT scale it was decoded at (a cached decode may be larger than the
+// plan asked for), or more for an embedded thumbnail. 0 when unknown.
+inline int decoded_scale(int source_w, const ImageData& image) {
+    if (source_w <= 0 || image.width <= 0) return 0;
+    int scale = (source_w + image.width / 2) / image.width;
+    return scale > 1 ? scale : 1;
+}
+
+// Planar resizing needs no orientation transform and no padding. JPEG output
+// then stays YCbCr end to end; other outputs only gain while chroma is still
+// subsampled.
+inline PlanarDecode choose_planar_decode(ImageFormat input_format, ImageFormat output_format,
+                                         const ResizeOptions& opts, int orientation) {
+    if (input_format != FORMAT_JPEG || orientation != 1 || opts.mode == ResizeOptions::CONTAIN) {
+        return PLANAR_NONE;
+    }
+    return output_format == FORMAT_JPEG ? PLANAR_ALWAYS : PLANAR_SUBSAMPLED;
+}
+
+// Resize a planar YCbCr image plane by plane, reading chroma at its native
+// subsampled resolution. With keep_planar the output is planar 4:2:0 for
+// encode_jpeg; otherwise it is converted to interleaved RGB.
+bool resize_planar(
+    const ImageData& input,
+    ImageData& output,
+    int output_w, int output_h,
+    const ResizeOptions& opts,
+    bool keep_planar = false
+);
+
+// Per-item stages shared by resize(), the batch workers, the max_speed
+// pipeline and job queues (fastresize.cpp). Each sets the thread's last
+// error when it fails.
+
+bool validate_options(const ResizeOptions& opts);
+
+// Everything decided from the image header, before any pixels are decoded
+struct ItemPlan {
+    ImageFormat input_format;
+    ImageFormat output_format;
+    int orientation;            // Applied EXIF orientation (1 without auto_orient)
+    int source_w, source_h;     // Stored orientation
+    int output_w, output_h;
+    int decode_w, decode_h;     // Stored orientation, like the decoder's result
+    int scale;                  // JPEG DCT scale the decoder picks, 1 for other formats
+    PlanarDecode planar;
+    bool identity;
+    OutputCacheKey cache_key;
+};
+
+// FORMAT_UNKNOWN as output_format keeps the input's format
+bool plan_item(const std::string& input_path, ImageFormat output_format,
+               const ResizeOptions& options, ItemPlan& plan);
+void record_plan(const ItemPlan& plan, ItemResult& stats);
+
+// Identity copies and output cache hits need no decode. Sets *done when the
+// item was handled that way.
+bool resize_without_decode(const std::string& input_path, const std::string& output_path,
+                           const ResizeOptions& options, ItemPlan& plan, ItemResult& stats, bool* done);
+
+// Decodes the source of plan at target_w x target_h; items sharing one
+// decode pass the largest of their targets, which keeps plan.scale. Goes
+// through the decode cache unless options allow an embedded thumbnail.
+bool decode_planned_source(const std::string& input_path, const ResizeOptions& options,
+                           const ItemPlan& plan, int target_w, int target_h,
+                           std::shared_ptr<const ImageData>& source);
+
+// A planned item of one source waiting for its decode
+struct SharedDecodeItem {
+    const ItemPlan* plan;
+    const ResizeOptions* options;
+    ItemResult* stats;
+};
+
+// Decodes the source of pending items, once for each set of items the
+// decoder would give the same image (same scale and layout), at the largest
+// of their targets. Embedded-thumbnail items decode on their own. Sets
+// decode_us and decode_scale, then calls decoded with the indexes into
+// pending of each set and its source, null when the decode failed.
+void decode_shared_source(
+    const std::string& input_path,
+    const std::vector<SharedDecodeItem>& pending,
+    const std::function<void(const std::vector<size_t>&, const std::shared_ptr<const ImageData>&)>& decoded);
+
+// Resize stage of an item; input_data may be shared with other items of
+// the same source and is left untouched. The output goes to encode_resized().
+bool resize_decoded_pixels(const ImageData& input_data, const ResizeOptions& options,
+                           const ItemPlan& plan, ImageData& output_data, ItemResult& stats);
+
+// Encode stage of an item; frees the resized pixels
+bool encode_resized(ImageData& output_data, const std::string& output_path, const ResizeOptions& options,
+                    const ItemPlan& plan, BufferPool* buffer_pool, ItemResult& stats);
+
+// Reference for compare_resize(): separable double-precision resample of
+// the full-resolution src with opts' filter (never swapped for large
+// downscales), window and padding. out_w/out_h are in display orientation.
+std::vector<unsigned char> reference_resize(const ImageData& src, int orientation,
+                                            int out_w, int out_h, const ResizeOptions& opts);
+
+// PSNR, SSIM and max error of two interleaved images of the same layout
+void measure_quality(const unsigned char* a, const unsigned char* b,
+                     int width, int height, int channels, QualityReport& report);
+
 void set_last_error(ErrorCode code, const std::string& message);
+// The last error set on the calling thread. Batch workers report these, as
+// the process-wide error may already belong to another item.
+ErrorCode thread_last_error_code();
+std::string thread_last_error();
+
+// Completes a batch item's ItemResult once it has finished or failed with
+// status: outcome, file sizes and total time since start_ns (trace_now()).
+void finish_item_result(const std::string& input_path, const std::string& output_path,
+                        ErrorCode status, uint64_t start_ns, ItemResult& item);
 
 ThreadPool* create_thread_pool(size_t num_threads);
 void destroy_thread_pool(ThreadPool* pool);
 void thread_pool_enqueue(ThreadPool* pool, std::function<void()> task);
 void thread_pool_wait(ThreadPool* pool);
+// Runs task(0) .. task(count - 1) on pool and waits for those tasks only.
+void thread_pool_run(ThreadPool* pool, size_t count, const std::function<void(size_t)>& task);
+// Process-wide pool for splitting one image into strips (parallel JPEG
+// decode, PNG encode). Started on first use so callers don't start and
+// join threads per image.
+ThreadPool* shared_strip_pool();
+// True on threads owned by a ThreadPool; used to avoid nesting pools.
+bool thread_pool_is_worker();
 
 BufferPool* create_buffer_pool();
 void destroy_buffer_pool(BufferPool* pool);
 unsigned char* buffer_pool_acquire(BufferPool* pool, size_t size);
 void buffer_pool_release(BufferPool* pool, unsigned char* buffer, size_t capacity);
 
+// Pixel buffer accounting (memory.cpp). Every decoded image, resize output,
+// conversion scratch and encode buffer comes from alloc_pixels() and goes
+// back through free_pixels(), which keeps the process-wide figures of
+// get_memory_stats(). Buffers are also charged to the MemoryAccount current
+// on the allocating thread, if any, and remember it, so they may be freed on
+// any thread. Thread pools carry the account over to their tasks.
+struct MemoryAccount {
+    std::atomic<int64_t> current{0};
+    std::atomic<int64_t> peak{0};
+};
+
+unsigned char* alloc_pixels(size_t size);
+void free_pixels(unsigned char* pixels);
+// Uncharges a buffer from its account; for buffers that outlive the batch
+// (decode cache entries). It still counts process-wide.
+void detach_pixels(unsigned char* pixels);
+// Memory a library allocates for us (libwebp pictures): +bytes once
+// allocated, -bytes once freed, on the same thread
+void track_external_memory(int64_t bytes);
+
+MemoryAccount* current_memory_account();
+
+class MemoryAccountScope {
+public:
+    explicit MemoryAccountScope(MemoryAccount* account);
+    ~MemoryAccountScope();
+
+    MemoryAccountScope(const MemoryAccountScope&) = delete;
+    MemoryAccountScope& operator=(const MemoryAccountScope&) = delete;
+
+private:
+    MemoryAccount* previous_;
+};
+
+// Fast non-cryptographic 64-bit hashes for change detection
+uint64_t hash_bytes(const void* data, size_t size, uint64_t seed = 0);
+bool hash_file(const std::string& path, uint64_t& hash);
+uint64_t hash_resize_options(const ResizeOptions& opts);
+
+// BatchOptions::incremental. An empty manifest_path compares output and
+// input mtimes; otherwise the manifest is loaded here and updated by
+// finish_incremental_batch() for the outputs this run wrote.
+IncrementalBatch* create_incremental_batch(const std::string& manifest_path);
+void destroy_incremental_batch(IncrementalBatch* batch);
+// Drops the items whose output is current; returns how many were dropped.
+// positions receives the original index of each item that is kept.
+size_t remove_current_items(IncrementalBatch* batch, std::vector<BatchItem>& items,
+                            size_t num_threads, std::vector<size_t>& positions);
+// One item at a time, for streaming batches; false when its output is
+// current. Safe to call from several threads at once.
+bool keep_pending_item(IncrementalBatch* batch, const BatchItem& item);
+bool finish_incremental_batch(IncrementalBatch* batch);
+
 }
 }
 
@@ -0,0 +1,130 @@
+/*
+ * FastResize - The Fastest Image Resizing Library On The Planet
+ * Copyright (C) 2025 Tran Huu Canh (0xTh3OKrypt) and FastResize Contributors
+ *
+ * Resize 1,000 images in 2 seconds. Up to 2.9x faster than libvips,
+ * 3.1x faster than imageflow. Uses 3-4x less RAM than alternatives.
+ *
+ * Author: Tran Huu Canh (0xTh3OKrypt)
+ * Email: tranhuucanh39@gmail.com
+ * Homepage: https://github.com/tranhuucanh/fast_resize
+ *
+ * BSD 3-Clause License
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "internal.h"
+#include <new>
+
+namespace fastresize {
+namespace internal {
+
+// ============================================
+// Pixel Buffer Accounting
+// ============================================
+
+// Precedes every buffer from alloc_pixels(); keeps the pixels 16-byte aligned
+struct alignas(16) PixelHeader {
+    size_t size;
+    MemoryAccount* account;
+};
+
+static std::atomic<int64_t> g_current_bytes(0);
+static std::atomic<int64_t> g_peak_bytes(0);
+static thread_local MemoryAccount* t_account = nullptr;
+
+static void raise_peak(std::atomic<int64_t>& peak, int64_t value) {
+    int64_t seen = peak.load(std::memory_order_relaxed);
+    while (value > seen && !peak.compare_exchange_weak(seen, value, std::memory_order_relaxed)) {
+    }
+}
+
+static void charge(MemoryAccount* account, int64_t bytes) {
+    raise_peak(g_peak_bytes, g_current_bytes.fetch_add(bytes, std::memory_order_relaxed) + bytes);
+    if (account) {
+        raise_peak(account->peak, account->current.fetch_add(bytes, std::memory_order_relaxed) + bytes);
+    }
+}
+
+unsigned char* alloc_pixels(size_t size) {
+    PixelHeader* header = static_cast<PixelHeader*>(::operator new(sizeof(PixelHeader) + size));
+    header->size = size;
+    header->account = t_account;
+    charge(t_account, static_cast<int64_t>(size));
+    return reinterpret_cast<unsigned char*>(header + 1);
+}
+
+void free_pixels(unsigned char* pixels) {
+    if (!pixels) return;
+    PixelHeader* header = reinterpret_cast<PixelHeader*>(pixels) - 1;
+    charge(header->account, -static_cast<int64_t>(header->size));
+    ::operator delete(header);
+}
+
+void detach_pixels(unsigned char* pixels) {
+    if (!pixels) return;
+    PixelHeader* header = reinterpret_cast<PixelHeader*>(pixels) - 1;
+    if (header->account) {
+        header->account->current.fetch_sub(static_cast<int64_t>(header->size), std::memory_order_relaxed);
+        header->account = nullptr;
+    }
+}
+
+void track_external_memory(int64_t bytes) {
+    charge(t_account, bytes);
+}
+
+MemoryAccount* current_memory_account() {
+    return t_account;
+}
+
+MemoryAccountScope::MemoryAccountScope(MemoryAccount* account)
+    : previous_(t_account)
+{
+    t_account = account;
+}
+
+MemoryAccountScope::~MemoryAccountScope() {
+    t_account = previous_;
+}
+
+}
+
+MemoryStats get_memory_stats() {
+    MemoryStats stats;
+    stats.current_bytes = static_cast<uint64_t>(internal::g_current_bytes.load(std::memory_order_relaxed));
+    stats.peak_bytes = static_cast<uint64_t>(internal::g_peak_bytes.load(std::memory_order_relaxed));
+    return stats;
+}
+
+void reset_peak_memory() {
+    internal::g_peak_bytes.store(internal::g_current_bytes.load(std::memory_order_relaxed),
+                                 std::memory_order_relaxed);
+}
+
+}
@@ -0,0 +1,289 @@
+/*
+ * FastResize - The Fastest Image Resizing Library On The Planet
+ * Copyright (C) 2025 Tran Huu Canh (0xTh3OKrypt) and FastResize Contributors
+ *
+ * Resize 1,000 images in 2 seconds. Up to 2.9x faster than libvips,
+ * 3.1x faster than imageflow. Uses 3-4x less RAM than alternatives.
+ *
+ * Author: Tran Huu Canh (0xTh3OKrypt)
+ * Email: tranhuucanh39@gmail.com
+ * Homepage: https://github.com/tranhuucanh/fast_resize
+ *
+ * BSD 3-Clause License
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "metrics.h"
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace fastresize {
+namespace internal {
+
+// ============================================
+// Per-Thread Blocks
+// ============================================
+
+// Latency buckets double from 8 us to ~33.5 s, so every bucket has the same
+// relative width; the last slot holds anything slower.
+static const int HISTOGRAM_MIN_SHIFT = 3;
+static const int HISTOGRAM_BOUNDS = 23;
+
+struct HistogramCells {
+    std::atomic<uint64_t> buckets[HISTOGRAM_BOUNDS + 1];
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> sum_ns;
+};
+
+// Written only by the owning thread; relaxed loads and stores are enough
+// for other threads to read it
+struct MetricsBlock {
+    std::atomic<uint64_t> counters[COUNTER_COUNT];
+    HistogramCells histograms[HISTOGRAM_COUNT];
+
+    MetricsBlock() {
+        for (std::atomic<uint64_t>& counter : counters) counter.store(0, std::memory_order_relaxed);
+        for (HistogramCells& histogram : histograms) {
+            for (std::atomic<uint64_t>& bucket : histogram.buckets) bucket.store(0, std::memory_order_relaxed);
+            histogram.count.store(0, std::memory_order_relaxed);
+            histogram.sum_ns.store(0, std::memory_order_relaxed);
+        }
+    }
+};
+
+// Plain totals, for summing blocks and keeping those of exited threads
+struct MetricsTotals {
+    uint64_t counters[COUNTER_COUNT] = {};
+    uint64_t buckets[HISTOGRAM_COUNT][HISTOGRAM_BOUNDS + 1] = {};
+    uint64_t count[HISTOGRAM_COUNT] = {};
+    uint64_t sum_ns[HISTOGRAM_COUNT] = {};
+
+    void add(const MetricsBlock& block) {
+        for (int c = 0; c < COUNTER_COUNT; ++c) {
+            counters[c] += block.counters[c].load(std::memory_order_relaxed);
+        }
+        for (int h = 0; h < HISTOGRAM_COUNT; ++h) {
+            const HistogramCells& cells = block.histograms[h];
+            for (int b = 0; b <= HISTOGRAM_BOUNDS; ++b) {
+                buckets[h][b] += cells.buckets[b].load(std::memory_order_relaxed);
+            }
+            count[h] += cells.count.load(std::memory_order_relaxed);
+            sum_ns[h] += cells.sum_ns.load(std::memory_order_relaxed);
+        }
+    }
+};
+
+static std::mutex g_metrics_mutex;
+static std::vector<MetricsBlock*> g_metrics_blocks;
+static MetricsTotals g_metrics_exited;
+
+// Registers on first use; folds into g_metrics_exited when the thread exits,
+// so pools created per batch don't leave blocks behind
+class ThreadMetrics {
+public:
+    MetricsBlock& block() {
+        if (!block_) {
+            block_.reset(new MetricsBlock());
+            std::lock_guard<std::mutex> lock(g_metrics_mutex);
+            g_metrics_blocks.push_back(block_.get());
+        }
+        return *block_;
+    }
+
+    ~ThreadMetrics() {
+        if (!block_) return;
+        std::lock_guard<std::mutex> lock(g_metrics_mutex);
+        g_metrics_exited.add(*block_);
+        for (size_t i = 0; i < g_metrics_blocks.size(); ++i) {
+            if (g_metrics_blocks[i] == block_.get()) {
+                g_metrics_blocks.erase(g_metrics_blocks.begin() + i);
+                break;
+            }
+        }
+    }
+
+private:
+    std::unique_ptr<MetricsBlock> block_;
+};
+
+static thread_local ThreadMetrics t_metrics;
+
+static void bump(std::atomic<uint64_t>& cell, uint64_t value) {
+    cell.store(cell.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+static int histogram_bucket(uint64_t ns) {
+    uint64_t us = (ns + 999) / 1000;
+    if (us <= (1u << HISTOGRAM_MIN_SHIFT)) return 0;
+
+    int bucket = 1;
+    while (bucket < HISTOGRAM_BOUNDS && us > (1ull << (bucket + HISTOGRAM_MIN_SHIFT))) {
+        ++bucket;
+    }
+    return bucket;
+}
+
+void metrics_add(Counter counter, uint64_t value) {
+    bump(t_metrics.block().counters[counter], value);
+}
+
+void metrics_observe(Histogram histogram, uint64_t ns) {
+    HistogramCells& cells = t_metrics.block().histograms[histogram];
+    bump(cells.buckets[histogram_bucket(ns)], 1);
+    bump(cells.count, 1);
+    bump(cells.sum_ns, ns);
+}
+
+void metrics_record_item(const ItemResult& item) {
+    MetricsBlock& block = t_metrics.block();
+    bump(block.counters[outcome_counter(item.outcome)], 1);
+    bump(block.counters[COUNTER_BYTES_READ], item.bytes_read);
+    bump(block.counters[COUNTER_BYTES_WRITTEN], item.bytes_written);
+
+    for (int i = 0; i < 4; ++i) {
+        if (item.decode_scale == (1 << i)) {
+            bump(block.counters[COUNTER_DECODE_SCALE + i], 1);
+        }
+    }
+}
+
+// ============================================
+// Prometheus Text Exposition
+// ============================================
+
+static const char* const OUTCOME_LABELS[] = {"not_run", "resized", "copied", "cached", "skipped", "failed"};
+static const char* const FORMAT_LABELS[] = {"unknown", "jpeg", "png", "webp", "bmp"};
+static const char* const FILTER_LABELS[] = {"mitchell", "catmull_rom", "box", "triangle"};
+static const char* const QUEUE_LABELS[] = {"queue=\"decoded\",op=\"push\"", "queue=\"decoded\",op=\"pop\"",
+                                           "queue=\"resized\",op=\"push\"", "queue=\"resized\",op=\"pop\"",
+                                           "queue=\"submitted\",op=\"push\"", "queue=\"submitted\",op=\"pop\""};
+
+// Shortest decimal form: 0.000008, 0.5, 33.554432
+static std::string format_seconds(double seconds) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.9f", seconds);
+    std::string text(buf);
+    text.erase(text.find_last_not_of('0') + 1);
+    if (text.back() == '.') text.pop_back();
+    return text;
+}
+
+static void append_line(std::string& out, const std::string& name, const std::string& labels, uint64_t value) {
+    out += name;
+    if (!labels.empty()) out += "{" + labels + "}";
+    out += " " + std::to_string(value) + "\n";
+}
+
+static void append_header(std::string& out, const char* name, const char* type, const char* help) {
+    out += std::string("# HELP ") + name + " " + help + "\n";
+    out += std::string("# TYPE ") + name + " " + type + "\n";
+}
+
+// One series per label value that has observations
+static void append_histogram(std::string& out, const MetricsTotals& totals, const char* name,
+                             const char* help, Histogram first, const char* label,
+                             const char* const* values, int value_count) {
+    append_header(out, name, "histogram", help);
+    for (int v = 0; v < value_count; ++v) {
+        int h = first + v;
+        if (totals.count[h] == 0) continue;
+
+        std::string labels = label ? std::string(label) + "=\"" + values[v] + "\"" : values[v];
+        uint64_t cumulative = 0;
+        for (int b = 0; b < HISTOGRAM_BOUNDS; ++b) {
+            cumulative += totals.buckets[h][b];
+            double bound = static_cast<double>(1u << (b + HISTOGRAM_MIN_SHIFT)) / 1e6;
+            append_line(out, std::string(name) + "_bucket", labels + ",le=\"" + format_seconds(bound) + "\"",
+                        cumulative);
+        }
+        append_line(out, std::string(name) + "_bucket", labels + ",le=\"+Inf\"", totals.count[h]);
+        out += std::string(name) + "_sum{" + labels + "} " + format_seconds(totals.sum_ns[h] / 1e9) + "\n";
+        append_line(out, std::string(name) + "_count", labels, totals.count[h]);
+    }
+}
+
+} // namespace internal
+
+std::string metrics_text() {
+    using namespace internal;
+
+    MetricsTotals totals;
+    {
+        std::lock_guard<std::mutex> lock(g_metrics_mutex);
+        totals = g_metrics_exited;
+        for (const MetricsBlock* block : g_metrics_blocks) {
+            totals.add(*block);
+        }
+    }
+
+    std::string out;
+    append_header(out, "fastresize_images_total", "counter", "Images processed, by outcome.");
+    for (int o = ItemResult::RESIZED; o <= ItemResult::FAILED; ++o) {
+        append_line(out, "fastresize_images_total", std::string("outcome=\"") + OUTCOME_LABELS[o] + "\"",
+                    totals.counters[COUNTER_IMAGES + o]);
+    }
+
+    append_header(out, "fastresize_read_bytes_total", "counter", "Input file bytes of processed images.");
+    append_line(out, "fastresize_read_bytes_total", "", totals.counters[COUNTER_BYTES_READ]);
+    append_header(out, "fastresize_written_bytes_total", "counter", "Output file bytes written.");
+    append_line(out, "fastresize_written_bytes_total", "", totals.counters[COUNTER_BYTES_WRITTEN]);
+
+    append_header(out, "fastresize_decode_scale_total", "counter",
+                  "Decodes by JPEG DCT scale denominator; other formats decode at 1.");
+    for (int i = 0; i < 4; ++i) {
+        append_line(out, "fastresize_decode_scale_total", "scale=\"" + std::to_string(1 << i) + "\"",
+                    totals.counters[COUNTER_DECODE_SCALE + i]);
+    }
+
+    append_header(out, "fastresize_resize_path_total", "counter",
+                  "Resizes by the SIMD kernels or stb_image_resize2.");
+    append_line(out, "fastresize_resize_path_total", "path=\"simd\"", totals.counters[COUNTER_RESIZE_SIMD]);
+    append_line(out, "fastresize_resize_path_total", "path=\"stbir\"", totals.counters[COUNTER_RESIZE_STBIR]);
+
+    append_histogram(out, totals, "fastresize_decode_seconds", "Decode time by input format.",
+                     HISTOGRAM_DECODE, "format", FORMAT_LABELS, FORMAT_BMP + 1);
+    append_histogram(out, totals, "fastresize_resize_seconds", "Resize time by filter.",
+                     HISTOGRAM_RESIZE, "filter", FILTER_LABELS, ResizeOptions::TRIANGLE + 1);
+    append_histogram(out, totals, "fastresize_encode_seconds", "Encode and write time by output format.",
+                     HISTOGRAM_ENCODE, "format", FORMAT_LABELS, FORMAT_BMP + 1);
+    append_histogram(out, totals, "fastresize_queue_wait_seconds",
+                     "Time max_speed pipeline and job queue stages block on their queues.",
+                     HISTOGRAM_QUEUE_WAIT, nullptr, QUEUE_LABELS, 6);
+
+    MemoryStats memory = get_memory_stats();
+    append_header(out, "fastresize_pixel_memory_bytes", "gauge", "Bytes held in pixel buffers.");
+    append_line(out, "fastresize_pixel_memory_bytes", "", memory.current_bytes);
+    append_header(out, "fastresize_pixel_memory_peak_bytes", "gauge", "Most bytes held in pixel buffers.");
+    append_line(out, "fastresize_pixel_memory_peak_bytes", "", memory.peak_bytes);
+
+    return out;
+}
+
+} // namespace fastresize
@@ -0,0 +1,130 @@
+/*
+ * FastResize - The Fastest Image Resizing Library On The Planet
+ * Copyright (C) 2025 Tran Huu Canh (0xTh3OKrypt) and FastResize Contributors
+ *
+ * Resize 1,000 images in 2 seconds. Up to 2.9x faster than libvips,
+ * 3.1x faster than imageflow. Uses 3-4x less RAM than alternatives.
+ *
+ * Author: Tran Huu Canh (0xTh3OKrypt)
+ * Email: tranhuucanh39@gmail.com
+ * Homepage: https://github.com/tranhuucanh/fast_resize
+ *
+ * BSD 3-Clause License
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef FASTRESIZE_METRICS_H
+#define FASTRESIZE_METRICS_H
+
+#include "internal.h"
+#include "trace.h"
+#include <cstdint>
+
+namespace fastresize {
+namespace internal {
+
+// Process-wide counters and latency histograms behind metrics_text(). Each
+// thread writes its own block without locks or atomic read-modify-writes;
+// metrics_text() sums the blocks of live threads and the totals of exited
+// ones.
+
+enum Counter {
+    COUNTER_IMAGES,             // + ItemResult::Outcome
+    COUNTER_BYTES_READ = COUNTER_IMAGES + ItemResult::FAILED + 1,
+    COUNTER_BYTES_WRITTEN,
+    COUNTER_DECODE_SCALE,       // + log2 of the JPEG DCT scale (1, 2, 4, 8)
+    COUNTER_RESIZE_SIMD = COUNTER_DECODE_SCALE + 4,
+    COUNTER_RESIZE_STBIR,
+    COUNTER_COUNT
+};
+
+enum Histogram {
+    HISTOGRAM_DECODE,           // + ImageFormat
+    HISTOGRAM_RESIZE = HISTOGRAM_DECODE + FORMAT_BMP + 1,   // + ResizeOptions::Filter
+    HISTOGRAM_ENCODE = HISTOGRAM_RESIZE + ResizeOptions::TRIANGLE + 1,  // + ImageFormat
+    HISTOGRAM_QUEUE_WAIT = HISTOGRAM_ENCODE + FORMAT_BMP + 1,   // + PipelineQueue * 2 + pop
+    HISTOGRAM_COUNT = HISTOGRAM_QUEUE_WAIT + 6
+};
+
+// The pipeline's BoundedQueues
+enum PipelineQueue {
+    QUEUE_DECODED,              // Decode stage to resize stage
+    QUEUE_RESIZED,              // Resize stage to encode stage
+    QUEUE_SUBMITTED             // Job submission to decode stage
+};
+
+void metrics_add(Counter counter, uint64_t value = 1);
+void metrics_observe(Histogram histogram, uint64_t ns);
+
+// Outcome, decode scale and bytes of a finished item
+void metrics_record_item(const ItemResult& item);
+
+inline Counter outcome_counter(ItemResult::Outcome outcome) {
+    return static_cast<Counter>(COUNTER_IMAGES + outcome);
+}
+
+inline Histogram decode_histogram(ImageFormat format) {
+    return static_cast<Histogram>(HISTOGRAM_DECODE + format);
+}
+
+inline Histogram resize_histogram(ResizeOptions::Filter filter) {
+    return static_cast<Histogram>(HISTOGRAM_RESIZE + filter);
+}
+
+inline Histogram encode_histogram(ImageFormat format) {
+    return static_cast<Histogram>(HISTOGRAM_ENCODE + format);
+}
+
+inline Histogram queue_wait_histogram(PipelineQueue queue, bool pop) {
+    return static_cast<Histogram>(HISTOGRAM_QUEUE_WAIT + queue * 2 + (pop ? 1 : 0));
+}
+
+// Observes the time from construction to destruction
+class StageTimer {
+public:
+    explicit StageTimer(Histogram histogram)
+        : histogram_(histogram)
+        , start_(trace_now())
+    {}
+
+    ~StageTimer() {
+        metrics_observe(histogram_, trace_now() - start_);
+    }
+
+    StageTimer(const StageTimer&) = delete;
+    StageTimer& operator=(const StageTimer&) = delete;
+
+private:
+    Histogram histogram_;
+    uint64_t start_;
+};
+
+} // namespace internal
+} // namespace fastresize
+
+#endif // FASTRESIZE_METRICS_H
@@ -39,7 +39,12 @@
  */
 
 #include "pipeline.h"
+#include "trace.h"
+#include <algorithm>
+#include <memory>
 #include <thread>
+#include <unordered_map>
+#include <utility>
 
 namespace fastresize {
 namespace internal {
@@ -53,8 +58,8 @@ PipelineProcessor::PipelineProcessor(
     : decode_pool_(nullptr)
     , resize_pool_(nullptr)
     , encode_pool_(nullptr)
-    , decode_queue_(queue_capacity)
-    , resize_queue_(queue_capacity)
+    , decode_queue_(queue_capacity, QUEUE_DECODED)
+    , resize_queue_(queue_capacity, QUEUE_RESIZED)
     , success_count_(0)
     , failed_count_(0)
 {
@@ -77,41 +82,164 @@ PipelineProcessor::~PipelineProcessor() {
     }
 }
 
-void PipelineProcessor::decode_stage(const std::vector<BatchItem>& items) {
-    for (size_t i = 0; i < items.size(); ++i) {
-        thread_pool_enqueue(decode_pool_, [this, &items, i]() {
-            const auto& item = items[i];
-
-            DecodeResult result;
-            result.task_id = i;
-            result.output_path = item.output_path;
-            result.options = item.options;
-            result.success = false;
-
-            ImageFormat fmt = detect_format(item.input_path);
-            if (fmt == FORMAT_UNKNOWN) {
-                result.error_message = "Unknown format: " + item.input_path;
-                decode_queue_.push(std::move(result));
-                return;
-            }
+// Output format from the extension; the pipeline defaults to JPEG
+static ImageFormat output_format_for(const std::string& output_path) {
+    ImageFormat out_fmt = FORMAT_UNKNOWN;
+    size_t dot_pos = output_path.find_last_of('.');
+    if (dot_pos != std::string::npos) {
+        std::string ext = output_path.substr(dot_pos + 1);
+        for (char& c : ext) {
+            if (c >= 'A' && c <= 'Z') c = c - 'A' + 'a';
+        }
+        out_fmt = string_to_format(ext);
+    }
 
-            int input_w, input_h, input_c;
-            if (get_image_dimensions(item.input_path, input_w, input_h, input_c)) {
-                int target_w, target_h;
-                calculate_dimensions(input_w, input_h, item.options, target_w, target_h);
-                result.image = decode_image(item.input_path, fmt, target_w, target_h);
-            } else {
-                result.image = decode_image(item.input_path, fmt);
-            }
+    return out_fmt == FORMAT_UNKNOWN ? FORMAT_JPEG : out_fmt;
+}
 
-            if (result.image.pixels == nullptr) {
-                result.error_message = "Decode failed: " + item.input_path;
-                decode_queue_.push(std::move(result));
-                return;
+size_t calculate_encode_threads(const std::vector<BatchItem>& items) {
+    if (items.empty()) return 4;
+
+    // Relative to a JPEG encode of the same image: WebP method 0 costs about
+    // the same, each method step adds roughly half of that, lossless doubles it
+    double total_cost = 0.0;
+    for (const BatchItem& item : items) {
+        double cost = 1.0;
+        if (output_format_for(item.output_path) == FORMAT_WEBP) {
+            cost += item.options.webp_effort * 0.5;
+            if (item.options.webp_lossless || item.options.webp_near_lossless < 100) {
+                cost *= 2.0;
             }
+        }
+        total_cost += cost;
+    }
+
+    double avg_cost = total_cost / items.size();
+    size_t threads = static_cast<size_t>(2.0 + 2.0 * avg_cost + 0.5);
+
+    if (threads < 4) threads = 4;
+    if (threads > 8) threads = 8;
+
+    return threads;
+}
+
+std::vector<std::vector<size_t>> group_by_source(const std::vector<BatchItem>& items) {
+    std::vector<std::vector<size_t>> groups;
+    std::unordered_map<std::string, size_t> group_of;
+    group_of.reserve(items.size());
+
+    for (size_t i = 0; i < items.size(); ++i) {
+        auto inserted = group_of.emplace(items[i].input_path, groups.size());
+        if (inserted.second) {
+            groups.emplace_back();
+        }
+        groups[inserted.first->second].push_back(i);
+    }
+
+    return groups;
+}
+
+static uint64_t elapsed_us(uint64_t start_ns) {
+    return (trace_now() - start_ns) / 1000;
+}
+
+void PipelineProcessor::finish_item(int task_id, ErrorCode status) {
+    const BatchItem& item = (*items_)[task_id];
+    finish_item_result(item.input_path, item.output_path, status,
+                       item_starts_[task_id], item_results_[task_id]);
+}
+
+// Status of an item a stage failed, from the error set on its thread;
+// failures that leave no error of their own are reported as RESIZE_ERROR
+static ErrorCode stage_error() {
+    ErrorCode code = thread_last_error_code();
+    return code != OK ? code : RESIZE_ERROR;
+}
+
+void PipelineProcessor::fail_decode(DecodeResult& result) {
+    result.success = false;
+    result.error_code = stage_error();
+    result.error_message = (*items_)[result.task_id].input_path + ": " + thread_last_error();
+    decode_queue_.push(std::move(result));
+}
+
+bool PipelineProcessor::plan_decode(const BatchItem& item, DecodeResult& result) {
+    ItemResult& stats = item_results_[result.task_id];
+    uint64_t start = trace_now();
+    bool planned = validate_options(item.options) &&
+        plan_item(item.input_path, output_format_for(item.output_path), item.options, result.plan);
+    stats.probe_us = elapsed_us(start);
+    if (!planned) {
+        fail_decode(result);
+        return false;
+    }
+    record_plan(result.plan, stats);
+
+    // Identity operations and cache hits never enter the resize and encode stages
+    bool done;
+    bool ok = resize_without_decode(item.input_path, item.output_path, item.options,
+                                    result.plan, stats, &done);
+    if (!done) {
+        return true;
+    }
+    if (ok) {
+        finish_item(result.task_id, OK);
+        success_count_.fetch_add(1);
+    } else {
+        fail_decode(result);
+    }
+    return false;
+}
+
+void PipelineProcessor::decode_source(const std::vector<BatchItem>& items,
+                                      const std::vector<size_t>& group) {
+    uint64_t start = trace_now();
+    for (size_t index : group) {
+        item_starts_[index] = start;
+    }
+
+    std::vector<DecodeResult> pending;
+    for (size_t index : group) {
+        const BatchItem& item = items[index];
+
+        DecodeResult result;
+        result.task_id = index;
+        result.output_path = item.output_path;
+        result.options = item.options;
+        result.success = false;
 
+        if (plan_decode(item, result)) {
+            pending.push_back(std::move(result));
+        }
+    }
+
+    // Each shared source is freed in the resize stage with its last reference
+    std::vector<SharedDecodeItem> shared(pending.size());
+    for (size_t i = 0; i < pending.size(); ++i) {
+        shared[i].plan = &pending[i].plan;
+        shared[i].options = &pending[i].options;
+        shared[i].stats = &item_results_[pending[i].task_id];
+    }
+
+    decode_shared_source(items[group[0]].input_path, shared, [&](
+        const std::vector<size_t>& members, const std::shared_ptr<const ImageData>& source) {
+        for (size_t member : members) {
+            DecodeResult& result = pending[member];
+            if (!source) {
+                fail_decode(result);
+                continue;
+            }
+            result.source = source;
             result.success = true;
             decode_queue_.push(std::move(result));
+        }
+    });
+}
+
+void PipelineProcessor::decode_stage(const std::vector<BatchItem>& items) {
+    for (const std::vector<size_t>& group : group_by_source(items)) {
+        thread_pool_enqueue(decode_pool_, [this, &items, group]() {
+            decode_source(items, group);
         });
     }
 
@@ -126,56 +254,33 @@ void PipelineProcessor::resize_stage() {
 
             while (decode_queue_.pop(decode_result)) {
                 ResizeResult resize_result;
+                resize_result.image.pixels = nullptr;
+                resize_result.plan = decode_result.plan;
                 resize_result.task_id = decode_result.task_id;
                 resize_result.output_path = decode_result.output_path;
                 resize_result.options = decode_result.options;
                 resize_result.success = false;
 
                 if (!decode_result.success) {
+                    resize_result.error_code = decode_result.error_code;
                     resize_result.error_message = decode_result.error_message;
-                    resize_result.pixels = nullptr;
-                    resize_result.width = 0;
-                    resize_result.height = 0;
-                    resize_result.channels = 0;
                     resize_queue_.push(std::move(resize_result));
                     continue;
                 }
 
-                int out_w, out_h;
-                calculate_dimensions(
-                    decode_result.image.width,
-                    decode_result.image.height,
-                    decode_result.options,
-                    out_w, out_h
-                );
-
-                unsigned char* resized_pixels = nullptr;
-                bool resize_ok = resize_image(
-                    decode_result.image.pixels,
-                    decode_result.image.width,
-                    decode_result.image.height,
-                    decode_result.image.channels,
-                    &resized_pixels,
-                    out_w, out_h,
-                    decode_result.options
-                );
-
-                free_image_data(decode_result.image);
-
-                if (!resize_ok || resized_pixels == nullptr) {
-                    resize_result.error_message = "Resize failed";
-                    resize_result.pixels = nullptr;
-                    resize_result.width = 0;
-                    resize_result.height = 0;
-                    resize_result.channels = 0;
+                bool resize_ok = resize_decoded_pixels(*decode_result.source, decode_result.options,
+                                                       decode_result.plan, resize_result.image,
+                                                       item_results_[decode_result.task_id]);
+                decode_result.source.reset();
+
+                if (!resize_ok) {
+                    resize_result.error_code = stage_error();
+                    resize_result.error_message = (*items_)[decode_result.task_id].input_path + ": " +
+                                                  thread_last_error();
                     resize_queue_.push(std::move(resize_result));
                     continue;
                 }
 
-                resize_result.pixels = resized_pixels;
-                resize_result.width = out_w;
-                resize_result.height = out_h;
-                resize_result.channels = decode_result.image.channels;
                 resize_result.success = true;
                 resize_queue_.push(std::move(resize_result));
             }
@@ -194,63 +299,25 @@ void PipelineProcessor::encode_stage() {
 
             while (resize_queue_.pop(resize_result)) {
                 if (!resize_result.success) {
-                    failed_count_.fetch_add(1);
-                    if (!resize_result.error_message.empty()) {
-                        std::lock_guard<std::mutex> lock(errors_mutex_);
-                        errors_.push_back(resize_result.error_message);
-                    }
-                    continue;
-                }
-
-                ImageFormat out_fmt = FORMAT_UNKNOWN;
-                size_t dot_pos = resize_result.output_path.find_last_of('.');
-                if (dot_pos != std::string::npos) {
-                    std::string ext = resize_result.output_path.substr(dot_pos + 1);
-                    for (char& c : ext) {
-                        if (c >= 'A' && c <= 'Z') c = c - 'A' + 'a';
-                    }
-                    out_fmt = string_to_format(ext);
-                }
-
-                if (out_fmt == FORMAT_UNKNOWN) {
-                    out_fmt = FORMAT_JPEG;
-                }
-
-                if (resize_result.pixels == nullptr || resize_result.width <= 0 ||
-                    resize_result.height <= 0 || resize_result.channels <= 0) {
+                    finish_item(resize_result.task_id, resize_result.error_code);
                     failed_count_.fetch_add(1);
                     std::lock_guard<std::mutex> lock(errors_mutex_);
-                    errors_.push_back("Invalid resize data for: " + resize_result.output_path);
-                    if (resize_result.pixels) delete[] resize_result.pixels;
+                    errors_.push_back(resize_result.error_message);
                     continue;
                 }
 
-                ImageData img_data;
-                img_data.pixels = resize_result.pixels;
-                img_data.width = resize_result.width;
-                img_data.height = resize_result.height;
-                img_data.channels = resize_result.channels;
-
-                bool encode_ok = encode_image(
-                    resize_result.output_path,
-                    img_data,
-                    out_fmt,
-                    resize_result.options.quality,
-                    buffer_pool
-                );
-
-                delete[] resize_result.pixels;
+                bool encode_ok = encode_resized(resize_result.image, resize_result.output_path,
+                                                resize_result.options, resize_result.plan, buffer_pool,
+                                                item_results_[resize_result.task_id]);
 
                 if (encode_ok) {
+                    finish_item(resize_result.task_id, OK);
                     success_count_.fetch_add(1);
                 } else {
+                    finish_item(resize_result.task_id, stage_error());
                     failed_count_.fetch_add(1);
                     std::lock_guard<std::mutex> lock(errors_mutex_);
-                    char buf[512];
-                    snprintf(buf, sizeof(buf), "Encode failed: %s (fmt=%d, %dx%d, %dch)",
-                             resize_result.output_path.c_str(), (int)out_fmt,
-                             resize_result.width, resize_result.height, resize_result.channels);
-                    errors_.push_back(buf);
+                    errors_.push_back((*items_)[resize_result.task_id].input_path + ": " + thread_last_error());
                 }
             }
         });
@@ -263,10 +330,24 @@ BatchResult PipelineProcessor::process_batch(const std::vector<BatchItem>& items
     success_count_ = 0;
     failed_count_ = 0;
     errors_.clear();
-
-    std::thread decode_thread([this, &items]() { decode_stage(items); });
-    std::thread resize_thread([this]() { resize_stage(); });
-    std::thread encode_thread([this]() { encode_stage(); });
+    items_ = &items;
+    item_results_.assign(items.size(), ItemResult());
+    item_starts_.assign(items.size(), 0);
+
+    // Stage threads hand the batch's memory account on to their pools
+    MemoryAccount* account = current_memory_account();
+    std::thread decode_thread([this, &items, account]() {
+        MemoryAccountScope scope(account);
+        decode_stage(items);
+    });
+    std::thread resize_thread([this, account]() {
+        MemoryAccountScope scope(account);
+        resize_stage();
+    });
+    std::thread encode_thread([this, account]() {
+        MemoryAccountScope scope(account);
+        encode_stage();
+    });
 
     decode_thread.join();
     resize_thread.join();
@@ -277,6 +358,8 @@ BatchResult PipelineProcessor::process_batch(const std::vector<BatchItem>& items
     result.success = success_count_.load();
     result.failed = failed_count_.load();
     result.errors = errors_;
+    result.items.swap(item_results_);
+    items_ = nullptr;
 
     return result;
 }
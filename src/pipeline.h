@@ -41,6 +41,8 @@
 #pragma once
 
 #include "internal.h"
+#include "metrics.h"
+#include <memory>
 #include <queue>
 #include <mutex>
 #include <condition_variable>
@@ -53,12 +55,14 @@ namespace internal {
 template<typename T>
 class BoundedQueue {
 public:
-    BoundedQueue(size_t capacity)
+    BoundedQueue(size_t capacity, PipelineQueue name)
         : capacity_(capacity)
+        , name_(name)
         , done_(false)
     {}
 
     bool push(T&& item) {
+        StageTimer wait(queue_wait_histogram(name_, false));
         std::unique_lock<std::mutex> lock(mutex_);
 
         cv_not_full_.wait(lock, [this]() {
@@ -73,7 +77,21 @@ public:
         return true;
     }
 
+    // Never blocks; item is left untouched when the queue is full or done
+    bool try_push(T&& item) {
+        StageTimer wait(queue_wait_histogram(name_, false));
+        std::unique_lock<std::mutex> lock(mutex_);
+
+        if (done_ || queue_.size() >= capacity_) return false;
+
+        queue_.push(std::move(item));
+        lock.unlock();
+        cv_not_empty_.notify_one();
+        return true;
+    }
+
     bool pop(T& item) {
+        StageTimer wait(queue_wait_histogram(name_, true));
         std::unique_lock<std::mutex> lock(mutex_);
 
         cv_not_empty_.wait(lock, [this]() {
@@ -104,6 +122,7 @@ public:
 
 private:
     size_t capacity_;
+    PipelineQueue name_;
     std::queue<T> queue_;
     mutable std::mutex mutex_;
     std::condition_variable cv_not_empty_;
@@ -119,23 +138,24 @@ struct DecodeTask {
 };
 
 struct DecodeResult {
-    ImageData image;
+    std::shared_ptr<const ImageData> source;    // May be shared by several items of the same input
+    ItemPlan plan;
     std::string output_path;
     ResizeOptions options;
     int task_id;
     bool success;
+    ErrorCode error_code = OK;
     std::string error_message;
 };
 
 struct ResizeResult {
-    unsigned char* pixels;
-    int width;
-    int height;
-    int channels;
+    ImageData image;
+    ItemPlan plan;
     std::string output_path;
     ResizeOptions options;
     int task_id;
     bool success;
+    ErrorCode error_code = OK;
     std::string error_message;
 };
 
@@ -151,6 +171,14 @@ inline size_t calculate_queue_capacity(int avg_width, int avg_height) {
     return capacity;
 }
 
+// Item indices grouped by input path, in order of first use, so each source
+// is decoded once however many outputs it has
+std::vector<std::vector<size_t>> group_by_source(const std::vector<BatchItem>& items);
+
+// Encode threads scaled by the average encode cost of the batch; WebP
+// effort and lossless mode can make encoding the slowest stage.
+size_t calculate_encode_threads(const std::vector<BatchItem>& items);
+
 class PipelineProcessor {
 public:
     PipelineProcessor(
@@ -178,6 +206,18 @@ private:
     std::mutex errors_mutex_;
     std::vector<std::string> errors_;
 
+    // Indexed by task_id; each item is written by one stage at a time
+    std::vector<ItemResult> item_results_;
+    std::vector<uint64_t> item_starts_;
+    const std::vector<BatchItem>* items_ = nullptr;
+
+    void finish_item(int task_id, ErrorCode status);
+    // Sends an item on to the encode stage as failed with this thread's error
+    void fail_decode(DecodeResult& result);
+
+    // False when the item is already finished: copied, cached or failed
+    bool plan_decode(const BatchItem& item, DecodeResult& result);
+    void decode_source(const std::vector<BatchItem>& items, const std::vector<size_t>& group);
     void decode_stage(const std::vector<BatchItem>& items);
     void resize_stage();
     void encode_stage();
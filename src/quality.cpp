@@ -0,0 +1,404 @@
+/*
+ * FastResize - The Fastest Image Resizing Library On The Planet
+ * Copyright (C) 2025 Tran Huu Canh (0xTh3OKrypt) and FastResize Contributors
+ *
+ * Resize 1,000 images in 2 seconds. Up to 2.9x faster than libvips,
+ * 3.1x faster than imageflow. Uses 3-4x less RAM than alternatives.
+ *
+ * Author: Tran Huu Canh (0xTh3OKrypt)
+ * Email: tranhuucanh39@gmail.com
+ * Homepage: https://github.com/tranhuucanh/fast_resize
+ *
+ * BSD 3-Clause License
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "internal.h"
+#include <algorithm>
+#include <cmath>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#ifdef __ARM_NEON
+#include <arm_neon.h>
+#endif
+
+namespace fastresize {
+namespace internal {
+
+// ============================================
+// Reference Resampler
+// ============================================
+
+static double filter_support(ResizeOptions::Filter filter) {
+    switch (filter) {
+        case ResizeOptions::BOX: return 0.5;
+        case ResizeOptions::TRIANGLE: return 1.0;
+        default: return 2.0;
+    }
+}
+
+// Mitchell-Netravali cubic with parameters B and C
+static double cubic(double x, double b, double c) {
+    if (x < 1.0) {
+        return ((12 - 9 * b - 6 * c) * x * x * x + (-18 + 12 * b + 6 * c) * x * x + (6 - 2 * b)) / 6;
+    }
+    if (x < 2.0) {
+        return ((-b - 6 * c) * x * x * x + (6 * b + 30 * c) * x * x + (-12 * b - 48 * c) * x + (8 * b + 24 * c)) / 6;
+    }
+    return 0.0;
+}
+
+static double filter_weight(ResizeOptions::Filter filter, double x) {
+    x = std::fabs(x);
+    switch (filter) {
+        case ResizeOptions::BOX: return x < 0.5 ? 1.0 : x == 0.5 ? 0.5 : 0.0;
+        case ResizeOptions::TRIANGLE: return std::max(0.0, 1.0 - x);
+        case ResizeOptions::CATMULL_ROM: return cubic(x, 0.0, 0.5);
+        default: return cubic(x, 1.0 / 3, 1.0 / 3);
+    }
+}
+
+// Normalized taps of one output pixel over source pixels first..first+size-1
+struct Taps {
+    int first;
+    std::vector<double> weights;
+};
+
+// Pixel centers sit at i + 0.5; downscales stretch the kernel over the
+// footprint and edges repeat the border pixel, as stb_image_resize does.
+static std::vector<Taps> compute_taps(int src_size, int dst_size, ResizeOptions::Filter filter) {
+    double scale = static_cast<double>(src_size) / dst_size;
+    double stretch = std::max(scale, 1.0);
+    double support = filter_support(filter) * stretch;
+
+    std::vector<Taps> taps(dst_size);
+    for (int d = 0; d < dst_size; ++d) {
+        double center = (d + 0.5) * scale;
+        int lo = static_cast<int>(std::floor(center - support));
+        int hi = static_cast<int>(std::ceil(center + support));
+
+        Taps& t = taps[d];
+        t.first = std::max(lo, 0);
+        t.weights.assign(std::min(hi, src_size - 1) - t.first + 1, 0.0);
+
+        double total = 0.0;
+        for (int i = lo; i <= hi; ++i) {
+            double w = filter_weight(filter, (i + 0.5 - center) / stretch);
+            int clamped = std::min(std::max(i, 0), src_size - 1);
+            t.weights[clamped - t.first] += w;
+            total += w;
+        }
+
+        if (total != 0.0) {
+            for (double& w : t.weights) w /= total;
+        } else {
+            int nearest = std::min(std::max(static_cast<int>(center), 0), src_size - 1);
+            t.weights[nearest - t.first] = 1.0;
+        }
+    }
+    return taps;
+}
+
+// Stored pixel shown at display position (x, y) for EXIF orientation 1-8
+static size_t stored_index(int orientation, int w, int h, int x, int y) {
+    int sx, sy;
+    switch (orientation) {
+        case 2: sx = w - 1 - x; sy = y; break;
+        case 3: sx = w - 1 - x; sy = h - 1 - y; break;
+        case 4: sx = x; sy = h - 1 - y; break;
+        case 5: sx = y; sy = x; break;
+        case 6: sx = y; sy = h - 1 - x; break;
+        case 7: sx = w - 1 - y; sy = h - 1 - x; break;
+        case 8: sx = w - 1 - y; sy = x; break;
+        default: sx = x; sy = y; break;
+    }
+    return static_cast<size_t>(sy) * w + sx;
+}
+
+static unsigned char round_byte(double value) {
+    return static_cast<unsigned char>(std::min(std::max(value, 0.0), 255.0) + 0.5);
+}
+
+std::vector<unsigned char> reference_resize(const ImageData& src, int orientation,
+                                            int out_w, int out_h, const ResizeOptions& opts) {
+    int channels = src.channels;
+    bool transposed = orientation_swaps_axes(orientation);
+    int display_w = transposed ? src.height : src.width;
+    int display_h = transposed ? src.width : src.height;
+
+    ResizeWindow win;
+    calculate_window(display_w, display_h, out_w, out_h, opts, win);
+
+    // Padding, packed the way resize_image() fills it
+    unsigned int color = opts.background_color;
+    unsigned char r = (color >> 24) & 0xFF, g = (color >> 16) & 0xFF, b = (color >> 8) & 0xFF;
+    unsigned char gray = static_cast<unsigned char>((r * 77 + g * 150 + b * 29) >> 8);
+    unsigned char background[4] = {r, g, b, static_cast<unsigned char>(color & 0xFF)};
+    if (channels <= 2) {
+        background[0] = gray;
+        background[1] = background[3];
+    }
+
+    std::vector<unsigned char> output(static_cast<size_t>(out_w) * out_h * channels);
+    for (size_t i = 0; i < output.size(); ++i) {
+        output[i] = background[i % channels];
+    }
+
+    std::vector<Taps> x_taps = compute_taps(win.src_w, win.dst_w, opts.filter);
+    std::vector<Taps> y_taps = compute_taps(win.src_h, win.dst_h, opts.filter);
+
+    // RGBA is resampled alpha-weighted, like stb_image_resize's STBIR_RGBA
+    bool alpha_weighted = channels == 4;
+
+    // Horizontal pass over the rows of the source window, in display orientation
+    std::vector<double> rows(static_cast<size_t>(win.src_h) * win.dst_w * channels, 0.0);
+    for (int y = 0; y < win.src_h; ++y) {
+        double* row = &rows[static_cast<size_t>(y) * win.dst_w * channels];
+        for (int x = 0; x < win.dst_w; ++x) {
+            const Taps& t = x_taps[x];
+            double* out = row + static_cast<size_t>(x) * channels;
+            for (size_t k = 0; k < t.weights.size(); ++k) {
+                const unsigned char* p = src.pixels + stored_index(
+                    orientation, src.width, src.height,
+                    win.src_x + t.first + static_cast<int>(k), win.src_y + y) * channels;
+                double w = t.weights[k];
+                if (alpha_weighted) {
+                    double alpha = p[3] / 255.0;
+                    for (int c = 0; c < 3; ++c) out[c] += w * p[c] * alpha;
+                    out[3] += w * p[3];
+                } else {
+                    for (int c = 0; c < channels; ++c) out[c] += w * p[c];
+                }
+            }
+        }
+    }
+
+    // Vertical pass straight into the destination window
+    std::vector<double> pixel(channels);
+    for (int y = 0; y < win.dst_h; ++y) {
+        const Taps& t = y_taps[y];
+        unsigned char* out_row = output.data() + (static_cast<size_t>(win.dst_y + y) * out_w + win.dst_x) * channels;
+        for (int x = 0; x < win.dst_w; ++x) {
+            std::fill(pixel.begin(), pixel.end(), 0.0);
+            for (size_t k = 0; k < t.weights.size(); ++k) {
+                const double* p = &rows[((t.first + k) * win.dst_w + x) * channels];
+                for (int c = 0; c < channels; ++c) pixel[c] += t.weights[k] * p[c];
+            }
+            if (alpha_weighted && pixel[3] > 0.0) {
+                for (int c = 0; c < 3; ++c) pixel[c] *= 255.0 / pixel[3];
+            }
+            for (int c = 0; c < channels; ++c) {
+                out_row[x * channels + c] = round_byte(pixel[c]);
+            }
+        }
+    }
+
+    return output;
+}
+
+// ============================================
+// Metrics
+// ============================================
+
+// Sum of squared differences; max_error receives the largest difference
+static uint64_t squared_error(const unsigned char* a, const unsigned char* b, size_t size, int& max_error) {
+    uint64_t total = 0;
+    unsigned char largest = 0;
+    size_t i = 0;
+
+    // 32-bit lane sums are flushed every 4096 vectors, before they can overflow
+#ifdef __AVX2__
+    __m256i zero = _mm256_setzero_si256();
+    __m256i peak = zero;
+    while (size - i >= 32) {
+        size_t end = i + std::min<size_t>((size - i) / 32, 4096) * 32;
+        __m256i sums = zero;
+        for (; i < end; i += 32) {
+            __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+            __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+            __m256i diff = _mm256_or_si256(_mm256_subs_epu8(va, vb), _mm256_subs_epu8(vb, va));
+            peak = _mm256_max_epu8(peak, diff);
+            __m256i lo = _mm256_unpacklo_epi8(diff, zero);
+            __m256i hi = _mm256_unpackhi_epi8(diff, zero);
+            sums = _mm256_add_epi32(sums, _mm256_madd_epi16(lo, lo));
+            sums = _mm256_add_epi32(sums, _mm256_madd_epi16(hi, hi));
+        }
+        uint32_t lanes[8];
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), sums);
+        for (uint32_t lane : lanes) total += lane;
+    }
+    unsigned char peaks[32];
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(peaks), peak);
+    for (unsigned char p : peaks) largest = std::max(largest, p);
+#elif defined(__ARM_NEON)
+    uint8x16_t peak = vdupq_n_u8(0);
+    while (size - i >= 16) {
+        size_t end = i + std::min<size_t>((size - i) / 16, 4096) * 16;
+        uint32x4_t sums = vdupq_n_u32(0);
+        for (; i < end; i += 16) {
+            uint8x16_t diff = vabdq_u8(vld1q_u8(a + i), vld1q_u8(b + i));
+            peak = vmaxq_u8(peak, diff);
+            sums = vpadalq_u16(sums, vmull_u8(vget_low_u8(diff), vget_low_u8(diff)));
+            sums = vpadalq_u16(sums, vmull_u8(vget_high_u8(diff), vget_high_u8(diff)));
+        }
+        uint32_t lanes[4];
+        vst1q_u32(lanes, sums);
+        for (uint32_t lane : lanes) total += lane;
+    }
+    unsigned char peaks[16];
+    vst1q_u8(peaks, peak);
+    for (unsigned char p : peaks) largest = std::max(largest, p);
+#endif
+
+    for (; i < size; ++i) {
+        int diff = std::abs(a[i] - b[i]);
+        largest = std::max(largest, static_cast<unsigned char>(diff));
+        total += static_cast<uint64_t>(diff * diff);
+    }
+
+    max_error = largest;
+    return total;
+}
+
+// BT.601 luma, or the first channel of grayscale images
+static std::vector<float> luma_plane(const unsigned char* pixels, size_t count, int channels) {
+    std::vector<float> luma(count);
+    for (size_t i = 0; i < count; ++i) {
+        const unsigned char* p = pixels + i * channels;
+        luma[i] = channels >= 3 ? 0.299f * p[0] + 0.587f * p[1] + 0.114f * p[2] : p[0];
+    }
+    return luma;
+}
+
+// Sums of a, b, a*a, b*b and a*b over a w x h window
+static void window_sums(const float* a, const float* b, int stride, int w, int h, double sums[5]) {
+#ifdef __AVX2__
+    if (w == 8) {
+        __m256 sa = _mm256_setzero_ps(), sb = sa, saa = sa, sbb = sa, sab = sa;
+        for (int y = 0; y < h; ++y) {
+            __m256 va = _mm256_loadu_ps(a + static_cast<size_t>(y) * stride);
+            __m256 vb = _mm256_loadu_ps(b + static_cast<size_t>(y) * stride);
+            sa = _mm256_add_ps(sa, va);
+            sb = _mm256_add_ps(sb, vb);
+            saa = _mm256_add_ps(saa, _mm256_mul_ps(va, va));
+            sbb = _mm256_add_ps(sbb, _mm256_mul_ps(vb, vb));
+            sab = _mm256_add_ps(sab, _mm256_mul_ps(va, vb));
+        }
+        const __m256 vectors[5] = {sa, sb, saa, sbb, sab};
+        for (int s = 0; s < 5; ++s) {
+            float lanes[8];
+            _mm256_storeu_ps(lanes, vectors[s]);
+            sums[s] = 0.0;
+            for (float lane : lanes) sums[s] += lane;
+        }
+        return;
+    }
+#elif defined(__ARM_NEON)
+    if (w == 8) {
+        float32x4_t acc[5][2];
+        for (int s = 0; s < 5; ++s) acc[s][0] = acc[s][1] = vdupq_n_f32(0.0f);
+        for (int y = 0; y < h; ++y) {
+            for (int half = 0; half < 2; ++half) {
+                float32x4_t va = vld1q_f32(a + static_cast<size_t>(y) * stride + half * 4);
+                float32x4_t vb = vld1q_f32(b + static_cast<size_t>(y) * stride + half * 4);
+                acc[0][half] = vaddq_f32(acc[0][half], va);
+                acc[1][half] = vaddq_f32(acc[1][half], vb);
+                acc[2][half] = vmlaq_f32(acc[2][half], va, va);
+                acc[3][half] = vmlaq_f32(acc[3][half], vb, vb);
+                acc[4][half] = vmlaq_f32(acc[4][half], va, vb);
+            }
+        }
+        for (int s = 0; s < 5; ++s) {
+            float lanes[4];
+            vst1q_f32(lanes, vaddq_f32(acc[s][0], acc[s][1]));
+            sums[s] = static_cast<double>(lanes[0]) + lanes[1] + lanes[2] + lanes[3];
+        }
+        return;
+    }
+#endif
+
+    for (int s = 0; s < 5; ++s) sums[s] = 0.0;
+    for (int y = 0; y < h; ++y) {
+        const float* ra = a + static_cast<size_t>(y) * stride;
+        const float* rb = b + static_cast<size_t>(y) * stride;
+        for (int x = 0; x < w; ++x) {
+            sums[0] += ra[x];
+            sums[1] += rb[x];
+            sums[2] += ra[x] * ra[x];
+            sums[3] += rb[x] * rb[x];
+            sums[4] += ra[x] * rb[x];
+        }
+    }
+}
+
+// Mean SSIM over 8x8 windows every 4 pixels (whole image when smaller)
+static double mean_ssim(const std::vector<float>& a, const std::vector<float>& b, int width, int height) {
+    const double c1 = (0.01 * 255) * (0.01 * 255);
+    const double c2 = (0.03 * 255) * (0.03 * 255);
+    int window_w = std::min(width, 8);
+    int window_h = std::min(height, 8);
+    double n = static_cast<double>(window_w) * window_h;
+
+    double total = 0.0;
+    size_t windows = 0;
+    for (int y = 0; y + window_h <= height; y += 4) {
+        for (int x = 0; x + window_w <= width; x += 4) {
+            size_t offset = static_cast<size_t>(y) * width + x;
+            double sums[5];
+            window_sums(a.data() + offset, b.data() + offset, width, window_w, window_h, sums);
+
+            double mean_a = sums[0] / n, mean_b = sums[1] / n;
+            double var_a = sums[2] / n - mean_a * mean_a;
+            double var_b = sums[3] / n - mean_b * mean_b;
+            double covariance = sums[4] / n - mean_a * mean_b;
+            total += ((2 * mean_a * mean_b + c1) * (2 * covariance + c2)) /
+                     ((mean_a * mean_a + mean_b * mean_b + c1) * (var_a + var_b + c2));
+            ++windows;
+        }
+    }
+    return windows > 0 ? total / windows : 1.0;
+}
+
+void measure_quality(const unsigned char* a, const unsigned char* b,
+                     int width, int height, int channels, QualityReport& report) {
+    size_t count = static_cast<size_t>(width) * height;
+    report.width = width;
+    report.height = height;
+
+    uint64_t squared = squared_error(a, b, count * channels, report.max_error);
+    double mse = static_cast<double>(squared) / (count * channels);
+    report.psnr = mse > 0.0 ? 10.0 * std::log10(255.0 * 255.0 / mse) : 99.0;
+
+    report.ssim = mean_ssim(luma_plane(a, count, channels), luma_plane(b, count, channels), width, height);
+}
+
+}
+}
@@ -39,8 +39,13 @@
  */
 
 #include "internal.h"
+#include "metrics.h"
+#include "trace.h"
 #include "simd_resize.h"
 #include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <vector>
 
 #define STB_IMAGE_RESIZE_IMPLEMENTATION
 #include "stb_image_resize2.h"
@@ -90,19 +95,275 @@ void calculate_dimensions(
                 out_h = static_cast<int>(std::round(in_h * ratio));
             }
             break;
+
+        case ResizeOptions::COVER:
+        case ResizeOptions::CONTAIN:
+            out_w = opts.target_width;
+            out_h = opts.target_height;
+            break;
+    }
+
+    // COVER and CONTAIN always produce the requested box
+    if (opts.no_enlarge && opts.mode != ResizeOptions::COVER && opts.mode != ResizeOptions::CONTAIN &&
+        (out_w > in_w || out_h > in_h)) {
+        out_w = in_w;
+        out_h = in_h;
     }
 
     if (out_w < 1) out_w = 1;
     if (out_h < 1) out_h = 1;
 }
 
+void calculate_decode_target(
+    int in_w, int in_h,
+    const ResizeOptions& opts,
+    int& target_w, int& target_h
+) {
+    if (opts.mode != ResizeOptions::COVER && opts.mode != ResizeOptions::CONTAIN) {
+        calculate_dimensions(in_w, in_h, opts, target_w, target_h);
+        return;
+    }
+
+    float ratio_w = static_cast<float>(opts.target_width) / in_w;
+    float ratio_h = static_cast<float>(opts.target_height) / in_h;
+    float ratio = (opts.mode == ResizeOptions::COVER)
+        ? std::max(ratio_w, ratio_h)
+        : std::min(ratio_w, ratio_h);
+
+    target_w = static_cast<int>(std::ceil(in_w * ratio));
+    target_h = static_cast<int>(std::ceil(in_h * ratio));
+
+    if (target_w < 1) target_w = 1;
+    if (target_h < 1) target_h = 1;
+}
+
+static void apply_gravity(ResizeOptions::Gravity gravity, int slack_x, int slack_y, int& x, int& y) {
+    x = slack_x / 2;
+    y = slack_y / 2;
+
+    switch (gravity) {
+        case ResizeOptions::NORTH:      y = 0; break;
+        case ResizeOptions::SOUTH:      y = slack_y; break;
+        case ResizeOptions::EAST:       x = slack_x; break;
+        case ResizeOptions::WEST:       x = 0; break;
+        case ResizeOptions::NORTH_EAST: x = slack_x; y = 0; break;
+        case ResizeOptions::NORTH_WEST: x = 0; y = 0; break;
+        case ResizeOptions::SOUTH_EAST: x = slack_x; y = slack_y; break;
+        case ResizeOptions::SOUTH_WEST: x = 0; y = slack_y; break;
+        default: break;
+    }
+}
+
+void calculate_window(
+    int in_w, int in_h,
+    int out_w, int out_h,
+    const ResizeOptions& opts,
+    ResizeWindow& win
+) {
+    win.src_x = 0;
+    win.src_y = 0;
+    win.src_w = in_w;
+    win.src_h = in_h;
+    win.dst_x = 0;
+    win.dst_y = 0;
+    win.dst_w = out_w;
+    win.dst_h = out_h;
+
+    if (opts.mode == ResizeOptions::COVER) {
+        // Crop is a source-rectangle offset: the kernels just read a sub-window.
+        float ratio = std::max(static_cast<float>(out_w) / in_w,
+                               static_cast<float>(out_h) / in_h);
+        win.src_w = std::min(std::max(static_cast<int>(std::round(out_w / ratio)), 1), in_w);
+        win.src_h = std::min(std::max(static_cast<int>(std::round(out_h / ratio)), 1), in_h);
+        apply_gravity(opts.gravity, in_w - win.src_w, in_h - win.src_h, win.src_x, win.src_y);
+    } else if (opts.mode == ResizeOptions::CONTAIN) {
+        // Letterbox: the kernels write a sub-window, the margins get filled.
+        float ratio = std::min(static_cast<float>(out_w) / in_w,
+                               static_cast<float>(out_h) / in_h);
+        win.dst_w = std::min(std::max(static_cast<int>(std::round(in_w * ratio)), 1), out_w);
+        win.dst_h = std::min(std::max(static_cast<int>(std::round(in_h * ratio)), 1), out_h);
+        apply_gravity(opts.gravity, out_w - win.dst_w, out_h - win.dst_h, win.dst_x, win.dst_y);
+    }
+}
+
+// Map a rectangle given in display orientation back to stored pixel
+// coordinates. stored_w/stored_h are the dimensions of the stored image.
+static void display_rect_to_stored(
+    int orientation, int stored_w, int stored_h,
+    int x, int y, int w, int h,
+    int& out_x, int& out_y, int& out_w, int& out_h
+) {
+    switch (orientation) {
+        case 2: out_x = stored_w - x - w; out_y = y; break;
+        case 3: out_x = stored_w - x - w; out_y = stored_h - y - h; break;
+        case 4: out_x = x; out_y = stored_h - y - h; break;
+        case 5: out_x = y; out_y = x; break;
+        case 6: out_x = y; out_y = stored_h - x - w; break;
+        case 7: out_x = stored_w - y - h; out_y = stored_h - x - w; break;
+        case 8: out_x = stored_w - y - h; out_y = x; break;
+        default: out_x = x; out_y = y; break;
+    }
+
+    if (orientation_swaps_axes(orientation)) {
+        out_w = h;
+        out_h = w;
+    } else {
+        out_w = w;
+        out_h = h;
+    }
+}
+
+// Where stored-orientation pixel (x, y) of the resized window lands in the
+// output: origin + y * row_step + x * pixel_step (all in bytes).
+struct OrientedTarget {
+    unsigned char* origin;
+    ptrdiff_t row_step;
+    ptrdiff_t pixel_step;
+    int channels;
+};
+
+static void orient_target(
+    int orientation, unsigned char* output, int output_w, int channels,
+    const ResizeWindow& win, int dst_w, int dst_h,
+    OrientedTarget& target
+) {
+    ptrdiff_t c = channels;
+    ptrdiff_t stride = static_cast<ptrdiff_t>(output_w) * channels;
+    ptrdiff_t last_x = dst_w - 1;
+    ptrdiff_t last_y = dst_h - 1;
+    ptrdiff_t origin = 0;
+
+    switch (orientation) {
+        case 2:  // mirror horizontal
+            origin = last_x * c;
+            target.pixel_step = -c;
+            target.row_step = stride;
+            break;
+        case 3:  // rotate 180
+            origin = last_x * c + last_y * stride;
+            target.pixel_step = -c;
+            target.row_step = -stride;
+            break;
+        case 4:  // mirror vertical
+            origin = last_y * stride;
+            target.pixel_step = c;
+            target.row_step = -stride;
+            break;
+        case 5:  // transpose
+            target.pixel_step = stride;
+            target.row_step = c;
+            break;
+        case 6:  // rotate 90 CW
+            origin = last_y * c;
+            target.pixel_step = stride;
+            target.row_step = -c;
+            break;
+        case 7:  // transverse
+            origin = last_y * c + last_x * stride;
+            target.pixel_step = -stride;
+            target.row_step = -c;
+            break;
+        case 8:  // rotate 270 CW
+            origin = last_x * stride;
+            target.pixel_step = -stride;
+            target.row_step = c;
+            break;
+        default:
+            target.pixel_step = c;
+            target.row_step = stride;
+            break;
+    }
+
+    target.origin = output + win.dst_y * stride + win.dst_x * c + origin;
+    target.channels = channels;
+}
+
+static void write_oriented_scanline(const void* output_ptr, int num_pixels, int y, void* context) {
+    const OrientedTarget* target = static_cast<const OrientedTarget*>(context);
+    const unsigned char* in = static_cast<const unsigned char*>(output_ptr);
+    unsigned char* out = target->origin + y * target->row_step;
+    int c = target->channels;
+
+    for (int x = 0; x < num_pixels; x++) {
+        memcpy(out, in, c);
+        in += c;
+        out += target->pixel_step;
+    }
+}
+
+// Fill the output pixels outside the destination window with the background color
+static void fill_padding(
+    unsigned char* pixels, int width, int height, int channels,
+    const ResizeWindow& win, unsigned int color
+) {
+    unsigned char r = (color >> 24) & 0xFF;
+    unsigned char g = (color >> 16) & 0xFF;
+    unsigned char b = (color >> 8) & 0xFF;
+    unsigned char a = color & 0xFF;
+    unsigned char gray = static_cast<unsigned char>((r * 77 + g * 150 + b * 29) >> 8);
+
+    unsigned char pixel[4];
+    switch (channels) {
+        case 1: pixel[0] = gray; break;
+        case 2: pixel[0] = gray; pixel[1] = a; break;
+        case 3: pixel[0] = r; pixel[1] = g; pixel[2] = b; break;
+        default: pixel[0] = r; pixel[1] = g; pixel[2] = b; pixel[3] = a; break;
+    }
+
+    size_t row_bytes = static_cast<size_t>(width) * channels;
+    unsigned char* first_row = nullptr;
+
+    for (int y = 0; y < height; y++) {
+        unsigned char* row = pixels + y * row_bytes;
+        bool full_row = (y < win.dst_y || y >= win.dst_y + win.dst_h);
+
+        if (full_row && first_row) {
+            memcpy(row, first_row, row_bytes);
+            continue;
+        }
+
+        int right = win.dst_x + win.dst_w;
+        for (int x = 0; x < width; x++) {
+            if (!full_row && x == win.dst_x) {
+                x = right - 1;
+                continue;
+            }
+            memcpy(row + x * channels, pixel, channels);
+        }
+
+        if (full_row) first_row = row;
+    }
+}
+
+static stbir_filter select_filter(const ResizeOptions& opts, float max_downscale) {
+    if (max_downscale >= 3.0f && opts.filter == ResizeOptions::MITCHELL) {
+        return STBIR_FILTER_TRIANGLE;
+    }
+
+    switch (opts.filter) {
+        case ResizeOptions::MITCHELL:
+            return STBIR_FILTER_MITCHELL;
+        case ResizeOptions::CATMULL_ROM:
+            return STBIR_FILTER_CATMULLROM;
+        case ResizeOptions::BOX:
+            return STBIR_FILTER_BOX;
+        case ResizeOptions::TRIANGLE:
+            return STBIR_FILTER_TRIANGLE;
+        default:
+            return STBIR_FILTER_MITCHELL;
+    }
+}
+
 bool resize_image(
     const unsigned char* input_pixels,
     int input_w, int input_h, int channels,
     unsigned char** output_pixels,
     int output_w, int output_h,
-    const ResizeOptions& opts
+    const ResizeOptions& opts,
+    int orientation
 ) {
+    FASTRESIZE_TRACE_SCOPE("resize");
+    StageTimer timer(resize_histogram(opts.filter));
     if (!input_pixels || input_w <= 0 || input_h <= 0 ||
         output_w <= 0 || output_h <= 0 || channels <= 0) {
         set_last_error(RESIZE_ERROR, "Invalid input parameters for resize");
@@ -110,51 +371,59 @@ bool resize_image(
     }
 
     size_t output_size = static_cast<size_t>(output_w) * output_h * channels;
-    *output_pixels = new unsigned char[output_size];
+    *output_pixels = alloc_pixels(output_size);
 
-    float downscale_ratio_w = static_cast<float>(input_w) / output_w;
-    float downscale_ratio_h = static_cast<float>(input_h) / output_h;
-    float max_downscale = (downscale_ratio_w > downscale_ratio_h) ? downscale_ratio_w : downscale_ratio_h;
+    // The window is laid out in display orientation
+    bool transposed = orientation_swaps_axes(orientation);
+    int display_w = transposed ? input_h : input_w;
+    int display_h = transposed ? input_w : input_h;
 
-    stbir_filter stb_filter;
+    ResizeWindow win;
+    calculate_window(display_w, display_h, output_w, output_h, opts, win);
 
-    if (max_downscale >= 3.0f && opts.filter == ResizeOptions::MITCHELL) {
-        stb_filter = STBIR_FILTER_TRIANGLE;
-    } else {
-        switch (opts.filter) {
-            case ResizeOptions::MITCHELL:
-                stb_filter = STBIR_FILTER_MITCHELL;
-                break;
-            case ResizeOptions::CATMULL_ROM:
-                stb_filter = STBIR_FILTER_CATMULLROM;
-                break;
-            case ResizeOptions::BOX:
-                stb_filter = STBIR_FILTER_BOX;
-                break;
-            case ResizeOptions::TRIANGLE:
-                stb_filter = STBIR_FILTER_TRIANGLE;
-                break;
-            default:
-                stb_filter = STBIR_FILTER_MITCHELL;
-        }
+    if (win.dst_w != output_w || win.dst_h != output_h) {
+        fill_padding(*output_pixels, output_w, output_h, channels, win, opts.background_color);
     }
 
-    bool use_simd = (output_w < input_w && output_h < input_h) &&
+    int src_x, src_y, src_w, src_h;
+    display_rect_to_stored(orientation, input_w, input_h,
+                           win.src_x, win.src_y, win.src_w, win.src_h,
+                           src_x, src_y, src_w, src_h);
+
+    // Kernels produce rows in stored orientation
+    int dst_w = transposed ? win.dst_h : win.dst_w;
+    int dst_h = transposed ? win.dst_w : win.dst_h;
+
+    size_t src_stride = static_cast<size_t>(input_w) * channels;
+    const unsigned char* src = input_pixels + src_y * src_stride + static_cast<size_t>(src_x) * channels;
+
+    OrientedTarget target;
+    orient_target(orientation, *output_pixels, output_w, channels, win, dst_w, dst_h, target);
+
+    float downscale_ratio_w = static_cast<float>(src_w) / dst_w;
+    float downscale_ratio_h = static_cast<float>(src_h) / dst_h;
+    float max_downscale = (downscale_ratio_w > downscale_ratio_h) ? downscale_ratio_w : downscale_ratio_h;
+
+    stbir_filter stb_filter = select_filter(opts, max_downscale);
+
+    bool use_simd = (dst_w < src_w && dst_h < src_h) &&
                     (stb_filter == STBIR_FILTER_TRIANGLE ||
                      (stb_filter == STBIR_FILTER_MITCHELL && max_downscale < 3.0f)) &&
                     (channels == 3 || channels == 4 || channels == 1);
 
     if (use_simd) {
         bool simd_ok = simd_resize(
-            input_pixels, input_w, input_h, channels,
-            *output_pixels, output_w, output_h,
+            src, src_w, src_h, src_stride, channels,
+            target.origin, dst_w, dst_h, target.row_step, target.pixel_step,
             ResizeQuality::FAST
         );
 
         if (simd_ok) {
+            metrics_add(COUNTER_RESIZE_SIMD);
             return true;
         }
     }
+    metrics_add(COUNTER_RESIZE_STBIR);
 
     stbir_pixel_layout pixel_layout;
     switch (channels) {
@@ -171,22 +440,38 @@ bool resize_image(
             pixel_layout = STBIR_RGBA;
             break;
         default:
-            delete[] *output_pixels;
+            free_pixels(*output_pixels);
             *output_pixels = nullptr;
             set_last_error(RESIZE_ERROR, "Unsupported number of channels");
             return false;
     }
 
-    void* result = stbir_resize(
-        input_pixels, input_w, input_h, 0,
-        *output_pixels, output_w, output_h, 0,
-        pixel_layout, STBIR_TYPE_UINT8,
-        STBIR_EDGE_CLAMP,
-        stb_filter
-    );
+    bool result;
+    if (target.pixel_step == channels) {
+        result = stbir_resize(
+            src, src_w, src_h, static_cast<int>(src_stride),
+            target.origin, dst_w, dst_h, static_cast<int>(target.row_step),
+            pixel_layout, STBIR_TYPE_UINT8,
+            STBIR_EDGE_CLAMP,
+            stb_filter
+        ) != nullptr;
+    } else {
+        // Mirrored or transposed output: scatter each finished scanline
+        // straight to its final position instead of rotating afterwards.
+        STBIR_RESIZE resize;
+        stbir_resize_init(&resize,
+                          src, src_w, src_h, static_cast<int>(src_stride),
+                          nullptr, dst_w, dst_h, 0,
+                          pixel_layout, STBIR_TYPE_UINT8);
+        stbir_set_edgemodes(&resize, STBIR_EDGE_CLAMP, STBIR_EDGE_CLAMP);
+        stbir_set_filters(&resize, stb_filter, stb_filter);
+        stbir_set_pixel_callbacks(&resize, nullptr, write_oriented_scanline);
+        stbir_set_user_data(&resize, &target);
+        result = stbir_resize_extended(&resize) != 0;
+    }
 
     if (!result) {
-        delete[] *output_pixels;
+        free_pixels(*output_pixels);
         *output_pixels = nullptr;
         set_last_error(RESIZE_ERROR, "stb_image_resize2 failed");
         return false;
@@ -195,5 +480,160 @@ bool resize_image(
     return true;
 }
 
+// ============================================
+// Planar YCbCr
+// ============================================
+
+// Resize the luma-space rectangle [x0, x1) x [y0, y1) of one plane. Planes
+// subsampled by sub_x/sub_y cover sub_x * plane_w luma columns, so the same
+// rectangle is expressed in normalized plane coordinates.
+static bool resize_plane(
+    const unsigned char* src, int plane_w, int plane_h, int stride,
+    int sub_x, int sub_y,
+    double x0, double y0, double x1, double y1,
+    unsigned char* dst, int dst_w, int dst_h,
+    stbir_filter filter
+) {
+    STBIR_RESIZE resize;
+    stbir_resize_init(&resize,
+                      src, plane_w, plane_h, stride,
+                      dst, dst_w, dst_h, dst_w,
+                      STBIR_1CHANNEL, STBIR_TYPE_UINT8);
+    stbir_set_edgemodes(&resize, STBIR_EDGE_CLAMP, STBIR_EDGE_CLAMP);
+    stbir_set_filters(&resize, filter, filter);
+
+    double span_x = static_cast<double>(plane_w) * sub_x;
+    double span_y = static_cast<double>(plane_h) * sub_y;
+    stbir_set_input_subrect(&resize, x0 / span_x, y0 / span_y, x1 / span_x, y1 / span_y);
+
+    return stbir_resize_extended(&resize) != 0;
+}
+
+static inline unsigned char clamp_byte(int v) {
+    return static_cast<unsigned char>(v < 0 ? 0 : (v > 255 ? 255 : v));
+}
+
+// JFIF full-range YCbCr to RGB, 16-bit fixed point. Chroma is subsampled by
+// 1 << shift_x / 1 << shift_y and replicated, as libjpeg does without fancy
+// upsampling. Chroma terms are computed once per chroma row.
+static void ycbcr_to_rgb(const unsigned char* y_plane, const unsigned char* cb_plane,
+                         const unsigned char* cr_plane, int chroma_w,
+                         int shift_x, int shift_y,
+                         unsigned char* rgb, int width, int height) {
+    std::vector<int> red_terms(chroma_w), green_terms(chroma_w), blue_terms(chroma_w);
+    int term_row = -1;
+
+    for (int row = 0; row < height; ++row) {
+        int chroma_row = row >> shift_y;
+        if (chroma_row != term_row) {
+            const unsigned char* cb = cb_plane + static_cast<size_t>(chroma_row) * chroma_w;
+            const unsigned char* cr = cr_plane + static_cast<size_t>(chroma_row) * chroma_w;
+            for (int x = 0; x < chroma_w; ++x) {
+                int b = cb[x] - 128;
+                int r = cr[x] - 128;
+                red_terms[x] = (91881 * r + 32768) >> 16;
+                green_terms[x] = (-22554 * b - 46802 * r + 32768) >> 16;
+                blue_terms[x] = (116130 * b + 32768) >> 16;
+            }
+            term_row = chroma_row;
+        }
+
+        const unsigned char* y = y_plane + static_cast<size_t>(row) * width;
+        unsigned char* out = rgb + static_cast<size_t>(row) * width * 3;
+        const int* red = red_terms.data();
+        const int* green = green_terms.data();
+        const int* blue = blue_terms.data();
+
+        for (int x = 0; x < width; ++x) {
+            int c = x >> shift_x;
+            int luma = y[x];
+            out[x * 3] = clamp_byte(luma + red[c]);
+            out[x * 3 + 1] = clamp_byte(luma + green[c]);
+            out[x * 3 + 2] = clamp_byte(luma + blue[c]);
+        }
+    }
+}
+
+bool resize_planar(
+    const ImageData& input,
+    ImageData& output,
+    int output_w, int output_h,
+    const ResizeOptions& opts,
+    bool keep_planar
+) {
+    FASTRESIZE_TRACE_SCOPE("resize");
+    StageTimer timer(resize_histogram(opts.filter));
+    if (!input.planar || !input.pixels || input.width <= 0 || input.height <= 0 ||
+        input.chroma_width <= 0 || input.chroma_height <= 0 ||
+        output_w <= 0 || output_h <= 0) {
+        set_last_error(RESIZE_ERROR, "Invalid planar input for resize");
+        return false;
+    }
+
+    ResizeWindow win;
+    calculate_window(input.width, input.height, output_w, output_h, opts, win);
+    if (win.dst_w != output_w || win.dst_h != output_h) {
+        set_last_error(RESIZE_ERROR, "Planar resize does not support padding");
+        return false;
+    }
+
+    float max_downscale = std::max(static_cast<float>(win.src_w) / output_w,
+                                   static_cast<float>(win.src_h) / output_h);
+    stbir_filter filter = select_filter(opts, max_downscale);
+    metrics_add(COUNTER_RESIZE_STBIR);
+
+    int sub_x = (input.width + input.chroma_width - 1) / input.chroma_width;
+    int sub_y = (input.height + input.chroma_height - 1) / input.chroma_height;
+
+    // Chroma keeps its subsampling through the resize; planar output is
+    // always 4:2:0, the sampling encode_jpeg uses.
+    int out_sub_x = keep_planar ? 2 : sub_x;
+    int out_sub_y = keep_planar ? 2 : sub_y;
+    int chroma_w = (output_w + out_sub_x - 1) / out_sub_x;
+    int chroma_h = (output_h + out_sub_y - 1) / out_sub_y;
+
+    size_t luma_size = static_cast<size_t>(output_w) * output_h;
+    size_t chroma_size = static_cast<size_t>(chroma_w) * chroma_h;
+    unsigned char* planes = alloc_pixels(luma_size + chroma_size * 2);
+
+    // Output chroma covers chroma_w * out_sub_x luma columns, which may
+    // overhang the output by one; extend the source rectangle to match.
+    int x1 = win.src_x + win.src_w;
+    int y1 = win.src_y + win.src_h;
+    double chroma_x1 = win.src_x + static_cast<double>(win.src_w) * chroma_w * out_sub_x / output_w;
+    double chroma_y1 = win.src_y + static_cast<double>(win.src_h) * chroma_h * out_sub_y / output_h;
+
+    bool ok = resize_plane(input.planes[0], input.width, input.height, input.strides[0], 1, 1,
+                           win.src_x, win.src_y, x1, y1, planes, output_w, output_h, filter);
+    for (int c = 1; c < 3 && ok; ++c) {
+        ok = resize_plane(input.planes[c], input.chroma_width, input.chroma_height, input.strides[c],
+                          sub_x, sub_y, win.src_x, win.src_y, chroma_x1, chroma_y1,
+                          planes + luma_size + chroma_size * (c - 1), chroma_w, chroma_h, filter);
+    }
+
+    if (!ok) {
+        free_pixels(planes);
+        set_last_error(RESIZE_ERROR, "stb_image_resize2 failed");
+        return false;
+    }
+
+    output.width = output_w;
+    output.height = output_h;
+    output.channels = 3;
+
+    if (keep_planar) {
+        output.pixels = planes;
+        set_planar_layout(output, chroma_w, chroma_h);
+        return true;
+    }
+
+    output.pixels = alloc_pixels(luma_size * 3);
+    ycbcr_to_rgb(planes, planes + luma_size, planes + luma_size + chroma_size, chroma_w,
+                 sub_x == 2 ? 1 : 0, sub_y == 2 ? 1 : 0, output.pixels, output_w, output_h);
+
+    free_pixels(planes);
+    return true;
+}
+
 }
 }
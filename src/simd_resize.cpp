@@ -60,8 +60,9 @@ namespace internal {
 #ifdef USE_NEON
 
 static void resize_bilinear_neon_rgba(
-    const uint8_t* __restrict src, int src_w, int src_h,
+    const uint8_t* __restrict src, int src_w, int src_h, size_t src_stride,
     uint8_t* __restrict dst, int dst_w, int dst_h,
+    ptrdiff_t dst_stride, ptrdiff_t dst_step,
     int channels
 ) {
     const int FRAC_BITS = 8;
@@ -70,9 +71,6 @@ static void resize_bilinear_neon_rgba(
     int x_ratio_fp = ((src_w - 1) << 16) / dst_w;
     int y_ratio_fp = ((src_h - 1) << 16) / dst_h;
 
-    int src_stride = src_w * channels;
-    int dst_stride = dst_w * channels;
-
     for (int y = 0; y < dst_h; y++) {
         int src_y_fp = (y * y_ratio_fp) >> 8;
         int y1 = src_y_fp >> FRAC_BITS;
@@ -151,7 +149,7 @@ static void resize_bilinear_neon_rgba(
 
                     uint8x8_t result8 = vqmovun_s16(result);
 
-                    vst1_lane_u32((uint32_t*)(out_row + (x + i) * 4),
+                    vst1_lane_u32((uint32_t*)(out_row + (x + i) * dst_step),
                                   vreinterpret_u32_u8(result8), 0);
                 }
             } else if (channels == 3) {
@@ -166,7 +164,7 @@ static void resize_bilinear_neon_rgba(
                     int16_t wy1 = FRAC_ONE - y_frac;
                     int16_t wy2 = y_frac;
 
-                    uint8_t* out = out_row + (x + i) * 3;
+                    uint8_t* out = out_row + (x + i) * dst_step;
 
                     for (int c = 0; c < 3; c++) {
                         int top = (p_tl[c] * wx1 + p_tr[c] * wx2) >> FRAC_BITS;
@@ -226,7 +224,7 @@ static void resize_bilinear_neon_rgba(
 
                     uint8x8_t result8 = vqmovun_s16(result);
 
-                    vst1_lane_u32((uint32_t*)(out_row + (x + i) * 4),
+                    vst1_lane_u32((uint32_t*)(out_row + (x + i) * dst_step),
                                   vreinterpret_u32_u8(result8), 0);
                 }
             } else if (channels == 3) {
@@ -241,7 +239,7 @@ static void resize_bilinear_neon_rgba(
                     int16_t wy1 = FRAC_ONE - y_frac;
                     int16_t wy2 = y_frac;
 
-                    uint8_t* out = out_row + (x + i) * 3;
+                    uint8_t* out = out_row + (x + i) * dst_step;
 
                     for (int c = 0; c < 3; c++) {
                         int top = (p_tl[c] * wx1 + p_tr[c] * wx2) >> FRAC_BITS;
@@ -301,7 +299,7 @@ static void resize_bilinear_neon_rgba(
 
                     uint8x8_t result8 = vqmovun_s16(result);
 
-                    vst1_lane_u32((uint32_t*)(out_row + (x + i) * 4),
+                    vst1_lane_u32((uint32_t*)(out_row + (x + i) * dst_step),
                                   vreinterpret_u32_u8(result8), 0);
                 }
             } else if (channels == 3) {
@@ -316,7 +314,7 @@ static void resize_bilinear_neon_rgba(
                     int16_t wy1 = FRAC_ONE - y_frac;
                     int16_t wy2 = y_frac;
 
-                    uint8_t* out = out_row + (x + i) * 3;
+                    uint8_t* out = out_row + (x + i) * dst_step;
 
                     for (int c = 0; c < 3; c++) {
                         int top = (p_tl[c] * wx1 + p_tr[c] * wx2) >> FRAC_BITS;
@@ -346,7 +344,7 @@ static void resize_bilinear_neon_rgba(
             int w3 = (x_frac_inv * y_frac) >> FRAC_BITS;
             int w4 = (x_frac * y_frac) >> FRAC_BITS;
 
-            uint8_t* out = out_row + x * channels;
+            uint8_t* out = out_row + x * dst_step;
 
             for (int c = 0; c < channels; c++) {
                 int val = (p1[c] * w1 + p2[c] * w2 + p3[c] * w3 + p4[c] * w4) >> FRAC_BITS;
@@ -357,16 +355,14 @@ static void resize_bilinear_neon_rgba(
 }
 
 static void resize_area_neon(
-    const uint8_t* __restrict src, int src_w, int src_h,
+    const uint8_t* __restrict src, int src_w, int src_h, size_t src_stride,
     uint8_t* __restrict dst, int dst_w, int dst_h,
+    ptrdiff_t dst_stride, ptrdiff_t dst_step,
     int channels
 ) {
     float x_scale = (float)src_w / dst_w;
     float y_scale = (float)src_h / dst_h;
 
-    int src_stride = src_w * channels;
-    int dst_stride = dst_w * channels;
-
     for (int dy = 0; dy < dst_h; dy++) {
         int sy_start = (int)(dy * y_scale);
         int sy_end = std::min((int)((dy + 1) * y_scale), src_h);
@@ -417,7 +413,7 @@ static void resize_area_neon(
                 uint32_t sums[4];
                 vst1q_u32(sums, sum);
 
-                uint8_t* out = out_row + dx * 4;
+                uint8_t* out = out_row + dx * dst_step;
                 out[0] = sums[0] / pixel_count;
                 out[1] = sums[1] / pixel_count;
                 out[2] = sums[2] / pixel_count;
@@ -436,7 +432,7 @@ static void resize_area_neon(
                     }
                 }
 
-                uint8_t* out = out_row + dx * 3;
+                uint8_t* out = out_row + dx * dst_step;
                 out[0] = sum_r / pixel_count;
                 out[1] = sum_g / pixel_count;
                 out[2] = sum_b / pixel_count;
@@ -454,7 +450,7 @@ static void resize_area_neon(
                     }
                 }
 
-                uint8_t* out = out_row + dx * channels;
+                uint8_t* out = out_row + dx * dst_step;
                 for (int c = 0; c < channels; c++) {
                     out[c] = sums[c] / pixel_count;
                 }
@@ -466,8 +462,8 @@ static void resize_area_neon(
 #endif
 
 bool simd_resize(
-    const uint8_t* src, int src_w, int src_h, int channels,
-    uint8_t* dst, int dst_w, int dst_h,
+    const uint8_t* src, int src_w, int src_h, size_t src_stride, int channels,
+    uint8_t* dst, int dst_w, int dst_h, ptrdiff_t dst_stride, ptrdiff_t dst_pixel_step,
     ResizeQuality quality
 ) {
     if (!src || !dst || src_w <= 0 || src_h <= 0 ||
@@ -479,18 +475,22 @@ bool simd_resize(
         return false;
     }
 
+    if (src_stride == 0) src_stride = static_cast<size_t>(src_w) * channels;
+    if (dst_stride == 0) dst_stride = static_cast<ptrdiff_t>(dst_w) * channels;
+    if (dst_pixel_step == 0) dst_pixel_step = channels;
+
     float x_scale = (float)src_w / dst_w;
     float y_scale = (float)src_h / dst_h;
     float max_scale = std::max(x_scale, y_scale);
 
 #ifdef USE_NEON
     if (max_scale > 3.0f && (channels == 3 || channels == 4)) {
-        resize_area_neon(src, src_w, src_h, dst, dst_w, dst_h, channels);
+        resize_area_neon(src, src_w, src_h, src_stride, dst, dst_w, dst_h, dst_stride, dst_pixel_step, channels);
         return true;
     }
 
     if (channels == 3 || channels == 4) {
-        resize_bilinear_neon_rgba(src, src_w, src_h, dst, dst_w, dst_h, channels);
+        resize_bilinear_neon_rgba(src, src_w, src_h, src_stride, dst, dst_w, dst_h, dst_stride, dst_pixel_step, channels);
         return true;
     }
 #endif
@@ -53,12 +53,18 @@ enum class ResizeQuality {
     BEST
 };
 
+// Strides and steps are in bytes; 0 means tightly packed. The destination is
+// addressed as dst + y * dst_stride + x * dst_pixel_step, so negative or
+// swapped steps write the output mirrored or transposed.
 bool simd_resize(
     const uint8_t* src,
     int src_w, int src_h,
+    size_t src_stride,
     int channels,
     uint8_t* dst,
     int dst_w, int dst_h,
+    ptrdiff_t dst_stride,
+    ptrdiff_t dst_pixel_step,
     ResizeQuality quality = ResizeQuality::FAST
 );
 
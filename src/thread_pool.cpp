@@ -50,6 +50,8 @@
 namespace fastresize {
 namespace internal {
 
+static thread_local bool t_pool_worker = false;
+
 class ThreadPool {
 public:
     explicit ThreadPool(size_t num_threads);
@@ -79,6 +81,7 @@ ThreadPool::ThreadPool(size_t num_threads)
 {
     for (size_t i = 0; i < num_threads; ++i) {
         threads_.emplace_back([this] {
+            t_pool_worker = true;
             while (true) {
                 std::function<void()> task;
                 {
@@ -93,11 +96,17 @@ ThreadPool::ThreadPool(size_t num_threads)
                     task = std::move(tasks_.front());
                     tasks_.pop();
                     --queued_tasks_;
+                    ++active_tasks_;
                 }
 
-                ++active_tasks_;
                 task();
-                --active_tasks_;
+
+                // Under the lock so wait() can't miss the last task
+                // finishing, even when tasks enqueue follow-up tasks
+                {
+                    std::unique_lock<std::mutex> lock(queue_mutex_);
+                    --active_tasks_;
+                }
                 wait_condition_.notify_all();
             }
         });
@@ -154,7 +163,7 @@ private:
 BufferPool::~BufferPool() {
     std::lock_guard<std::mutex> lock(mutex_);
     for (Buffer& buf : pool_) {
-        delete[] buf.data;
+        free_pixels(buf.data);
     }
     pool_.clear();
 }
@@ -170,7 +179,7 @@ unsigned char* BufferPool::acquire(size_t size) {
         }
     }
 
-    return new unsigned char[size];
+    return alloc_pixels(size);
 }
 
 void BufferPool::release(unsigned char* buffer, size_t capacity) {
@@ -184,7 +193,7 @@ void BufferPool::release(unsigned char* buffer, size_t capacity) {
         buf.capacity = capacity;
         pool_.push_back(buf);
     } else {
-        delete[] buffer;
+        free_pixels(buffer);
     }
 }
 
@@ -198,7 +207,16 @@ void destroy_thread_pool(ThreadPool* pool) {
 
 void thread_pool_enqueue(ThreadPool* pool, std::function<void()> task) {
     if (pool) {
-        pool->enqueue(std::move(task));
+        // Whatever the task allocates counts against the enqueuing batch
+        MemoryAccount* account = current_memory_account();
+        if (account) {
+            pool->enqueue([account, task = std::move(task)]() {
+                MemoryAccountScope scope(account);
+                task();
+            });
+        } else {
+            pool->enqueue(std::move(task));
+        }
     }
 }
 
@@ -208,6 +226,33 @@ void thread_pool_wait(ThreadPool* pool) {
     }
 }
 
+void thread_pool_run(ThreadPool* pool, size_t count, const std::function<void(size_t)>& task) {
+    // Other callers may share the pool, so wait for these tasks only
+    std::mutex done_mutex;
+    std::condition_variable done_cv;
+    size_t left = count;
+    for (size_t i = 0; i < count; ++i) {
+        thread_pool_enqueue(pool, [&, i]() {
+            task(i);
+            std::lock_guard<std::mutex> lock(done_mutex);
+            if (--left == 0) done_cv.notify_one();
+        });
+    }
+    std::unique_lock<std::mutex> lock(done_mutex);
+    done_cv.wait(lock, [&]() { return left == 0; });
+}
+
+ThreadPool* shared_strip_pool() {
+    // Joining it from a static destructor could race with work still
+    // running at exit, so it is never destroyed
+    static ThreadPool* pool = create_thread_pool(std::thread::hardware_concurrency());
+    return pool;
+}
+
+bool thread_pool_is_worker() {
+    return t_pool_worker;
+}
+
 BufferPool* create_buffer_pool() {
     return new BufferPool();
 }
@@ -217,14 +262,14 @@ void destroy_buffer_pool(BufferPool* pool) {
 }
 
 unsigned char* buffer_pool_acquire(BufferPool* pool, size_t size) {
-    return pool ? pool->acquire(size) : new unsigned char[size];
+    return pool ? pool->acquire(size) : alloc_pixels(size);
 }
 
 void buffer_pool_release(BufferPool* pool, unsigned char* buffer, size_t capacity) {
     if (pool) {
         pool->release(buffer, capacity);
     } else {
-        delete[] buffer;
+        free_pixels(buffer);
     }
 }
 
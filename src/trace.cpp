@@ -0,0 +1,178 @@
+/*
+ * FastResize - The Fastest Image Resizing Library On The Planet
+ * Copyright (C) 2025 Tran Huu Canh (0xTh3OKrypt) and FastResize Contributors
+ *
+ * Resize 1,000 images in 2 seconds. Up to 2.9x faster than libvips,
+ * 3.1x faster than imageflow. Uses 3-4x less RAM than alternatives.
+ *
+ * Author: Tran Huu Canh (0xTh3OKrypt)
+ * Email: tranhuucanh39@gmail.com
+ * Homepage: https://github.com/tranhuucanh/fast_resize
+ *
+ * BSD 3-Clause License
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "trace.h"
+#include "internal.h"
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace fastresize {
+namespace internal {
+
+// ============================================
+// Trace Buffers
+// ============================================
+
+// Per-thread rings, so recording takes no lock. A thread registers a new
+// buffer the first time it records in each trace; buffers of threads that
+// have exited stay registered until the next trace_start().
+
+static const size_t TRACE_RING_EVENTS = 1 << 16;
+
+struct TraceEvent {
+    const char* name;
+    uint64_t start;
+    uint64_t end;
+};
+
+struct TraceBuffer {
+    uint32_t thread_id;
+    std::vector<TraceEvent> events;
+    size_t next = 0;            // Total recorded; wraps over the oldest
+};
+
+struct ThreadTrace {
+    std::shared_ptr<TraceBuffer> buffer;
+    uint64_t generation = 0;
+};
+
+std::atomic<bool> g_trace_active(false);
+
+static std::mutex g_trace_mutex;
+static std::vector<std::shared_ptr<TraceBuffer>> g_trace_buffers;
+static std::atomic<uint64_t> g_trace_generation(0);
+static uint64_t g_trace_epoch = 0;
+static uint32_t g_trace_next_thread = 0;
+
+static thread_local ThreadTrace t_trace;
+
+uint64_t trace_now() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+void trace_start() {
+    std::lock_guard<std::mutex> lock(g_trace_mutex);
+    g_trace_buffers.clear();
+    g_trace_next_thread = 0;
+    g_trace_epoch = trace_now();
+    g_trace_generation.fetch_add(1, std::memory_order_relaxed);
+#ifdef FASTRESIZE_TRACING
+    g_trace_active.store(true, std::memory_order_release);
+#endif
+}
+
+void trace_record(const char* name, uint64_t start_ns, uint64_t end_ns) {
+    uint64_t generation = g_trace_generation.load(std::memory_order_relaxed);
+    if (!t_trace.buffer || t_trace.generation != generation) {
+        std::shared_ptr<TraceBuffer> buffer = std::make_shared<TraceBuffer>();
+        buffer->events.resize(TRACE_RING_EVENTS);
+
+        std::lock_guard<std::mutex> lock(g_trace_mutex);
+        buffer->thread_id = ++g_trace_next_thread;
+        g_trace_buffers.push_back(buffer);
+        t_trace.buffer = buffer;
+        t_trace.generation = generation;
+    }
+
+    TraceBuffer& buffer = *t_trace.buffer;
+    TraceEvent& event = buffer.events[buffer.next % TRACE_RING_EVENTS];
+    event.name = name;
+    event.start = start_ns;
+    event.end = end_ns;
+    buffer.next++;
+}
+
+#ifdef FASTRESIZE_TRACING
+// Microseconds since trace_start(), as trace_event timestamps expect
+static double trace_us(uint64_t ns) {
+    return ns > g_trace_epoch ? (ns - g_trace_epoch) / 1000.0 : 0.0;
+}
+#endif
+
+bool trace_stop(const std::string& path) {
+    g_trace_active.store(false, std::memory_order_release);
+
+#ifndef FASTRESIZE_TRACING
+    (void)path;
+    set_last_error(WRITE_ERROR, "Tracing was not compiled in (FASTRESIZE_TRACING)");
+    return false;
+#else
+    std::lock_guard<std::mutex> lock(g_trace_mutex);
+
+    FILE* file = fopen(path.c_str(), "w");
+    if (!file) {
+        set_last_error(WRITE_ERROR, "Cannot open trace file: " + path);
+        return false;
+    }
+
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"fastresize\"}}");
+
+    for (const std::shared_ptr<TraceBuffer>& buffer : g_trace_buffers) {
+        fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+                      "\"args\":{\"name\":\"thread %u\"}}",
+                buffer->thread_id, buffer->thread_id);
+
+        size_t count = buffer->next < TRACE_RING_EVENTS ? buffer->next : TRACE_RING_EVENTS;
+        size_t first = buffer->next - count;
+        for (size_t i = first; i < buffer->next; ++i) {
+            const TraceEvent& event = buffer->events[i % TRACE_RING_EVENTS];
+            fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"fastresize\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,"
+                          "\"ts\":%.3f,\"dur\":%.3f}",
+                    event.name, buffer->thread_id, trace_us(event.start),
+                    (event.end - event.start) / 1000.0);
+        }
+    }
+
+    fprintf(file, "\n]}\n");
+    bool ok = fclose(file) == 0;
+    if (!ok) {
+        set_last_error(WRITE_ERROR, "Failed to write trace file: " + path);
+    }
+    return ok;
+#endif
+}
+
+} // namespace internal
+} // namespace fastresize
@@ -0,0 +1,101 @@
+/*
+ * FastResize - The Fastest Image Resizing Library On The Planet
+ * Copyright (C) 2025 Tran Huu Canh (0xTh3OKrypt) and FastResize Contributors
+ *
+ * Resize 1,000 images in 2 seconds. Up to 2.9x faster than libvips,
+ * 3.1x faster than imageflow. Uses 3-4x less RAM than alternatives.
+ *
+ * Author: Tran Huu Canh (0xTh3OKrypt)
+ * Email: tranhuucanh39@gmail.com
+ * Homepage: https://github.com/tranhuucanh/fast_resize
+ *
+ * BSD 3-Clause License
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef FASTRESIZE_TRACE_H
+#define FASTRESIZE_TRACE_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace fastresize {
+namespace internal {
+
+// Stage timing for BatchOptions::trace_path. While a trace runs, each
+// FASTRESIZE_TRACE_SCOPE records its start and end into a ring buffer owned
+// by the calling thread; trace_stop() writes every buffer as Chrome
+// trace_event JSON (chrome://tracing, Perfetto). Without the
+// FASTRESIZE_TRACING build option the scopes compile to nothing.
+
+extern std::atomic<bool> g_trace_active;
+
+// One traced batch at a time; trace_stop() after its threads have finished
+void trace_start();
+bool trace_stop(const std::string& path);
+
+uint64_t trace_now();   // Monotonic nanoseconds
+void trace_record(const char* name, uint64_t start_ns, uint64_t end_ns);
+
+class TraceScope {
+public:
+    explicit TraceScope(const char* name)
+        : name_(name)
+        , active_(g_trace_active.load(std::memory_order_relaxed))
+        , start_(active_ ? trace_now() : 0)
+    {}
+
+    ~TraceScope() {
+        if (active_) {
+            trace_record(name_, start_, trace_now());
+        }
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    const char* name_;
+    bool active_;
+    uint64_t start_;
+};
+
+} // namespace internal
+} // namespace fastresize
+
+#ifdef FASTRESIZE_TRACING
+#define FASTRESIZE_TRACE_JOIN2(a, b) a##b
+#define FASTRESIZE_TRACE_JOIN(a, b) FASTRESIZE_TRACE_JOIN2(a, b)
+#define FASTRESIZE_TRACE_SCOPE(name) \
+    ::fastresize::internal::TraceScope FASTRESIZE_TRACE_JOIN(trace_scope_, __LINE__)(name)
+#else
+#define FASTRESIZE_TRACE_SCOPE(name) ((void)0)
+#endif
+
+#endif // FASTRESIZE_TRACE_H
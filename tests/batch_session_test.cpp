@@ -0,0 +1,127 @@
+// Streaming batches: close_batch() on a session nothing was pushed to,
+// results with and without an on_item callback, and batch_push() refusing
+// items once stop_on_error has seen a failure.
+//
+//   batch_session_test WORK_DIR
+
+#include "test_util.h"
+#include <chrono>
+#include <thread>
+
+using fastresize::BatchItem;
+using fastresize::BatchOptions;
+using fastresize::BatchResult;
+using fastresize::BatchSession;
+using fastresize::ItemResult;
+using fastresize::ResizeOptions;
+using fastresize::internal::ImageData;
+
+static std::string g_input;
+static std::string g_work;
+
+static BatchItem make_item(const std::string& name) {
+    BatchItem item;
+    item.input_path = g_input;
+    item.output_path = g_work + "/" + name + ".png";
+    item.options.mode = ResizeOptions::FIT_WIDTH;
+    item.options.target_width = 40;
+    return item;
+}
+
+static void test_empty_session() {
+    BatchResult result = fastresize::close_batch(fastresize::open_batch());
+    CHECK(result.total == 0 && result.success == 0 && result.failed == 0 && result.skipped == 0);
+    CHECK(result.items.empty() && result.errors.empty());
+
+    // The callback never runs, and an incremental session still closes cleanly
+    BatchOptions opts;
+    opts.incremental = true;
+    opts.manifest_path = g_work + "/empty.manifest";
+    size_t calls = 0;
+    result = fastresize::close_batch(fastresize::open_batch(opts, [&](size_t, const ItemResult&, const std::string&) {
+        calls++;
+    }));
+    CHECK(calls == 0 && result.total == 0);
+    CHECK_MSG(result.errors.empty(), "%s", result.errors.empty() ? "" : result.errors[0].c_str());
+}
+
+static void test_results() {
+    // Without a callback every item lands in BatchResult::items, in push order
+    BatchSession* session = fastresize::open_batch();
+    BatchItem missing = make_item("missing");
+    missing.input_path = g_work + "/missing.png";
+    CHECK(fastresize::batch_push(session, make_item("kept0")));
+    CHECK(fastresize::batch_push(session, missing));
+    CHECK(fastresize::batch_push(session, make_item("kept2")));
+    BatchResult result = fastresize::close_batch(session);
+    CHECK(result.total == 3 && result.success == 2 && result.failed == 1 && result.errors.size() == 1);
+    CHECK(result.items.size() == 3);
+    if (result.items.size() == 3) {
+        CHECK(result.items[0].outcome == ItemResult::RESIZED && result.items[0].output_width == 40);
+        CHECK(result.items[1].outcome == ItemResult::FAILED);
+        CHECK(result.items[2].outcome == ItemResult::RESIZED);
+    }
+
+    // With one, each index is reported once and items stays empty
+    std::vector<int> seen(4, 0);
+    session = fastresize::open_batch(BatchOptions(), [&](size_t index, const ItemResult& item, const std::string& error) {
+        if (index < seen.size()) seen[index]++;
+        CHECK(item.outcome == ItemResult::RESIZED && error.empty());
+    });
+    for (int i = 0; i < 4; ++i) {
+        CHECK(fastresize::batch_push(session, make_item("streamed" + std::to_string(i))));
+    }
+    result = fastresize::close_batch(session);
+    CHECK(result.total == 4 && result.success == 4 && result.items.empty());
+    for (size_t i = 0; i < seen.size(); ++i) {
+        CHECK_MSG(seen[i] == 1, "item %zu reported %d times", i, seen[i]);
+    }
+}
+
+static void test_push_after_stop() {
+    BatchOptions opts;
+    opts.stop_on_error = true;
+    BatchSession* session = fastresize::open_batch(opts);
+
+    BatchItem missing = make_item("stop");
+    missing.input_path = g_work + "/missing.png";
+    CHECK(fastresize::batch_push(session, missing));
+
+    // The failure stops the session asynchronously; pushes are refused after
+    int accepted = 1;
+    bool refused = false;
+    for (int attempt = 0; attempt < 500 && !refused; ++attempt) {
+        if (fastresize::batch_push(session, make_item("after" + std::to_string(attempt)))) {
+            accepted++;
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        } else {
+            refused = true;
+        }
+    }
+    CHECK_MSG(refused, "%d pushes accepted after the failure", accepted - 1);
+    CHECK(!fastresize::batch_push(session, make_item("again")));
+
+    BatchResult result = fastresize::close_batch(session);
+    CHECK_MSG(result.total == accepted, "total %d, %d pushes accepted", result.total, accepted);
+    CHECK(result.failed == 1 && result.success + result.failed == result.total);
+    CHECK(result.items.size() == (size_t)accepted);
+}
+
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s WORK_DIR\n", argv[0]);
+        return 2;
+    }
+    g_work = test::scratch_dir(argv[1]);
+    g_input = g_work + "/input.png";
+
+    std::vector<unsigned char> pixels = test::gradient(80, 60, 3);
+    ImageData image = test::image_view(pixels, 80, 60, 3);
+    CHECK(fastresize::internal::encode_image(g_input, image, fastresize::internal::FORMAT_PNG, ResizeOptions()));
+
+    test_empty_session();
+    test_results();
+    test_push_after_stop();
+
+    return test::finish("batch_session_test");
+}
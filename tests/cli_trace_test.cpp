@@ -0,0 +1,181 @@
+// `fast_resize batch --trace` end to end: runs the CLI on a few generated
+// images, parses the trace it writes as JSON and checks it holds Chrome
+// trace_event records for the stages the batch went through.
+//
+//   cli_trace_test FAST_RESIZE_BINARY WORK_DIR
+
+#include "test_util.h"
+#include <cctype>
+#include <map>
+#include <set>
+
+using fastresize::internal::ImageData;
+
+// Just enough JSON for the trace: objects, arrays, strings, numbers
+struct JsonValue {
+    enum Type { NUL, BOOL, NUMBER, STRING, ARRAY, OBJECT } type = NUL;
+    double number = 0.0;
+    std::string text;
+    std::vector<JsonValue> items;
+    std::map<std::string, JsonValue> fields;
+
+    const JsonValue* field(const std::string& key) const {
+        auto it = fields.find(key);
+        return it == fields.end() ? nullptr : &it->second;
+    }
+};
+
+class JsonParser {
+public:
+    explicit JsonParser(const std::string& text) : text_(text), pos_(0) {}
+
+    bool parse(JsonValue& value) {
+        if (!parse_value(value)) return false;
+        skip_space();
+        return pos_ == text_.size();
+    }
+
+private:
+    void skip_space() {
+        while (pos_ < text_.size() && isspace((unsigned char)text_[pos_])) pos_++;
+    }
+
+    bool consume(char c) {
+        skip_space();
+        if (pos_ < text_.size() && text_[pos_] == c) {
+            pos_++;
+            return true;
+        }
+        return false;
+    }
+
+    bool parse_string(std::string& out) {
+        if (!consume('"')) return false;
+        out.clear();
+        while (pos_ < text_.size() && text_[pos_] != '"') {
+            if (text_[pos_] == '\\') {
+                if (++pos_ >= text_.size()) return false;
+            } else if ((unsigned char)text_[pos_] < 0x20) {
+                return false;
+            }
+            out += text_[pos_++];
+        }
+        return consume('"');
+    }
+
+    bool parse_value(JsonValue& value) {
+        skip_space();
+        if (pos_ >= text_.size()) return false;
+        char c = text_[pos_];
+
+        if (c == '{') {
+            pos_++;
+            value.type = JsonValue::OBJECT;
+            if (consume('}')) return true;
+            do {
+                std::string key;
+                if (!parse_string(key) || !consume(':')) return false;
+                if (!parse_value(value.fields[key])) return false;
+            } while (consume(','));
+            return consume('}');
+        }
+        if (c == '[') {
+            pos_++;
+            value.type = JsonValue::ARRAY;
+            if (consume(']')) return true;
+            do {
+                value.items.emplace_back();
+                if (!parse_value(value.items.back())) return false;
+            } while (consume(','));
+            return consume(']');
+        }
+        if (c == '"') {
+            value.type = JsonValue::STRING;
+            return parse_string(value.text);
+        }
+        if (text_.compare(pos_, 4, "true") == 0 || text_.compare(pos_, 5, "false") == 0) {
+            value.type = JsonValue::BOOL;
+            pos_ += text_[pos_] == 't' ? 4 : 5;
+            return true;
+        }
+        if (text_.compare(pos_, 4, "null") == 0) {
+            pos_ += 4;
+            return true;
+        }
+
+        const char* start = text_.c_str() + pos_;
+        char* end = nullptr;
+        value.type = JsonValue::NUMBER;
+        value.number = strtod(start, &end);
+        if (end == start) return false;
+        pos_ += end - start;
+        return true;
+    }
+
+    const std::string& text_;
+    size_t pos_;
+};
+
+int main(int argc, char** argv) {
+    if (argc != 3) {
+        fprintf(stderr, "Usage: %s FAST_RESIZE_BINARY WORK_DIR\n", argv[0]);
+        return 2;
+    }
+    std::string cli = argv[1];
+    std::string work = test::scratch_dir(argv[2]);
+    std::string input_dir = test::scratch_dir(work + "/in");
+    std::string output_dir = test::scratch_dir(work + "/out");
+    std::string trace_path = work + "/trace.json";
+
+    fastresize::ResizeOptions encode_opts;
+    const char* names[] = {"a.png", "b.jpg", "c.png"};
+    const fastresize::internal::ImageFormat formats[] = {
+        fastresize::internal::FORMAT_PNG, fastresize::internal::FORMAT_JPEG, fastresize::internal::FORMAT_PNG
+    };
+    for (int i = 0; i < 3; ++i) {
+        std::vector<unsigned char> pixels = test::gradient(96 + i * 16, 64, 3);
+        ImageData image = test::image_view(pixels, 96 + i * 16, 64, 3);
+        CHECK(fastresize::internal::encode_image(input_dir + "/" + names[i], image, formats[i], encode_opts));
+    }
+
+    std::string command = "'" + cli + "' batch '" + input_dir + "' '" + output_dir +
+                          "' -w 32 -t 2 --trace '" + trace_path + "'";
+    int status = system(command.c_str());
+    CHECK_MSG(status == 0, "%s exited with %d", command.c_str(), status);
+
+    std::string text;
+    CHECK_MSG(test::read_file(trace_path, text), "no trace at %s", trace_path.c_str());
+
+    JsonValue root;
+    CHECK_MSG(JsonParser(text).parse(root), "trace is not valid JSON");
+
+    const JsonValue* events = root.field("traceEvents");
+    CHECK(root.type == JsonValue::OBJECT && events && events->type == JsonValue::ARRAY);
+    if (!events) return test::finish("cli_trace_test");
+
+    std::set<std::string> stages;
+    size_t complete = 0;
+    for (const JsonValue& event : events->items) {
+        const JsonValue* name = event.field("name");
+        const JsonValue* phase = event.field("ph");
+        CHECK(event.type == JsonValue::OBJECT && name && phase);
+        if (!name || !phase || phase->text != "X") continue;
+
+        const JsonValue* ts = event.field("ts");
+        const JsonValue* dur = event.field("dur");
+        const JsonValue* tid = event.field("tid");
+        CHECK(ts && ts->type == JsonValue::NUMBER && ts->number >= 0.0);
+        CHECK(dur && dur->type == JsonValue::NUMBER && dur->number >= 0.0);
+        CHECK(tid && tid->type == JsonValue::NUMBER);
+        stages.insert(name->text);
+        complete++;
+    }
+
+    // Every image is decoded, resized and encoded once
+    CHECK_MSG(complete >= 9, "%zu complete events", complete);
+    for (const char* stage : {"decode", "resize", "encode"}) {
+        CHECK_MSG(stages.count(stage) == 1, "no \"%s\" events", stage);
+    }
+
+    return test::finish("cli_trace_test");
+}
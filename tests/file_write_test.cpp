@@ -0,0 +1,122 @@
+// Output files: identity copies are byte-identical (small and multi-chunk,
+// plain and atomic), a copy onto itself leaves the file intact, failed
+// atomic writes and copies leave no temporary file behind, and new outputs
+// get 0666 less the umask, as fopen() would give them.
+//
+//   file_write_test WORK_DIR
+
+#include "test_util.h"
+#include <dirent.h>
+#include <cstring>
+
+using fastresize::ResizeOptions;
+using fastresize::internal::ImageData;
+
+static std::vector<unsigned char> pattern_bytes(size_t size) {
+    std::vector<unsigned char> bytes(size);
+    uint32_t state = 12345;
+    for (size_t i = 0; i < size; ++i) {
+        state = state * 1103515245u + 12345u;
+        bytes[i] = (unsigned char)(state >> 16);
+    }
+    return bytes;
+}
+
+static bool same_file(const std::string& path, const std::vector<unsigned char>& expected) {
+    std::string text;
+    return test::read_file(path, text) && text.size() == expected.size() &&
+           memcmp(text.data(), expected.data(), expected.size()) == 0;
+}
+
+// Names in dir containing ".tmp-", the suffix of in-flight writes
+static int temp_files(const std::string& dir) {
+    int count = 0;
+    DIR* handle = opendir(dir.c_str());
+    if (!handle) return -1;
+    struct dirent* ent;
+    while ((ent = readdir(handle)) != nullptr) {
+        if (strstr(ent->d_name, ".tmp-")) count++;
+    }
+    closedir(handle);
+    return count;
+}
+
+static int file_mode(const std::string& path) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 ? (int)(st.st_mode & 0777) : -1;
+}
+
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s WORK_DIR\n", argv[0]);
+        return 2;
+    }
+    std::string work = test::scratch_dir(argv[1]);
+
+    // Copies: under one chunk, several 64 KiB chunks with a partial last one
+    static const size_t sizes[] = {0, 1000, 3 * 64 * 1024 + 77};
+    for (size_t size : sizes) {
+        std::vector<unsigned char> bytes = pattern_bytes(size);
+        std::string source = work + "/source.bin";
+        CHECK(test::write_file(source, bytes));
+
+        for (int atomic = 0; atomic < 2; ++atomic) {
+            std::string copy = work + "/copy" + std::to_string(atomic) + ".bin";
+            // Replaces a longer file, so stale bytes past the end would show
+            CHECK(test::write_file(copy, pattern_bytes(size + 5000)));
+            CHECK(fastresize::internal::copy_image_file(source, copy, atomic != 0));
+            CHECK_MSG(same_file(copy, bytes), "%zu bytes, atomic %d: copy differs", size, atomic);
+        }
+    }
+    CHECK(temp_files(work) == 0);
+
+    // Onto itself, directly and through another name for the same path
+    std::vector<unsigned char> bytes = pattern_bytes(5000);
+    std::string self = work + "/self.bin";
+    CHECK(test::write_file(self, bytes));
+    for (int atomic = 0; atomic < 2; ++atomic) {
+        CHECK(fastresize::internal::copy_image_file(self, self, atomic != 0));
+        CHECK_MSG(same_file(self, bytes), "atomic %d: copy onto itself changed the file", atomic);
+        CHECK(fastresize::internal::copy_image_file(self, work + "/./self.bin", atomic != 0));
+        CHECK_MSG(same_file(self, bytes), "atomic %d: copy onto itself by another name changed the file", atomic);
+    }
+
+    // A target that is a non-empty directory: the rename fails and the
+    // temporary file next to it must be removed
+    std::string blocked = work + "/blocked.png";
+    mkdir(blocked.c_str(), 0755);
+    CHECK(test::write_file(blocked + "/keep", bytes));
+
+    std::vector<unsigned char> pixels = test::gradient(64, 48, 3);
+    ImageData image = test::image_view(pixels, 64, 48, 3);
+    ResizeOptions atomic_opts;
+    atomic_opts.atomic_write = true;
+    CHECK(!fastresize::internal::encode_image(blocked, image, fastresize::internal::FORMAT_PNG, atomic_opts));
+    CHECK_MSG(temp_files(work) == 0, "failed atomic encode left %d temp file(s)", temp_files(work));
+    CHECK(!fastresize::internal::copy_image_file(self, blocked, true));
+    CHECK_MSG(temp_files(work) == 0, "failed atomic copy left %d temp file(s)", temp_files(work));
+
+    // New outputs are 0666 less the umask
+    static const mode_t masks[] = {022, 077, 0};
+    for (mode_t mask : masks) {
+        mode_t previous = umask(mask);
+        int expected = (int)(0666 & ~mask);
+        for (int atomic = 0; atomic < 2; ++atomic) {
+            ResizeOptions opts;
+            opts.atomic_write = atomic != 0;
+            std::string encoded = work + "/mode_encoded" + std::to_string(atomic) + ".png";
+            std::string copied = work + "/mode_copied" + std::to_string(atomic) + ".bin";
+            remove(encoded.c_str());
+            remove(copied.c_str());
+            CHECK(fastresize::internal::encode_image(encoded, image, fastresize::internal::FORMAT_PNG, opts));
+            CHECK(fastresize::internal::copy_image_file(self, copied, atomic != 0));
+            CHECK_MSG(file_mode(encoded) == expected, "umask %03o, atomic %d: encoded output mode %03o",
+                      (int)mask, atomic, file_mode(encoded));
+            CHECK_MSG(file_mode(copied) == expected, "umask %03o, atomic %d: copied output mode %03o",
+                      (int)mask, atomic, file_mode(copied));
+        }
+        umask(previous);
+    }
+
+    return test::finish("file_write_test");
+}
@@ -0,0 +1,362 @@
+// Output geometry of resize(): dimensions and corner pixels for every EXIF
+// orientation, and for COVER crops and CONTAIN padding at every gravity,
+// including the pad colour. The fixture is split into ten flat regions (five bands along
+// its long side, two halves across it) with well separated colours, so each
+// sampled pixel names the stored region it came from, even through JPEG.
+// Expectations are worked out here in display space and mapped back to
+// stored pixels independently of the library's own window code.
+//
+//   geometry_test WORK_DIR
+
+#include "test_util.h"
+#include <cmath>
+#include <cstring>
+#include <jpeglib.h>
+
+using fastresize::ResizeOptions;
+using fastresize::internal::ImageData;
+using fastresize::internal::ImageFormat;
+
+static const int STORED_W = 160;
+static const int STORED_H = 80;
+
+struct Color {
+    int r, g, b, a;
+};
+
+static const Color PALETTE[10] = {
+    {255, 0, 0, 255},   {0, 255, 0, 255},   {0, 0, 255, 255},   {255, 255, 0, 255}, {0, 255, 255, 255},
+    {255, 0, 255, 255}, {255, 255, 255, 255}, {0, 0, 0, 255},   {255, 128, 0, 255}, {0, 128, 255, 255},
+};
+
+// Region of a stored pixel; band boundaries at 1/8, 3/8, 5/8 and 7/8
+static int region_at(double x, double y) {
+    int band = (int)std::floor((x / STORED_W) * 4.0 + 0.5);
+    int half = y < STORED_H / 2 ? 0 : 1;
+    return band * 2 + half;
+}
+
+// Distance from a stored position to the nearest region boundary
+static double boundary_distance(double x, double y) {
+    double distance = std::fabs(y - STORED_H / 2);
+    for (int i = 1; i < 8; i += 2) {
+        distance = std::min(distance, std::fabs(x - STORED_W * i / 8.0));
+    }
+    return distance;
+}
+
+static std::vector<unsigned char> region_pixels(int channels) {
+    std::vector<unsigned char> pixels((size_t)STORED_W * STORED_H * channels);
+    for (int y = 0; y < STORED_H; ++y) {
+        for (int x = 0; x < STORED_W; ++x) {
+            const Color& color = PALETTE[region_at(x + 0.5, y + 0.5)];
+            unsigned char* px = &pixels[((size_t)y * STORED_W + x) * channels];
+            px[0] = (unsigned char)color.r;
+            px[1] = (unsigned char)color.g;
+            px[2] = (unsigned char)color.b;
+            if (channels == 4) px[3] = 255;
+        }
+    }
+    return pixels;
+}
+
+// Baseline 4:2:0 JPEG with an APP1 Exif block holding only Orientation
+static bool write_oriented_jpeg(const std::string& path, const std::vector<unsigned char>& pixels,
+                                int orientation) {
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) return false;
+
+    struct jpeg_compress_struct cinfo;
+    struct jpeg_error_mgr jerr;
+    cinfo.err = jpeg_std_error(&jerr);
+    jpeg_create_compress(&cinfo);
+    jpeg_stdio_dest(&cinfo, file);
+
+    cinfo.image_width = STORED_W;
+    cinfo.image_height = STORED_H;
+    cinfo.input_components = 3;
+    cinfo.in_color_space = JCS_RGB;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, 95, TRUE);
+    jpeg_start_compress(&cinfo, TRUE);
+
+    // "Exif\0\0", big-endian TIFF header, IFD0 with one SHORT entry
+    const unsigned char exif[] = {
+        'E', 'x', 'i', 'f', 0, 0,
+        'M', 'M', 0, 42, 0, 0, 0, 8,
+        0, 1,
+        0x01, 0x12, 0, 3, 0, 0, 0, 1, 0, (unsigned char)orientation, 0, 0,
+        0, 0, 0, 0
+    };
+    jpeg_write_marker(&cinfo, JPEG_APP0 + 1, exif, sizeof(exif));
+
+    while (cinfo.next_scanline < cinfo.image_height) {
+        JSAMPROW row = (JSAMPROW)&pixels[cinfo.next_scanline * STORED_W * 3];
+        jpeg_write_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_compress(&cinfo);
+    jpeg_destroy_compress(&cinfo);
+    return fclose(file) == 0;
+}
+
+// Display position to stored position (continuous coordinates)
+static void display_to_stored(int orientation, double dx, double dy, double& sx, double& sy) {
+    switch (orientation) {
+        case 2:  sx = STORED_W - dx; sy = dy; break;
+        case 3:  sx = STORED_W - dx; sy = STORED_H - dy; break;
+        case 4:  sx = dx; sy = STORED_H - dy; break;
+        case 5:  sx = dy; sy = dx; break;
+        case 6:  sx = dy; sy = STORED_H - dx; break;
+        case 7:  sx = STORED_W - dy; sy = STORED_H - dx; break;
+        case 8:  sx = STORED_W - dy; sy = dx; break;
+        default: sx = dx; sy = dy; break;
+    }
+}
+
+// Display-space rectangle of the source that is read, and where it lands
+struct Expected {
+    int out_w, out_h;
+    double src_x, src_y, src_w, src_h;
+    int dst_x, dst_y, dst_w, dst_h;
+};
+
+// Offset of a crop or letterbox inside slack spare pixels
+static int gravity_offset(ResizeOptions::Gravity gravity, bool vertical, int slack) {
+    switch (gravity) {
+        case ResizeOptions::NORTH:      return vertical ? 0 : slack / 2;
+        case ResizeOptions::SOUTH:      return vertical ? slack : slack / 2;
+        case ResizeOptions::EAST:       return vertical ? slack / 2 : slack;
+        case ResizeOptions::WEST:       return vertical ? slack / 2 : 0;
+        case ResizeOptions::NORTH_EAST: return vertical ? 0 : slack;
+        case ResizeOptions::NORTH_WEST: return 0;
+        case ResizeOptions::SOUTH_EAST: return slack;
+        case ResizeOptions::SOUTH_WEST: return vertical ? slack : 0;
+        default:                        return slack / 2;
+    }
+}
+
+static Expected expected_geometry(const ResizeOptions& opts, int display_w, int display_h) {
+    Expected e;
+    if (opts.mode == ResizeOptions::COVER || opts.mode == ResizeOptions::CONTAIN) {
+        e.out_w = opts.target_width;
+        e.out_h = opts.target_height;
+        e.src_x = e.src_y = 0;
+        e.src_w = display_w;
+        e.src_h = display_h;
+        e.dst_x = e.dst_y = 0;
+        e.dst_w = e.out_w;
+        e.dst_h = e.out_h;
+
+        float ratio_w = (float)e.out_w / display_w;
+        float ratio_h = (float)e.out_h / display_h;
+        if (opts.mode == ResizeOptions::COVER) {
+            // Whole source pixels of the display image are cropped away
+            float ratio = std::max(ratio_w, ratio_h);
+            int crop_w = std::min((int)std::lround(e.out_w / ratio), display_w);
+            int crop_h = std::min((int)std::lround(e.out_h / ratio), display_h);
+            e.src_x = gravity_offset(opts.gravity, false, display_w - crop_w);
+            e.src_y = gravity_offset(opts.gravity, true, display_h - crop_h);
+            e.src_w = crop_w;
+            e.src_h = crop_h;
+        } else {
+            float ratio = std::min(ratio_w, ratio_h);
+            e.dst_w = std::min((int)std::lround(display_w * ratio), e.out_w);
+            e.dst_h = std::min((int)std::lround(display_h * ratio), e.out_h);
+            e.dst_x = gravity_offset(opts.gravity, false, e.out_w - e.dst_w);
+            e.dst_y = gravity_offset(opts.gravity, true, e.out_h - e.dst_h);
+        }
+        return e;
+    }
+
+    if (opts.mode == ResizeOptions::FIT_WIDTH) {
+        e.out_w = opts.target_width;
+        e.out_h = (int)std::lround(display_h * (double)opts.target_width / display_w);
+    } else {
+        double ratio = std::min((double)opts.target_width / display_w, (double)opts.target_height / display_h);
+        e.out_w = (int)std::lround(display_w * ratio);
+        e.out_h = (int)std::lround(display_h * ratio);
+    }
+    e.src_x = e.src_y = 0;
+    e.src_w = display_w;
+    e.src_h = display_h;
+    e.dst_x = e.dst_y = 0;
+    e.dst_w = e.out_w;
+    e.dst_h = e.out_h;
+    return e;
+}
+
+struct Case {
+    ResizeOptions::Mode mode;
+    int width, height;
+};
+
+static Color background_of(unsigned int rgba) {
+    return Color{(int)(rgba >> 24), (int)((rgba >> 16) & 0xFF), (int)((rgba >> 8) & 0xFF), (int)(rgba & 0xFF)};
+}
+
+static bool near(const unsigned char* px, const Color& color, int channels, int tolerance) {
+    int values[4] = {color.r, color.g, color.b, color.a};
+    for (int c = 0; c < channels; ++c) {
+        if (std::abs(px[c] - values[c]) > tolerance) return false;
+    }
+    return true;
+}
+
+// Resizes input and checks the output size, a pixel 3 in from each corner of
+// the output and, when padded, 3 in from each corner of the resized picture
+static void check_case(const std::string& input, const std::string& output, ImageFormat output_format,
+                       int orientation, const ResizeOptions& opts, const char* label) {
+    bool swapped = fastresize::internal::orientation_swaps_axes(orientation);
+    int display_w = swapped ? STORED_H : STORED_W;
+    int display_h = swapped ? STORED_W : STORED_H;
+    Expected e = expected_geometry(opts, display_w, display_h);
+
+    CHECK_MSG(fastresize::resize(input, output, opts), "%s: %s", label, fastresize::get_last_error().c_str());
+    ImageData result = fastresize::internal::decode_image(output, output_format);
+    CHECK_MSG(result.pixels && result.width == e.out_w && result.height == e.out_h,
+              "%s: %dx%d, expected %dx%d", label, result.width, result.height, e.out_w, e.out_h);
+    if (!result.pixels || result.width != e.out_w || result.height != e.out_h) {
+        fastresize::internal::free_image_data(result);
+        return;
+    }
+
+    // Exact for PNG, JPEG output is a second lossy pass
+    int tolerance = output_format == fastresize::internal::FORMAT_JPEG ? 48 : 24;
+    int inset = 3;
+    int xs[4] = {inset, e.out_w - 1 - inset, e.dst_x + inset, e.dst_x + e.dst_w - 1 - inset};
+    int ys[4] = {inset, e.out_h - 1 - inset, e.dst_y + inset, e.dst_y + e.dst_h - 1 - inset};
+    int samples = e.dst_w < e.out_w || e.dst_h < e.out_h ? 4 : 2;
+
+    for (int yi = 0; yi < samples; ++yi) {
+        for (int xi = 0; xi < samples; ++xi) {
+            int ox = xs[xi], oy = ys[yi];
+            const unsigned char* px = result.pixels + ((size_t)oy * result.width + ox) * result.channels;
+
+            if (ox < e.dst_x || ox >= e.dst_x + e.dst_w || oy < e.dst_y || oy >= e.dst_y + e.dst_h) {
+                // JPEG has no alpha to carry the padding's
+                Color pad = background_of(opts.background_color);
+                CHECK_MSG(near(px, pad, result.channels, tolerance),
+                          "%s: padding (%d, %d) is %d,%d,%d, expected %d,%d,%d", label,
+                          ox, oy, px[0], px[1], px[2], pad.r, pad.g, pad.b);
+                continue;
+            }
+
+            double dx = e.src_x + (ox + 0.5 - e.dst_x) * e.src_w / e.dst_w;
+            double dy = e.src_y + (oy + 0.5 - e.dst_y) * e.src_h / e.dst_h;
+            double sx, sy;
+            display_to_stored(orientation, dx, dy, sx, sy);
+            // A fixture that puts a sample on a region edge would test the filter instead
+            CHECK_MSG(boundary_distance(sx, sy) > 6.0, "%s: sample (%d, %d) is on a region edge", label, ox, oy);
+
+            const Color& color = PALETTE[region_at(sx, sy)];
+            CHECK_MSG(near(px, color, result.channels, tolerance),
+                      "%s: pixel (%d, %d) is %d,%d,%d, expected %d,%d,%d (stored %.0f, %.0f)", label,
+                      ox, oy, px[0], px[1], px[2], color.r, color.g, color.b, sx, sy);
+        }
+    }
+    fastresize::internal::free_image_data(result);
+}
+
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s WORK_DIR\n", argv[0]);
+        return 2;
+    }
+    std::string work = test::scratch_dir(argv[1]);
+    std::vector<unsigned char> rgb = region_pixels(3);
+
+    static const Case orient_cases[] = {
+        {ResizeOptions::EXACT_SIZE, 80, 80},
+        {ResizeOptions::FIT_WIDTH, 60, 0},
+    };
+    static const ImageFormat outputs[] = {fastresize::internal::FORMAT_PNG, fastresize::internal::FORMAT_JPEG};
+
+    for (int orientation = 1; orientation <= 8; ++orientation) {
+        std::string input = work + "/orient" + std::to_string(orientation) + ".jpg";
+        CHECK(write_oriented_jpeg(input, rgb, orientation));
+
+        for (const Case& c : orient_cases) {
+            for (ImageFormat format : outputs) {
+                ResizeOptions opts;
+                opts.mode = c.mode;
+                opts.target_width = c.width;
+                opts.target_height = c.height;
+                opts.quality = 95;
+
+                std::string output = work + "/out." + fastresize::internal::format_to_string(format);
+                char label[96];
+                snprintf(label, sizeof(label), "orientation %d, mode %d %dx%d -> %s", orientation,
+                         (int)c.mode, c.width, c.height, fastresize::internal::format_to_string(format).c_str());
+                check_case(input, output, format, orientation, opts, label);
+            }
+        }
+
+        // Without auto_orient the stored layout comes out as is
+        ResizeOptions opts;
+        opts.mode = ResizeOptions::FIT_WIDTH;
+        opts.target_width = 80;
+        opts.auto_orient = false;
+        char label[64];
+        snprintf(label, sizeof(label), "orientation %d ignored", orientation);
+        check_case(input, work + "/out.png", fastresize::internal::FORMAT_PNG, 1, opts, label);
+    }
+
+    // COVER crops and CONTAIN letterboxes in both directions, at every
+    // gravity and orientation. Orientation 1 COVER from JPEG resizes the
+    // planar YCbCr planes; everything else goes through the RGB kernels.
+    static const Case fit_cases[] = {
+        {ResizeOptions::COVER, 60, 60},
+        {ResizeOptions::COVER, 22, 52},
+        {ResizeOptions::CONTAIN, 60, 60},
+        {ResizeOptions::CONTAIN, 150, 50},
+    };
+    static const ResizeOptions::Gravity gravities[] = {
+        ResizeOptions::CENTER, ResizeOptions::NORTH, ResizeOptions::SOUTH,
+        ResizeOptions::EAST, ResizeOptions::WEST, ResizeOptions::NORTH_EAST,
+        ResizeOptions::NORTH_WEST, ResizeOptions::SOUTH_EAST, ResizeOptions::SOUTH_WEST
+    };
+
+    for (int orientation = 1; orientation <= 8; ++orientation) {
+        std::string input = work + "/orient" + std::to_string(orientation) + ".jpg";
+        for (const Case& c : fit_cases) {
+            for (ResizeOptions::Gravity gravity : gravities) {
+                for (ImageFormat format : outputs) {
+                    ResizeOptions opts;
+                    opts.mode = c.mode;
+                    opts.target_width = c.width;
+                    opts.target_height = c.height;
+                    opts.gravity = gravity;
+                    opts.background_color = 0x40C080FF;
+                    opts.quality = 95;
+
+                    std::string output = work + "/out." + fastresize::internal::format_to_string(format);
+                    char label[112];
+                    snprintf(label, sizeof(label), "orientation %d, %s %dx%d, gravity %d -> %s", orientation,
+                             c.mode == ResizeOptions::COVER ? "cover" : "contain", c.width, c.height,
+                             (int)gravity, fastresize::internal::format_to_string(format).c_str());
+                    check_case(input, output, format, orientation, opts, label);
+                }
+            }
+        }
+    }
+
+    // RGBA keeps the padding's alpha
+    std::vector<unsigned char> rgba = region_pixels(4);
+    std::string rgba_input = work + "/rgba.png";
+    ImageData rgba_image = test::image_view(rgba, STORED_W, STORED_H, 4);
+    CHECK(fastresize::internal::encode_image(rgba_input, rgba_image, fastresize::internal::FORMAT_PNG,
+                                             ResizeOptions()));
+    for (ResizeOptions::Gravity gravity : gravities) {
+        ResizeOptions opts;
+        opts.mode = ResizeOptions::CONTAIN;
+        opts.target_width = 60;
+        opts.target_height = 60;
+        opts.gravity = gravity;
+        opts.background_color = 0x40C08080;
+        char label[64];
+        snprintf(label, sizeof(label), "rgba contain, gravity %d", (int)gravity);
+        check_case(rgba_input, work + "/rgba_out.png", fastresize::internal::FORMAT_PNG, 1, opts, label);
+    }
+
+    return test::finish("geometry_test");
+}
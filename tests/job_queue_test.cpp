@@ -0,0 +1,204 @@
+// The asynchronous job queue: futures and callbacks of submitted jobs,
+// QUEUE_FULL from a bounded queue whose encode stage is held up, a
+// callback that throws, and destroy_job_queue() finishing pending work.
+//
+//   job_queue_test full|throw|drain WORK_DIR
+
+#include "test_util.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+using fastresize::BatchItem;
+using fastresize::JobHandle;
+using fastresize::JobQueue;
+using fastresize::JobQueueOptions;
+using fastresize::JobResult;
+using fastresize::ItemResult;
+using fastresize::ResizeOptions;
+using fastresize::internal::ImageData;
+
+static std::string g_input;
+static std::string g_work;
+
+static BatchItem make_item(const std::string& name) {
+    BatchItem item;
+    item.input_path = g_input;
+    item.output_path = g_work + "/" + name + ".jpg";
+    item.options.mode = ResizeOptions::FIT_WIDTH;
+    item.options.target_width = 48;
+    return item;
+}
+
+static bool file_exists(const std::string& path) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 && st.st_size > 0;
+}
+
+static bool resized(const JobHandle& handle) {
+    if (handle.id == 0) return false;
+    JobResult result = handle.result.get();
+    return result.id == handle.id && result.item.outcome == ItemResult::RESIZED &&
+           result.item.output_width == 48 && result.error.empty();
+}
+
+static JobQueueOptions one_thread_per_stage(size_t capacity) {
+    JobQueueOptions options;
+    options.num_threads = 1;
+    options.queue_capacity = capacity;
+    return options;
+}
+
+// The first callback holds the single encode thread until released, so
+// the stages behind it fill and try_submit_job() must refuse more
+static void test_queue_full() {
+    JobQueue* queue = fastresize::create_job_queue(one_thread_per_stage(1));
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    bool blocked = false;
+    bool released = false;
+    std::atomic<int> callbacks(0);
+
+    auto callback = [&](const JobResult&) {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (callbacks.fetch_add(1) == 0) {
+            blocked = true;
+            changed.notify_all();
+            changed.wait(lock, [&]() { return released; });
+        }
+    };
+
+    std::vector<JobHandle> handles;
+    handles.push_back(fastresize::submit_job(queue, make_item("full0"), callback));
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        CHECK(changed.wait_for(lock, std::chrono::seconds(10), [&]() { return blocked; }));
+    }
+
+    // One job per stage queue and per stage thread at most can be in flight
+    bool full = false;
+    for (int attempt = 0; attempt < 200 && !full; ++attempt) {
+        JobHandle handle;
+        fastresize::SubmitStatus status =
+            fastresize::try_submit_job(queue, make_item("full" + std::to_string(handles.size())), handle, callback);
+        if (status == fastresize::QUEUE_FULL) {
+            full = true;
+            CHECK(handle.id == 0);
+        } else {
+            CHECK(status == fastresize::SUBMITTED && handle.id != 0);
+            handles.push_back(handle);
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+    }
+    CHECK_MSG(full, "never QUEUE_FULL after %zu submissions", handles.size());
+    CHECK_MSG(handles.size() <= 8, "%zu jobs accepted by a pipeline of capacity 1", handles.size());
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        released = true;
+    }
+    changed.notify_all();
+
+    fastresize::wait_job_queue(queue);
+    for (size_t i = 0; i < handles.size(); ++i) {
+        CHECK_MSG(resized(handles[i]), "job %zu", i);
+    }
+    CHECK(callbacks.load() == (int)handles.size());
+
+    // Room again once the queue drained
+    JobHandle handle;
+    CHECK(fastresize::try_submit_job(queue, make_item("after"), handle) == fastresize::SUBMITTED);
+    CHECK(resized(handle));
+    fastresize::destroy_job_queue(queue);
+}
+
+// A throwing callback still completes its job, and the encode thread lives
+// on to finish the next ones
+static void test_callback_throws() {
+    JobQueue* queue = fastresize::create_job_queue(one_thread_per_stage(4));
+
+    JobHandle thrown = fastresize::submit_job(queue, make_item("thrown"), [](const JobResult&) {
+        throw std::runtime_error("callback failure");
+    });
+    CHECK(resized(thrown));
+    CHECK(file_exists(make_item("thrown").output_path));
+
+    std::atomic<int> callbacks(0);
+    std::vector<JobHandle> handles;
+    for (int i = 0; i < 3; ++i) {
+        handles.push_back(fastresize::submit_job(queue, make_item("next" + std::to_string(i)),
+                                                 [&](const JobResult&) { callbacks++; }));
+    }
+
+    // A failing job reports through both the future and the callback
+    BatchItem missing = make_item("missing");
+    missing.input_path = g_work + "/missing.png";
+    std::string callback_error;
+    JobHandle failed = fastresize::submit_job(queue, missing, [&](const JobResult& result) {
+        callback_error = result.error;
+    });
+
+    fastresize::wait_job_queue(queue);
+    for (size_t i = 0; i < handles.size(); ++i) {
+        CHECK_MSG(resized(handles[i]), "job %zu after the throw", i);
+    }
+    CHECK(callbacks.load() == 3);
+
+    JobResult result = failed.result.get();
+    CHECK(result.item.outcome == ItemResult::FAILED && result.item.status != fastresize::OK);
+    CHECK(!result.error.empty() && result.error == callback_error);
+    fastresize::destroy_job_queue(queue);
+}
+
+// destroy_job_queue() right after submitting finishes every job first
+static void test_drain() {
+    JobQueue* queue = fastresize::create_job_queue(one_thread_per_stage(2));
+
+    static const int JOBS = 12;
+    std::atomic<int> callbacks(0);
+    std::vector<JobHandle> handles;
+    for (int i = 0; i < JOBS; ++i) {
+        handles.push_back(fastresize::submit_job(queue, make_item("drain" + std::to_string(i)),
+                                                 [&](const JobResult&) { callbacks++; }));
+        CHECK(handles.back().id != 0);
+    }
+    fastresize::destroy_job_queue(queue);
+
+    CHECK_MSG(callbacks.load() == JOBS, "%d of %d callbacks ran", callbacks.load(), JOBS);
+    for (int i = 0; i < JOBS; ++i) {
+        bool ready = handles[i].result.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+        CHECK_MSG(ready && resized(handles[i]), "job %d not finished by destroy_job_queue()", i);
+        CHECK(file_exists(make_item("drain" + std::to_string(i)).output_path));
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc != 3) {
+        fprintf(stderr, "Usage: %s full|throw|drain WORK_DIR\n", argv[0]);
+        return 2;
+    }
+    std::string test_case = argv[1];
+    g_work = test::scratch_dir(argv[2]);
+    g_input = g_work + "/input.png";
+
+    std::vector<unsigned char> pixels = test::gradient(96, 64, 3);
+    ImageData image = test::image_view(pixels, 96, 64, 3);
+    CHECK(fastresize::internal::encode_image(g_input, image, fastresize::internal::FORMAT_PNG, ResizeOptions()));
+
+    if (test_case == "full") {
+        test_queue_full();
+    } else if (test_case == "throw") {
+        test_callback_throws();
+    } else if (test_case == "drain") {
+        test_drain();
+    } else {
+        fprintf(stderr, "Unknown case: %s\n", test_case.c_str());
+        return 2;
+    }
+
+    return test::finish(("job_queue_test " + test_case).c_str());
+}
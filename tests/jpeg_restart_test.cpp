@@ -0,0 +1,125 @@
+// The restart-marker strip decoder must reproduce the serial libjpeg decode
+// byte for byte: JPEGs written with restart intervals are decoded both ways
+// at DCT scales 1, 2, 4 and 8, for sizes and strip counts that leave
+// partial MCU rows and uneven strips.
+//
+//   jpeg_restart_test WORK_DIR
+
+#include "test_util.h"
+#include <cstring>
+#include <jpeglib.h>
+
+using fastresize::internal::ImageData;
+
+struct RestartCase {
+    int width, height, channels;
+    int restart_rows;       // restart_in_rows, or 0 to use restart_mcus
+    int restart_mcus;
+};
+
+static bool write_restart_jpeg(const std::string& path, const std::vector<unsigned char>& pixels,
+                               const RestartCase& spec) {
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) return false;
+
+    struct jpeg_compress_struct cinfo;
+    struct jpeg_error_mgr jerr;
+    cinfo.err = jpeg_std_error(&jerr);
+    jpeg_create_compress(&cinfo);
+    jpeg_stdio_dest(&cinfo, file);
+
+    cinfo.image_width = spec.width;
+    cinfo.image_height = spec.height;
+    cinfo.input_components = spec.channels;
+    cinfo.in_color_space = spec.channels == 1 ? JCS_GRAYSCALE : JCS_RGB;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, 90, TRUE);
+    if (spec.restart_rows > 0) {
+        cinfo.restart_in_rows = spec.restart_rows;
+    } else {
+        cinfo.restart_interval = spec.restart_mcus;
+    }
+
+    jpeg_start_compress(&cinfo, TRUE);
+    size_t stride = (size_t)spec.width * spec.channels;
+    while (cinfo.next_scanline < cinfo.image_height) {
+        JSAMPROW row = (JSAMPROW)&pixels[cinfo.next_scanline * stride];
+        jpeg_write_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_compress(&cinfo);
+    jpeg_destroy_compress(&cinfo);
+    return fclose(file) == 0;
+}
+
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s WORK_DIR\n", argv[0]);
+        return 2;
+    }
+    std::string work = test::scratch_dir(argv[1]);
+
+    static const RestartCase cases[] = {
+        {203, 157, 3, 1, 0},    // 4:2:0, 10 MCU rows with a partial last one
+        {203, 157, 3, 3, 0},    // Strips of several rows, uneven split
+        {256, 120, 3, 0, 5},    // Interval not a row: only some restarts begin a row
+        {150, 93, 1, 1, 0},     // Grayscale, 8-line MCUs
+        {150, 93, 1, 0, 19},    // Grayscale, 19 MCUs = one row
+    };
+    static const int scales[] = {1, 2, 4, 8};
+    static const size_t strip_counts[] = {2, 3, 7, 64};
+
+    for (const RestartCase& spec : cases) {
+        std::vector<unsigned char> pixels = test::gradient(spec.width, spec.height, spec.channels);
+        std::string path = work + "/restart.jpg";
+        CHECK(write_restart_jpeg(path, pixels, spec));
+
+        for (int scale : scales) {
+            int target_w = spec.width / scale;
+            int target_h = spec.height / scale;
+
+            // Too small for the size threshold, so decode_image() is serial
+            ImageData serial = fastresize::internal::decode_image(path, fastresize::internal::FORMAT_JPEG,
+                                                                  target_w, target_h);
+            CHECK(serial.pixels != nullptr);
+            if (!serial.pixels) continue;
+            CHECK_MSG(serial.width == (spec.width + scale - 1) / scale,
+                      "%dx%d at 1/%d decoded %d wide", spec.width, spec.height, scale, serial.width);
+
+            for (size_t strips : strip_counts) {
+                ImageData parallel = fastresize::internal::decode_jpeg_strips(path, target_w, target_h, strips);
+                bool same = parallel.pixels && parallel.width == serial.width &&
+                            parallel.height == serial.height && parallel.channels == serial.channels &&
+                            memcmp(parallel.pixels, serial.pixels,
+                                   (size_t)serial.width * serial.height * serial.channels) == 0;
+                CHECK_MSG(same, "%dx%dx%d, restart %d rows / %d MCUs, 1/%d, %zu strips: %s",
+                          spec.width, spec.height, spec.channels, spec.restart_rows, spec.restart_mcus,
+                          scale, strips, parallel.pixels ? "pixels differ" : "strip decode failed");
+                fastresize::internal::free_image_data(parallel);
+            }
+            fastresize::internal::free_image_data(serial);
+        }
+    }
+
+    // Headers with a restart interval but no scan: truncated before the SOS
+    // marker, the strip decoder must refuse it rather than scan from nowhere
+    {
+        RestartCase spec = {203, 157, 3, 1, 0};
+        std::vector<unsigned char> pixels = test::gradient(spec.width, spec.height, spec.channels);
+        std::string path = work + "/restart.jpg";
+        CHECK(write_restart_jpeg(path, pixels, spec));
+
+        std::string text;
+        CHECK(test::read_file(path, text));
+        size_t sos = text.find("\xFF\xDA");
+        CHECK(sos != std::string::npos);
+        std::vector<unsigned char> truncated(text.begin(), text.begin() + (sos == std::string::npos ? 0 : sos));
+        std::string truncated_path = work + "/no_scan.jpg";
+        CHECK(test::write_file(truncated_path, truncated));
+
+        ImageData parallel = fastresize::internal::decode_jpeg_strips(truncated_path, spec.width, spec.height, 4);
+        CHECK_MSG(parallel.pixels == nullptr, "decoded a JPEG without a scan");
+        fastresize::internal::free_image_data(parallel);
+    }
+
+    return test::finish("jpeg_restart_test");
+}
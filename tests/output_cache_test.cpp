@@ -0,0 +1,140 @@
+// Output cache behaviour through the public API: a repeated resize is a
+// hit, a change of options or of the source's bytes is a miss, inputs with
+// identical content share one entry, and eviction keeps the cache
+// directory within max_bytes.
+//
+//   output_cache_test WORK_DIR
+
+#include "test_util.h"
+#include <dirent.h>
+
+using fastresize::ResizeOptions;
+using fastresize::internal::ImageData;
+
+// Number and total size of the entry files in the cache directory
+static void scan_cache(const std::string& dir, size_t& files, size_t& bytes) {
+    files = 0;
+    bytes = 0;
+    DIR* handle = opendir(dir.c_str());
+    if (!handle) return;
+    struct dirent* ent;
+    while ((ent = readdir(handle)) != nullptr) {
+        if (ent->d_name[0] == '.') continue;
+        struct stat st;
+        std::string path = dir + "/" + ent->d_name;
+        if (stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode)) {
+            files++;
+            bytes += st.st_size;
+        }
+    }
+    closedir(handle);
+}
+
+static bool write_png(const std::string& path, int width, int height, int seed) {
+    std::vector<unsigned char> pixels = test::gradient(width, height, 3);
+    for (size_t i = 0; i < pixels.size(); i += 97) {
+        pixels[i] = (unsigned char)(pixels[i] + seed);
+    }
+    ImageData image = test::image_view(pixels, width, height, 3);
+    return fastresize::internal::encode_image(path, image, fastresize::internal::FORMAT_PNG, ResizeOptions());
+}
+
+static ResizeOptions fit_width(int width) {
+    ResizeOptions opts;
+    opts.mode = ResizeOptions::FIT_WIDTH;
+    opts.target_width = width;
+    return opts;
+}
+
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s WORK_DIR\n", argv[0]);
+        return 2;
+    }
+    std::string work = test::scratch_dir(argv[1]);
+    std::string cache_dir = test::scratch_dir(work + "/cache");
+    std::string input = work + "/input.png";
+    CHECK(write_png(input, 240, 160, 0));
+
+    CHECK(fastresize::enable_output_cache(cache_dir, 0));
+
+    // First run stores, the same resize again is a hit with the same bytes
+    CHECK(fastresize::resize(input, work + "/first.png", fit_width(120)));
+    fastresize::OutputCacheStats stats = fastresize::get_output_cache_stats();
+    CHECK_MSG(stats.hits == 0 && stats.misses == 1 && stats.entries == 1,
+              "after the first run: %llu hits, %llu misses, %zu entries",
+              (unsigned long long)stats.hits, (unsigned long long)stats.misses, stats.entries);
+
+    CHECK(fastresize::resize(input, work + "/second.png", fit_width(120)));
+    stats = fastresize::get_output_cache_stats();
+    CHECK_MSG(stats.hits == 1 && stats.entries == 1, "repeat: %llu hits, %zu entries",
+              (unsigned long long)stats.hits, stats.entries);
+    std::string first, second;
+    CHECK(test::read_file(work + "/first.png", first) && test::read_file(work + "/second.png", second));
+    CHECK_MSG(!first.empty() && first == second, "the hit wrote different bytes");
+
+    // Other options miss
+    CHECK(fastresize::resize(input, work + "/narrow.png", fit_width(100)));
+    stats = fastresize::get_output_cache_stats();
+    CHECK_MSG(stats.hits == 1 && stats.misses == 2 && stats.entries == 2,
+              "new options: %llu hits, %llu misses, %zu entries",
+              (unsigned long long)stats.hits, (unsigned long long)stats.misses, stats.entries);
+
+    // A copy under another name has the same content: one shared entry
+    std::string copy = work + "/copy.png";
+    std::string bytes;
+    CHECK(test::read_file(input, bytes));
+    CHECK(test::write_file(copy, std::vector<unsigned char>(bytes.begin(), bytes.end())));
+    CHECK(fastresize::resize(copy, work + "/from_copy.png", fit_width(120)));
+    stats = fastresize::get_output_cache_stats();
+    CHECK_MSG(stats.hits == 2 && stats.entries == 2, "identical content: %llu hits, %zu entries",
+              (unsigned long long)stats.hits, stats.entries);
+
+    // Rewritten source bytes miss, and the output follows the new source
+    CHECK(write_png(input, 240, 160, 1));
+    CHECK(fastresize::resize(input, work + "/changed.png", fit_width(120)));
+    stats = fastresize::get_output_cache_stats();
+    CHECK_MSG(stats.hits == 2 && stats.misses == 3 && stats.entries == 3,
+              "changed source: %llu hits, %llu misses, %zu entries",
+              (unsigned long long)stats.hits, (unsigned long long)stats.misses, stats.entries);
+    std::string changed;
+    CHECK(test::read_file(work + "/changed.png", changed));
+    CHECK_MSG(changed != first, "a changed source got the old output");
+
+    size_t files, dir_bytes;
+    scan_cache(cache_dir, files, dir_bytes);
+    CHECK_MSG(files == 3 && dir_bytes == stats.bytes, "%zu files of %zu bytes for %zu entries of %zu bytes",
+              files, dir_bytes, stats.entries, stats.bytes);
+
+    // A limit of about three entries: more stores evict down to it
+    size_t entry_bytes = first.size();
+    size_t max_bytes = entry_bytes * 3;
+    fastresize::disable_output_cache();
+    std::string small_dir = test::scratch_dir(work + "/small");
+    CHECK(fastresize::enable_output_cache(small_dir, max_bytes));
+    for (int width = 110; width <= 130; width += 2) {
+        CHECK(fastresize::resize(input, work + "/evict.png", fit_width(width)));
+        stats = fastresize::get_output_cache_stats();
+        scan_cache(small_dir, files, dir_bytes);
+        CHECK_MSG(stats.bytes <= max_bytes && dir_bytes <= max_bytes,
+                  "width %d: cache holds %zu bytes, directory %zu, limit %zu",
+                  width, stats.bytes, dir_bytes, max_bytes);
+        CHECK_MSG(files == stats.entries, "width %d: %zu files for %zu entries", width, files, stats.entries);
+    }
+    CHECK_MSG(stats.entries >= 1 && stats.entries < 11, "%zu entries left of 11 stores", stats.entries);
+
+    // The most recent store survives eviction
+    CHECK(fastresize::resize(input, work + "/evict.png", fit_width(130)));
+    CHECK(fastresize::get_output_cache_stats().hits == stats.hits + 1);
+
+    // Entries left by an earlier enable are reused
+    fastresize::disable_output_cache();
+    CHECK(fastresize::enable_output_cache(small_dir, max_bytes));
+    stats = fastresize::get_output_cache_stats();
+    CHECK_MSG(stats.entries == files && stats.hits == 0, "reloaded %zu entries of %zu files", stats.entries, files);
+    CHECK(fastresize::resize(input, work + "/evict.png", fit_width(130)));
+    CHECK(fastresize::get_output_cache_stats().hits == 1);
+
+    fastresize::disable_output_cache();
+    return test::finish("output_cache_test");
+}
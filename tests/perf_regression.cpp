@@ -0,0 +1,393 @@
+// Performance regression gate.
+//
+// Runs the end-to-end batch on a fixed synthetic corpus (plain and
+// max_speed), measures images/sec, peak RSS and p99 per-image latency, and
+// compares them to a checked-in baseline with per-metric tolerance bands.
+// Every output of each mode is then checked against the double-precision
+// reference resample compare_resize() uses, so a faster kernel can't
+// silently trade away quality. Exits non-zero on any regression, and with
+// SKIP_EXIT_CODE when the baseline was recorded for another workload.
+//
+// Baselines are machine specific: record one on the machine that runs the
+// gate with --update-baseline.
+
+#include <fastresize.h>
+#include "internal.h"
+#include "trace.h"
+#include "bench_corpus.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/resource.h>
+#include <sys/stat.h>
+
+using fastresize::ResizeOptions;
+using fastresize::internal::ImageData;
+
+struct Metrics {
+    double images_per_sec = 0.0;
+    double peak_rss_mb = 0.0;
+    double p99_ms = 0.0;
+};
+
+struct Tolerance {
+    double images_per_sec = 0.25;   // Allowed drop, as a fraction of the baseline
+    double peak_rss_mb = 0.25;      // Allowed growth
+    double p99_ms = 0.50;
+};
+
+static const char* MODES[] = {"plain", "max_speed"};
+
+// Exit status when the baseline's workload isn't this machine's; ctest
+// reports the test as skipped (SKIP_RETURN_CODE in tests/CMakeLists.txt)
+static const int SKIP_EXIT_CODE = 77;
+
+// What the numbers were measured on. Optional encoders change the corpus
+// (no libwebp, no WebP images) and the core count changes the thread
+// counts, so numbers from another workload can't be compared.
+struct Workload {
+    int images = 0;
+    int jpeg = 0;
+    int png = 0;
+    int webp = 0;
+    int bmp = 0;
+    int cores = 0;
+};
+
+static const char* const WORKLOAD_KEYS[] = {"images", "jpeg", "png", "webp", "bmp", "cores"};
+
+static int* workload_fields(Workload& workload, int index) {
+    int* fields[] = {&workload.images, &workload.jpeg, &workload.png,
+                     &workload.webp, &workload.bmp, &workload.cores};
+    return fields[index];
+}
+
+static Workload current_workload(const std::vector<bench::CorpusImage>& corpus) {
+    Workload workload;
+    workload.images = (int)corpus.size();
+    for (const bench::CorpusImage& image : corpus) {
+        switch (image.format) {
+            case fastresize::internal::FORMAT_JPEG: workload.jpeg++; break;
+            case fastresize::internal::FORMAT_PNG:  workload.png++; break;
+            case fastresize::internal::FORMAT_WEBP: workload.webp++; break;
+            default:                                workload.bmp++; break;
+        }
+    }
+    workload.cores = (int)std::thread::hardware_concurrency();
+    return workload;
+}
+
+static std::string describe(Workload workload) {
+    std::string text;
+    for (int i = 0; i < 6; ++i) {
+        if (!text.empty()) text += ", ";
+        text += std::to_string(*workload_fields(workload, i)) + " " + WORKLOAD_KEYS[i];
+    }
+    return text;
+}
+
+// Number after "key": inside the object that follows "section": in our own
+// baseline format; good enough for a file this test also writes
+static bool json_number(const std::string& text, const std::string& section,
+                        const std::string& key, double& value) {
+    size_t start = text.find("\"" + section + "\"");
+    if (start == std::string::npos) return false;
+    size_t end = text.find('}', start);
+    size_t pos = text.find("\"" + key + "\"", start);
+    if (pos == std::string::npos || pos > end) return false;
+    pos = text.find(':', pos);
+    if (pos == std::string::npos) return false;
+    value = std::strtod(text.c_str() + pos + 1, nullptr);
+    return true;
+}
+
+// Drops the process's peak RSS back to its current RSS (Linux 4.0+)
+static bool reset_peak_rss() {
+    FILE* file = fopen("/proc/self/clear_refs", "w");
+    if (!file) return false;
+    bool ok = fputs("5", file) >= 0;
+    return fclose(file) == 0 && ok;
+}
+
+static double peak_rss_mb() {
+    FILE* file = fopen("/proc/self/status", "r");
+    if (file) {
+        char line[256];
+        while (fgets(line, sizeof(line), file)) {
+            long kb;
+            if (sscanf(line, "VmHWM: %ld kB", &kb) == 1) {
+                fclose(file);
+                return kb / 1024.0;
+            }
+        }
+        fclose(file);
+    }
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return usage.ru_maxrss / (1024.0 * 1024.0);
+#else
+    return usage.ru_maxrss / 1024.0;
+#endif
+}
+
+static double percentile(std::vector<double> values, double fraction) {
+    if (values.empty()) return 0.0;
+    std::sort(values.begin(), values.end());
+    size_t index = (size_t)std::ceil(fraction * values.size());
+    return values[index > 0 ? index - 1 : 0];
+}
+
+static ResizeOptions gate_options() {
+    ResizeOptions opts;
+    opts.mode = ResizeOptions::FIT_WIDTH;
+    opts.target_width = 800;
+    return opts;
+}
+
+// Best throughput of runs; p99 latency and peak RSS over all of them
+static bool measure(const std::vector<std::string>& inputs, const std::string& out_dir,
+                    bool max_speed, int runs, Metrics& metrics) {
+    ResizeOptions opts = gate_options();
+
+    fastresize::BatchOptions batch_opts;
+    batch_opts.max_speed = max_speed;
+
+    bool rss_reset = reset_peak_rss();
+    double rss_before = peak_rss_mb();
+
+    std::vector<double> latencies;
+    for (int run = 0; run < runs; ++run) {
+        uint64_t start = fastresize::internal::trace_now();
+        fastresize::BatchResult result = fastresize::batch_resize(inputs, out_dir, opts, batch_opts);
+        double seconds = (fastresize::internal::trace_now() - start) / 1e9;
+
+        if (result.failed > 0) {
+            for (const std::string& error : result.errors) {
+                std::cerr << "  " << error << "\n";
+            }
+            return false;
+        }
+
+        metrics.images_per_sec = std::max(metrics.images_per_sec, inputs.size() / seconds);
+        for (const fastresize::ItemResult& item : result.items) {
+            latencies.push_back(item.total_us / 1000.0);
+        }
+    }
+
+    metrics.p99_ms = percentile(latencies, 0.99);
+    // Without a resettable peak, report the growth over what came before
+    metrics.peak_rss_mb = rss_reset ? peak_rss_mb() : peak_rss_mb() - rss_before;
+    return true;
+}
+
+// Lowest PSNR of any output against its reference; -1 when one can't be read
+// or doesn't have the reference's layout
+static double lowest_psnr(const std::vector<bench::CorpusImage>& corpus, const std::string& out_dir,
+                          std::string& worst) {
+    ResizeOptions opts = gate_options();
+    double lowest = 99.0;
+    for (const bench::CorpusImage& image : corpus) {
+        std::string name = image.path.substr(image.path.find_last_of('/') + 1);
+        std::string output_path = out_dir + "/" + name;
+
+        ImageData input = fastresize::internal::decode_image(image.path, image.format);
+        ImageData output = fastresize::internal::decode_image(output_path, image.format);
+        if (!input.pixels || !output.pixels || input.channels != output.channels) {
+            fastresize::internal::free_image_data(input);
+            fastresize::internal::free_image_data(output);
+            worst = name;
+            return -1.0;
+        }
+
+        std::vector<unsigned char> reference = fastresize::internal::reference_resize(
+            input, opts.auto_orient ? input.orientation : 1, output.width, output.height, opts);
+        fastresize::QualityReport report;
+        fastresize::internal::measure_quality(output.pixels, reference.data(), output.width,
+                                              output.height, output.channels, report);
+        if (report.psnr < lowest) {
+            lowest = report.psnr;
+            worst = name;
+        }
+
+        fastresize::internal::free_image_data(input);
+        fastresize::internal::free_image_data(output);
+    }
+    return lowest;
+}
+
+static bool write_baseline(const std::string& path, Workload workload, const Metrics* metrics,
+                           const Tolerance& tolerance, double min_psnr) {
+    std::ofstream out(path);
+    out << "{\n";
+    out << "  \"workload\": {";
+    for (int i = 0; i < 6; ++i) {
+        out << (i > 0 ? ", " : "") << "\"" << WORKLOAD_KEYS[i] << "\": " << *workload_fields(workload, i);
+    }
+    out << "},\n";
+    out << "  \"tolerance\": {\"images_per_sec\": " << tolerance.images_per_sec
+        << ", \"peak_rss_mb\": " << tolerance.peak_rss_mb
+        << ", \"p99_ms\": " << tolerance.p99_ms << "},\n";
+    out << "  \"golden\": {\"min_psnr_db\": " << min_psnr << "},\n";
+    for (int i = 0; i < 2; ++i) {
+        out << "  \"" << MODES[i] << "\": {\"images_per_sec\": " << metrics[i].images_per_sec
+            << ", \"peak_rss_mb\": " << metrics[i].peak_rss_mb
+            << ", \"p99_ms\": " << metrics[i].p99_ms << "}" << (i == 0 ? ",\n" : "\n");
+    }
+    out << "}\n";
+    return out.good();
+}
+
+static bool check(const char* mode, const char* metric, double value, double baseline,
+                  double tolerance, bool higher_is_better) {
+    double limit = higher_is_better ? baseline * (1.0 - tolerance) : baseline * (1.0 + tolerance);
+    bool ok = higher_is_better ? value >= limit : value <= limit;
+    printf("  %-10s %-15s %10.2f  baseline %10.2f  limit %10.2f  %s\n", mode, metric,
+           value, baseline, limit, ok ? "ok" : "REGRESSION");
+    return ok;
+}
+
+int main(int argc, char** argv) {
+    std::string baseline_path = "perf_baseline.json";
+    std::string corpus_dir = "perf_corpus";
+    std::string out_dir = "perf_out";
+    int runs = 3;
+    bool update = false;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--baseline" && i + 1 < argc) {
+            baseline_path = argv[++i];
+        } else if (arg == "--corpus" && i + 1 < argc) {
+            corpus_dir = argv[++i];
+        } else if (arg == "--out" && i + 1 < argc) {
+            out_dir = argv[++i];
+        } else if (arg == "--runs" && i + 1 < argc) {
+            runs = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--update-baseline") {
+            update = true;
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [--baseline FILE] [--corpus DIR] [--out DIR]"
+                      << " [--runs N] [--update-baseline]\n";
+            return 2;
+        }
+    }
+
+    std::string baseline;
+    Tolerance tolerance;
+    double min_psnr = 30.0;
+    {
+        std::ifstream in(baseline_path);
+        std::stringstream text;
+        text << in.rdbuf();
+        baseline = text.str();
+    }
+    if (baseline.empty() && !update) {
+        std::cerr << "Error: Cannot read baseline " << baseline_path
+                  << " (record one with --update-baseline)\n";
+        return 2;
+    }
+    // An update keeps the tolerances and quality floor already in the file
+    json_number(baseline, "tolerance", "images_per_sec", tolerance.images_per_sec);
+    json_number(baseline, "tolerance", "peak_rss_mb", tolerance.peak_rss_mb);
+    json_number(baseline, "tolerance", "p99_ms", tolerance.p99_ms);
+    json_number(baseline, "golden", "min_psnr_db", min_psnr);
+
+    // Fixed corpus: the small and medium buckets, two images of each kind
+    bench::CorpusSpec spec;
+    spec.include_large = false;
+    std::vector<bench::CorpusImage> corpus;
+    if (!bench::generate_corpus(corpus_dir, spec, corpus)) {
+        return 2;
+    }
+    // Each mode writes its own outputs, so both get quality checked
+    mkdir(out_dir.c_str(), 0755);
+    std::string mode_dirs[2];
+    for (int i = 0; i < 2; ++i) {
+        mode_dirs[i] = out_dir + "/" + MODES[i];
+        mkdir(mode_dirs[i].c_str(), 0755);
+    }
+
+    std::vector<std::string> inputs;
+    for (const bench::CorpusImage& image : corpus) {
+        inputs.push_back(image.path);
+    }
+    printf("Corpus: %zu images, best of %d runs\n", inputs.size(), runs);
+
+    Workload workload = current_workload(corpus);
+    if (!update) {
+        Workload recorded;
+        bool same = true;
+        for (int i = 0; i < 6; ++i) {
+            double value;
+            if (!json_number(baseline, "workload", WORKLOAD_KEYS[i], value)) value = -1;
+            *workload_fields(recorded, i) = (int)value;
+            same &= *workload_fields(recorded, i) == *workload_fields(workload, i);
+        }
+        // Nothing to compare against: a skip, not a failure
+        if (!same) {
+            std::cerr << "Skipped: Baseline was recorded for " << describe(recorded)
+                      << "; this machine has " << describe(workload)
+                      << ". Re-record it here with --update-baseline\n";
+            return SKIP_EXIT_CODE;
+        }
+    }
+
+    Metrics metrics[2];
+    bool passed = true;
+    for (int i = 0; i < 2; ++i) {
+        if (!measure(inputs, mode_dirs[i], i == 1, runs, metrics[i])) {
+            std::cerr << "Error: Batch failed in " << MODES[i] << " mode\n";
+            return 1;
+        }
+    }
+
+    // After all the timing, so decoding references doesn't inflate peak RSS
+    for (int i = 0; i < 2; ++i) {
+        std::string worst;
+        double lowest = lowest_psnr(corpus, mode_dirs[i], worst);
+        printf("  %-10s %-15s %10.2f  minimum %10.2f  (%s)  %s\n", MODES[i], "psnr_db", lowest,
+               min_psnr, worst.c_str(), lowest >= min_psnr ? "ok" : "REGRESSION");
+        passed &= lowest >= min_psnr;
+    }
+
+    if (update) {
+        if (!write_baseline(baseline_path, workload, metrics, tolerance, min_psnr)) {
+            std::cerr << "Error: Cannot write " << baseline_path << "\n";
+            return 2;
+        }
+        for (int i = 0; i < 2; ++i) {
+            printf("  %-10s %.2f images/s, %.2f MB peak RSS, %.2f ms p99\n", MODES[i],
+                   metrics[i].images_per_sec, metrics[i].peak_rss_mb, metrics[i].p99_ms);
+        }
+        printf("Baseline written to %s\n", baseline_path.c_str());
+        return passed ? 0 : 1;
+    }
+
+    for (int i = 0; i < 2; ++i) {
+        double expected;
+        if (json_number(baseline, MODES[i], "images_per_sec", expected)) {
+            passed &= check(MODES[i], "images_per_sec", metrics[i].images_per_sec, expected,
+                            tolerance.images_per_sec, true);
+        }
+        if (json_number(baseline, MODES[i], "peak_rss_mb", expected)) {
+            passed &= check(MODES[i], "peak_rss_mb", metrics[i].peak_rss_mb, expected,
+                            tolerance.peak_rss_mb, false);
+        }
+        if (json_number(baseline, MODES[i], "p99_ms", expected)) {
+            passed &= check(MODES[i], "p99_ms", metrics[i].p99_ms, expected,
+                            tolerance.p99_ms, false);
+        }
+    }
+
+    printf("%s\n", passed ? "PASSED" : "FAILED");
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,75 @@
+// Round trip of the parallel PNG writer: images encoded in several deflate
+// strips, for every channel count, row filter and the extreme zlib windows,
+// must decode through libpng to exactly the input pixels.
+//
+//   png_strip_test WORK_DIR
+
+#include "test_util.h"
+#include <cstring>
+
+using fastresize::ResizeOptions;
+using fastresize::internal::ImageData;
+
+// IDAT chunks in a PNG; the strip writer emits one per strip
+static int count_idat(const std::vector<unsigned char>& png) {
+    int count = 0;
+    size_t pos = 8;
+    while (pos + 8 <= png.size()) {
+        size_t length = ((size_t)png[pos] << 24) | (png[pos + 1] << 16) | (png[pos + 2] << 8) | png[pos + 3];
+        if (memcmp(&png[pos + 4], "IDAT", 4) == 0) count++;
+        pos += 12 + length;
+    }
+    return count;
+}
+
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s WORK_DIR\n", argv[0]);
+        return 2;
+    }
+    std::string work = test::scratch_dir(argv[1]);
+
+    static const ResizeOptions::PngFilter filters[] = {
+        ResizeOptions::PNG_ADAPTIVE, ResizeOptions::PNG_NONE, ResizeOptions::PNG_SUB,
+        ResizeOptions::PNG_UP, ResizeOptions::PNG_AVERAGE, ResizeOptions::PNG_PAETH
+    };
+    static const int window_bits[] = {9, 15};
+    // Heights the strip counts don't divide, rows wider than the 9-bit window
+    static const int width = 261, height = 97;
+    static const size_t strip_counts[] = {2, 5, 8};
+
+    for (int channels = 1; channels <= 4; ++channels) {
+        std::vector<unsigned char> pixels = test::gradient(width, height, channels);
+        ImageData image = test::image_view(pixels, width, height, channels);
+
+        for (ResizeOptions::PngFilter filter : filters) {
+            for (int bits : window_bits) {
+                for (size_t strips : strip_counts) {
+                    ResizeOptions opts;
+                    opts.png_filter = filter;
+                    opts.png_window_bits = bits;
+
+                    std::vector<unsigned char> png;
+                    bool encoded = fastresize::internal::encode_png_strips(image, opts, strips, png);
+                    CHECK_MSG(encoded, "%d channels, filter %d, window %d, %zu strips",
+                              channels, (int)filter, bits, strips);
+                    if (!encoded) continue;
+                    CHECK_MSG(count_idat(png) == (int)strips, "%d IDAT chunks for %zu strips",
+                              count_idat(png), strips);
+
+                    std::string path = work + "/strips.png";
+                    CHECK(test::write_file(path, png));
+                    ImageData decoded = fastresize::internal::decode_image(path, fastresize::internal::FORMAT_PNG);
+                    bool same = decoded.pixels && decoded.width == width && decoded.height == height &&
+                                decoded.channels == channels &&
+                                memcmp(decoded.pixels, pixels.data(), pixels.size()) == 0;
+                    CHECK_MSG(same, "%d channels, filter %d, window %d, %zu strips: decoded pixels differ",
+                              channels, (int)filter, bits, strips);
+                    fastresize::internal::free_image_data(decoded);
+                }
+            }
+        }
+    }
+
+    return test::finish("png_strip_test");
+}
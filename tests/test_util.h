@@ -0,0 +1,108 @@
+// Helpers shared by the functional tests: a CHECK macro that keeps going
+// after a failure, scratch directories and generated pixel fixtures.
+
+#ifndef FASTRESIZE_TEST_UTIL_H
+#define FASTRESIZE_TEST_UTIL_H
+
+#include "internal.h"
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+
+namespace test {
+
+static int g_failures = 0;
+
+#define CHECK(cond)                                                          \
+    do {                                                                     \
+        if (!(cond)) {                                                       \
+            fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, \
+                    #cond);                                                  \
+            ::test::g_failures++;                                            \
+        }                                                                    \
+    } while (0)
+
+// Like CHECK, with a printf-style note on what was being checked
+#define CHECK_MSG(cond, ...)                                                 \
+    do {                                                                     \
+        if (!(cond)) {                                                       \
+            fprintf(stderr, "%s:%d: CHECK failed: %s: ", __FILE__, __LINE__, \
+                    #cond);                                                  \
+            fprintf(stderr, __VA_ARGS__);                                    \
+            fprintf(stderr, "\n");                                           \
+            ::test::g_failures++;                                            \
+        }                                                                    \
+    } while (0)
+
+inline int finish(const char* name) {
+    if (g_failures > 0) {
+        fprintf(stderr, "%s: %d check(s) failed\n", name, g_failures);
+        return 1;
+    }
+    printf("%s: passed\n", name);
+    return 0;
+}
+
+// Empties dir (files only, one level) or creates it
+inline std::string scratch_dir(const std::string& dir) {
+    mkdir(dir.c_str(), 0755);
+    std::string command = "rm -rf '" + dir + "'/*";
+    if (system(command.c_str()) != 0) {
+        fprintf(stderr, "Cannot clear %s\n", dir.c_str());
+    }
+    return dir;
+}
+
+// Smooth gradients with a little per-channel structure; compresses like a
+// photo rather than a flat fill
+inline std::vector<unsigned char> gradient(int width, int height, int channels) {
+    std::vector<unsigned char> pixels((size_t)width * height * channels);
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            unsigned char* px = &pixels[((size_t)y * width + x) * channels];
+            for (int c = 0; c < channels; ++c) {
+                int value = (x * 255 / (width > 1 ? width - 1 : 1)) * (c + 1) +
+                            (y * 255 / (height > 1 ? height - 1 : 1)) * (3 - c % 3) +
+                            ((x * 7 + y * 13 + c * 29) % 17);
+                px[c] = (unsigned char)(value & 0xFF);
+            }
+        }
+    }
+    return pixels;
+}
+
+inline fastresize::internal::ImageData image_view(std::vector<unsigned char>& pixels,
+                                                  int width, int height, int channels) {
+    fastresize::internal::ImageData data;
+    data.pixels = pixels.data();
+    data.width = width;
+    data.height = height;
+    data.channels = channels;
+    return data;
+}
+
+inline bool read_file(const std::string& path, std::string& text) {
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) return false;
+    char buffer[65536];
+    size_t count;
+    text.clear();
+    while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        text.append(buffer, count);
+    }
+    fclose(file);
+    return true;
+}
+
+inline bool write_file(const std::string& path, const std::vector<unsigned char>& bytes) {
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) return false;
+    bool ok = fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+    return fclose(file) == 0 && ok;
+}
+
+} // namespace test
+
+#endif